@@ -2,102 +2,407 @@
 // https://github.com/nalgeon/sqlean
 
 // Base64 encoding/decoding (RFC 4648)
+//
+// Processes the bulk of the data with SSSE3/AVX2/NEON kernels when the CPU
+// supports them, and the rest with the scalar code. The x86 kernels follow
+// Muła, Lemire: Faster Base64 Encoding and Decoding Using AVX2 Instructions.
 
+#include <stddef.h>
 #include <stdint.h>
-#include <stdlib.h>
-#include <string.h>
+
+#include "crypto/base64.h"
+#include "crypto/cpu.h"
 
 static const char base64_chars[] =
     "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-uint8_t* base64_encode(const uint8_t* src, size_t len, size_t* out_len) {
-    uint8_t* encoded = NULL;
-    size_t i, j;
-    uint32_t octets;
+// Maps base64 characters to their values, and other bytes to 0xFF.
+static const uint8_t base64_table[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 62, 0xFF, 0xFF, 0xFF, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
 
-    *out_len = ((len + 2) / 3) * 4;
-    encoded = malloc(*out_len + 1);
-    if (encoded == NULL) {
-        *out_len = 0;
-        return NULL;
-    }
+// Scalar implementation.
 
-    for (i = 0, j = 0; i < len; i += 3, j += 4) {
-        octets =
-            (src[i] << 16) | ((i + 1 < len ? src[i + 1] : 0) << 8) | (i + 2 < len ? src[i + 2] : 0);
-        encoded[j] = base64_chars[(octets >> 18) & 0x3f];
-        encoded[j + 1] = base64_chars[(octets >> 12) & 0x3f];
-        encoded[j + 2] = base64_chars[(octets >> 6) & 0x3f];
-        encoded[j + 3] = base64_chars[octets & 0x3f];
+static void encode_scalar(const uint8_t* src, size_t len, uint8_t* dst) {
+    size_t i = 0;
+    for (; i + 3 <= len; i += 3) {
+        uint32_t octets = (src[i] << 16) | (src[i + 1] << 8) | src[i + 2];
+        *dst++ = base64_chars[(octets >> 18) & 0x3f];
+        *dst++ = base64_chars[(octets >> 12) & 0x3f];
+        *dst++ = base64_chars[(octets >> 6) & 0x3f];
+        *dst++ = base64_chars[octets & 0x3f];
     }
-
-    if (len % 3 == 1) {
-        encoded[*out_len - 1] = '=';
-        encoded[*out_len - 2] = '=';
-    } else if (len % 3 == 2) {
-        encoded[*out_len - 1] = '=';
+    if (len - i == 1) {
+        uint32_t octets = src[i] << 16;
+        *dst++ = base64_chars[(octets >> 18) & 0x3f];
+        *dst++ = base64_chars[(octets >> 12) & 0x3f];
+        *dst++ = '=';
+        *dst++ = '=';
+    } else if (len - i == 2) {
+        uint32_t octets = (src[i] << 16) | (src[i + 1] << 8);
+        *dst++ = base64_chars[(octets >> 18) & 0x3f];
+        *dst++ = base64_chars[(octets >> 12) & 0x3f];
+        *dst++ = base64_chars[(octets >> 6) & 0x3f];
+        *dst++ = '=';
     }
+}
 
-    encoded[*out_len] = '\0';
-    return encoded;
+// Decodes the groups of 4 characters. Only the last group may be padded.
+static int decode_scalar(const uint8_t* src, size_t len, uint8_t* dst) {
+    for (size_t i = 0; i < len; i += 4) {
+        size_t n = 3;
+        uint8_t a = base64_table[src[i]];
+        uint8_t b = base64_table[src[i + 1]];
+        uint8_t c = 0;
+        uint8_t d = 0;
+        if (i + 4 == len && src[i + 3] == '=') {
+            if (src[i + 2] == '=') {
+                n = 1;
+            } else {
+                n = 2;
+                c = base64_table[src[i + 2]];
+            }
+        } else {
+            c = base64_table[src[i + 2]];
+            d = base64_table[src[i + 3]];
+        }
+        if ((a | b | c | d) & 0xC0) {
+            // invalid character
+            return -1;
+        }
+
+        uint32_t block = (a << 18) | (b << 12) | (c << 6) | d;
+        *dst++ = (block >> 16) & 0xFF;
+        if (n > 1) {
+            *dst++ = (block >> 8) & 0xFF;
+        }
+        if (n > 2) {
+            *dst++ = block & 0xFF;
+        }
+    }
+    return 0;
 }
 
-static const uint8_t base64_table[] = {
-    // Map base64 characters to their corresponding values
-    ['A'] = 0,  ['B'] = 1,  ['C'] = 2,  ['D'] = 3,  ['E'] = 4,  ['F'] = 5,  ['G'] = 6,  ['H'] = 7,
-    ['I'] = 8,  ['J'] = 9,  ['K'] = 10, ['L'] = 11, ['M'] = 12, ['N'] = 13, ['O'] = 14, ['P'] = 15,
-    ['Q'] = 16, ['R'] = 17, ['S'] = 18, ['T'] = 19, ['U'] = 20, ['V'] = 21, ['W'] = 22, ['X'] = 23,
-    ['Y'] = 24, ['Z'] = 25, ['a'] = 26, ['b'] = 27, ['c'] = 28, ['d'] = 29, ['e'] = 30, ['f'] = 31,
-    ['g'] = 32, ['h'] = 33, ['i'] = 34, ['j'] = 35, ['k'] = 36, ['l'] = 37, ['m'] = 38, ['n'] = 39,
-    ['o'] = 40, ['p'] = 41, ['q'] = 42, ['r'] = 43, ['s'] = 44, ['t'] = 45, ['u'] = 46, ['v'] = 47,
-    ['w'] = 48, ['x'] = 49, ['y'] = 50, ['z'] = 51, ['0'] = 52, ['1'] = 53, ['2'] = 54, ['3'] = 55,
-    ['4'] = 56, ['5'] = 57, ['6'] = 58, ['7'] = 59, ['8'] = 60, ['9'] = 61, ['+'] = 62, ['/'] = 63,
-};
+// x86 implementation.
 
-uint8_t* base64_decode(const uint8_t* src, size_t len, size_t* out_len) {
-    if (len % 4 != 0) {
-        return NULL;
+#if defined(CPU_X86)
+#include <immintrin.h>
+
+// Converts 12 bytes (at the start of the vector) into 16 base64 characters.
+__attribute__((target("ssse3"))) static __m128i encode_block_ssse3(__m128i in) {
+    // split the bytes into 6-bit indices, one per byte
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    __m128i indices = _mm_or_si128(t1, t3);
+
+    // map the indices to characters by adding the offset of the range
+    // (A-Z, a-z, 0-9, + or /) the index belongs to
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+    __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                    '/' - 63, 'A', 0, 0);
+    return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+}
+
+// Encodes 12 bytes at a time, returns the number of bytes encoded.
+__attribute__((target("ssse3"))) static size_t encode_ssse3(const uint8_t* src,
+                                                            size_t len,
+                                                            uint8_t* dst) {
+    size_t i = 0;
+    // reads 16 bytes, but consumes only 12
+    for (; i + 16 <= len; i += 12, dst += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)dst, encode_block_ssse3(in));
     }
+    return i;
+}
 
-    size_t padding = 0;
-    if (src[len - 1] == '=') {
-        padding++;
+// Same as encode_block_ssse3, but for 12 bytes in each 128-bit lane.
+__attribute__((target("avx2"))) static __m256i encode_block_avx2(__m256i in) {
+    in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11,
+                                                  10, 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9,
+                                                  11, 10));
+    __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    __m256i indices = _mm256_or_si256(t1, t3);
+
+    __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+    __m256i offsets = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0, 'a' - 26, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63,
+        'A', 0, 0);
+    return _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, range));
+}
+
+// Encodes 24 bytes at a time, returns the number of bytes encoded.
+__attribute__((target("avx2"))) static size_t encode_avx2(const uint8_t* src,
+                                                          size_t len,
+                                                          uint8_t* dst) {
+    size_t i = 0;
+    // reads 28 bytes, but consumes only 24
+    for (; i + 28 <= len; i += 24, dst += 32) {
+        __m128i lo = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(src + i + 12));
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        _mm256_storeu_si256((__m256i*)dst, encode_block_avx2(in));
     }
-    if (src[len - 2] == '=') {
-        padding++;
+    return i;
+}
+
+// Converts 16 base64 characters into 6-bit values.
+// Sets the bits in `invalid` for the bytes that are not base64 characters.
+__attribute__((target("ssse3"))) static __m128i decode_values_ssse3(__m128i in,
+                                                                    __m128i* invalid) {
+    // a character is valid if its low and high nibble classes do not intersect
+    __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                   0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10,
+                                   0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    // offsets from the characters to their values by the high nibble ('/' is special)
+    __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+
+    __m128i nibble_mask = _mm_set1_epi8(0x0f);
+    __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), nibble_mask);
+    __m128i lo_nibbles = _mm_and_si128(in, nibble_mask);
+    __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    *invalid = _mm_or_si128(*invalid, _mm_and_si128(lo, hi));
+
+    __m128i eq_slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+    __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_slash, hi_nibbles));
+    return _mm_add_epi8(in, roll);
+}
+
+// Packs 16 6-bit values into 12 bytes (at the start of the vector).
+__attribute__((target("ssse3"))) static __m128i decode_pack_ssse3(__m128i values) {
+    __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(merged,
+                            _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+// Decodes 16 characters at a time, returns the number of characters decoded.
+// Stops before the first block with invalid characters.
+__attribute__((target("ssse3"))) static size_t decode_ssse3(const uint8_t* src,
+                                                            size_t len,
+                                                            uint8_t* dst,
+                                                            size_t dst_len) {
+    size_t i = 0;
+    // writes 16 bytes, but produces only 12
+    for (; i + 16 <= len && i / 4 * 3 + 16 <= dst_len; i += 16, dst += 12) {
+        __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i invalid = _mm_setzero_si128();
+        __m128i values = decode_values_ssse3(in, &invalid);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(invalid, _mm_setzero_si128())) != 0xFFFF) {
+            break;
+        }
+        _mm_storeu_si128((__m128i*)dst, decode_pack_ssse3(values));
     }
+    return i;
+}
+
+// Same as decode_ssse3, but 32 characters at a time.
+__attribute__((target("avx2"))) static size_t decode_avx2(const uint8_t* src,
+                                                          size_t len,
+                                                          uint8_t* dst,
+                                                          size_t dst_len) {
+    __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                      0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A, 0x15, 0x11,
+                                      0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13,
+                                      0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10,
+                                      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                      0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10,
+                                      0x10, 0x10, 0x10, 0x10, 0x10);
+    __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m256i nibble_mask = _mm256_set1_epi8(0x0f);
+    __m256i pack_shuffle =
+        _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5,
+                         4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    size_t i = 0;
+    // writes 32 bytes, but produces only 24
+    for (; i + 32 <= len && i / 4 * 3 + 32 <= dst_len; i += 32, dst += 24) {
+        __m256i in = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), nibble_mask);
+        __m256i lo_nibbles = _mm256_and_si256(in, nibble_mask);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        if (!_mm256_testz_si256(lo, hi)) {
+            break;
+        }
+        __m256i eq_slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+        __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_slash, hi_nibbles));
+        __m256i values = _mm256_add_epi8(in, roll);
 
-    *out_len = (len / 4) * 3 - padding;
-    uint8_t* decoded = malloc(*out_len);
-    if (decoded == NULL) {
-        *out_len = 0;
-        return NULL;
+        __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        merged = _mm256_shuffle_epi8(merged, pack_shuffle);
+        merged = _mm256_permutevar8x32_epi32(merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256((__m256i*)dst, merged);
     }
+    return i;
+}
+#endif /* CPU_X86 */
 
-    for (size_t i = 0, j = 0; i < len; i += 4, j += 3) {
-        uint32_t block = 0;
-        for (size_t k = 0; k < 4; k++) {
-            block <<= 6;
-            if (src[i + k] == '=') {
-                padding--;
-            } else {
-                uint8_t index = base64_table[src[i + k]];
-                if (index == 0 && src[i + k] != 'A') {
-                    free(decoded);
-                    return NULL;
-                }
-                block |= index;
-            }
+// ARM implementation.
+
+#if defined(CPU_ARM)
+#include <arm_neon.h>
+
+// Encodes 48 bytes at a time, returns the number of bytes encoded.
+static size_t encode_neon(const uint8_t* src, size_t len, uint8_t* dst) {
+    const uint8_t* chars = (const uint8_t*)base64_chars;
+    uint8x16x4_t table = {{vld1q_u8(chars), vld1q_u8(chars + 16), vld1q_u8(chars + 32),
+                           vld1q_u8(chars + 48)}};
+    uint8x16_t mask = vdupq_n_u8(0x3f);
+
+    size_t i = 0;
+    for (; i + 48 <= len; i += 48, dst += 64) {
+        // load the bytes deinterleaved, so that each vector holds
+        // the same byte of 16 three-byte groups
+        uint8x16x3_t in = vld3q_u8(src + i);
+        uint8x16x4_t out;
+        out.val[0] = vshrq_n_u8(in.val[0], 2);
+        out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask);
+        out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask);
+        out.val[3] = vandq_u8(in.val[2], mask);
+        for (int k = 0; k < 4; k++) {
+            out.val[k] = vqtbl4q_u8(table, out.val[k]);
         }
+        vst4q_u8(dst, out);
+    }
+    return i;
+}
 
-        decoded[j] = (block >> 16) & 0xFF;
-        if (j + 1 < *out_len) {
-            decoded[j + 1] = (block >> 8) & 0xFF;
+// Decodes 64 characters at a time, returns the number of characters decoded.
+// Stops before the first block with invalid characters.
+static size_t decode_neon(const uint8_t* src, size_t len, uint8_t* dst) {
+    // lookup tables for the characters 0-63 and 64-127
+    uint8x16x4_t table_lo = {{vld1q_u8(base64_table), vld1q_u8(base64_table + 16),
+                              vld1q_u8(base64_table + 32), vld1q_u8(base64_table + 48)}};
+    uint8x16x4_t table_hi = {{vld1q_u8(base64_table + 64), vld1q_u8(base64_table + 80),
+                              vld1q_u8(base64_table + 96), vld1q_u8(base64_table + 112)}};
+
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64, dst += 48) {
+        uint8x16x4_t in = vld4q_u8(src + i);
+        uint8x16_t invalid = vdupq_n_u8(0);
+        for (int k = 0; k < 4; k++) {
+            uint8x16_t c = in.val[k];
+            uint8x16_t v = vqtbl4q_u8(table_lo, c);
+            v = vqtbx4q_u8(v, table_hi, vsubq_u8(c, vdupq_n_u8(64)));
+            invalid = vorrq_u8(invalid, vcgeq_u8(c, vdupq_n_u8(128)));
+            invalid = vorrq_u8(invalid, vceqq_u8(v, vdupq_n_u8(0xFF)));
+            in.val[k] = v;
+        }
+        if (vmaxvq_u8(invalid)) {
+            break;
         }
-        if (j + 2 < *out_len) {
-            decoded[j + 2] = block & 0xFF;
+        uint8x16x3_t out;
+        out.val[0] = vorrq_u8(vshlq_n_u8(in.val[0], 2), vshrq_n_u8(in.val[1], 4));
+        out.val[1] = vorrq_u8(vshlq_n_u8(in.val[1], 4), vshrq_n_u8(in.val[2], 2));
+        out.val[2] = vorrq_u8(vshlq_n_u8(in.val[2], 6), in.val[3]);
+        vst3q_u8(dst, out);
+    }
+    return i;
+}
+#endif /* CPU_ARM */
+
+// base64_encoded_len returns the length of the encoded data.
+size_t base64_encoded_len(size_t len) {
+    return (len + 2) / 3 * 4;
+}
+
+// base64_encode encodes the data into dst, which should be
+// base64_encoded_len(len) bytes long.
+void base64_encode(const uint8_t* src, size_t len, uint8_t* dst) {
+    size_t done = 0;
+#if defined(CPU_X86)
+    int features = cpu_features();
+    if (features & CPU_AVX2) {
+        done = encode_avx2(src, len, dst);
+    }
+    if (features & CPU_SSSE3) {
+        done += encode_ssse3(src + done, len - done, dst + done / 3 * 4);
+    }
+#endif
+#if defined(CPU_ARM)
+    if (cpu_features() & CPU_NEON) {
+        done = encode_neon(src, len, dst);
+    }
+#endif
+    encode_scalar(src + done, len - done, dst + done / 3 * 4);
+}
+
+// base64_decoded_len calculates the length of the decoded data.
+// Returns 0 on success, -1 if the encoded length is invalid.
+int base64_decoded_len(const uint8_t* src, size_t len, size_t* out_len) {
+    if (len % 4 != 0) {
+        return -1;
+    }
+    size_t padding = 0;
+    if (len > 0 && src[len - 1] == '=') {
+        padding++;
+        if (src[len - 2] == '=') {
+            padding++;
         }
     }
+    *out_len = len / 4 * 3 - padding;
+    return 0;
+}
 
-    return decoded;
+// base64_decode decodes the data into dst, which should be
+// base64_decoded_len bytes long. Returns 0 on success,
+// -1 if the data contains invalid characters.
+int base64_decode(const uint8_t* src, size_t len, uint8_t* dst) {
+    size_t dst_len;
+    if (base64_decoded_len(src, len, &dst_len) != 0) {
+        return -1;
+    }
+    // the kernels only process the full groups without padding
+    size_t body_len = len > 4 ? len - 4 : 0;
+    size_t done = 0;
+#if defined(CPU_X86)
+    int features = cpu_features();
+    if (features & CPU_AVX2) {
+        done = decode_avx2(src, body_len, dst, dst_len);
+    }
+    if (features & CPU_SSSE3) {
+        done += decode_ssse3(src + done, body_len - done, dst + done / 4 * 3,
+                             dst_len - done / 4 * 3);
+    }
+#endif
+#if defined(CPU_ARM)
+    if (cpu_features() & CPU_NEON) {
+        done = decode_neon(src, body_len, dst);
+    }
+#endif
+    return decode_scalar(src + done, len - done, dst + done / 4 * 3);
 }
@@ -9,7 +9,9 @@
 #include <stddef.h>
 #include <stdint.h>
 
-uint8_t* base64_encode(const uint8_t* src, size_t len, size_t* out_len);
-uint8_t* base64_decode(const uint8_t* src, size_t len, size_t* out_len);
+size_t base64_encoded_len(size_t len);
+void base64_encode(const uint8_t* src, size_t len, uint8_t* dst);
+int base64_decoded_len(const uint8_t* src, size_t len, size_t* out_len);
+int base64_decode(const uint8_t* src, size_t len, uint8_t* dst);
 
 #endif /* BASE64_H */
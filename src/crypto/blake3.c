@@ -8,6 +8,8 @@
 #include <string.h>
 
 #include "crypto/blake3.h"
+#include "crypto/cpu.h"
+#include "crypto/workers.h"
 
 #define CHUNK_START 1 << 0
 #define CHUNK_END 1 << 1
@@ -23,6 +25,18 @@ static uint32_t IV[8] = {
 
 static size_t MSG_PERMUTATION[16] = {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8};
 
+// Message word order for each of the 7 rounds,
+// the MSG_PERMUTATION applied 0 to 6 times.
+static const uint8_t MSG_SCHEDULE[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
 inline static uint32_t rotate_right(uint32_t x, int n) {
     return (x >> n) | (x << (32 - n));
 }
@@ -123,6 +137,90 @@ inline static void words_from_little_endian_bytes(const void* bytes,
     }
 }
 
+// SIMD implementations, which hash several chunks in parallel.
+#if defined(CPU_X86)
+#define BLAKE3_SIMD_NAME hash_chunks_sse41
+#define BLAKE3_SIMD_VEC vec_sse41
+#define BLAKE3_SIMD_LANES 4
+#define BLAKE3_SIMD_TARGET __attribute__((target("sse4.1")))
+#include "crypto/blake3_simd.impl.h"
+#undef BLAKE3_SIMD_NAME
+#undef BLAKE3_SIMD_VEC
+#undef BLAKE3_SIMD_LANES
+#undef BLAKE3_SIMD_TARGET
+
+#define BLAKE3_SIMD_NAME hash_chunks_avx2
+#define BLAKE3_SIMD_VEC vec_avx2
+#define BLAKE3_SIMD_LANES 8
+#define BLAKE3_SIMD_TARGET __attribute__((target("avx2")))
+#include "crypto/blake3_simd.impl.h"
+#undef BLAKE3_SIMD_NAME
+#undef BLAKE3_SIMD_VEC
+#undef BLAKE3_SIMD_LANES
+#undef BLAKE3_SIMD_TARGET
+
+#define BLAKE3_SIMD_NAME hash_chunks_avx512
+#define BLAKE3_SIMD_VEC vec_avx512
+#define BLAKE3_SIMD_LANES 16
+#define BLAKE3_SIMD_TARGET __attribute__((target("avx512f")))
+#include "crypto/blake3_simd.impl.h"
+#undef BLAKE3_SIMD_NAME
+#undef BLAKE3_SIMD_VEC
+#undef BLAKE3_SIMD_LANES
+#undef BLAKE3_SIMD_TARGET
+#endif /* CPU_X86 */
+
+#if defined(CPU_ARM)
+#define BLAKE3_SIMD_NAME hash_chunks_neon
+#define BLAKE3_SIMD_VEC vec_neon
+#define BLAKE3_SIMD_LANES 4
+#define BLAKE3_SIMD_TARGET
+#include "crypto/blake3_simd.impl.h"
+#undef BLAKE3_SIMD_NAME
+#undef BLAKE3_SIMD_VEC
+#undef BLAKE3_SIMD_LANES
+#undef BLAKE3_SIMD_TARGET
+#endif /* CPU_ARM */
+
+// The maximum number of chunks hashed in parallel.
+#define BLAKE3_MAX_LANES 16
+
+typedef void (*hash_chunks_fn)(const uint8_t* input,
+                               const uint32_t key[8],
+                               uint64_t counter,
+                               uint32_t flags,
+                               uint32_t* out);
+
+// Returns the fastest SIMD implementation supported by the CPU
+// and sets the number of chunks it hashes at once. Returns NULL
+// if there is no suitable implementation.
+static hash_chunks_fn simd_hash_chunks(size_t* lanes) {
+    int features = cpu_features();
+    (void)features;
+#if defined(CPU_X86)
+    if (features & CPU_AVX512) {
+        *lanes = 16;
+        return hash_chunks_avx512;
+    }
+    if (features & CPU_AVX2) {
+        *lanes = 8;
+        return hash_chunks_avx2;
+    }
+    if (features & CPU_SSE41) {
+        *lanes = 4;
+        return hash_chunks_sse41;
+    }
+#endif
+#if defined(CPU_ARM)
+    if (features & CPU_NEON) {
+        *lanes = 4;
+        return hash_chunks_neon;
+    }
+#endif
+    *lanes = 0;
+    return NULL;
+}
+
 // Each chunk or parent node can produce either an 8-word chaining value or, by
 // setting the ROOT flag, any number of final output bytes. The Output struct
 // captures the state just prior to choosing between those two possibilities.
@@ -299,6 +397,8 @@ inline static void hasher_add_chunk_cv(blake3_hasher* self,
 // Add input to the hash state. This can be called any number of times.
 static void blake3_hasher_update(blake3_hasher* self, const void* input, size_t input_len) {
     const uint8_t* input_u8 = (const uint8_t*)input;
+    size_t lanes;
+    hash_chunks_fn hash_chunks = simd_hash_chunks(&lanes);
     while (input_len > 0) {
         // If the current chunk is complete, finalize it and reset the chunk state.
         // More input is coming, so this chunk is not ROOT.
@@ -311,6 +411,21 @@ static void blake3_hasher_update(blake3_hasher* self, const void* input, size_t
             chunk_state_init(&self->chunk_state, self->key_words, total_chunks, self->flags);
         }
 
+        // Hash whole chunks in parallel if the CPU allows it. The last chunk
+        // always goes through the chunk state, because it might be the root.
+        while (hash_chunks && chunk_state_len(&self->chunk_state) == 0 &&
+               input_len > lanes * BLAKE3_CHUNK_LEN) {
+            uint32_t cvs[BLAKE3_MAX_LANES * 8];
+            uint64_t counter = self->chunk_state.chunk_counter;
+            hash_chunks(input_u8, self->key_words, counter, self->flags, cvs);
+            for (size_t lane = 0; lane < lanes; lane++) {
+                hasher_add_chunk_cv(self, &cvs[lane * 8], counter + lane + 1);
+            }
+            chunk_state_init(&self->chunk_state, self->key_words, counter + lanes, self->flags);
+            input_u8 += lanes * BLAKE3_CHUNK_LEN;
+            input_len -= lanes * BLAKE3_CHUNK_LEN;
+        }
+
         // Compress input bytes into the current chunk state.
         size_t want = BLAKE3_CHUNK_LEN - chunk_state_len(&self->chunk_state);
         size_t take = want;
@@ -323,8 +438,8 @@ static void blake3_hasher_update(blake3_hasher* self, const void* input, size_t
     }
 }
 
-// Finalize the hash and write any number of output bytes.
-static void blake3_hasher_finalize(const blake3_hasher* self, void* out, size_t out_len) {
+// Returns the output of the top node of the tree.
+inline static output hasher_top_output(const blake3_hasher* self) {
     // Starting with the output from the current chunk, compute all the parent
     // chaining values along the right edge of the tree, until we have the root
     // output.
@@ -337,24 +452,118 @@ static void blake3_hasher_finalize(const blake3_hasher* self, void* out, size_t
         current_output = parent_output(&self->cv_stack[parent_nodes_remaining * 8], current_cv,
                                        self->key_words, self->flags);
     }
-    output_root_bytes(&current_output, out, out_len);
+    return current_output;
+}
+
+// Finalize the hash and write any number of output bytes.
+static void blake3_hasher_finalize(const blake3_hasher* self, void* out, size_t out_len) {
+    output root_output = hasher_top_output(self);
+    output_root_bytes(&root_output, out, out_len);
+}
+
+// Inputs smaller than this are always hashed on a single thread.
+#define BLAKE3_PARALLEL_MIN_LEN (1024 * 1024)
+// Each thread hashes subtrees of at least this many chunks.
+#define BLAKE3_TASK_MIN_CHUNKS 64
+// The maximum number of subtrees hashed in a single parallel step.
+#define BLAKE3_MAX_TASKS (4 * WORKERS_MAX_THREADS)
+
+// A parallel step: hashes ntasks subtrees of equal size, which follow
+// each other in the input.
+typedef struct subtree_job {
+    const uint8_t* input;
+    uint64_t counter;      // number of the first chunk
+    uint64_t task_chunks;  // number of chunks in each subtree
+    const uint32_t* key_words;
+    uint32_t flags;
+    uint32_t cvs[BLAKE3_MAX_TASKS * 8];
+} subtree_job;
+
+// Computes the chaining value of a single subtree of the job.
+static void subtree_task(void* arg, size_t idx) {
+    subtree_job* job = (subtree_job*)arg;
+    size_t task_len = (size_t)job->task_chunks * BLAKE3_CHUNK_LEN;
+    blake3_hasher hasher;
+    hasher_init_internal(&hasher, job->key_words, job->flags);
+    hasher.chunk_state.chunk_counter = job->counter + idx * job->task_chunks;
+    blake3_hasher_update(&hasher, job->input + idx * task_len, task_len);
+    // The subtree is never the whole tree, so it's not ROOT.
+    output subtree_output = hasher_top_output(&hasher);
+    output_chaining_value(&subtree_output, &job->cvs[idx * 8]);
+}
+
+// Add input to the hash state using up to `nthreads` threads.
+// Splits the input into subtrees, which are hashed in parallel,
+// and merges their chaining values into the tree as usual.
+// The result is the same as with blake3_hasher_update.
+static void blake3_hasher_update_parallel(blake3_hasher* self,
+                                          const void* input,
+                                          size_t input_len,
+                                          int nthreads) {
+    const uint8_t* input_u8 = (const uint8_t*)input;
+    while (nthreads > 1 && input_len >= BLAKE3_PARALLEL_MIN_LEN &&
+           chunk_state_len(&self->chunk_state) == 0) {
+        // Find the largest subtree that starts at the current chunk
+        // and does not cover the rest of the input (the root must stay
+        // in the hasher).
+        uint64_t counter = self->chunk_state.chunk_counter;
+        uint64_t subtree_chunks = 1;
+        while ((subtree_chunks * 2) * BLAKE3_CHUNK_LEN < input_len &&
+               counter % (subtree_chunks * 2) == 0) {
+            subtree_chunks *= 2;
+        }
+        if (subtree_chunks < 2 * BLAKE3_TASK_MIN_CHUNKS) {
+            break;
+        }
+
+        // Split the subtree into smaller ones for the threads.
+        size_t ntasks = 1;
+        while (ntasks * 2 <= BLAKE3_MAX_TASKS && ntasks < 4 * (size_t)nthreads &&
+               subtree_chunks / (ntasks * 2) >= BLAKE3_TASK_MIN_CHUNKS) {
+            ntasks *= 2;
+        }
+
+        subtree_job job;
+        job.input = input_u8;
+        job.counter = counter;
+        job.task_chunks = subtree_chunks / ntasks;
+        job.key_words = self->key_words;
+        job.flags = self->flags;
+        if (workers_run(nthreads, subtree_task, &job, ntasks) != 0) {
+            break;
+        }
+
+        // Each subtree is aligned to its own size, so it is merged into
+        // the tree the same way as a single chunk one level up.
+        for (size_t i = 0; i < ntasks; i++) {
+            uint64_t total = counter / job.task_chunks + i + 1;
+            hasher_add_chunk_cv(self, &job.cvs[i * 8], total);
+        }
+        chunk_state_init(&self->chunk_state, self->key_words, counter + subtree_chunks,
+                         self->flags);
+        input_u8 += subtree_chunks * BLAKE3_CHUNK_LEN;
+        input_len -= subtree_chunks * BLAKE3_CHUNK_LEN;
+    }
+    blake3_hasher_update(self, input_u8, input_len);
 }
 
-void* blake3_init() {
-    blake3_hasher* context;
-    context = malloc(sizeof(blake3_hasher));
-    if (!context)
-        return NULL;
-    blake3_hasher_init(context);
-    return context;
+void blake3_init(blake3_hasher* ctx) {
+    blake3_hasher_init(ctx);
 }
 
 void blake3_update(blake3_hasher* ctx, const unsigned char* data, size_t len) {
     blake3_hasher_update(ctx, data, len);
 }
 
+// Same as blake3_update, but uses up to `nthreads` threads for large inputs.
+void blake3_update_parallel(blake3_hasher* ctx,
+                            const unsigned char* data,
+                            size_t len,
+                            int nthreads) {
+    blake3_hasher_update_parallel(ctx, data, len, nthreads);
+}
+
 int blake3_final(blake3_hasher* ctx, unsigned char hash[]) {
     blake3_hasher_finalize(ctx, hash, BLAKE3_OUT_LEN);
-    free(ctx);
     return BLAKE3_OUT_LEN;
 }
@@ -32,8 +32,12 @@ typedef struct blake3_hasher {
     uint32_t flags;
 } blake3_hasher;
 
-void* blake3_init();
+void blake3_init(blake3_hasher* ctx);
 void blake3_update(blake3_hasher* ctx, const unsigned char data[], size_t len);
+void blake3_update_parallel(blake3_hasher* ctx,
+                            const unsigned char data[],
+                            size_t len,
+                            int nthreads);
 int blake3_final(blake3_hasher* ctx, unsigned char hash[]);
 
 #endif
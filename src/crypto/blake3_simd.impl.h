@@ -0,0 +1,111 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// BLAKE3 compression of several chunks at once, one chunk per vector lane.
+// Uses the GCC/Clang vector extensions, so the same code compiles
+// to SSE, AVX2, AVX-512 or NEON instructions depending on the target.
+//
+// Included by blake3.c once per instruction set, with the following defined:
+//   - BLAKE3_SIMD_NAME: function name
+//   - BLAKE3_SIMD_VEC: vector type name
+//   - BLAKE3_SIMD_LANES: number of 32-bit lanes in the vector
+//   - BLAKE3_SIMD_TARGET: target attribute for the function (may be empty)
+
+typedef uint32_t BLAKE3_SIMD_VEC __attribute__((vector_size(4 * BLAKE3_SIMD_LANES)));
+
+#define SIMD_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define SIMD_G(a, b, c, d, mx, my)          \
+    v[a] = v[a] + v[b] + (mx);              \
+    v[d] = SIMD_ROTR(v[d] ^ v[a], 16);      \
+    v[c] = v[c] + v[d];                     \
+    v[b] = SIMD_ROTR(v[b] ^ v[c], 12);      \
+    v[a] = v[a] + v[b] + (my);              \
+    v[d] = SIMD_ROTR(v[d] ^ v[a], 8);       \
+    v[c] = v[c] + v[d];                     \
+    v[b] = SIMD_ROTR(v[b] ^ v[c], 7)
+
+// Hashes BLAKE3_SIMD_LANES full chunks that follow each other in the input,
+// starting with the chunk number `counter`. Writes the chaining value
+// of each chunk (8 words per chunk) into `out`.
+BLAKE3_SIMD_TARGET static void BLAKE3_SIMD_NAME(const uint8_t* input,
+                                                const uint32_t key[8],
+                                                uint64_t counter,
+                                                uint32_t flags,
+                                                uint32_t* out) {
+    typedef BLAKE3_SIMD_VEC vec;
+    const vec zero = {0};
+    vec h[8];
+    vec counter_low, counter_high;
+    vec v[16];
+    vec m[16];
+
+    for (size_t i = 0; i < 8; i++) {
+        h[i] = zero + key[i];
+    }
+    for (size_t lane = 0; lane < BLAKE3_SIMD_LANES; lane++) {
+        counter_low[lane] = (uint32_t)(counter + lane);
+        counter_high[lane] = (uint32_t)((counter + lane) >> 32);
+    }
+
+    for (size_t block = 0; block < BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN; block++) {
+        // transpose the message, so that each vector holds
+        // the same message word for all the chunks
+        for (size_t lane = 0; lane < BLAKE3_SIMD_LANES; lane++) {
+            uint32_t words[16];
+            words_from_little_endian_bytes(
+                input + lane * BLAKE3_CHUNK_LEN + block * BLAKE3_BLOCK_LEN, BLAKE3_BLOCK_LEN,
+                words);
+            for (size_t i = 0; i < 16; i++) {
+                m[i][lane] = words[i];
+            }
+        }
+
+        uint32_t block_flags = flags;
+        if (block == 0) {
+            block_flags |= CHUNK_START;
+        }
+        if (block == BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN - 1) {
+            block_flags |= CHUNK_END;
+        }
+
+        for (size_t i = 0; i < 8; i++) {
+            v[i] = h[i];
+        }
+        v[8] = zero + IV[0];
+        v[9] = zero + IV[1];
+        v[10] = zero + IV[2];
+        v[11] = zero + IV[3];
+        v[12] = counter_low;
+        v[13] = counter_high;
+        v[14] = zero + (uint32_t)BLAKE3_BLOCK_LEN;
+        v[15] = zero + block_flags;
+
+        for (size_t r = 0; r < 7; r++) {
+            const uint8_t* s = MSG_SCHEDULE[r];
+            // Mix the columns.
+            SIMD_G(0, 4, 8, 12, m[s[0]], m[s[1]]);
+            SIMD_G(1, 5, 9, 13, m[s[2]], m[s[3]]);
+            SIMD_G(2, 6, 10, 14, m[s[4]], m[s[5]]);
+            SIMD_G(3, 7, 11, 15, m[s[6]], m[s[7]]);
+            // Mix the diagonals.
+            SIMD_G(0, 5, 10, 15, m[s[8]], m[s[9]]);
+            SIMD_G(1, 6, 11, 12, m[s[10]], m[s[11]]);
+            SIMD_G(2, 7, 8, 13, m[s[12]], m[s[13]]);
+            SIMD_G(3, 4, 9, 14, m[s[14]], m[s[15]]);
+        }
+
+        for (size_t i = 0; i < 8; i++) {
+            h[i] = v[i] ^ v[i + 8];
+        }
+    }
+
+    for (size_t lane = 0; lane < BLAKE3_SIMD_LANES; lane++) {
+        for (size_t i = 0; i < 8; i++) {
+            out[lane * 8 + i] = h[i][lane];
+        }
+    }
+}
+
+#undef SIMD_G
+#undef SIMD_ROTR
@@ -0,0 +1,179 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// Blocked Bloom filter based on the XXH3 hash.
+// See Putze, Sanders, Singler: Cache-, Hash- and Space-Efficient Bloom Filters.
+//
+// Each value is hashed once. The upper half of the hash selects the block,
+// and the lower half derives the bit positions within the block
+// (multiplied by a different odd constant for each position, like the
+// split block filters in Parquet). So a lookup touches a single cache line
+// instead of nhashes random ones.
+//
+// Serialized layout (little-endian):
+//   - version (1 byte)
+//   - number of hashes (1 byte)
+//   - reserved (2 bytes, zero)
+//   - number of blocks (4 bytes)
+//   - blocks (BLOOM_BLOCK_LEN bytes each)
+
+#include <math.h>
+#include <string.h>
+
+#include "crypto/bloom.h"
+#include "crypto/xxhash.h"
+
+#define BLOOM_VERSION 1
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_LEN * 8)
+
+// Odd constants to derive the bit positions from the hash.
+static const uint32_t SALT[BLOOM_MAX_HASHES] = {
+    0x47b6137b, 0x44974d91, 0x8824ad5b, 0xa2b7289d, 0x705495c7, 0x2df1424b,
+    0x9efc4947, 0x5c6bfb31, 0x9e3779b1, 0x85ebca77, 0xc2b2ae3d, 0x27d4eb2f,
+    0x165667b1, 0xd3a2646d, 0xfd7046c5, 0xb55a4f09,
+};
+
+// The maximum number of bits per value (for very low false positive rates).
+#define BLOOM_MAX_BITS_PER_VALUE 64
+
+// blocked_fp_rate returns the false positive rate of the blocked filter
+// with the given number of bits per value and hashes. Blocking makes
+// some blocks more loaded than others, so the rate is higher than the classic
+// (1 - e^(-k/c))^k. The number of values in a block follows the Poisson
+// distribution, and the rate is averaged over it.
+static double blocked_fp_rate(double bits_per_value, int nhashes) {
+    double mean = BLOOM_BLOCK_BITS / bits_per_value;
+    double max_load = mean + 10 * sqrt(mean) + 20;
+    double miss = 1.0 - 1.0 / BLOOM_BLOCK_BITS;
+    double prob = exp(-mean);
+    double rate = 0;
+    for (int load = 0; load <= max_load; load++) {
+        if (load > 0) {
+            prob *= mean / load;
+        }
+        rate += prob * pow(1 - pow(miss, (double)nhashes * load), nhashes);
+    }
+    return rate;
+}
+
+// bloom_params calculates the number of blocks and hashes needed
+// to store n values with the given false positive rate.
+// Returns 0 on success, -1 if the filter would be too large.
+int bloom_params(double n, double fp_rate, uint32_t* nblocks, uint8_t* nhashes) {
+    // start with the size of a classic Bloom filter and grow it
+    // until the blocked filter reaches the requested rate
+    const double ln2 = 0.69314718055994530942;
+    double bits_per_value = -log(fp_rate) / (ln2 * ln2);
+    int best_hashes = 1;
+    for (;;) {
+        double best_rate = 1;
+        for (int k = 1; k <= BLOOM_MAX_HASHES; k++) {
+            double rate = blocked_fp_rate(bits_per_value, k);
+            if (rate < best_rate) {
+                best_rate = rate;
+                best_hashes = k;
+            }
+        }
+        if (best_rate <= fp_rate || bits_per_value >= BLOOM_MAX_BITS_PER_VALUE) {
+            break;
+        }
+        bits_per_value *= 1.05;
+    }
+
+    double blocks = ceil(n * bits_per_value / BLOOM_BLOCK_BITS);
+    if (blocks > UINT32_MAX) {
+        return -1;
+    }
+    *nblocks = (uint32_t)blocks;
+    *nhashes = (uint8_t)best_hashes;
+    return 0;
+}
+
+// bloom_len returns the serialized size of the filter with the given number of blocks.
+size_t bloom_len(uint32_t nblocks) {
+    return BLOOM_HEADER_LEN + (size_t)nblocks * BLOOM_BLOCK_LEN;
+}
+
+// bloom_init writes an empty filter into buf, which should be bloom_len(nblocks) bytes long.
+void bloom_init(uint8_t* buf, uint32_t nblocks, uint8_t nhashes) {
+    buf[0] = BLOOM_VERSION;
+    buf[1] = nhashes;
+    buf[2] = 0;
+    buf[3] = 0;
+    buf[4] = (uint8_t)nblocks;
+    buf[5] = (uint8_t)(nblocks >> 8);
+    buf[6] = (uint8_t)(nblocks >> 16);
+    buf[7] = (uint8_t)(nblocks >> 24);
+    memset(buf + BLOOM_HEADER_LEN, 0, (size_t)nblocks * BLOOM_BLOCK_LEN);
+}
+
+// bloom_parse validates the serialized filter and fills the filter struct.
+// The filter points into buf, so buf should outlive it.
+// Returns 0 on success, -1 if buf is not a valid filter.
+int bloom_parse(const uint8_t* buf, size_t len, bloom_filter* filter) {
+    if (len < BLOOM_HEADER_LEN + BLOOM_BLOCK_LEN) {
+        return -1;
+    }
+    if (buf[0] != BLOOM_VERSION || buf[1] < 1 || buf[1] > BLOOM_MAX_HASHES) {
+        return -1;
+    }
+    uint32_t nblocks = (uint32_t)buf[4] | (uint32_t)buf[5] << 8 | (uint32_t)buf[6] << 16 |
+                       (uint32_t)buf[7] << 24;
+    if (nblocks == 0 || len != bloom_len(nblocks)) {
+        return -1;
+    }
+    filter->nblocks = nblocks;
+    filter->nhashes = buf[1];
+    filter->blocks = (uint8_t*)buf + BLOOM_HEADER_LEN;
+    return 0;
+}
+
+// block_for returns the block for the hash.
+// Maps the upper half of the hash to [0, nblocks) without division.
+static inline uint8_t* block_for(const bloom_filter* filter, uint64_t hash) {
+    uint64_t idx = ((hash >> 32) * filter->nblocks) >> 32;
+    return filter->blocks + idx * BLOOM_BLOCK_LEN;
+}
+
+// bit_for returns the i-th bit position within the block for the hash.
+// Takes the top 9 bits of the salted lower half of the hash.
+static inline uint32_t bit_for(uint64_t hash, uint8_t i) {
+    return ((uint32_t)hash * SALT[i]) >> (32 - 9);
+}
+
+// bloom_add adds the value to the filter.
+void bloom_add(bloom_filter* filter, const void* data, size_t len) {
+    uint64_t hash = XXH3_64bits(data, len);
+    uint8_t* block = block_for(filter, hash);
+    for (uint8_t i = 0; i < filter->nhashes; i++) {
+        uint32_t bit = bit_for(hash, i);
+        block[bit / 8] |= (uint8_t)(1 << (bit % 8));
+    }
+}
+
+// bloom_contains returns 1 if the value may be in the filter,
+// and 0 if it's definitely not.
+int bloom_contains(const bloom_filter* filter, const void* data, size_t len) {
+    uint64_t hash = XXH3_64bits(data, len);
+    const uint8_t* block = block_for(filter, hash);
+    for (uint8_t i = 0; i < filter->nhashes; i++) {
+        uint32_t bit = bit_for(hash, i);
+        if (!(block[bit / 8] & (1 << (bit % 8)))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// bloom_merge adds all the values from src to dst.
+// Returns 0 on success, -1 if the filters have different parameters.
+int bloom_merge(bloom_filter* dst, const bloom_filter* src) {
+    if (dst->nblocks != src->nblocks || dst->nhashes != src->nhashes) {
+        return -1;
+    }
+    size_t len = (size_t)dst->nblocks * BLOOM_BLOCK_LEN;
+    for (size_t i = 0; i < len; i++) {
+        dst->blocks[i] |= src->blocks[i];
+    }
+    return 0;
+}
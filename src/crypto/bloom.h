@@ -0,0 +1,35 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// Blocked Bloom filter based on the XXH3 hash.
+
+#ifndef __BLOOM_H__
+#define __BLOOM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The filter is stored as a header followed by the blocks.
+// Each block is the size of a cache line, and all the bits
+// for a single value are set within one block.
+#define BLOOM_HEADER_LEN 8
+#define BLOOM_BLOCK_LEN 64
+
+// The maximum number of bits set for a single value.
+#define BLOOM_MAX_HASHES 16
+
+typedef struct {
+    uint32_t nblocks;
+    uint8_t nhashes;
+    uint8_t* blocks;
+} bloom_filter;
+
+int bloom_params(double n, double fp_rate, uint32_t* nblocks, uint8_t* nhashes);
+size_t bloom_len(uint32_t nblocks);
+void bloom_init(uint8_t* buf, uint32_t nblocks, uint8_t nhashes);
+int bloom_parse(const uint8_t* buf, size_t len, bloom_filter* filter);
+void bloom_add(bloom_filter* filter, const void* data, size_t len);
+int bloom_contains(const bloom_filter* filter, const void* data, size_t len);
+int bloom_merge(bloom_filter* dst, const bloom_filter* src);
+
+#endif /* __BLOOM_H__ */
@@ -0,0 +1,108 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// CPU feature detection, used to select the fastest implementation
+// of the hash functions at load time.
+
+#include "crypto/cpu.h"
+
+#if defined(CPU_X86)
+#include <cpuid.h>
+#endif
+
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#endif
+
+// Detected features, or -1 if not detected yet.
+static int features = -1;
+
+#if defined(CPU_X86)
+// xgetbv returns the extended control register,
+// which tells if the OS saves the AVX registers on context switch.
+static unsigned long long xgetbv(void) {
+    unsigned int eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+}
+
+static int detect(void) {
+    int result = 0;
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    if (ecx & (1 << 9)) {
+        result |= CPU_SSSE3;
+    }
+    if (ecx & (1 << 19)) {
+        result |= CPU_SSE41;
+    }
+    // AVX requires both the CPU (bit 28) and the OS (bit 27, OSXSAVE) support,
+    // and so does AVX-512 (the OS must save the opmask and upper ZMM registers)
+    unsigned long long xcr0 = (ecx & (1 << 27)) ? xgetbv() : 0;
+    int avx = (ecx & (1 << 28)) && (xcr0 & 0x06) == 0x06;
+    int avx512 = avx && (xcr0 & 0xE6) == 0xE6;
+
+    if (__get_cpuid_max(0, 0) < 7) {
+        return result;
+    }
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    if (avx && (ebx & (1 << 5))) {
+        result |= CPU_AVX2;
+    }
+    if (avx512 && (ebx & (1 << 16))) {
+        result |= CPU_AVX512;
+    }
+    if (ebx & (1 << 29)) {
+        result |= CPU_SHA;
+    }
+    return result;
+}
+
+#elif defined(__aarch64__) && defined(__APPLE__)
+static int detect(void) {
+    // all Apple ARM processors support the crypto extensions
+    return CPU_NEON | CPU_ARM_SHA1 | CPU_ARM_SHA2;
+}
+
+#elif defined(__aarch64__) && defined(__linux__)
+static int detect(void) {
+    // hwcap bits from asm/hwcap.h
+    const unsigned long hwcap_asimd = 1 << 1;
+    const unsigned long hwcap_sha1 = 1 << 5;
+    const unsigned long hwcap_sha2 = 1 << 6;
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    int result = 0;
+    if (hwcap & hwcap_asimd) {
+        result |= CPU_NEON;
+    }
+    if (hwcap & hwcap_sha1) {
+        result |= CPU_ARM_SHA1;
+    }
+    if (hwcap & hwcap_sha2) {
+        result |= CPU_ARM_SHA2;
+    }
+    return result;
+}
+
+#elif defined(__aarch64__)
+static int detect(void) {
+    // NEON is a mandatory part of ARMv8-A
+    return CPU_NEON;
+}
+
+#else
+static int detect(void) {
+    return 0;
+}
+#endif
+
+// cpu_features returns the features supported by the CPU (CPU_* flags).
+// Detects the features on the first call and returns the cached result afterwards.
+int cpu_features(void) {
+    if (features == -1) {
+        features = detect();
+    }
+    return features;
+}
@@ -0,0 +1,41 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// CPU feature detection, used to select the fastest implementation
+// of the hash functions at load time.
+
+#ifndef __CPU_H__
+#define __CPU_H__
+
+// Architectures with SIMD kernels. The kernels are compiled with function-level
+// target attributes, so the rest of the code does not require any special flags.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_X86 1
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__) && !defined(__ARM_BIG_ENDIAN)
+#define CPU_ARM 1
+#if defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_SHA2)
+#define CPU_ARM_CRYPTO 1
+#define CPU_TARGET_ARM_CRYPTO
+#elif !defined(__clang__)
+#define CPU_ARM_CRYPTO 1
+#define CPU_TARGET_ARM_CRYPTO __attribute__((target("+crypto")))
+#endif
+#endif
+
+// x86 features.
+#define CPU_SSSE3 (1 << 0)
+#define CPU_SSE41 (1 << 1)
+#define CPU_AVX2 (1 << 2)
+#define CPU_SHA (1 << 3)
+#define CPU_AVX512 (1 << 4)
+
+// ARM features.
+#define CPU_NEON (1 << 8)
+#define CPU_ARM_SHA1 (1 << 9)
+#define CPU_ARM_SHA2 (1 << 10)
+
+int cpu_features(void);
+
+#endif
@@ -8,6 +8,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
 #include "sqlite3ext.h"
 SQLITE_EXTENSION_INIT3
 
@@ -15,16 +19,37 @@ SQLITE_EXTENSION_INIT3
 #include "crypto/base64.h"
 #include "crypto/base85.h"
 #include "crypto/blake3.h"
+#include "crypto/bloom.h"
+#include "crypto/cpu.h"
+#include "crypto/hash.h"
 #include "crypto/hex.h"
-#include "crypto/md5.h"
-#include "crypto/sha1.h"
-#include "crypto/sha2.h"
 #include "crypto/url.h"
-#include "crypto/xxhash.h"
+#include "crypto/workers.h"
 
 // encoder/decoder function
 typedef uint8_t* (*encdec_fn)(const uint8_t* src, size_t len, size_t* out_len);
 
+// Encoder/decoder that writes into a buffer of the exact size,
+// so the result can be handed over to SQLite without copying.
+typedef struct {
+    size_t (*encoded_len)(size_t len);
+    void (*encode)(const uint8_t* src, size_t len, uint8_t* dst);
+    int (*decoded_len)(const uint8_t* src, size_t len, size_t* out_len);
+    int (*decode)(const uint8_t* src, size_t len, uint8_t* dst);
+} codec;
+
+static const codec base64_codec = {base64_encoded_len, base64_encode, base64_decoded_len,
+                                   base64_decode};
+static const codec hex_codec = {hex_encoded_len, hex_encode, hex_decoded_len, hex_decode};
+
+// Returns the data of the value as bytes.
+static const void* value_data(sqlite3_value* value) {
+    if (sqlite3_value_type(value) == SQLITE_BLOB) {
+        return sqlite3_value_blob(value);
+    }
+    return sqlite3_value_text(value);
+}
+
 // Generic compute hash function. Algorithm is encoded in the user data field.
 static void crypto_hash(sqlite3_context* context, int argc, sqlite3_value** argv) {
     assert(argc == 1);
@@ -33,101 +58,496 @@ static void crypto_hash(sqlite3_context* context, int argc, sqlite3_value** argv
         return;
     }
 
-    void* (*init_func)() = NULL;
-    void (*update_func)(void*, void*, size_t) = NULL;
-    int (*final_func)(void*, void*) = NULL;
-    int algo = (intptr_t)sqlite3_user_data(context);
-
-    switch (algo) {
-        case 1: /* Hardened SHA1 */
-            init_func = (void*)sha1_init;
-            update_func = (void*)sha1_update;
-            final_func = (void*)sha1_final;
-            algo = 1;
-            break;
-        case 3: /* Blake3 */
-            init_func = (void*)blake3_init;
-            update_func = (void*)blake3_update;
-            final_func = (void*)blake3_final;
-            algo = 3;
-            break;
-        case 5: /* MD5 */
-            init_func = (void*)md5_init;
-            update_func = (void*)md5_update;
-            final_func = (void*)md5_final;
-            algo = 1;
-            break;
-        case 1032: /* XXH32 */
-            init_func = (void*)xxh32_init;
-            update_func = (void*)xxh32_update;
-            final_func = (void*)xxh32_final;
-            algo = 1;
-            break;
-        case 1064: /* XXH64 */
-            init_func = (void*)xxh64_init;
-            update_func = (void*)xxh64_update;
-            final_func = (void*)xxh64_final;
-            algo = 1;
-            break;
-        case 3064: /* XXH3 64-bit */
-            init_func = (void*)xxh3_64_init;
-            update_func = (void*)xxh3_64_update;
-            final_func = (void*)xxh3_64_final;
-            algo = 1;
-            break;
-        case 3128: /* XXH3 128-bit */
-            init_func = (void*)xxh3_128_init;
-            update_func = (void*)xxh3_128_update;
-            final_func = (void*)xxh3_128_final;
-            algo = 1;
-            break;
-        case 2256: /* SHA2-256 */
-            init_func = (void*)sha256_init;
-            update_func = (void*)sha256_update;
-            final_func = (void*)sha256_final;
-            algo = 1;
-            break;
-        case 2384: /* SHA2-384 */
-            init_func = (void*)sha384_init;
-            update_func = (void*)sha384_update;
-            final_func = (void*)sha384_final;
-            algo = 1;
-            break;
-        case 2512: /* SHA2-512 */
-            init_func = (void*)sha512_init;
-            update_func = (void*)sha512_update;
-            final_func = (void*)sha512_final;
-            algo = 1;
-            break;
-        default:
-            sqlite3_result_error(context, "unknown algorithm", -1);
+    const hash_algo* algo = sqlite3_user_data(context);
+    const void* data = value_data(argv[0]);
+    size_t datalen = sqlite3_value_bytes(argv[0]);
+
+    uint8_t digest[HASH_MAX_DIGEST_LEN];
+    hash_compute(algo, data, datalen, digest);
+    sqlite3_result_blob(context, digest, algo->digest_len, SQLITE_TRANSIENT);
+}
+
+// Computes a 64-bit hash of the value and returns it as an integer.
+// The hash function is encoded in the user data field.
+// crypto_xxh3_int(data [, seed])
+static void crypto_hash_int(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 1 || argc == 2);
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return;
+    }
+    uint64_t seed = 0;
+    if (argc == 2) {
+        if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER) {
+            sqlite3_result_error(context, "seed should be an integer", -1);
             return;
+        }
+        seed = (uint64_t)sqlite3_value_int64(argv[1]);
     }
 
-    void* ctx = NULL;
-    if (algo) {
-        ctx = init_func();
+    int64_t (*hash_fn)(const void*, size_t, uint64_t) = sqlite3_user_data(context);
+    const void* data = value_data(argv[0]);
+    size_t datalen = sqlite3_value_bytes(argv[0]);
+    sqlite3_result_int64(context, hash_fn(data, datalen, seed));
+}
+
+// Maps the key to one of the n buckets using the jump consistent hash
+// (Lamping and Veach, https://arxiv.org/abs/1406.2294). When the number
+// of buckets grows from n to n+1, only 1/(n+1) of the keys move,
+// and all of them move to the new bucket.
+static int32_t jump_hash(uint64_t key, int32_t nbuckets) {
+    int64_t b = -1;
+    int64_t j = 0;
+    while (j < nbuckets) {
+        b = j;
+        key = key * 2862933555777941757ULL + 1;
+        j = (int64_t)((b + 1) * ((double)(1LL << 31) / (double)((key >> 33) + 1)));
     }
-    if (!ctx) {
-        sqlite3_result_error(context, "could not allocate algorithm context", -1);
+    return (int32_t)b;
+}
+
+// Returns the bucket number (from 0 to n-1) for the value.
+// crypto_hash_bucket(data, n)
+static void crypto_hash_bucket(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 2);
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return;
+    }
+    if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER || sqlite3_value_int64(argv[1]) < 1 ||
+        sqlite3_value_int64(argv[1]) > INT32_MAX) {
+        sqlite3_result_error(context, "number of buckets should be a positive 32-bit integer",
+                             -1);
         return;
     }
+    int32_t nbuckets = (int32_t)sqlite3_value_int64(argv[1]);
 
-    void* data = NULL;
-    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) {
-        data = (void*)sqlite3_value_blob(argv[0]);
-    } else {
-        data = (void*)sqlite3_value_text(argv[0]);
+    const void* data = value_data(argv[0]);
+    size_t datalen = sqlite3_value_bytes(argv[0]);
+    uint64_t key = (uint64_t)xxh3_64_int(data, datalen, 0);
+    sqlite3_result_int(context, jump_hash(key, nbuckets));
+}
+
+// Default Bloom filter parameters.
+#define BLOOM_DEFAULT_N 100000
+#define BLOOM_DEFAULT_FP_RATE 0.01
+
+// Bloom filter aggregate context. The blocks are aligned to the cache line,
+// so that adding a value touches a single line.
+typedef struct {
+    void* mem;
+    bloom_filter filter;
+} BloomAgg;
+
+// Allocates an empty filter according to the bloom_agg parameters.
+// Returns SQLITE_OK or an error code, with the error set.
+static int bloom_agg_alloc(sqlite3_context* context,
+                           int argc,
+                           sqlite3_value** argv,
+                           BloomAgg* agg) {
+    double n = BLOOM_DEFAULT_N;
+    double fp_rate = BLOOM_DEFAULT_FP_RATE;
+    if (argc >= 2) {
+        if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER || sqlite3_value_int64(argv[1]) < 1) {
+            sqlite3_result_error(context, "expected_n should be a positive integer", -1);
+            return SQLITE_ERROR;
+        }
+        n = (double)sqlite3_value_int64(argv[1]);
+    }
+    if (argc >= 3) {
+        int type = sqlite3_value_type(argv[2]);
+        fp_rate = sqlite3_value_double(argv[2]);
+        if ((type != SQLITE_FLOAT && type != SQLITE_INTEGER) || !(fp_rate > 0 && fp_rate < 1)) {
+            sqlite3_result_error(context, "fp_rate should be a number between 0 and 1", -1);
+            return SQLITE_ERROR;
+        }
     }
 
+    uint32_t nblocks;
+    uint8_t nhashes;
+    sqlite3* db = sqlite3_context_db_handle(context);
+    size_t max_len = (size_t)sqlite3_limit(db, SQLITE_LIMIT_LENGTH, -1);
+    if (bloom_params(n, fp_rate, &nblocks, &nhashes) != 0 || bloom_len(nblocks) > max_len) {
+        sqlite3_result_error(context, "bloom filter is too large", -1);
+        return SQLITE_TOOBIG;
+    }
+
+    size_t len = (size_t)nblocks * BLOOM_BLOCK_LEN;
+    agg->mem = sqlite3_malloc64(len + BLOOM_BLOCK_LEN);
+    if (!agg->mem) {
+        sqlite3_result_error_nomem(context);
+        return SQLITE_NOMEM;
+    }
+    uintptr_t addr = (uintptr_t)agg->mem;
+    addr = (addr + BLOOM_BLOCK_LEN - 1) & ~(uintptr_t)(BLOOM_BLOCK_LEN - 1);
+    agg->filter.blocks = (uint8_t*)addr;
+    agg->filter.nblocks = nblocks;
+    agg->filter.nhashes = nhashes;
+    memset(agg->filter.blocks, 0, len);
+    return SQLITE_OK;
+}
+
+// Adds the value to the Bloom filter.
+// bloom_agg(data [, expected_n [, fp_rate]])
+static void crypto_bloom_step(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc >= 1 && argc <= 3);
+
+    BloomAgg* agg = sqlite3_aggregate_context(context, sizeof(*agg));
+    if (!agg) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    if (!agg->mem && bloom_agg_alloc(context, argc, argv, agg) != SQLITE_OK) {
+        return;
+    }
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return;
+    }
+    const void* data = value_data(argv[0]);
     size_t datalen = sqlite3_value_bytes(argv[0]);
+    bloom_add(&agg->filter, data, datalen);
+}
+
+// Returns the Bloom filter as a blob.
+static void crypto_bloom_final(sqlite3_context* context) {
+    BloomAgg* agg = sqlite3_aggregate_context(context, 0);
+    if (!agg || !agg->mem) {
+        sqlite3_result_null(context);
+        return;
+    }
+    size_t len = bloom_len(agg->filter.nblocks);
+    uint8_t* buf = sqlite3_malloc64(len);
+    if (!buf) {
+        sqlite3_free(agg->mem);
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    bloom_init(buf, agg->filter.nblocks, agg->filter.nhashes);
+    memcpy(buf + BLOOM_HEADER_LEN, agg->filter.blocks, len - BLOOM_HEADER_LEN);
+    sqlite3_free(agg->mem);
+    sqlite3_result_blob64(context, buf, len, sqlite3_free);
+}
+
+// Parses the Bloom filter from the argument value.
+// Sets the error and returns -1 if the value is not a valid filter.
+static int bloom_from_value(sqlite3_context* context, sqlite3_value* value, bloom_filter* filter) {
+    const uint8_t* buf = sqlite3_value_blob(value);
+    size_t len = sqlite3_value_bytes(value);
+    if (sqlite3_value_type(value) != SQLITE_BLOB || bloom_parse(buf, len, filter) != 0) {
+        sqlite3_result_error(context, "invalid bloom filter", -1);
+        return -1;
+    }
+    return 0;
+}
+
+// Checks if the value may be in the Bloom filter.
+// Returns 0 if the value is definitely not there, 1 if it probably is.
+// bloom_contains(filter, data)
+static void crypto_bloom_contains(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 2);
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL ||
+        sqlite3_value_type(argv[1]) == SQLITE_NULL) {
+        return;
+    }
+    bloom_filter filter;
+    if (bloom_from_value(context, argv[0], &filter) != 0) {
+        return;
+    }
+    const void* data = value_data(argv[1]);
+    size_t datalen = sqlite3_value_bytes(argv[1]);
+    sqlite3_result_int(context, bloom_contains(&filter, data, datalen));
+}
+
+// Combines two Bloom filters with the same parameters into one.
+// If one of the filters is NULL, returns the other one.
+// bloom_merge(filter1, filter2)
+static void crypto_bloom_merge(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 2);
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        sqlite3_result_value(context, argv[1]);
+        return;
+    }
+    if (sqlite3_value_type(argv[1]) == SQLITE_NULL) {
+        sqlite3_result_value(context, argv[0]);
+        return;
+    }
+
+    bloom_filter src;
+    bloom_filter other;
+    if (bloom_from_value(context, argv[0], &src) != 0 ||
+        bloom_from_value(context, argv[1], &other) != 0) {
+        return;
+    }
+    if (src.nblocks != other.nblocks || src.nhashes != other.nhashes) {
+        sqlite3_result_error(context, "bloom filters should have the same parameters", -1);
+        return;
+    }
+
+    size_t len = bloom_len(src.nblocks);
+    uint8_t* buf = sqlite3_malloc64(len);
+    if (!buf) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    memcpy(buf, sqlite3_value_blob(argv[0]), len);
+    bloom_filter dst;
+    bloom_parse(buf, len, &dst);
+    bloom_merge(&dst, &other);
+    sqlite3_result_blob64(context, buf, len, sqlite3_free);
+}
+
+// Size of the buffer used to hash blobs and files piece by piece.
+#define HASH_BUFFER_SIZE (64 * 1024)
+
+// Finds the hash algorithm by the name in the argument value.
+// Sets the error and returns NULL if the algorithm is unknown.
+static const hash_algo* algo_from_value(sqlite3_context* context, sqlite3_value* value) {
+    const hash_algo* algo = hash_find((const char*)sqlite3_value_text(value));
+    if (!algo) {
+        sqlite3_result_error(context, "unknown algorithm", -1);
+    }
+    return algo;
+}
+
+// Computes a hash of the blob stored in the database, reading it piece by piece,
+// so the memory usage does not depend on the blob size.
+// crypto_hash_blob(algo, schema, table, column, rowid)
+static void crypto_hash_blob(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 5);
+
+    const hash_algo* algo = algo_from_value(context, argv[0]);
+    if (!algo) {
+        return;
+    }
+    if (sqlite3_value_type(argv[2]) == SQLITE_NULL || sqlite3_value_type(argv[3]) == SQLITE_NULL ||
+        sqlite3_value_type(argv[4]) == SQLITE_NULL) {
+        return;
+    }
+
+    sqlite3* db = sqlite3_context_db_handle(context);
+    const char* schema = (const char*)sqlite3_value_text(argv[1]);
+    const char* table = (const char*)sqlite3_value_text(argv[2]);
+    const char* column = (const char*)sqlite3_value_text(argv[3]);
+    sqlite3_int64 rowid = sqlite3_value_int64(argv[4]);
+    if (schema == NULL) {
+        schema = "main";
+    }
+
+    sqlite3_blob* blob;
+    if (sqlite3_blob_open(db, schema, table, column, rowid, 0, &blob) != SQLITE_OK) {
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+        return;
+    }
+
+    unsigned char* buffer = sqlite3_malloc(HASH_BUFFER_SIZE);
+    if (!buffer) {
+        sqlite3_blob_close(blob);
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    hash_ctx ctx;
+    algo->init(&ctx);
+    int size = sqlite3_blob_bytes(blob);
+    int rc = SQLITE_OK;
+    for (int offset = 0; offset < size && rc == SQLITE_OK; offset += HASH_BUFFER_SIZE) {
+        int n = size - offset < HASH_BUFFER_SIZE ? size - offset : HASH_BUFFER_SIZE;
+        rc = sqlite3_blob_read(blob, buffer, n, offset);
+        if (rc == SQLITE_OK) {
+            algo->update(&ctx, buffer, n);
+        }
+    }
+    sqlite3_free(buffer);
+    sqlite3_blob_close(blob);
+
+    if (rc != SQLITE_OK) {
+        sqlite3_result_error_code(context, rc);
+        return;
+    }
+    uint8_t digest[HASH_MAX_DIGEST_LEN];
+    algo->final(&ctx, digest);
+    sqlite3_result_blob(context, digest, algo->digest_len, SQLITE_TRANSIENT);
+}
+
+// Computes a hash of the file, reading it piece by piece,
+// so the memory usage does not depend on the file size.
+// Returns NULL if the file does not exist or is unreadable.
+// crypto_hash_file(algo, path)
+static void crypto_hash_file(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 2);
+
+    const hash_algo* algo = algo_from_value(context, argv[0]);
+    if (!algo) {
+        return;
+    }
+    const char* path = (const char*)sqlite3_value_text(argv[1]);
+    if (path == NULL) {
+        return;
+    }
+
+    FILE* file;
+#if defined(_WIN32)
+    extern LPWSTR sqlite3_win32_utf8_to_unicode(const char*);
+    LPWSTR wpath = sqlite3_win32_utf8_to_unicode(path);
+    if (!wpath) {
+        return;
+    }
+    file = _wfopen(wpath, L"rb");
+    sqlite3_free(wpath);
+#else
+    file = fopen(path, "rb");
+#endif
+    if (!file) {
+        return;
+    }
+
+    unsigned char* buffer = sqlite3_malloc(HASH_BUFFER_SIZE);
+    if (!buffer) {
+        fclose(file);
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    hash_ctx ctx;
+    algo->init(&ctx);
+    size_t n;
+    while ((n = fread(buffer, 1, HASH_BUFFER_SIZE, file)) > 0) {
+        algo->update(&ctx, buffer, n);
+    }
+    int failed = ferror(file);
+    sqlite3_free(buffer);
+    fclose(file);
+
+    if (failed) {
+        sqlite3_result_error(context, "could not read the file", -1);
+        return;
+    }
+    uint8_t digest[HASH_MAX_DIGEST_LEN];
+    algo->final(&ctx, digest);
+    sqlite3_result_blob(context, digest, algo->digest_len, SQLITE_TRANSIENT);
+}
+
+// Aggregate hash state. The hash context lives in the aggregate
+// context memory, which SQLite does not align beyond 8 bytes,
+// so there is some room to align it manually.
+typedef struct {
+    const hash_algo* algo;
+    unsigned char mem[sizeof(hash_ctx) + _Alignof(hash_ctx)];
+} HashAgg;
+
+// Returns the hash context of the aggregate.
+static void* agg_hash_ctx(HashAgg* agg) {
+    uintptr_t addr = (uintptr_t)agg->mem;
+    uintptr_t align = _Alignof(hash_ctx);
+    return (void*)((addr + align - 1) & ~(align - 1));
+}
+
+// Feeds the next value into the aggregate hash.
+// The algorithm is either the first argument (crypto_hash_agg)
+// or encoded in the user data field (crypto_sha256_agg etc.)
+static void crypto_hash_step(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 1 || argc == 2);
+    sqlite3_value* value = argv[argc - 1];
+    if (sqlite3_value_type(value) == SQLITE_NULL) {
+        return;
+    }
+
+    HashAgg* agg = sqlite3_aggregate_context(context, sizeof(*agg));
+    if (!agg) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    if (!agg->algo) {
+        const hash_algo* algo = sqlite3_user_data(context);
+        if (argc == 2) {
+            algo = algo_from_value(context, argv[0]);
+        }
+        if (!algo) {
+            return;
+        }
+        agg->algo = algo;
+        agg->algo->init(agg_hash_ctx(agg));
+    }
+
+    size_t datalen = sqlite3_value_bytes(value);
+    if (datalen > 0) {
+        agg->algo->update(agg_hash_ctx(agg), value_data(value), datalen);
+    }
+}
+
+// Returns the hash of all the values.
+// Returns NULL if there were no values.
+static void crypto_hash_final(sqlite3_context* context) {
+    HashAgg* agg = sqlite3_aggregate_context(context, 0);
+    if (!agg || !agg->algo) {
+        return;
+    }
+    uint8_t digest[HASH_MAX_DIGEST_LEN];
+    agg->algo->final(agg_hash_ctx(agg), digest);
+    sqlite3_result_blob(context, digest, agg->algo->digest_len, SQLITE_TRANSIENT);
+}
+
+// Returns the hash of the values so far (window function).
+// Finalizes a copy of the hash context, so that more values can be added later.
+static void crypto_hash_value(sqlite3_context* context) {
+    HashAgg* agg = sqlite3_aggregate_context(context, 0);
+    if (!agg || !agg->algo) {
+        return;
+    }
+    hash_ctx copy;
+    memcpy(&copy, agg_hash_ctx(agg), agg->algo->ctx_size);
+    uint8_t digest[HASH_MAX_DIGEST_LEN];
+    agg->algo->final(&copy, digest);
+    sqlite3_result_blob(context, digest, agg->algo->digest_len, SQLITE_TRANSIENT);
+}
+
+// A value can not be removed from the hash, so only the window frames
+// that start with the first row of the partition are supported.
+static void crypto_hash_inverse(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    (void)argc;
+    (void)argv;
+    sqlite3_result_error(context, "sliding window frames are not supported", -1);
+}
+
+// Computes a BLAKE3 hash using up to the specified number of threads.
+// crypto_blake3(data, threads)
+static void crypto_blake3_parallel(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 2);
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return;
+    }
+    if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER || sqlite3_value_int64(argv[1]) < 1) {
+        sqlite3_result_error(context, "threads should be a positive integer", -1);
+        return;
+    }
+    sqlite3_int64 nthreads = sqlite3_value_int64(argv[1]);
+    if (nthreads > WORKERS_MAX_THREADS) {
+        nthreads = WORKERS_MAX_THREADS;
+    }
+
+    const void* data = value_data(argv[0]);
+    size_t datalen = sqlite3_value_bytes(argv[0]);
+
+    blake3_hasher ctx;
+    blake3_init(&ctx);
     if (datalen > 0) {
-        update_func(ctx, data, datalen);
+        blake3_update_parallel(&ctx, data, datalen, (int)nthreads);
     }
 
-    unsigned char hash[128] = {0};
-    int hashlen = final_func(ctx, hash);
-    sqlite3_result_blob(context, hash, hashlen, SQLITE_TRANSIENT);
+    uint8_t digest[BLAKE3_OUT_LEN];
+    blake3_final(&ctx, digest);
+    sqlite3_result_blob(context, digest, BLAKE3_OUT_LEN, SQLITE_TRANSIENT);
+}
+
+// Releases the worker threads when the function is destroyed
+// (e.g. when the connection is closed).
+static void release_workers(void* unused) {
+    (void)unused;
+    workers_release();
 }
 
 // Encodes binary data into a textual representation using the specified encoder.
@@ -144,6 +564,26 @@ static void encode(sqlite3_context* context, int argc, sqlite3_value** argv, enc
     sqlite3_result_text(context, result, -1, free);
 }
 
+// Encodes binary data into a textual representation using the specified codec.
+static void encode_into(sqlite3_context* context, sqlite3_value* value, const codec* codec) {
+    if (sqlite3_value_type(value) == SQLITE_NULL) {
+        sqlite3_result_null(context);
+        return;
+    }
+    size_t source_len = sqlite3_value_bytes(value);
+    const uint8_t* source = (uint8_t*)sqlite3_value_blob(value);
+    size_t result_len = codec->encoded_len(source_len);
+    // the terminating zero lets SQLite use the buffer as is
+    uint8_t* result = sqlite3_malloc64(result_len + 1);
+    if (result == NULL) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    codec->encode(source, source_len, result);
+    result[result_len] = '\0';
+    sqlite3_result_text64(context, (char*)result, result_len, sqlite3_free, SQLITE_UTF8);
+}
+
 // Encodes binary data into a textual representation using the specified algorithm.
 // encode('hello', 'base64') = 'aGVsbG8='
 static void crypto_encode(sqlite3_context* context, int argc, sqlite3_value** argv) {
@@ -155,7 +595,7 @@ static void crypto_encode(sqlite3_context* context, int argc, sqlite3_value** ar
         return;
     }
     if (strncmp(format, "base64", n) == 0) {
-        encode(context, 1, argv, base64_encode);
+        encode_into(context, argv[0], &base64_codec);
         return;
     }
     if (strncmp(format, "base85", n) == 0) {
@@ -163,7 +603,7 @@ static void crypto_encode(sqlite3_context* context, int argc, sqlite3_value** ar
         return;
     }
     if (strncmp(format, "hex", n) == 0) {
-        encode(context, 1, argv, hex_encode);
+        encode_into(context, argv[0], &hex_codec);
         return;
     }
     if (strncmp(format, "url", n) == 0) {
@@ -198,6 +638,38 @@ static void decode(sqlite3_context* context, int argc, sqlite3_value** argv, enc
     sqlite3_result_blob(context, result, result_len, free);
 }
 
+// Decodes binary data from a textual representation using the specified codec.
+static void decode_into(sqlite3_context* context, sqlite3_value* value, const codec* codec) {
+    if (sqlite3_value_type(value) == SQLITE_NULL) {
+        sqlite3_result_null(context);
+        return;
+    }
+
+    size_t source_len = sqlite3_value_bytes(value);
+    const uint8_t* source = (uint8_t*)sqlite3_value_text(value);
+    if (source_len == 0) {
+        sqlite3_result_zeroblob(context, 0);
+        return;
+    }
+
+    size_t result_len = 0;
+    if (codec->decoded_len(source, source_len, &result_len) != 0) {
+        sqlite3_result_error(context, "invalid input string", -1);
+        return;
+    }
+    uint8_t* result = sqlite3_malloc64(result_len > 0 ? result_len : 1);
+    if (result == NULL) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    if (codec->decode(source, source_len, result) != 0) {
+        sqlite3_free(result);
+        sqlite3_result_error(context, "invalid input string", -1);
+        return;
+    }
+    sqlite3_result_blob64(context, result, result_len, sqlite3_free);
+}
+
 // Decodes binary data from a textual representation using the specified algorithm.
 // decode('aGVsbG8=', 'base64') = cast('hello' as blob)
 static void crypto_decode(sqlite3_context* context, int argc, sqlite3_value** argv) {
@@ -209,7 +681,7 @@ static void crypto_decode(sqlite3_context* context, int argc, sqlite3_value** ar
         return;
     }
     if (strncmp(format, "base64", n) == 0) {
-        decode(context, 1, argv, base64_decode);
+        decode_into(context, argv[0], &base64_codec);
         return;
     }
     if (strncmp(format, "base85", n) == 0) {
@@ -217,7 +689,7 @@ static void crypto_decode(sqlite3_context* context, int argc, sqlite3_value** ar
         return;
     }
     if (strncmp(format, "hex", n) == 0) {
-        decode(context, 1, argv, hex_decode);
+        decode_into(context, argv[0], &hex_codec);
         return;
     }
     if (strncmp(format, "url", n) == 0) {
@@ -228,27 +700,79 @@ static void crypto_decode(sqlite3_context* context, int argc, sqlite3_value** ar
 }
 
 int crypto_init(sqlite3* db) {
+    // select the hardware-accelerated implementations (if supported) at load time
+    cpu_features();
+
     static const int flags = SQLITE_UTF8 | SQLITE_INNOCUOUS | SQLITE_DETERMINISTIC;
-    sqlite3_create_function(db, "crypto_blake3", 1, flags, (void*)3, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "blake3", 1, flags, (void*)3, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "crypto_md5", 1, flags, (void*)5, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "md5", 1, flags, (void*)5, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "crypto_sha1", 1, flags, (void*)1, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "sha1", 1, flags, (void*)1, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "crypto_sha256", 1, flags, (void*)2256, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "sha256", 1, flags, (void*)2256, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "crypto_sha384", 1, flags, (void*)2384, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "sha384", 1, flags, (void*)2384, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "crypto_sha512", 1, flags, (void*)2512, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "sha512", 1, flags, (void*)2512, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "crypto_xxh32", 1, flags, (void*)1032, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "xxh32", 1, flags, (void*)1032, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "crypto_xxh64", 1, flags, (void*)1064, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "xxh64", 1, flags, (void*)1064, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "crypto_xxh3_64", 1, flags, (void*)3064, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "xxh3_64", 1, flags, (void*)3064, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "crypto_xxh3_128", 1, flags, (void*)3128, crypto_hash, 0, 0);
-    sqlite3_create_function(db, "xxh3_128", 1, flags, (void*)3128, crypto_hash, 0, 0);
+    static const struct {
+        const char* name;
+        const char* alias;
+        const char* agg_name;
+        const char* agg_alias;
+        const hash_algo* algo;
+    } hashes[] = {
+        {"crypto_blake3", "blake3", "crypto_blake3_agg", "blake3_agg", &hash_blake3},
+        {"crypto_md5", "md5", "crypto_md5_agg", "md5_agg", &hash_md5},
+        {"crypto_sha1", "sha1", "crypto_sha1_agg", "sha1_agg", &hash_sha1},
+        {"crypto_sha256", "sha256", "crypto_sha256_agg", "sha256_agg", &hash_sha256},
+        {"crypto_sha384", "sha384", "crypto_sha384_agg", "sha384_agg", &hash_sha384},
+        {"crypto_sha512", "sha512", "crypto_sha512_agg", "sha512_agg", &hash_sha512},
+        {"crypto_xxh32", "xxh32", "crypto_xxh32_agg", "xxh32_agg", &hash_xxh32},
+        {"crypto_xxh64", "xxh64", "crypto_xxh64_agg", "xxh64_agg", &hash_xxh64},
+        {"crypto_xxh3_64", "xxh3_64", "crypto_xxh3_64_agg", "xxh3_64_agg", &hash_xxh3_64},
+        {"crypto_xxh3_128", "xxh3_128", "crypto_xxh3_128_agg", "xxh3_128_agg", &hash_xxh3_128},
+    };
+    for (size_t i = 0; i < sizeof(hashes) / sizeof(hashes[0]); i++) {
+        void* algo = (void*)hashes[i].algo;
+        sqlite3_create_function(db, hashes[i].name, 1, flags, algo, crypto_hash, 0, 0);
+        sqlite3_create_function(db, hashes[i].alias, 1, flags, algo, crypto_hash, 0, 0);
+        sqlite3_create_window_function(db, hashes[i].agg_name, 1, flags, algo, crypto_hash_step,
+                                       crypto_hash_final, crypto_hash_value,
+                                       crypto_hash_inverse, 0);
+        sqlite3_create_window_function(db, hashes[i].agg_alias, 1, flags, algo, crypto_hash_step,
+                                       crypto_hash_final, crypto_hash_value,
+                                       crypto_hash_inverse, 0);
+    }
+    void* xxh3_int_fn = (void*)xxh3_64_int;
+    void* xxh64_int_fn = (void*)xxh64_int;
+    sqlite3_create_function(db, "crypto_xxh3_int", 1, flags, xxh3_int_fn, crypto_hash_int, 0, 0);
+    sqlite3_create_function(db, "crypto_xxh3_int", 2, flags, xxh3_int_fn, crypto_hash_int, 0, 0);
+    sqlite3_create_function(db, "xxh3_int", 1, flags, xxh3_int_fn, crypto_hash_int, 0, 0);
+    sqlite3_create_function(db, "xxh3_int", 2, flags, xxh3_int_fn, crypto_hash_int, 0, 0);
+    sqlite3_create_function(db, "crypto_xxh64_int", 1, flags, xxh64_int_fn, crypto_hash_int, 0, 0);
+    sqlite3_create_function(db, "crypto_xxh64_int", 2, flags, xxh64_int_fn, crypto_hash_int, 0, 0);
+    sqlite3_create_function(db, "xxh64_int", 1, flags, xxh64_int_fn, crypto_hash_int, 0, 0);
+    sqlite3_create_function(db, "xxh64_int", 2, flags, xxh64_int_fn, crypto_hash_int, 0, 0);
+    sqlite3_create_function(db, "crypto_hash_bucket", 2, flags, 0, crypto_hash_bucket, 0, 0);
+    sqlite3_create_function(db, "hash_bucket", 2, flags, 0, crypto_hash_bucket, 0, 0);
+
+    for (int nargs = 1; nargs <= 3; nargs++) {
+        sqlite3_create_function(db, "crypto_bloom_agg", nargs, flags, 0, 0, crypto_bloom_step,
+                                crypto_bloom_final);
+        sqlite3_create_function(db, "bloom_agg", nargs, flags, 0, 0, crypto_bloom_step,
+                                crypto_bloom_final);
+    }
+    sqlite3_create_function(db, "crypto_bloom_contains", 2, flags, 0, crypto_bloom_contains, 0,
+                            0);
+    sqlite3_create_function(db, "bloom_contains", 2, flags, 0, crypto_bloom_contains, 0, 0);
+    sqlite3_create_function(db, "crypto_bloom_merge", 2, flags, 0, crypto_bloom_merge, 0, 0);
+    sqlite3_create_function(db, "bloom_merge", 2, flags, 0, crypto_bloom_merge, 0, 0);
+
+    sqlite3_create_window_function(db, "crypto_hash_agg", 2, flags, 0, crypto_hash_step,
+                                   crypto_hash_final, crypto_hash_value, crypto_hash_inverse, 0);
+
+    // the worker threads are stopped when all the functions using them are destroyed
+    workers_retain();
+    sqlite3_create_function_v2(db, "crypto_blake3", 2, flags, 0, crypto_blake3_parallel, 0, 0,
+                               release_workers);
+    workers_retain();
+    sqlite3_create_function_v2(db, "blake3", 2, flags, 0, crypto_blake3_parallel, 0, 0,
+                               release_workers);
+
+    // these read the database and the file system, so they can't be used in triggers and views
+    static const int direct_flags = SQLITE_UTF8 | SQLITE_DIRECTONLY;
+    sqlite3_create_function(db, "crypto_hash_blob", 5, direct_flags, 0, crypto_hash_blob, 0, 0);
+    sqlite3_create_function(db, "crypto_hash_file", 2, direct_flags, 0, crypto_hash_file, 0, 0);
 
     sqlite3_create_function(db, "crypto_encode", 2, flags, 0, crypto_encode, 0, 0);
     sqlite3_create_function(db, "encode", 2, flags, 0, crypto_encode, 0, 0);
@@ -0,0 +1,96 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// Hash algorithm descriptors.
+
+#include <string.h>
+
+#include "crypto/hash.h"
+
+// Each algorithm has its own context type, so the descriptor
+// functions are thin wrappers that accept a generic context.
+#define HASH_WRAPPERS(algo, ctx_type)                                                    \
+    static void algo##_init_fn(void* ctx) {                                              \
+        algo##_init((ctx_type*)ctx);                                                     \
+    }                                                                                    \
+    static void algo##_update_fn(void* ctx, const void* data, size_t len) {              \
+        algo##_update((ctx_type*)ctx, data, len);                                        \
+    }                                                                                    \
+    static void algo##_final_fn(void* ctx, uint8_t* digest) {                            \
+        algo##_final((ctx_type*)ctx, digest);                                            \
+    }
+
+#define HASH_DIGEST_WRAPPER(algo)                                                        \
+    static void algo##_digest_fn(const void* data, size_t len, uint8_t* digest) {        \
+        algo##_digest(data, len, digest);                                                \
+    }
+
+HASH_WRAPPERS(blake3, blake3_hasher)
+HASH_WRAPPERS(md5, MD5_CTX)
+HASH_WRAPPERS(sha1, SHA1Context)
+HASH_WRAPPERS(sha256, sha256_ctx)
+HASH_WRAPPERS(sha384, sha384_ctx)
+HASH_WRAPPERS(sha512, sha512_ctx)
+HASH_WRAPPERS(xxh32, XXH32_state_t)
+HASH_WRAPPERS(xxh64, XXH64_state_t)
+HASH_WRAPPERS(xxh3_64, XXH3_state_t)
+HASH_WRAPPERS(xxh3_128, XXH3_state_t)
+HASH_DIGEST_WRAPPER(xxh32)
+HASH_DIGEST_WRAPPER(xxh64)
+HASH_DIGEST_WRAPPER(xxh3_64)
+HASH_DIGEST_WRAPPER(xxh3_128)
+
+#define HASH_ALGO(algo, ctx_type, len, digest_fn)                                        \
+    const hash_algo hash_##algo = {                                                      \
+        .name = #algo,                                                                   \
+        .digest_len = len,                                                               \
+        .ctx_size = sizeof(ctx_type),                                                    \
+        .init = algo##_init_fn,                                                          \
+        .update = algo##_update_fn,                                                      \
+        .final = algo##_final_fn,                                                        \
+        .digest = digest_fn,                                                             \
+    };
+
+HASH_ALGO(blake3, blake3_hasher, BLAKE3_OUT_LEN, NULL)
+HASH_ALGO(md5, MD5_CTX, MD5_BLOCK_SIZE, NULL)
+HASH_ALGO(sha1, SHA1Context, SHA1_BLOCK_SIZE, NULL)
+HASH_ALGO(sha256, sha256_ctx, SHA256_DIGEST_SIZE, NULL)
+HASH_ALGO(sha384, sha384_ctx, SHA384_DIGEST_SIZE, NULL)
+HASH_ALGO(sha512, sha512_ctx, SHA512_DIGEST_SIZE, NULL)
+HASH_ALGO(xxh32, XXH32_state_t, 4, xxh32_digest_fn)
+HASH_ALGO(xxh64, XXH64_state_t, 8, xxh64_digest_fn)
+HASH_ALGO(xxh3_64, XXH3_state_t, 8, xxh3_64_digest_fn)
+HASH_ALGO(xxh3_128, XXH3_state_t, 16, xxh3_128_digest_fn)
+
+static const hash_algo* algos[] = {
+    &hash_blake3, &hash_md5,   &hash_sha1,  &hash_sha256,  &hash_sha384,
+    &hash_sha512, &hash_xxh32, &hash_xxh64, &hash_xxh3_64, &hash_xxh3_128,
+};
+
+// hash_find returns the algorithm with the given name, or NULL if there is none.
+const hash_algo* hash_find(const char* name) {
+    if (name == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(algos) / sizeof(algos[0]); i++) {
+        if (strcmp(algos[i]->name, name) == 0) {
+            return algos[i];
+        }
+    }
+    return NULL;
+}
+
+// hash_compute hashes the data and writes the digest (algo->digest_len bytes).
+// Uses a stack context, so there is no memory allocation.
+void hash_compute(const hash_algo* algo, const void* data, size_t len, uint8_t* digest) {
+    if (algo->digest) {
+        algo->digest(data, len, digest);
+        return;
+    }
+    hash_ctx ctx;
+    algo->init(&ctx);
+    if (len > 0) {
+        algo->update(&ctx, data, len);
+    }
+    algo->final(&ctx, digest);
+}
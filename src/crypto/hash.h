@@ -0,0 +1,61 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// Hash algorithm descriptors.
+
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "crypto/blake3.h"
+#include "crypto/md5.h"
+#include "crypto/sha1.h"
+#include "crypto/sha2.h"
+#include "crypto/xxhash.h"
+
+// The maximum digest length of all the algorithms.
+#define HASH_MAX_DIGEST_LEN 64
+
+// Memory for the context of any algorithm, suitably aligned.
+// Lets the callers keep the context on the stack instead of the heap.
+typedef union {
+    blake3_hasher blake3;
+    MD5_CTX md5;
+    SHA1Context sha1;
+    sha256_ctx sha256;
+    sha512_ctx sha512;
+    XXH32_state_t xxh32;
+    XXH64_state_t xxh64;
+    XXH3_state_t xxh3;
+} hash_ctx;
+
+// Hash algorithm.
+typedef struct {
+    const char* name;
+    size_t digest_len;
+    size_t ctx_size;
+    void (*init)(void* ctx);
+    void (*update)(void* ctx, const void* data, size_t len);
+    void (*final)(void* ctx, uint8_t* digest);
+    // Hashes the data in one go, or NULL if the algorithm
+    // doesn't have a faster way than init-update-final.
+    void (*digest)(const void* data, size_t len, uint8_t* digest);
+} hash_algo;
+
+extern const hash_algo hash_blake3;
+extern const hash_algo hash_md5;
+extern const hash_algo hash_sha1;
+extern const hash_algo hash_sha256;
+extern const hash_algo hash_sha384;
+extern const hash_algo hash_sha512;
+extern const hash_algo hash_xxh32;
+extern const hash_algo hash_xxh64;
+extern const hash_algo hash_xxh3_64;
+extern const hash_algo hash_xxh3_128;
+
+const hash_algo* hash_find(const char* name);
+void hash_compute(const hash_algo* algo, const void* data, size_t len, uint8_t* digest);
+
+#endif /* __HASH_H__ */
@@ -2,71 +2,287 @@
 // https://github.com/nalgeon/sqlean
 
 // Hex encoding/decoding
+//
+// Processes the bulk of the data with SSSE3/AVX2/NEON kernels when the CPU
+// supports them, and the rest with the scalar code.
 
 #include <stddef.h>
 #include <stdint.h>
-#include <stdio.h>
-#include <stdlib.h>
 
-uint8_t* hex_encode(const uint8_t* src, size_t len, size_t* out_len) {
-    *out_len = len * 2;
-    uint8_t* encoded = malloc(*out_len + 1);
-    if (encoded == NULL) {
-        *out_len = 0;
-        return NULL;
-    }
+#include "crypto/cpu.h"
+#include "crypto/hex.h"
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// Maps hex digits (in any case) to their values, and other bytes to 0xFF.
+static const uint8_t hex_table[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 10, 11, 12, 13, 14, 15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 10, 11, 12, 13, 14, 15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+// Scalar implementation.
+
+static void encode_scalar(const uint8_t* src, size_t len, uint8_t* dst) {
     for (size_t i = 0; i < len; i++) {
-        sprintf((char*)encoded + (i * 2), "%02x", src[i]);
+        *dst++ = hex_digits[src[i] >> 4];
+        *dst++ = hex_digits[src[i] & 0x0f];
     }
-    encoded[*out_len] = '\0';
-    *out_len = len * 2;
-    return encoded;
 }
 
-uint8_t* hex_decode(const uint8_t* src, size_t len, size_t* out_len) {
-    if (len % 2 != 0) {
-        // input length must be even
-        return NULL;
+static int decode_scalar(const uint8_t* src, size_t len, uint8_t* dst) {
+    for (size_t i = 0; i < len; i += 2) {
+        uint8_t hi = hex_table[src[i]];
+        uint8_t lo = hex_table[src[i + 1]];
+        if ((hi | lo) & 0xF0) {
+            // invalid character
+            return -1;
+        }
+        *dst++ = (hi << 4) | lo;
     }
+    return 0;
+}
+
+// x86 implementation.
 
-    size_t decoded_len = len / 2;
-    uint8_t* decoded = malloc(decoded_len);
-    if (decoded == NULL) {
-        *out_len = 0;
-        return NULL;
+#if defined(CPU_X86)
+#include <immintrin.h>
+
+// Encodes 16 bytes at a time, returns the number of bytes encoded.
+__attribute__((target("ssse3"))) static size_t encode_ssse3(const uint8_t* src,
+                                                            size_t len,
+                                                            uint8_t* dst) {
+    __m128i digits = _mm_loadu_si128((const __m128i*)hex_digits);
+    __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16, dst += 32) {
+        __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(in, 4), mask));
+        __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(in, mask));
+        _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi8(hi, lo));
     }
+    return i;
+}
 
-    for (size_t i = 0; i < decoded_len; i++) {
-        uint8_t hi = src[i * 2];
-        uint8_t lo = src[i * 2 + 1];
+// Encodes 32 bytes at a time, returns the number of bytes encoded.
+__attribute__((target("avx2"))) static size_t encode_avx2(const uint8_t* src,
+                                                          size_t len,
+                                                          uint8_t* dst) {
+    __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)hex_digits));
+    __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32, dst += 64) {
+        __m256i in = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(in, 4), mask));
+        __m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(in, mask));
+        // the unpacks work within the 128-bit lanes, so put the lanes back in order
+        __m256i first = _mm256_unpacklo_epi8(hi, lo);
+        __m256i second = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i*)dst, _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i*)(dst + 32), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+    return i;
+}
 
-        if (hi >= '0' && hi <= '9') {
-            hi -= '0';
-        } else if (hi >= 'A' && hi <= 'F') {
-            hi -= 'A' - 10;
-        } else if (hi >= 'a' && hi <= 'f') {
-            hi -= 'a' - 10;
-        } else {
-            // invalid character
-            free(decoded);
-            return NULL;
+// Converts 16 hex digits into their values.
+// Sets the bytes in `valid` to 0 for the characters that are not hex digits.
+__attribute__((target("ssse3"))) static __m128i decode_values_ssse3(__m128i in,
+                                                                    __m128i* valid) {
+    // c - '0' is a digit if it's less than 10,
+    // (c | 0x20) - 'a' is a letter if it's less than 6
+    __m128i zero = _mm_setzero_si128();
+    __m128i digit = _mm_sub_epi8(in, _mm_set1_epi8('0'));
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_subs_epu8(digit, _mm_set1_epi8(9)), zero);
+    __m128i letter = _mm_sub_epi8(_mm_or_si128(in, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i is_letter = _mm_cmpeq_epi8(_mm_subs_epu8(letter, _mm_set1_epi8(5)), zero);
+    *valid = _mm_and_si128(*valid, _mm_or_si128(is_digit, is_letter));
+    letter = _mm_add_epi8(letter, _mm_set1_epi8(10));
+    return _mm_or_si128(_mm_and_si128(is_digit, digit), _mm_andnot_si128(is_digit, letter));
+}
+
+// Decodes 32 characters at a time, returns the number of characters decoded.
+// Stops before the first block with invalid characters.
+__attribute__((target("ssse3"))) static size_t decode_ssse3(const uint8_t* src,
+                                                            size_t len,
+                                                            uint8_t* dst) {
+    // multiplies the high digit of each pair by 16 and adds the low one
+    __m128i weights = _mm_set1_epi16(0x0110);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32, dst += 16) {
+        __m128i valid = _mm_set1_epi8(-1);
+        __m128i v0 = decode_values_ssse3(_mm_loadu_si128((const __m128i*)(src + i)), &valid);
+        __m128i v1 = decode_values_ssse3(_mm_loadu_si128((const __m128i*)(src + i + 16)), &valid);
+        if (_mm_movemask_epi8(valid) != 0xFFFF) {
+            break;
         }
+        __m128i b0 = _mm_maddubs_epi16(v0, weights);
+        __m128i b1 = _mm_maddubs_epi16(v1, weights);
+        _mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(b0, b1));
+    }
+    return i;
+}
 
-        if (lo >= '0' && lo <= '9') {
-            lo -= '0';
-        } else if (lo >= 'A' && lo <= 'F') {
-            lo -= 'A' - 10;
-        } else if (lo >= 'a' && lo <= 'f') {
-            lo -= 'a' - 10;
-        } else {
-            // invalid character
-            free(decoded);
-            return NULL;
+// Same as decode_values_ssse3, but for 32 hex digits.
+__attribute__((target("avx2"))) static __m256i decode_values_avx2(__m256i in, __m256i* valid) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i digit = _mm256_sub_epi8(in, _mm256_set1_epi8('0'));
+    __m256i is_digit = _mm256_cmpeq_epi8(_mm256_subs_epu8(digit, _mm256_set1_epi8(9)), zero);
+    __m256i letter =
+        _mm256_sub_epi8(_mm256_or_si256(in, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i is_letter = _mm256_cmpeq_epi8(_mm256_subs_epu8(letter, _mm256_set1_epi8(5)), zero);
+    *valid = _mm256_and_si256(*valid, _mm256_or_si256(is_digit, is_letter));
+    letter = _mm256_add_epi8(letter, _mm256_set1_epi8(10));
+    return _mm256_or_si256(_mm256_and_si256(is_digit, digit),
+                           _mm256_andnot_si256(is_digit, letter));
+}
+
+// Same as decode_ssse3, but 64 characters at a time.
+__attribute__((target("avx2"))) static size_t decode_avx2(const uint8_t* src,
+                                                          size_t len,
+                                                          uint8_t* dst) {
+    __m256i weights = _mm256_set1_epi16(0x0110);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64, dst += 32) {
+        __m256i valid = _mm256_set1_epi8(-1);
+        __m256i v0 = decode_values_avx2(_mm256_loadu_si256((const __m256i*)(src + i)), &valid);
+        __m256i v1 =
+            decode_values_avx2(_mm256_loadu_si256((const __m256i*)(src + i + 32)), &valid);
+        if (_mm256_movemask_epi8(valid) != -1) {
+            break;
         }
+        __m256i b0 = _mm256_maddubs_epi16(v0, weights);
+        __m256i b1 = _mm256_maddubs_epi16(v1, weights);
+        // the pack works within the 128-bit lanes, so put the lanes back in order
+        __m256i out = _mm256_permute4x64_epi64(_mm256_packus_epi16(b0, b1), 0xD8);
+        _mm256_storeu_si256((__m256i*)dst, out);
+    }
+    return i;
+}
+#endif /* CPU_X86 */
+
+// ARM implementation.
 
-        decoded[i] = (hi << 4) | lo;
+#if defined(CPU_ARM)
+#include <arm_neon.h>
+
+// Encodes 16 bytes at a time, returns the number of bytes encoded.
+static size_t encode_neon(const uint8_t* src, size_t len, uint8_t* dst) {
+    uint8x16_t digits = vld1q_u8((const uint8_t*)hex_digits);
+    uint8x16_t mask = vdupq_n_u8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16, dst += 32) {
+        uint8x16_t in = vld1q_u8(src + i);
+        uint8x16x2_t out;
+        out.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(in, 4));
+        out.val[1] = vqtbl1q_u8(digits, vandq_u8(in, mask));
+        // store interleaved: high digit, low digit, high digit...
+        vst2q_u8(dst, out);
+    }
+    return i;
+}
+
+// Converts 16 hex digits into their values.
+// Sets the bytes in `valid` to 0 for the characters that are not hex digits.
+static uint8x16_t decode_values_neon(uint8x16_t in, uint8x16_t* valid) {
+    uint8x16_t digit = vsubq_u8(in, vdupq_n_u8('0'));
+    uint8x16_t is_digit = vcltq_u8(digit, vdupq_n_u8(10));
+    uint8x16_t letter = vsubq_u8(vorrq_u8(in, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    uint8x16_t is_letter = vcltq_u8(letter, vdupq_n_u8(6));
+    *valid = vandq_u8(*valid, vorrq_u8(is_digit, is_letter));
+    return vbslq_u8(is_digit, digit, vaddq_u8(letter, vdupq_n_u8(10)));
+}
+
+// Decodes 32 characters at a time, returns the number of characters decoded.
+// Stops before the first block with invalid characters.
+static size_t decode_neon(const uint8_t* src, size_t len, uint8_t* dst) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32, dst += 16) {
+        // load deinterleaved: high digits in val[0], low digits in val[1]
+        uint8x16x2_t in = vld2q_u8(src + i);
+        uint8x16_t valid = vdupq_n_u8(0xFF);
+        uint8x16_t hi = decode_values_neon(in.val[0], &valid);
+        uint8x16_t lo = decode_values_neon(in.val[1], &valid);
+        if (vminvq_u8(valid) == 0) {
+            break;
+        }
+        vst1q_u8(dst, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+    }
+    return i;
+}
+#endif /* CPU_ARM */
+
+// hex_encoded_len returns the length of the encoded data.
+size_t hex_encoded_len(size_t len) {
+    return len * 2;
+}
+
+// hex_encode encodes the data into dst, which should be
+// hex_encoded_len(len) bytes long. Uses lowercase digits.
+void hex_encode(const uint8_t* src, size_t len, uint8_t* dst) {
+    size_t done = 0;
+#if defined(CPU_X86)
+    int features = cpu_features();
+    if (features & CPU_AVX2) {
+        done = encode_avx2(src, len, dst);
     }
+    if (features & CPU_SSSE3) {
+        done += encode_ssse3(src + done, len - done, dst + done * 2);
+    }
+#endif
+#if defined(CPU_ARM)
+    if (cpu_features() & CPU_NEON) {
+        done = encode_neon(src, len, dst);
+    }
+#endif
+    encode_scalar(src + done, len - done, dst + done * 2);
+}
+
+// hex_decoded_len calculates the length of the decoded data.
+// Returns 0 on success, -1 if the encoded length is invalid.
+int hex_decoded_len(const uint8_t* src, size_t len, size_t* out_len) {
+    (void)src;
+    if (len % 2 != 0) {
+        return -1;
+    }
+    *out_len = len / 2;
+    return 0;
+}
 
-    *out_len = decoded_len;
-    return decoded;
+// hex_decode decodes the data into dst, which should be
+// hex_decoded_len bytes long. Accepts digits in any case.
+// Returns 0 on success, -1 if the data contains invalid characters.
+int hex_decode(const uint8_t* src, size_t len, uint8_t* dst) {
+    if (len % 2 != 0) {
+        return -1;
+    }
+    size_t done = 0;
+#if defined(CPU_X86)
+    int features = cpu_features();
+    if (features & CPU_AVX2) {
+        done = decode_avx2(src, len, dst);
+    }
+    if (features & CPU_SSSE3) {
+        done += decode_ssse3(src + done, len - done, dst + done / 2);
+    }
+#endif
+#if defined(CPU_ARM)
+    if (cpu_features() & CPU_NEON) {
+        done = decode_neon(src, len, dst);
+    }
+#endif
+    return decode_scalar(src + done, len - done, dst + done / 2);
 }
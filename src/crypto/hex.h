@@ -9,7 +9,9 @@
 #include <stddef.h>
 #include <stdint.h>
 
-uint8_t* hex_encode(const uint8_t* src, size_t len, size_t* out_len);
-uint8_t* hex_decode(const uint8_t* src, size_t len, size_t* out_len);
+size_t hex_encoded_len(size_t len);
+void hex_encode(const uint8_t* src, size_t len, uint8_t* dst);
+int hex_decoded_len(const uint8_t* src, size_t len, size_t* out_len);
+int hex_decode(const uint8_t* src, size_t len, uint8_t* dst);
 
 #endif /* _HEX_H_ */
@@ -132,16 +132,13 @@ static void md5_transform(MD5_CTX* ctx, const BYTE data[]) {
     ctx->state[3] += d;
 }
 
-void* md5_init() {
-    MD5_CTX* ctx;
-    ctx = malloc(sizeof(MD5_CTX));
+void md5_init(MD5_CTX* ctx) {
     ctx->datalen = 0;
     ctx->bitlen = 0;
     ctx->state[0] = 0x67452301;
     ctx->state[1] = 0xEFCDAB89;
     ctx->state[2] = 0x98BADCFE;
     ctx->state[3] = 0x10325476;
-    return ctx;
 }
 
 void md5_update(MD5_CTX* ctx, const BYTE data[], size_t len) {
@@ -196,6 +193,5 @@ int md5_final(MD5_CTX* ctx, BYTE hash[]) {
         hash[i + 8] = (ctx->state[2] >> (i * 8)) & 0x000000ff;
         hash[i + 12] = (ctx->state[3] >> (i * 8)) & 0x000000ff;
     }
-    free(ctx);
     return MD5_BLOCK_SIZE;
 }
@@ -27,7 +27,7 @@ typedef struct {
 } MD5_CTX;
 
 /*********************** FUNCTION DECLARATIONS **********************/
-void* md5_init();
+void md5_init(MD5_CTX* ctx);
 void md5_update(MD5_CTX* ctx, const BYTE data[], size_t len);
 int md5_final(MD5_CTX* ctx, BYTE hash[]);
 
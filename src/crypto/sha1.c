@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "crypto/cpu.h"
 #include "crypto/sha1.h"
 
 #define SHA_ROT(x, l, r) ((x) << (l) | (x) >> (r))
@@ -47,7 +48,7 @@
 /*
  * Hash a single 512-bit block. This is the core of the algorithm.
  */
-void SHA1Transform(unsigned int state[5], const unsigned char buffer[64]) {
+static void SHA1Transform(unsigned int state[5], const unsigned char buffer[64]) {
     unsigned int qq[5]; /* a, b, c, d, e; */
     static int one = 1;
     unsigned int block[16];
@@ -184,18 +185,217 @@ void SHA1Transform(unsigned int state[5], const unsigned char buffer[64]) {
 #undef e
 }
 
+/*
+ * Hardware-accelerated SHA-1, selected at load time.
+ */
+
+#if defined(CPU_X86)
+#include <immintrin.h>
+
+/* 4 rounds with the x86 SHA extensions: e_cur is the E value for the rounds,
+ * and e_next receives the value to calculate E for the next rounds. */
+#define SHA1_X86_ROUNDS(e_cur, e_next, msg, func) \
+    e_cur = _mm_sha1nexte_epu32(e_cur, msg);      \
+    e_next = abcd;                                \
+    abcd = _mm_sha1rnds4_epu32(abcd, e_cur, func)
+
+/* Message expansion steps. */
+#define SHA1_X86_MSG1(m0, m1) m0 = _mm_sha1msg1_epu32(m0, m1)
+#define SHA1_X86_MSG2(m0, m1) m0 = _mm_sha1msg2_epu32(m0, m1)
+#define SHA1_X86_XOR(m0, m1) m0 = _mm_xor_si128(m0, m1)
+
+/*
+ * Hash the 512-bit blocks with the x86 SHA extensions (SHA-NI).
+ */
+__attribute__((target("sha,sse4.1"))) static void SHA1TransformX86(unsigned int state[5],
+                                                                   const unsigned char* data,
+                                                                   size_t nblocks) {
+    const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i abcd, abcd_save, e0, e0_save, e1;
+    __m128i m0, m1, m2, m3;
+
+    abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+    e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+    for (; nblocks > 0; nblocks--, data += 64) {
+        abcd_save = abcd;
+        e0_save = e0;
+
+        m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 0)), bswap);
+        m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), bswap);
+        m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), bswap);
+        m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), bswap);
+
+        /* Rounds 0-19 */
+        e0 = _mm_add_epi32(e0, m0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        SHA1_X86_ROUNDS(e1, e0, m1, 0);
+        SHA1_X86_MSG1(m0, m1);
+        SHA1_X86_ROUNDS(e0, e1, m2, 0);
+        SHA1_X86_MSG1(m1, m2);
+        SHA1_X86_XOR(m0, m2);
+        SHA1_X86_MSG2(m0, m3);
+        SHA1_X86_ROUNDS(e1, e0, m3, 0);
+        SHA1_X86_MSG1(m2, m3);
+        SHA1_X86_XOR(m1, m3);
+        SHA1_X86_MSG2(m1, m0);
+        SHA1_X86_ROUNDS(e0, e1, m0, 0);
+        SHA1_X86_MSG1(m3, m0);
+        SHA1_X86_XOR(m2, m0);
+
+        /* Rounds 20-39 */
+        SHA1_X86_MSG2(m2, m1);
+        SHA1_X86_ROUNDS(e1, e0, m1, 1);
+        SHA1_X86_MSG1(m0, m1);
+        SHA1_X86_XOR(m3, m1);
+        SHA1_X86_MSG2(m3, m2);
+        SHA1_X86_ROUNDS(e0, e1, m2, 1);
+        SHA1_X86_MSG1(m1, m2);
+        SHA1_X86_XOR(m0, m2);
+        SHA1_X86_MSG2(m0, m3);
+        SHA1_X86_ROUNDS(e1, e0, m3, 1);
+        SHA1_X86_MSG1(m2, m3);
+        SHA1_X86_XOR(m1, m3);
+        SHA1_X86_MSG2(m1, m0);
+        SHA1_X86_ROUNDS(e0, e1, m0, 1);
+        SHA1_X86_MSG1(m3, m0);
+        SHA1_X86_XOR(m2, m0);
+        SHA1_X86_MSG2(m2, m1);
+        SHA1_X86_ROUNDS(e1, e0, m1, 1);
+        SHA1_X86_MSG1(m0, m1);
+        SHA1_X86_XOR(m3, m1);
+
+        /* Rounds 40-59 */
+        SHA1_X86_MSG2(m3, m2);
+        SHA1_X86_ROUNDS(e0, e1, m2, 2);
+        SHA1_X86_MSG1(m1, m2);
+        SHA1_X86_XOR(m0, m2);
+        SHA1_X86_MSG2(m0, m3);
+        SHA1_X86_ROUNDS(e1, e0, m3, 2);
+        SHA1_X86_MSG1(m2, m3);
+        SHA1_X86_XOR(m1, m3);
+        SHA1_X86_MSG2(m1, m0);
+        SHA1_X86_ROUNDS(e0, e1, m0, 2);
+        SHA1_X86_MSG1(m3, m0);
+        SHA1_X86_XOR(m2, m0);
+        SHA1_X86_MSG2(m2, m1);
+        SHA1_X86_ROUNDS(e1, e0, m1, 2);
+        SHA1_X86_MSG1(m0, m1);
+        SHA1_X86_XOR(m3, m1);
+        SHA1_X86_MSG2(m3, m2);
+        SHA1_X86_ROUNDS(e0, e1, m2, 2);
+        SHA1_X86_MSG1(m1, m2);
+        SHA1_X86_XOR(m0, m2);
+
+        /* Rounds 60-79 */
+        SHA1_X86_MSG2(m0, m3);
+        SHA1_X86_ROUNDS(e1, e0, m3, 3);
+        SHA1_X86_MSG1(m2, m3);
+        SHA1_X86_XOR(m1, m3);
+        SHA1_X86_MSG2(m1, m0);
+        SHA1_X86_ROUNDS(e0, e1, m0, 3);
+        SHA1_X86_MSG1(m3, m0);
+        SHA1_X86_XOR(m2, m0);
+        SHA1_X86_MSG2(m2, m1);
+        SHA1_X86_ROUNDS(e1, e0, m1, 3);
+        SHA1_X86_XOR(m3, m1);
+        SHA1_X86_MSG2(m3, m2);
+        SHA1_X86_ROUNDS(e0, e1, m2, 3);
+        SHA1_X86_ROUNDS(e1, e0, m3, 3);
+
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = (unsigned int)_mm_extract_epi32(e0, 3);
+}
+#endif /* CPU_X86 */
+
+#if defined(CPU_ARM_CRYPTO)
+#include <arm_neon.h>
+
+/*
+ * Hash the 512-bit blocks with the ARMv8 cryptography extensions.
+ */
+CPU_TARGET_ARM_CRYPTO static void SHA1TransformArm(unsigned int state[5],
+                                                   const unsigned char* data,
+                                                   size_t nblocks) {
+    static const uint32_t k[4] = {0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6};
+    uint32x4_t abcd, abcd_save, msg;
+    uint32x4_t w[4];
+    uint32_t e, e_save, e_next;
+    int j;
+
+    abcd = vld1q_u32(state);
+    e = state[4];
+
+    for (; nblocks > 0; nblocks--, data += 64) {
+        abcd_save = abcd;
+        e_save = e;
+
+        for (j = 0; j < 4; j++) {
+            w[j] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * j)));
+        }
+
+        /* 4 rounds per step, each step also expands the next 4 words */
+        for (j = 0; j < 20; j++) {
+            msg = vaddq_u32(w[j & 3], vdupq_n_u32(k[j / 5]));
+            if (j < 16) {
+                w[j & 3] = vsha1su1q_u32(vsha1su0q_u32(w[j & 3], w[(j + 1) & 3], w[(j + 2) & 3]),
+                                         w[(j + 3) & 3]);
+            }
+            e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+            if (j < 5) {
+                abcd = vsha1cq_u32(abcd, e, msg);
+            } else if (j >= 10 && j < 15) {
+                abcd = vsha1mq_u32(abcd, e, msg);
+            } else {
+                abcd = vsha1pq_u32(abcd, e, msg);
+            }
+            e = e_next;
+        }
+
+        abcd = vaddq_u32(abcd, abcd_save);
+        e += e_save;
+    }
+
+    vst1q_u32(state, abcd);
+    state[4] = e;
+}
+#endif /* CPU_ARM_CRYPTO */
+
+/*
+ * Hash the 512-bit blocks with the fastest implementation supported by the CPU.
+ */
+static void SHA1TransformBlocks(unsigned int state[5], const unsigned char* data, size_t nblocks) {
+#if defined(CPU_X86)
+    if ((cpu_features() & (CPU_SHA | CPU_SSE41)) == (CPU_SHA | CPU_SSE41)) {
+        SHA1TransformX86(state, data, nblocks);
+        return;
+    }
+#endif
+#if defined(CPU_ARM_CRYPTO)
+    if (cpu_features() & CPU_ARM_SHA1) {
+        SHA1TransformArm(state, data, nblocks);
+        return;
+    }
+#endif
+    for (; nblocks > 0; nblocks--, data += 64) {
+        SHA1Transform(state, data);
+    }
+}
+
 /* Initialize a SHA1 context */
-void* sha1_init() {
+void sha1_init(SHA1Context* ctx) {
     /* SHA1 initialization constants */
-    SHA1Context* ctx;
-    ctx = malloc(sizeof(SHA1Context));
     ctx->state[0] = 0x67452301;
     ctx->state[1] = 0xEFCDAB89;
     ctx->state[2] = 0x98BADCFE;
     ctx->state[3] = 0x10325476;
     ctx->state[4] = 0xC3D2E1F0;
     ctx->count[0] = ctx->count[1] = 0;
-    return ctx;
 }
 
 /* Add new content to the SHA1 hash */
@@ -209,10 +409,9 @@ void sha1_update(SHA1Context* ctx, const unsigned char* data, size_t len) {
     j = (j >> 3) & 63;
     if ((j + len) > 63) {
         (void)memcpy(&ctx->buffer[j], data, (i = 64 - j));
-        SHA1Transform(ctx->state, ctx->buffer);
-        for (; i + 63 < len; i += 64) {
-            SHA1Transform(ctx->state, &data[i]);
-        }
+        SHA1TransformBlocks(ctx->state, ctx->buffer, 1);
+        SHA1TransformBlocks(ctx->state, &data[i], (len - i) / 64);
+        i += (len - i) / 64 * 64;
         j = 0;
     } else {
         i = 0;
@@ -236,6 +435,5 @@ int sha1_final(SHA1Context* ctx, unsigned char hash[]) {
     for (i = 0; i < 20; i++) {
         hash[i] = (unsigned char)((ctx->state[i >> 2] >> ((3 - (i & 3)) * 8)) & 255);
     }
-    free(ctx);
     return SHA1_BLOCK_SIZE;
 }
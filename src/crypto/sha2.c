@@ -35,6 +35,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "crypto/cpu.h"
 #include "crypto/sha2.h"
 
 #define SHFR(x, n) (x >> n)
@@ -161,9 +162,126 @@ static const uint64 sha512_k[80] = {
     0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
     0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL};
 
+/* Hardware-accelerated SHA-256, selected at load time */
+
+#if defined(CPU_X86)
+#include <immintrin.h>
+
+/* Processes the blocks with the x86 SHA extensions (SHA-NI). */
+__attribute__((target("sha,sse4.1"))) static void sha256_transf_x86(uint32* h,
+                                                                    const uint8* message,
+                                                                    uint64 block_nb) {
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i state0, state1, msg, tmp, abef_save, cdgh_save;
+    __m128i w[4];
+    uint64 i;
+    int j;
+
+    /* The instructions expect the state as ABEF and CDGH */
+    tmp = _mm_loadu_si128((const __m128i*)&h[0]);
+    state1 = _mm_loadu_si128((const __m128i*)&h[4]);
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (i = 0; i < block_nb; i++) {
+        const uint8* sub_block = message + (i << 6);
+        abef_save = state0;
+        cdgh_save = state1;
+
+        for (j = 0; j < 4; j++) {
+            w[j] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(sub_block + 16 * j)), bswap);
+        }
+
+        /* 4 rounds per step, each step also expands the next 4 words */
+        for (j = 0; j < 16; j++) {
+            msg = _mm_add_epi32(w[j & 3], _mm_loadu_si128((const __m128i*)&sha256_k[4 * j]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+            if (j < 12) {
+                tmp = _mm_sha256msg1_epu32(w[j & 3], w[(j + 1) & 3]);
+                tmp = _mm_add_epi32(tmp, _mm_alignr_epi8(w[(j + 3) & 3], w[(j + 2) & 3], 4));
+                w[j & 3] = _mm_sha256msg2_epu32(tmp, w[(j + 3) & 3]);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+    }
+
+    /* Back to ABCD and EFGH */
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128((__m128i*)&h[0], state0);
+    _mm_storeu_si128((__m128i*)&h[4], state1);
+}
+#endif /* CPU_X86 */
+
+#if defined(CPU_ARM_CRYPTO)
+#include <arm_neon.h>
+
+/* Processes the blocks with the ARMv8 cryptography extensions. */
+CPU_TARGET_ARM_CRYPTO static void sha256_transf_arm(uint32* h,
+                                                    const uint8* message,
+                                                    uint64 block_nb) {
+    uint32x4_t state0, state1, abcd_save, efgh_save, msg, tmp;
+    uint32x4_t w[4];
+    uint64 i;
+    int j;
+
+    state0 = vld1q_u32(&h[0]);
+    state1 = vld1q_u32(&h[4]);
+
+    for (i = 0; i < block_nb; i++) {
+        const uint8* sub_block = message + (i << 6);
+        abcd_save = state0;
+        efgh_save = state1;
+
+        for (j = 0; j < 4; j++) {
+            w[j] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(sub_block + 16 * j)));
+        }
+
+        /* 4 rounds per step, each step also expands the next 4 words */
+        for (j = 0; j < 16; j++) {
+            msg = vaddq_u32(w[j & 3], vld1q_u32(&sha256_k[4 * j]));
+            if (j < 12) {
+                w[j & 3] = vsha256su1q_u32(vsha256su0q_u32(w[j & 3], w[(j + 1) & 3]),
+                                           w[(j + 2) & 3], w[(j + 3) & 3]);
+            }
+            tmp = state0;
+            state0 = vsha256hq_u32(state0, state1, msg);
+            state1 = vsha256h2q_u32(state1, tmp, msg);
+        }
+
+        state0 = vaddq_u32(state0, abcd_save);
+        state1 = vaddq_u32(state1, efgh_save);
+    }
+
+    vst1q_u32(&h[0], state0);
+    vst1q_u32(&h[4], state1);
+}
+#endif /* CPU_ARM_CRYPTO */
+
 /* SHA-2 internal function */
 
 static void sha256_transf(sha256_ctx* ctx, const uint8* message, uint64 block_nb) {
+#if defined(CPU_X86)
+    if ((cpu_features() & (CPU_SHA | CPU_SSE41)) == (CPU_SHA | CPU_SSE41)) {
+        sha256_transf_x86(ctx->h, message, block_nb);
+        return;
+    }
+#endif
+#if defined(CPU_ARM_CRYPTO)
+    if (cpu_features() & CPU_ARM_SHA2) {
+        sha256_transf_arm(ctx->h, message, block_nb);
+        return;
+    }
+#endif
+
     uint32 w[64];
     uint32 wv[8];
     uint32 t1, t2;
@@ -460,13 +578,7 @@ static void sha512_transf(sha512_ctx* ctx, const uint8* message, uint64 block_nb
 
 /* SHA-224 functions */
 
-sha224_ctx* sha224_init(void) {
-    sha224_ctx* ctx;
-    ctx = malloc(sizeof(sha224_ctx));
-    if (!ctx) {
-        return 0;
-    }
-
+void sha224_init(sha224_ctx* ctx) {
     ctx->h[0] = sha224_h0[0];
     ctx->h[1] = sha224_h0[1];
     ctx->h[2] = sha224_h0[2];
@@ -478,7 +590,6 @@ sha224_ctx* sha224_init(void) {
 
     ctx->len = 0;
     ctx->tot_len = 0;
-    return ctx;
 }
 
 void sha224_update(sha224_ctx* ctx, const uint8* message, uint64 len) {
@@ -540,19 +651,12 @@ int sha224_final(sha224_ctx* ctx, uint8* digest) {
     UNPACK32(ctx->h[5], &digest[20]);
     UNPACK32(ctx->h[6], &digest[24]);
 
-    free(ctx);
     return SHA224_DIGEST_SIZE;
 }
 
 /* SHA-256 functions */
 
-sha256_ctx* sha256_init(void) {
-    sha256_ctx* ctx;
-    ctx = malloc(sizeof(sha256_ctx));
-    if (!ctx) {
-        return 0;
-    }
-
+void sha256_init(sha256_ctx* ctx) {
     ctx->h[0] = sha256_h0[0];
     ctx->h[1] = sha256_h0[1];
     ctx->h[2] = sha256_h0[2];
@@ -564,7 +668,6 @@ sha256_ctx* sha256_init(void) {
 
     ctx->len = 0;
     ctx->tot_len = 0;
-    return ctx;
 }
 
 void sha256_update(sha256_ctx* ctx, const uint8* message, uint64 len) {
@@ -627,19 +730,12 @@ int sha256_final(sha256_ctx* ctx, uint8* digest) {
     UNPACK32(ctx->h[6], &digest[24]);
     UNPACK32(ctx->h[7], &digest[28]);
 
-    free(ctx);
     return SHA256_DIGEST_SIZE;
 }
 
 /* SHA-384 functions */
 
-sha384_ctx* sha384_init(void) {
-    sha384_ctx* ctx;
-    ctx = malloc(sizeof(sha384_ctx));
-    if (!ctx) {
-        return 0;
-    }
-
+void sha384_init(sha384_ctx* ctx) {
     ctx->h[0] = sha384_h0[0];
     ctx->h[1] = sha384_h0[1];
     ctx->h[2] = sha384_h0[2];
@@ -651,7 +747,6 @@ sha384_ctx* sha384_init(void) {
 
     ctx->len = 0;
     ctx->tot_len = 0;
-    return ctx;
 }
 
 void sha384_update(sha384_ctx* ctx, const uint8* message, uint64 len) {
@@ -712,19 +807,12 @@ int sha384_final(sha384_ctx* ctx, uint8* digest) {
     UNPACK64(ctx->h[4], &digest[32]);
     UNPACK64(ctx->h[5], &digest[40]);
 
-    free(ctx);
     return SHA384_DIGEST_SIZE;
 }
 
 /* SHA-512 functions */
 
-sha512_ctx* sha512_init(void) {
-    sha512_ctx* ctx;
-    ctx = malloc(sizeof(sha512_ctx));
-    if (!ctx) {
-        return 0;
-    }
-
+void sha512_init(sha512_ctx* ctx) {
     ctx->h[0] = sha512_h0[0];
     ctx->h[1] = sha512_h0[1];
     ctx->h[2] = sha512_h0[2];
@@ -736,7 +824,6 @@ sha512_ctx* sha512_init(void) {
 
     ctx->len = 0;
     ctx->tot_len = 0;
-    return ctx;
 }
 
 void sha512_update(sha512_ctx* ctx, const uint8* message, uint64 len) {
@@ -799,6 +886,5 @@ int sha512_final(sha512_ctx* ctx, uint8* digest) {
     UNPACK64(ctx->h[6], &digest[48]);
     UNPACK64(ctx->h[7], &digest[56]);
 
-    free(ctx);
     return SHA512_DIGEST_SIZE;
 }
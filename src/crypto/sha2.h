@@ -70,19 +70,19 @@ typedef struct {
 typedef sha512_ctx sha384_ctx;
 typedef sha256_ctx sha224_ctx;
 
-sha224_ctx* sha224_init(void);
+void sha224_init(sha224_ctx* ctx);
 void sha224_update(sha224_ctx* ctx, const uint8* message, uint64 len);
 int sha224_final(sha224_ctx* ctx, uint8* digest);
 
-sha256_ctx* sha256_init(void);
+void sha256_init(sha256_ctx* ctx);
 void sha256_update(sha256_ctx* ctx, const uint8* message, uint64 len);
 int sha256_final(sha256_ctx* ctx, uint8* digest);
 
-sha384_ctx* sha384_init(void);
+void sha384_init(sha384_ctx* ctx);
 void sha384_update(sha384_ctx* ctx, const uint8* message, uint64 len);
 int sha384_final(sha384_ctx* ctx, uint8* digest);
 
-sha512_ctx* sha512_init(void);
+void sha512_init(sha512_ctx* ctx);
 void sha512_update(sha512_ctx* ctx, const uint8* message, uint64 len);
 int sha512_final(sha512_ctx* ctx, uint8* digest);
 
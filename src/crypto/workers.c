@@ -0,0 +1,165 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// A small pool of worker threads for splitting a hash computation
+// into independent tasks.
+//
+// The pool is shared by all connections. The threads are started lazily
+// by the first job that needs them, and stopped when the last user
+// releases the pool (see workers_retain and workers_release).
+// The pool runs one job at a time.
+
+#include "crypto/workers.h"
+
+#if !defined(_WIN32)
+#include <pthread.h>
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t wakeup;    // a new job or shutdown
+    pthread_cond_t finished;  // all tasks of the job are done
+    pthread_t threads[WORKERS_MAX_THREADS - 1];
+    int nthreads;
+    int refs;
+    int busy;
+    int shutdown;
+    // the current job
+    workers_task_fn fn;
+    void* arg;
+    size_t ntasks;
+    size_t next;
+    size_t done;
+    int helpers;  // number of workers that may still join the job
+} pool = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .wakeup = PTHREAD_COND_INITIALIZER,
+    .finished = PTHREAD_COND_INITIALIZER,
+};
+
+// run_tasks runs the job tasks until there are none left.
+// Expects the mutex to be locked.
+static void run_tasks(void) {
+    workers_task_fn fn = pool.fn;
+    void* arg = pool.arg;
+    while (pool.next < pool.ntasks) {
+        size_t idx = pool.next++;
+        pthread_mutex_unlock(&pool.mutex);
+        fn(arg, idx);
+        pthread_mutex_lock(&pool.mutex);
+        pool.done++;
+        if (pool.done == pool.ntasks) {
+            pthread_cond_signal(&pool.finished);
+        }
+    }
+}
+
+static void* worker_main(void* unused) {
+    (void)unused;
+    pthread_mutex_lock(&pool.mutex);
+    for (;;) {
+        while (!pool.shutdown && (pool.helpers == 0 || pool.next >= pool.ntasks)) {
+            pthread_cond_wait(&pool.wakeup, &pool.mutex);
+        }
+        if (pool.shutdown) {
+            break;
+        }
+        pool.helpers--;
+        run_tasks();
+    }
+    pthread_mutex_unlock(&pool.mutex);
+    return NULL;
+}
+
+// workers_run calls fn(arg, idx) for each idx in [0, ntasks) using up to
+// nthreads threads (the calling thread included), and returns when all
+// the calls are done. Returns 0 on success, or -1 if the pool is busy
+// with another job or the threads could not be started, in which case
+// none of the tasks are run.
+int workers_run(int nthreads, workers_task_fn fn, void* arg, size_t ntasks) {
+    if (nthreads > WORKERS_MAX_THREADS) {
+        nthreads = WORKERS_MAX_THREADS;
+    }
+    pthread_mutex_lock(&pool.mutex);
+    if (pool.busy || pool.shutdown) {
+        pthread_mutex_unlock(&pool.mutex);
+        return -1;
+    }
+    while (pool.nthreads < nthreads - 1) {
+        if (pthread_create(&pool.threads[pool.nthreads], NULL, worker_main, NULL) != 0) {
+            break;
+        }
+        pool.nthreads++;
+    }
+    if (pool.nthreads == 0) {
+        pthread_mutex_unlock(&pool.mutex);
+        return -1;
+    }
+
+    pool.busy = 1;
+    pool.fn = fn;
+    pool.arg = arg;
+    pool.ntasks = ntasks;
+    pool.next = 0;
+    pool.done = 0;
+    pool.helpers = nthreads - 1;
+    pthread_cond_broadcast(&pool.wakeup);
+
+    run_tasks();
+    while (pool.done < pool.ntasks) {
+        pthread_cond_wait(&pool.finished, &pool.mutex);
+    }
+
+    pool.helpers = 0;
+    pool.busy = 0;
+    pthread_mutex_unlock(&pool.mutex);
+    return 0;
+}
+
+// workers_retain registers a user of the pool.
+void workers_retain(void) {
+    pthread_mutex_lock(&pool.mutex);
+    pool.refs++;
+    pthread_mutex_unlock(&pool.mutex);
+}
+
+// workers_release unregisters a user of the pool.
+// Stops the threads when the last user is gone.
+void workers_release(void) {
+    pthread_mutex_lock(&pool.mutex);
+    pool.refs--;
+    if (pool.refs > 0 || pool.nthreads == 0 || pool.shutdown) {
+        pthread_mutex_unlock(&pool.mutex);
+        return;
+    }
+    pool.shutdown = 1;
+    pthread_cond_broadcast(&pool.wakeup);
+    int nthreads = pool.nthreads;
+    pthread_mutex_unlock(&pool.mutex);
+
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(pool.threads[i], NULL);
+    }
+
+    pthread_mutex_lock(&pool.mutex);
+    pool.nthreads = 0;
+    pool.shutdown = 0;
+    pthread_mutex_unlock(&pool.mutex);
+}
+
+#else
+
+// Threads are not supported on this platform, so the callers
+// always fall back to a single thread.
+int workers_run(int nthreads, workers_task_fn fn, void* arg, size_t ntasks) {
+    (void)nthreads;
+    (void)fn;
+    (void)arg;
+    (void)ntasks;
+    return -1;
+}
+
+void workers_retain(void) {}
+
+void workers_release(void) {}
+
+#endif /* _WIN32 */
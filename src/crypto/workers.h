@@ -0,0 +1,22 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// A small pool of worker threads for splitting a hash computation
+// into independent tasks.
+
+#ifndef __WORKERS_H__
+#define __WORKERS_H__
+
+#include <stddef.h>
+
+// The maximum number of threads working on a single job,
+// including the calling thread.
+#define WORKERS_MAX_THREADS 16
+
+typedef void (*workers_task_fn)(void* arg, size_t idx);
+
+int workers_run(int nthreads, workers_task_fn fn, void* arg, size_t ntasks);
+void workers_retain(void);
+void workers_release(void);
+
+#endif /* __WORKERS_H__ */
@@ -16,13 +16,8 @@
 
 // XXH32.
 
-void* xxh32_init() {
-    XXH32_state_t* ctx = XXH32_createState();
-    if (!ctx) {
-        return NULL;
-    }
+void xxh32_init(XXH32_state_t* ctx) {
     XXH32_reset(ctx, 0);
-    return ctx;
 }
 
 void xxh32_update(XXH32_state_t* ctx, const void* data, size_t len) {
@@ -30,23 +25,23 @@ void xxh32_update(XXH32_state_t* ctx, const void* data, size_t len) {
 }
 
 int xxh32_final(XXH32_state_t* ctx, uint8_t* hash) {
-    XXH32_hash_t digest = XXH32_digest(ctx);
     XXH32_canonical_t cano;
-    XXH32_canonicalFromHash(&cano, digest);
+    XXH32_canonicalFromHash(&cano, XXH32_digest(ctx));
+    memcpy(hash, cano.digest, XXH32_DIGEST_LENGTH);
+    return XXH32_DIGEST_LENGTH;
+}
+
+int xxh32_digest(const void* data, size_t len, uint8_t* hash) {
+    XXH32_canonical_t cano;
+    XXH32_canonicalFromHash(&cano, XXH32(data, len, 0));
     memcpy(hash, cano.digest, XXH32_DIGEST_LENGTH);
-    XXH32_freeState(ctx);
     return XXH32_DIGEST_LENGTH;
 }
 
 // XXH64.
 
-void* xxh64_init() {
-    XXH64_state_t* ctx = XXH64_createState();
-    if (!ctx) {
-        return NULL;
-    }
+void xxh64_init(XXH64_state_t* ctx) {
     XXH64_reset(ctx, 0);
-    return ctx;
 }
 
 void xxh64_update(XXH64_state_t* ctx, const void* data, size_t len) {
@@ -54,23 +49,28 @@ void xxh64_update(XXH64_state_t* ctx, const void* data, size_t len) {
 }
 
 int xxh64_final(XXH64_state_t* ctx, uint8_t* hash) {
-    XXH64_hash_t digest = XXH64_digest(ctx);
     XXH64_canonical_t cano;
-    XXH64_canonicalFromHash(&cano, digest);
+    XXH64_canonicalFromHash(&cano, XXH64_digest(ctx));
+    memcpy(hash, cano.digest, XXH64_DIGEST_LENGTH);
+    return XXH64_DIGEST_LENGTH;
+}
+
+int xxh64_digest(const void* data, size_t len, uint8_t* hash) {
+    XXH64_canonical_t cano;
+    XXH64_canonicalFromHash(&cano, XXH64(data, len, 0));
     memcpy(hash, cano.digest, XXH64_DIGEST_LENGTH);
-    XXH64_freeState(ctx);
     return XXH64_DIGEST_LENGTH;
 }
 
+int64_t xxh64_int(const void* data, size_t len, uint64_t seed) {
+    return (int64_t)XXH64(data, len, seed);
+}
+
 // XXH3 64-bit.
 
-void* xxh3_64_init() {
-    XXH3_state_t* ctx = XXH3_createState();
-    if (!ctx) {
-        return NULL;
-    }
+void xxh3_64_init(XXH3_state_t* ctx) {
+    XXH3_INITSTATE(ctx);
     XXH3_64bits_reset(ctx);
-    return ctx;
 }
 
 void xxh3_64_update(XXH3_state_t* ctx, const void* data, size_t len) {
@@ -78,23 +78,28 @@ void xxh3_64_update(XXH3_state_t* ctx, const void* data, size_t len) {
 }
 
 int xxh3_64_final(XXH3_state_t* ctx, uint8_t* hash) {
-    uint64_t digest = XXH3_64bits_digest(ctx);
     XXH64_canonical_t cano;
-    XXH64_canonicalFromHash(&cano, digest);
+    XXH64_canonicalFromHash(&cano, XXH3_64bits_digest(ctx));
     memcpy(hash, cano.digest, XXH64_DIGEST_LENGTH);
-    XXH3_freeState(ctx);
     return XXH64_DIGEST_LENGTH;
 }
 
+int xxh3_64_digest(const void* data, size_t len, uint8_t* hash) {
+    XXH64_canonical_t cano;
+    XXH64_canonicalFromHash(&cano, XXH3_64bits(data, len));
+    memcpy(hash, cano.digest, XXH64_DIGEST_LENGTH);
+    return XXH64_DIGEST_LENGTH;
+}
+
+int64_t xxh3_64_int(const void* data, size_t len, uint64_t seed) {
+    return (int64_t)XXH3_64bits_withSeed(data, len, seed);
+}
+
 // XXH3 128-bit.
 
-void* xxh3_128_init() {
-    XXH3_state_t* ctx = XXH3_createState();
-    if (!ctx) {
-        return NULL;
-    }
+void xxh3_128_init(XXH3_state_t* ctx) {
+    XXH3_INITSTATE(ctx);
     XXH3_128bits_reset(ctx);
-    return ctx;
 }
 
 void xxh3_128_update(XXH3_state_t* ctx, const void* data, size_t len) {
@@ -102,10 +107,15 @@ void xxh3_128_update(XXH3_state_t* ctx, const void* data, size_t len) {
 }
 
 int xxh3_128_final(XXH3_state_t* ctx, uint8_t* hash) {
-    XXH128_hash_t digest = XXH3_128bits_digest(ctx);
     XXH128_canonical_t cano;
-    XXH128_canonicalFromHash(&cano, digest);
+    XXH128_canonicalFromHash(&cano, XXH3_128bits_digest(ctx));
+    memcpy(hash, cano.digest, XXH128_DIGEST_LENGTH);
+    return XXH128_DIGEST_LENGTH;
+}
+
+int xxh3_128_digest(const void* data, size_t len, uint8_t* hash) {
+    XXH128_canonical_t cano;
+    XXH128_canonicalFromHash(&cano, XXH3_128bits(data, len));
     memcpy(hash, cano.digest, XXH128_DIGEST_LENGTH);
-    XXH3_freeState(ctx);
     return XXH128_DIGEST_LENGTH;
 }
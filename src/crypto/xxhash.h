@@ -7,22 +7,29 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#define XXH_STATIC_LINKING_ONLY
 #include "crypto/xxhash.impl.h"
 
-void* xxh32_init();
+void xxh32_init(XXH32_state_t* ctx);
 void xxh32_update(XXH32_state_t* ctx, const void* data, size_t len);
 int xxh32_final(XXH32_state_t* ctx, uint8_t* hash);
+int xxh32_digest(const void* data, size_t len, uint8_t* hash);
 
-void* xxh64_init();
+void xxh64_init(XXH64_state_t* ctx);
 void xxh64_update(XXH64_state_t* ctx, const void* data, size_t len);
 int xxh64_final(XXH64_state_t* ctx, uint8_t* hash);
+int xxh64_digest(const void* data, size_t len, uint8_t* hash);
+int64_t xxh64_int(const void* data, size_t len, uint64_t seed);
 
-void* xxh3_64_init();
+void xxh3_64_init(XXH3_state_t* ctx);
 void xxh3_64_update(XXH3_state_t* ctx, const void* data, size_t len);
 int xxh3_64_final(XXH3_state_t* ctx, uint8_t* hash);
+int xxh3_64_digest(const void* data, size_t len, uint8_t* hash);
+int64_t xxh3_64_int(const void* data, size_t len, uint64_t seed);
 
-void* xxh3_128_init();
+void xxh3_128_init(XXH3_state_t* ctx);
 void xxh3_128_update(XXH3_state_t* ctx, const void* data, size_t len);
 int xxh3_128_final(XXH3_state_t* ctx, uint8_t* hash);
+int xxh3_128_digest(const void* data, size_t len, uint8_t* hash);
 
 #endif
@@ -6,8 +6,105 @@
 #ifndef DEFINE_INTERNAL_H
 #define DEFINE_INTERNAL_H
 
+#include <stdbool.h>
+
 #include "sqlite3ext.h"
 
+// Maximum number of nested calls of a single defined function
+// (e.g. a recursive one).
+#define DEFINE_MAX_DEPTH 100
+
+// Maximum number of cached results of a memoized function.
+#define DEFINE_MEMO_SIZE 1024
+
+// Prepared statement for a defined function body.
+typedef struct define_stmt {
+    sqlite3_stmt* stmt;
+    bool busy;
+    struct define_stmt* next;
+} define_stmt;
+
+typedef struct define_pool define_pool;
+
+// Statements returning the data and schema versions of an attached database.
+typedef struct define_version {
+    char* schema;
+    sqlite3_stmt* data_stmt;
+    sqlite3_stmt* schema_stmt;
+    struct define_version* next;
+} define_version;
+
+// Function body compiled to an expression tree (see expr.c).
+typedef struct define_expr define_expr;
+
+// Cached results of a memoized function (see memo.c).
+typedef struct define_memo define_memo;
+
+// Defined scalar function. Each call checks out a statement
+// that is not busy, so nested and recursive calls get their own.
+typedef struct define_func {
+    define_pool* pool;
+    char* name;
+    char* sql;
+    define_stmt* stmts;
+    // compiled body, NULL if it only runs as a statement
+    define_expr* expr;
+    // cached results, NULL if the function is not memoized
+    define_memo* memo;
+    // number of bound parameters, -1 until the body is prepared
+    int nparams;
+    // total time spent preparing statements for the body
+    sqlite3_int64 prepare_ns;
+    // number of busy statements
+    int depth;
+    struct define_func* prev;
+    struct define_func* next;
+} define_func;
+
+// Defined functions of a single connection.
+struct define_pool {
+    sqlite3* db;
+    define_func* funcs;
+    // statements to check if the databases have changed
+    sqlite3_stmt* schemas;
+    define_version* versions;
+    // true if the statements will be freed on close
+    bool armed;
+    int refs;
+};
+
+define_pool* define_pool_open(sqlite3* db);
+define_pool* define_pool_retain(define_pool* pool);
+void define_pool_release(void* pool);
+void define_pool_clear(define_pool* pool);
+bool define_pool_data_version(define_pool* pool, sqlite3_uint64* version);
+
+define_func* define_func_new(define_pool* pool, const char* name, const char* sql);
+void define_func_free(void* func);
+int define_func_prepare(define_func* func, define_stmt** out);
+int define_func_acquire(define_func* func, define_stmt** out);
+void define_func_release(define_func* func, define_stmt* node);
+
+define_expr* define_expr_compile(sqlite3_stmt* stmt);
+int define_expr_eval(const define_expr* expr, sqlite3_context* ctx, sqlite3_value** argv);
+void define_expr_free(define_expr* expr);
+
+define_memo* define_memo_new(void);
+void define_memo_free(define_memo* memo);
+sqlite3_value* define_memo_get(define_memo* memo,
+                               define_pool* pool,
+                               int argc,
+                               sqlite3_value** argv);
+void define_memo_put(define_memo* memo,
+                     define_pool* pool,
+                     int argc,
+                     sqlite3_value** argv,
+                     sqlite3_value* result);
+void define_memo_stats(const define_memo* memo,
+                       int* size,
+                       sqlite3_int64* hits,
+                       sqlite3_int64* misses);
+
 int define_save_function(sqlite3* db, const char* name, const char* type, const char* body);
 
 int define_eval_init(sqlite3* db);
@@ -0,0 +1,1434 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// Expression compiler for simple defined function bodies.
+//
+// Bodies like `:a * 2 + :b` are parsed into a tree and evaluated
+// directly in C, without binding the arguments and stepping
+// the prepared statement.
+//
+// Supported: literals, parameters, arithmetic, concatenation, comparisons,
+// IS [NOT], [NOT] BETWEEN, [NOT] IN (list), AND, OR, NOT, CASE, and calls
+// to the built-in coalesce, ifnull, nullif, iif, min and max.
+// Bodies with anything else are not compiled and always run as statements.
+//
+// The evaluator follows SQLite semantics for integers, reals and NULLs,
+// and compares values like SQLite does without affinity (which is the case
+// for parameters and literals). Where SQLite would convert the value
+// (e.g. text in arithmetic), the evaluator gives up, and the call runs
+// as a statement. Functions that may raise an error (like abs) are not
+// supported, because SQLite evaluates calls on parameters ahead of time,
+// so the error could come from a CASE branch that is not taken.
+//
+// SQLite itself evaluates the literals and numbers the parameters
+// at compile time, so these match exactly.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sqlite3ext.h"
+SQLITE_EXTENSION_INIT3
+
+#include "define/define.h"
+
+// Limits for compiled expressions.
+#define MAX_NODES 256
+#define MAX_DEPTH 64
+#define MAX_PARAM_NAMES 32
+#define MAX_ALLOCS 8
+
+#pragma region types
+
+typedef enum {
+    OP_CONST,
+    OP_PARAM,
+    OP_NEG,
+    OP_NOT,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_REM,
+    OP_CONCAT,
+    OP_EQ,
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_IS,
+    OP_ISNOT,
+    OP_AND,
+    OP_OR,
+    OP_BETWEEN,
+    OP_NOTBETWEEN,
+    OP_IN,
+    OP_NOTIN,
+    OP_CASE,
+    OP_COALESCE,
+    OP_NULLIF,
+    OP_IIF,
+    OP_MIN,
+    OP_MAX,
+} expr_op;
+
+// Expression tree node. Operands are the indexes of other nodes
+// in the args array, starting from `first`.
+typedef struct {
+    expr_op op;
+    // constant or parameter index
+    int index;
+    // CASE: whether there is a base expression and an ELSE branch
+    bool has_base;
+    bool has_else;
+    int first;
+    int nargs;
+} expr_node;
+
+struct define_expr {
+    expr_node nodes[MAX_NODES];
+    int nnodes;
+    int args[MAX_NODES];
+    int nargs;
+    int root;
+    sqlite3_value** consts;
+    int nconsts;
+};
+
+// Evaluated value. Text and blob point into the arguments,
+// the constants or the evaluation allocations.
+typedef struct {
+    int type;
+    sqlite3_int64 i;
+    double r;
+    const char* z;
+    int n;
+} expr_value;
+
+// Evaluation state for a single call.
+typedef struct {
+    const define_expr* expr;
+    sqlite3_value** argv;
+    void* allocs[MAX_ALLOCS];
+    int nallocs;
+} expr_state;
+
+// Returned by the evaluator when the call should run as a statement.
+#define EXPR_FALLBACK (-1)
+
+#pragma endregion
+
+#pragma region parser
+
+typedef enum {
+    TK_END,
+    TK_ERROR,
+    TK_LITERAL,
+    TK_PARAM,
+    TK_ID,
+    TK_LP,
+    TK_RP,
+    TK_COMMA,
+    TK_PLUS,
+    TK_MINUS,
+    TK_STAR,
+    TK_SLASH,
+    TK_REM,
+    TK_CONCAT,
+    TK_EQ,
+    TK_NE,
+    TK_LT,
+    TK_LE,
+    TK_GT,
+    TK_GE,
+} token_type;
+
+typedef struct {
+    token_type type;
+    const char* z;
+    int n;
+} token;
+
+typedef struct {
+    define_expr* expr;
+    const char* pos;
+    token tok;
+    // end of the previous token
+    const char* last;
+    int depth;
+    // source spans of the constants, evaluated by SQLite after parsing
+    token spans[MAX_NODES];
+    // parameter numbering, the same as SQLite does
+    int nvars;
+    token names[MAX_PARAM_NAMES];
+    int name_idx[MAX_PARAM_NAMES];
+    int nnames;
+    sqlite3_stmt* stmt;
+} parser;
+
+static bool is_id_char(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_' || c == '$' || c >= 0x80;
+}
+
+static bool is_digit(unsigned char c) {
+    return c >= '0' && c <= '9';
+}
+
+// skip_space skips whitespace and comments.
+static const char* skip_space(const char* z) {
+    for (;;) {
+        if (*z == ' ' || *z == '\t' || *z == '\n' || *z == '\r' || *z == '\f') {
+            z++;
+        } else if (z[0] == '-' && z[1] == '-') {
+            while (*z && *z != '\n') {
+                z++;
+            }
+        } else if (z[0] == '/' && z[1] == '*') {
+            const char* end = strstr(z + 2, "*/");
+            if (end == NULL) {
+                return z;
+            }
+            z = end + 2;
+        } else {
+            return z;
+        }
+    }
+}
+
+// scan_quoted returns the length of the quoted token starting at z
+// (with the doubled quote as an escape), or 0 if it's not terminated.
+static int scan_quoted(const char* z, char quote) {
+    int i = 1;
+    for (;;) {
+        if (z[i] == 0) {
+            return 0;
+        }
+        if (z[i] == quote) {
+            if (z[i + 1] != quote) {
+                return i + 1;
+            }
+            i++;
+        }
+        i++;
+    }
+}
+
+// scan_number returns the length of the numeric literal starting at z.
+static int scan_number(const char* z) {
+    int i = 0;
+    if (z[0] == '0' && (z[1] == 'x' || z[1] == 'X')) {
+        i = 2;
+        while (is_id_char(z[i])) {
+            i++;
+        }
+        return i;
+    }
+    while (is_digit(z[i]) || z[i] == '_') {
+        i++;
+    }
+    if (z[i] == '.') {
+        i++;
+        while (is_digit(z[i]) || z[i] == '_') {
+            i++;
+        }
+    }
+    if (z[i] == 'e' || z[i] == 'E') {
+        int j = i + 1;
+        if (z[j] == '+' || z[j] == '-') {
+            j++;
+        }
+        if (is_digit(z[j])) {
+            i = j;
+            while (is_digit(z[i])) {
+                i++;
+            }
+        }
+    }
+    return i;
+}
+
+// next_token reads the next token into p->tok.
+static void next_token(parser* p) {
+    p->last = p->pos;
+    const char* z = skip_space(p->pos);
+    token* t = &p->tok;
+    t->z = z;
+    t->n = 1;
+    switch (z[0]) {
+        case 0:
+            t->type = TK_END;
+            t->n = 0;
+            break;
+        case '(':
+            t->type = TK_LP;
+            break;
+        case ')':
+            t->type = TK_RP;
+            break;
+        case ',':
+            t->type = TK_COMMA;
+            break;
+        case '+':
+            t->type = TK_PLUS;
+            break;
+        case '-':
+            t->type = TK_MINUS;
+            break;
+        case '*':
+            t->type = TK_STAR;
+            break;
+        case '/':
+            t->type = TK_SLASH;
+            break;
+        case '%':
+            t->type = TK_REM;
+            break;
+        case '|':
+            t->type = z[1] == '|' ? TK_CONCAT : TK_ERROR;
+            t->n = 2;
+            break;
+        case '=':
+            t->type = TK_EQ;
+            t->n = z[1] == '=' ? 2 : 1;
+            break;
+        case '!':
+            t->type = z[1] == '=' ? TK_NE : TK_ERROR;
+            t->n = 2;
+            break;
+        case '<':
+            if (z[1] == '=') {
+                t->type = TK_LE;
+                t->n = 2;
+            } else if (z[1] == '>') {
+                t->type = TK_NE;
+                t->n = 2;
+            } else {
+                t->type = z[1] == '<' ? TK_ERROR : TK_LT;
+            }
+            break;
+        case '>':
+            if (z[1] == '=') {
+                t->type = TK_GE;
+                t->n = 2;
+            } else {
+                t->type = z[1] == '>' ? TK_ERROR : TK_GT;
+            }
+            break;
+        case '\'':
+            t->n = scan_quoted(z, '\'');
+            t->type = t->n ? TK_LITERAL : TK_ERROR;
+            break;
+        case '?':
+            while (is_digit(z[t->n])) {
+                t->n++;
+            }
+            t->type = TK_PARAM;
+            break;
+        case ':':
+        case '@':
+        case '$':
+            while (is_id_char(z[t->n])) {
+                t->n++;
+            }
+            // no TCL-style names like $a::b or $a(b)
+            t->type = t->n > 1 && z[t->n] != ':' && z[t->n] != '(' ? TK_PARAM : TK_ERROR;
+            break;
+        default:
+            if (is_digit(z[0]) || (z[0] == '.' && is_digit(z[1]))) {
+                t->n = scan_number(z);
+                t->type = is_id_char(z[t->n]) ? TK_ERROR : TK_LITERAL;
+            } else if ((z[0] == 'x' || z[0] == 'X') && z[1] == '\'') {
+                t->n = scan_quoted(z + 1, '\'');
+                t->type = t->n ? TK_LITERAL : TK_ERROR;
+                t->n++;
+            } else if (is_id_char(z[0]) && !is_digit(z[0]) && z[0] != '$') {
+                while (is_id_char(z[t->n])) {
+                    t->n++;
+                }
+                t->type = TK_ID;
+            } else {
+                t->type = TK_ERROR;
+            }
+            break;
+    }
+    p->pos = z + t->n;
+}
+
+// is_keyword checks if the token is the given (lowercase) keyword.
+static bool is_keyword(const token* t, const char* kw) {
+    if (t->type != TK_ID || (int)strlen(kw) != t->n) {
+        return false;
+    }
+    return sqlite3_strnicmp(t->z, kw, t->n) == 0;
+}
+
+// accept_keyword consumes the token if it's the given keyword.
+static bool accept_keyword(parser* p, const char* kw) {
+    if (!is_keyword(&p->tok, kw)) {
+        return false;
+    }
+    next_token(p);
+    return true;
+}
+
+// add_node adds a node with the given operands and returns its index,
+// or -1 if there are too many nodes.
+static int add_node(parser* p, expr_op op, const int* operands, int n) {
+    define_expr* e = p->expr;
+    if (e->nnodes >= MAX_NODES || e->nargs + n > MAX_NODES) {
+        return -1;
+    }
+    expr_node* node = &e->nodes[e->nnodes];
+    memset(node, 0, sizeof(*node));
+    node->op = op;
+    node->first = e->nargs;
+    node->nargs = n;
+    for (int i = 0; i < n; i++) {
+        if (operands[i] < 0) {
+            return -1;
+        }
+        e->args[e->nargs++] = operands[i];
+    }
+    return e->nnodes++;
+}
+
+// add_literal adds a constant node for the source span.
+static int add_literal(parser* p, const char* z, int n) {
+    int idx = add_node(p, OP_CONST, NULL, 0);
+    if (idx < 0) {
+        return -1;
+    }
+    token* span = &p->spans[p->expr->nconsts];
+    span->z = z;
+    span->n = n;
+    p->expr->nodes[idx].index = p->expr->nconsts++;
+    return idx;
+}
+
+// add_param adds a parameter node, numbered the same way SQLite does.
+static int add_param(parser* p, const token* t) {
+    int num;
+    if (t->n == 1) {
+        // ?
+        num = ++p->nvars;
+    } else if (t->z[0] == '?') {
+        // ?NNN
+        num = 0;
+        for (int i = 1; i < t->n; i++) {
+            num = num * 10 + (t->z[i] - '0');
+            if (num > 32766) {
+                return -1;
+            }
+        }
+        if (num == 0) {
+            return -1;
+        }
+        if (num > p->nvars) {
+            p->nvars = num;
+        }
+    } else {
+        // :name, @name, $name
+        num = 0;
+        for (int i = 0; i < p->nnames; i++) {
+            if (p->names[i].n == t->n && memcmp(p->names[i].z, t->z, t->n) == 0) {
+                num = p->name_idx[i];
+                break;
+            }
+        }
+        if (num == 0) {
+            if (p->nnames == MAX_PARAM_NAMES) {
+                return -1;
+            }
+            num = ++p->nvars;
+            p->names[p->nnames] = *t;
+            p->name_idx[p->nnames++] = num;
+        }
+        // double check with the prepared statement
+        char name[64];
+        if (t->n >= (int)sizeof(name)) {
+            return -1;
+        }
+        memcpy(name, t->z, t->n);
+        name[t->n] = 0;
+        if (sqlite3_bind_parameter_index(p->stmt, name) != num) {
+            return -1;
+        }
+    }
+    int idx = add_node(p, OP_PARAM, NULL, 0);
+    if (idx >= 0) {
+        p->expr->nodes[idx].index = num - 1;
+    }
+    return idx;
+}
+
+static int parse_expr(parser* p);
+static int parse_unary(parser* p);
+
+// parse_list parses a comma-separated list of expressions up to the closing
+// parenthesis (which is consumed) into operands, and returns their number.
+static int parse_list(parser* p, int* operands, int max) {
+    int n = 0;
+    for (;;) {
+        if (n == max) {
+            return -1;
+        }
+        operands[n] = parse_expr(p);
+        if (operands[n++] < 0) {
+            return -1;
+        }
+        if (p->tok.type == TK_COMMA) {
+            next_token(p);
+            continue;
+        }
+        if (p->tok.type != TK_RP) {
+            return -1;
+        }
+        next_token(p);
+        return n;
+    }
+}
+
+// parse_case parses CASE [base] WHEN .. THEN .. [ELSE ..] END.
+static int parse_case(parser* p) {
+    int operands[2 * 16 + 2];
+    int n = 0;
+    bool has_base = false;
+    bool has_else = false;
+    if (!is_keyword(&p->tok, "when")) {
+        operands[n++] = parse_expr(p);
+        has_base = true;
+    }
+    while (accept_keyword(p, "when")) {
+        if (n + 2 > (int)(sizeof(operands) / sizeof(operands[0])) - 1) {
+            return -1;
+        }
+        operands[n++] = parse_expr(p);
+        if (!accept_keyword(p, "then")) {
+            return -1;
+        }
+        operands[n++] = parse_expr(p);
+    }
+    if (n < 2 + has_base) {
+        return -1;
+    }
+    if (accept_keyword(p, "else")) {
+        operands[n++] = parse_expr(p);
+        has_else = true;
+    }
+    if (!accept_keyword(p, "end")) {
+        return -1;
+    }
+    int idx = add_node(p, OP_CASE, operands, n);
+    if (idx >= 0) {
+        p->expr->nodes[idx].has_base = has_base;
+        p->expr->nodes[idx].has_else = has_else;
+    }
+    return idx;
+}
+
+// Built-in functions that can be evaluated natively.
+static const struct {
+    const char* name;
+    expr_op op;
+    int min_args;
+    int max_args;
+} functions[] = {
+    {"coalesce", OP_COALESCE, 2, 16}, {"ifnull", OP_COALESCE, 2, 2}, {"nullif", OP_NULLIF, 2, 2},
+    {"iif", OP_IIF, 3, 3},            {"min", OP_MIN, 2, 16},        {"max", OP_MAX, 2, 16},
+};
+
+// is_builtin checks that the function is not overridden
+// by an application-defined one with the same name.
+static bool is_builtin(sqlite3* db, const char* name) {
+    sqlite3_stmt* stmt;
+    const char* sql = "select count(*) from pragma_function_list where name = ? and builtin = 0";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    bool ok = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) == 0;
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+// parse_call parses a function call, the name token is already consumed.
+static int parse_call(parser* p, const token* name) {
+    for (size_t i = 0; i < sizeof(functions) / sizeof(functions[0]); i++) {
+        if (!is_keyword(name, functions[i].name)) {
+            continue;
+        }
+        if (!is_builtin(sqlite3_db_handle(p->stmt), functions[i].name)) {
+            return -1;
+        }
+        next_token(p);
+        int operands[16];
+        int n = parse_list(p, operands, 16);
+        if (n < functions[i].min_args || n > functions[i].max_args) {
+            return -1;
+        }
+        return add_node(p, functions[i].op, operands, n);
+    }
+    return -1;
+}
+
+// parse_primary parses literals, parameters, parentheses, CASE and function calls.
+static int parse_primary(parser* p) {
+    token t = p->tok;
+    switch (t.type) {
+        case TK_LITERAL:
+            next_token(p);
+            return add_literal(p, t.z, t.n);
+        case TK_PARAM:
+            next_token(p);
+            return add_param(p, &t);
+        case TK_LP: {
+            next_token(p);
+            int idx = parse_expr(p);
+            if (p->tok.type != TK_RP) {
+                return -1;
+            }
+            next_token(p);
+            return idx;
+        }
+        case TK_ID:
+            if (is_keyword(&t, "null") || is_keyword(&t, "true") || is_keyword(&t, "false")) {
+                next_token(p);
+                return add_literal(p, t.z, t.n);
+            }
+            if (is_keyword(&t, "case")) {
+                next_token(p);
+                return parse_case(p);
+            }
+            next_token(p);
+            if (p->tok.type != TK_LP) {
+                return -1;
+            }
+            return parse_call(p, &t);
+        default:
+            return -1;
+    }
+}
+
+// parse_unary parses unary minus and plus.
+static int parse_unary(parser* p) {
+    if (p->tok.type == TK_PLUS) {
+        next_token(p);
+        return parse_unary(p);
+    }
+    if (p->tok.type == TK_MINUS) {
+        const char* start = p->tok.z;
+        next_token(p);
+        int operand = parse_unary(p);
+        if (operand >= 0 && p->expr->nodes[operand].op == OP_CONST) {
+            // let SQLite evaluate negative constants, so that -9223372036854775808
+            // is an integer, like in SQL
+            token* span = &p->spans[p->expr->nodes[operand].index];
+            span->z = start;
+            span->n = (int)(p->last - start);
+            return operand;
+        }
+        return add_node(p, OP_NEG, &operand, 1);
+    }
+    return parse_primary(p);
+}
+
+// parse_binary parses left-associative binary operators of the given precedence level:
+// 0 - concatenation, 1 - multiplicative, 2 - additive, 3 - relational.
+static int parse_binary(parser* p, int level) {
+    static const struct {
+        token_type tok;
+        expr_op op;
+        int level;
+    } ops[] = {
+        {TK_CONCAT, OP_CONCAT, 0}, {TK_STAR, OP_MUL, 1}, {TK_SLASH, OP_DIV, 1},
+        {TK_REM, OP_REM, 1},       {TK_PLUS, OP_ADD, 2}, {TK_MINUS, OP_SUB, 2},
+        {TK_LT, OP_LT, 3},         {TK_LE, OP_LE, 3},    {TK_GT, OP_GT, 3},
+        {TK_GE, OP_GE, 3},
+    };
+    int left = level == 0 ? parse_unary(p) : parse_binary(p, level - 1);
+    for (;;) {
+        expr_op op = OP_CONST;
+        for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+            if (ops[i].level == level && ops[i].tok == p->tok.type) {
+                op = ops[i].op;
+                break;
+            }
+        }
+        if (op == OP_CONST || left < 0) {
+            return left;
+        }
+        next_token(p);
+        int operands[2] = {left, level == 0 ? parse_unary(p) : parse_binary(p, level - 1)};
+        left = add_node(p, op, operands, 2);
+    }
+}
+
+// parse_equality parses =, <>, IS [NOT], [NOT] IN and [NOT] BETWEEN.
+static int parse_equality(parser* p) {
+    int left = parse_binary(p, 3);
+    while (left >= 0) {
+        token_type type = p->tok.type;
+        if (type == TK_EQ || type == TK_NE) {
+            next_token(p);
+            int operands[2] = {left, parse_binary(p, 3)};
+            left = add_node(p, type == TK_EQ ? OP_EQ : OP_NE, operands, 2);
+            continue;
+        }
+        if (accept_keyword(p, "is")) {
+            expr_op op = accept_keyword(p, "not") ? OP_ISNOT : OP_IS;
+            if (is_keyword(&p->tok, "distinct") || is_keyword(&p->tok, "true") ||
+                is_keyword(&p->tok, "false")) {
+                // IS TRUE and IS FALSE check the truth value, not equality
+                return -1;
+            }
+            int operands[2] = {left, parse_binary(p, 3)};
+            left = add_node(p, op, operands, 2);
+            continue;
+        }
+        bool negate = false;
+        if (is_keyword(&p->tok, "not")) {
+            // NOT IN or NOT BETWEEN, otherwise not an equality operator
+            const char* pos = p->pos;
+            token tok = p->tok;
+            next_token(p);
+            if (!is_keyword(&p->tok, "in") && !is_keyword(&p->tok, "between")) {
+                p->pos = pos;
+                p->tok = tok;
+                return left;
+            }
+            negate = true;
+        }
+        if (accept_keyword(p, "between")) {
+            int operands[3] = {left, parse_binary(p, 3), -1};
+            if (!accept_keyword(p, "and")) {
+                return -1;
+            }
+            operands[2] = parse_binary(p, 3);
+            left = add_node(p, negate ? OP_NOTBETWEEN : OP_BETWEEN, operands, 3);
+            continue;
+        }
+        if (accept_keyword(p, "in")) {
+            if (p->tok.type != TK_LP) {
+                return -1;
+            }
+            next_token(p);
+            if (is_keyword(&p->tok, "select") || p->tok.type == TK_RP) {
+                return -1;
+            }
+            int operands[17] = {left};
+            int n = parse_list(p, operands + 1, 16);
+            if (n < 0) {
+                return -1;
+            }
+            left = add_node(p, negate ? OP_NOTIN : OP_IN, operands, n + 1);
+            continue;
+        }
+        return left;
+    }
+    return left;
+}
+
+// parse_not parses NOT.
+static int parse_not(parser* p) {
+    if (accept_keyword(p, "not")) {
+        int operand = parse_not(p);
+        return add_node(p, OP_NOT, &operand, 1);
+    }
+    return parse_equality(p);
+}
+
+// parse_and parses AND.
+static int parse_and(parser* p) {
+    int left = parse_not(p);
+    while (left >= 0 && accept_keyword(p, "and")) {
+        int operands[2] = {left, parse_not(p)};
+        left = add_node(p, OP_AND, operands, 2);
+    }
+    return left;
+}
+
+// parse_expr parses a full expression (OR has the lowest precedence).
+static int parse_expr(parser* p) {
+    if (++p->depth > MAX_DEPTH) {
+        return -1;
+    }
+    int left = parse_and(p);
+    while (left >= 0 && accept_keyword(p, "or")) {
+        int operands[2] = {left, parse_and(p)};
+        left = add_node(p, OP_OR, operands, 2);
+    }
+    p->depth--;
+    return left;
+}
+
+// eval_literals evaluates the literals with SQLite and stores them as constants.
+static bool eval_literals(sqlite3* db, define_expr* expr, const token* spans) {
+    if (expr->nconsts == 0) {
+        return true;
+    }
+    sqlite3_str* sql = sqlite3_str_new(db);
+    sqlite3_str_appendall(sql, "select ");
+    for (int i = 0; i < expr->nconsts; i++) {
+        sqlite3_str_appendf(sql, "%s%.*s", i > 0 ? ", " : "", spans[i].n, spans[i].z);
+    }
+    char* select = sqlite3_str_finish(sql);
+    if (select == NULL) {
+        return false;
+    }
+    sqlite3_stmt* stmt;
+    int ret = sqlite3_prepare_v2(db, select, -1, &stmt, NULL);
+    sqlite3_free(select);
+    if (ret != SQLITE_OK) {
+        return false;
+    }
+    bool ok = false;
+    if (sqlite3_column_count(stmt) == expr->nconsts && sqlite3_step(stmt) == SQLITE_ROW) {
+        expr->consts = sqlite3_malloc(expr->nconsts * (int)sizeof(sqlite3_value*));
+        if (expr->consts != NULL) {
+            memset(expr->consts, 0, expr->nconsts * sizeof(sqlite3_value*));
+            ok = true;
+            for (int i = 0; i < expr->nconsts; i++) {
+                expr->consts[i] = sqlite3_value_dup(sqlite3_column_value(stmt, i));
+                ok = ok && expr->consts[i] != NULL;
+            }
+        }
+    }
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+// is_utf8 checks if the database uses UTF-8, so that comparing
+// the UTF-8 text gives the same result as in SQL.
+static bool is_utf8(sqlite3* db) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "pragma encoding", -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    bool ok = sqlite3_step(stmt) == SQLITE_ROW &&
+              sqlite3_stricmp((const char*)sqlite3_column_text(stmt, 0), "UTF-8") == 0;
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+/*
+ * Compiles the function body from the prepared statement ("select <body>").
+ * Returns NULL if the body is not supported (or on out of memory),
+ * in which case the function runs as a statement.
+ */
+define_expr* define_expr_compile(sqlite3_stmt* stmt) {
+    const char* sql = sqlite3_sql(stmt);
+    sqlite3* db = sqlite3_db_handle(stmt);
+    if (sql == NULL || sqlite3_strnicmp(sql, "select ", 7) != 0 || !is_utf8(db)) {
+        return NULL;
+    }
+
+    define_expr* expr = sqlite3_malloc(sizeof(*expr));
+    if (expr == NULL) {
+        return NULL;
+    }
+    memset(expr, 0, sizeof(*expr));
+
+    parser p;
+    memset(&p, 0, sizeof(p));
+    p.expr = expr;
+    p.pos = sql + 7;
+    p.stmt = stmt;
+    next_token(&p);
+    expr->root = parse_expr(&p);
+
+    bool ok = expr->root >= 0 && p.tok.type == TK_END &&
+              p.nvars == sqlite3_bind_parameter_count(stmt);
+    if (ok) {
+        ok = eval_literals(db, expr, p.spans);
+    }
+    if (!ok) {
+        define_expr_free(expr);
+        return NULL;
+    }
+    return expr;
+}
+
+/*
+ * Frees the compiled expression.
+ */
+void define_expr_free(define_expr* expr) {
+    if (expr == NULL) {
+        return;
+    }
+    for (int i = 0; expr->consts != NULL && i < expr->nconsts; i++) {
+        sqlite3_value_free(expr->consts[i]);
+    }
+    sqlite3_free(expr->consts);
+    sqlite3_free(expr);
+}
+
+#pragma endregion
+
+#pragma region evaluator
+
+// load_value reads the SQLite value.
+static void load_value(sqlite3_value* src, expr_value* v) {
+    v->type = sqlite3_value_type(src);
+    switch (v->type) {
+        case SQLITE_INTEGER:
+            v->i = sqlite3_value_int64(src);
+            break;
+        case SQLITE_FLOAT:
+            v->r = sqlite3_value_double(src);
+            break;
+        case SQLITE_TEXT:
+            v->z = (const char*)sqlite3_value_text(src);
+            v->n = sqlite3_value_bytes(src);
+            break;
+        case SQLITE_BLOB:
+            v->z = sqlite3_value_blob(src);
+            v->n = sqlite3_value_bytes(src);
+            break;
+    }
+}
+
+static void set_null(expr_value* v) {
+    v->type = SQLITE_NULL;
+}
+
+static void set_int(expr_value* v, sqlite3_int64 i) {
+    v->type = SQLITE_INTEGER;
+    v->i = i;
+}
+
+// set_real sets the real value, NaN becomes NULL like in SQLite.
+static void set_real(expr_value* v, double r) {
+    if (r != r) {
+        v->type = SQLITE_NULL;
+        return;
+    }
+    v->type = SQLITE_FLOAT;
+    v->r = r;
+}
+
+static bool is_numeric(const expr_value* v) {
+    return v->type == SQLITE_INTEGER || v->type == SQLITE_FLOAT;
+}
+
+static double real_of(const expr_value* v) {
+    return v->type == SQLITE_INTEGER ? (double)v->i : v->r;
+}
+
+// int_of converts the numeric value to an integer like sqlite3VdbeIntValue.
+static sqlite3_int64 int_of(const expr_value* v) {
+    if (v->type == SQLITE_INTEGER) {
+        return v->i;
+    }
+    if (v->r <= (double)INT64_MIN) {
+        return INT64_MIN;
+    }
+    if (v->r >= (double)INT64_MAX) {
+        return INT64_MAX;
+    }
+    return (sqlite3_int64)v->r;
+}
+
+// int_real_cmp compares an integer with a real like sqlite3IntFloatCompare.
+static int int_real_cmp(sqlite3_int64 i, double r) {
+    if (r < -9223372036854775808.0) {
+        return +1;
+    }
+    if (r >= 9223372036854775808.0) {
+        return -1;
+    }
+    sqlite3_int64 y = (sqlite3_int64)r;
+    if (i < y) {
+        return -1;
+    }
+    if (i > y) {
+        return +1;
+    }
+    double s = (double)i;
+    return s < r ? -1 : s > r ? +1 : 0;
+}
+
+// compare compares two values like sqlite3MemCompare with the BINARY collation:
+// NULL < numbers < text < blobs.
+static int compare(const expr_value* a, const expr_value* b) {
+    static const int rank[] = {
+        [SQLITE_NULL] = 0, [SQLITE_INTEGER] = 1, [SQLITE_FLOAT] = 1,
+        [SQLITE_TEXT] = 2, [SQLITE_BLOB] = 3,
+    };
+    if (rank[a->type] != rank[b->type]) {
+        return rank[a->type] < rank[b->type] ? -1 : +1;
+    }
+    switch (rank[a->type]) {
+        case 0:
+            return 0;
+        case 1:
+            if (a->type == SQLITE_INTEGER && b->type == SQLITE_INTEGER) {
+                return a->i < b->i ? -1 : a->i > b->i ? +1 : 0;
+            }
+            if (a->type == SQLITE_INTEGER) {
+                return int_real_cmp(a->i, b->r);
+            }
+            if (b->type == SQLITE_INTEGER) {
+                return -int_real_cmp(b->i, a->r);
+            }
+            return a->r < b->r ? -1 : a->r > b->r ? +1 : 0;
+        default: {
+            int n = a->n < b->n ? a->n : b->n;
+            int rc = n > 0 ? memcmp(a->z, b->z, n) : 0;
+            return rc != 0 ? rc : a->n - b->n;
+        }
+    }
+}
+
+// truth returns 1 for true, 0 for false and -1 for NULL.
+// Returns EXPR_FALLBACK - 1 for text and blobs, which SQLite converts to numbers.
+static int truth(const expr_value* v) {
+    switch (v->type) {
+        case SQLITE_NULL:
+            return -1;
+        case SQLITE_INTEGER:
+            return v->i != 0;
+        case SQLITE_FLOAT:
+            return v->r != 0.0;
+        default:
+            return EXPR_FALLBACK - 1;
+    }
+}
+
+static int eval(expr_state* s, int idx, expr_value* out);
+
+// eval_arg evaluates the i-th operand of the node.
+static int eval_arg(expr_state* s, const expr_node* node, int i, expr_value* out) {
+    return eval(s, s->expr->args[node->first + i], out);
+}
+
+// eval_truth evaluates the i-th operand of the node as a boolean (see truth).
+static int eval_truth(expr_state* s, const expr_node* node, int i, int* out) {
+    expr_value v;
+    if (eval_arg(s, node, i, &v) != SQLITE_OK) {
+        return EXPR_FALLBACK;
+    }
+    *out = truth(&v);
+    return *out < -1 ? EXPR_FALLBACK : SQLITE_OK;
+}
+
+// eval_arith evaluates +, -, *, / and %.
+static int eval_arith(expr_op op, const expr_value* a, const expr_value* b, expr_value* out) {
+    if (a->type == SQLITE_NULL || b->type == SQLITE_NULL) {
+        set_null(out);
+        return SQLITE_OK;
+    }
+    if (!is_numeric(a) || !is_numeric(b)) {
+        return EXPR_FALLBACK;
+    }
+    if (a->type == SQLITE_INTEGER && b->type == SQLITE_INTEGER) {
+        sqlite3_int64 r;
+        switch (op) {
+            case OP_ADD:
+                if (!__builtin_add_overflow(a->i, b->i, &r)) {
+                    set_int(out, r);
+                    return SQLITE_OK;
+                }
+                break;
+            case OP_SUB:
+                if (!__builtin_sub_overflow(a->i, b->i, &r)) {
+                    set_int(out, r);
+                    return SQLITE_OK;
+                }
+                break;
+            case OP_MUL:
+                if (!__builtin_mul_overflow(a->i, b->i, &r)) {
+                    set_int(out, r);
+                    return SQLITE_OK;
+                }
+                break;
+            case OP_DIV:
+                if (b->i == 0) {
+                    set_null(out);
+                    return SQLITE_OK;
+                }
+                if (a->i != INT64_MIN || b->i != -1) {
+                    set_int(out, a->i / b->i);
+                    return SQLITE_OK;
+                }
+                break;
+            default:
+                if (b->i == 0) {
+                    set_null(out);
+                } else {
+                    set_int(out, b->i == -1 ? 0 : a->i % b->i);
+                }
+                return SQLITE_OK;
+        }
+        // integer overflow, fall through to real arithmetic
+    }
+    double x = real_of(a);
+    double y = real_of(b);
+    switch (op) {
+        case OP_ADD:
+            set_real(out, x + y);
+            break;
+        case OP_SUB:
+            set_real(out, x - y);
+            break;
+        case OP_MUL:
+            set_real(out, x * y);
+            break;
+        case OP_DIV:
+            if (y == 0.0) {
+                set_null(out);
+            } else {
+                set_real(out, x / y);
+            }
+            break;
+        default: {
+            sqlite3_int64 ia = int_of(a);
+            sqlite3_int64 ib = int_of(b);
+            if (ib == 0) {
+                set_null(out);
+            } else {
+                set_real(out, (double)(ib == -1 ? 0 : ia % ib));
+            }
+            break;
+        }
+    }
+    return SQLITE_OK;
+}
+
+// eval_concat evaluates ||, converting integers to text.
+static int eval_concat(expr_state* s, const expr_value* a, const expr_value* b, expr_value* out) {
+    if (a->type == SQLITE_NULL || b->type == SQLITE_NULL) {
+        set_null(out);
+        return SQLITE_OK;
+    }
+    char buf[2][24];
+    const expr_value* vals[2] = {a, b};
+    const char* z[2];
+    int n[2];
+    for (int i = 0; i < 2; i++) {
+        if (vals[i]->type == SQLITE_TEXT) {
+            z[i] = vals[i]->z;
+            n[i] = vals[i]->n;
+        } else if (vals[i]->type == SQLITE_INTEGER) {
+            n[i] = snprintf(buf[i], sizeof(buf[i]), "%lld", (long long)vals[i]->i);
+            z[i] = buf[i];
+        } else {
+            // reals are formatted the SQLite way, blobs are not valid text
+            return EXPR_FALLBACK;
+        }
+    }
+    if (s->nallocs == MAX_ALLOCS) {
+        return EXPR_FALLBACK;
+    }
+    char* res = sqlite3_malloc64((sqlite3_uint64)n[0] + n[1] + 1);
+    if (res == NULL) {
+        return EXPR_FALLBACK;
+    }
+    s->allocs[s->nallocs++] = res;
+    memcpy(res, z[0], n[0]);
+    memcpy(res + n[0], z[1], n[1]);
+    res[n[0] + n[1]] = 0;
+    out->type = SQLITE_TEXT;
+    out->z = res;
+    out->n = n[0] + n[1];
+    return SQLITE_OK;
+}
+
+// eval_in evaluates [NOT] IN (list).
+static int eval_in(expr_state* s, const expr_node* node, expr_value* out) {
+    expr_value x, v;
+    if (eval_arg(s, node, 0, &x) != SQLITE_OK) {
+        return EXPR_FALLBACK;
+    }
+    bool has_null = false;
+    for (int i = 1; i < node->nargs; i++) {
+        // SQLite evaluates the list even if x is NULL,
+        // so do the same in case it fails
+        if (eval_arg(s, node, i, &v) != SQLITE_OK) {
+            return EXPR_FALLBACK;
+        }
+        if (x.type == SQLITE_NULL) {
+            continue;
+        }
+        if (v.type == SQLITE_NULL) {
+            has_null = true;
+        } else if (compare(&x, &v) == 0) {
+            set_int(out, node->op == OP_IN);
+            return SQLITE_OK;
+        }
+    }
+    if (x.type == SQLITE_NULL || has_null) {
+        set_null(out);
+    } else {
+        set_int(out, node->op == OP_NOTIN);
+    }
+    return SQLITE_OK;
+}
+
+// eval_case evaluates CASE.
+static int eval_case(expr_state* s, const expr_node* node, expr_value* out) {
+    expr_value base, v;
+    int i = 0;
+    if (node->has_base) {
+        if (eval_arg(s, node, i++, &base) != SQLITE_OK) {
+            return EXPR_FALLBACK;
+        }
+    }
+    int nwhen = node->nargs - node->has_base - node->has_else;
+    for (; i < node->has_base + nwhen; i += 2) {
+        bool match;
+        if (node->has_base) {
+            if (eval_arg(s, node, i, &v) != SQLITE_OK) {
+                return EXPR_FALLBACK;
+            }
+            match = base.type != SQLITE_NULL && v.type != SQLITE_NULL && compare(&base, &v) == 0;
+        } else {
+            int t;
+            if (eval_truth(s, node, i, &t) != SQLITE_OK) {
+                return EXPR_FALLBACK;
+            }
+            match = t == 1;
+        }
+        if (match) {
+            return eval_arg(s, node, i + 1, out);
+        }
+    }
+    if (node->has_else) {
+        return eval_arg(s, node, node->nargs - 1, out);
+    }
+    set_null(out);
+    return SQLITE_OK;
+}
+
+// eval_minmax evaluates the scalar min and max like minmaxFunc in SQLite.
+static int eval_minmax(expr_state* s, const expr_node* node, expr_value* out) {
+    expr_value v;
+    bool is_null = false;
+    for (int i = 0; i < node->nargs; i++) {
+        if (eval_arg(s, node, i, i == 0 ? out : &v) != SQLITE_OK) {
+            return EXPR_FALLBACK;
+        }
+        expr_value* cur = i == 0 ? out : &v;
+        if (cur->type == SQLITE_NULL) {
+            is_null = true;
+            continue;
+        }
+        if (i == 0) {
+            continue;
+        }
+        int cmp = compare(out, &v);
+        if (node->op == OP_MIN ? cmp >= 0 : cmp < 0) {
+            *out = v;
+        }
+    }
+    if (is_null) {
+        set_null(out);
+    }
+    return SQLITE_OK;
+}
+
+// eval evaluates the node.
+// Returns SQLITE_OK or EXPR_FALLBACK if the call should run as a statement.
+static int eval(expr_state* s, int idx, expr_value* out) {
+    const expr_node* node = &s->expr->nodes[idx];
+    expr_value a, b;
+    int ta, tb;
+    switch (node->op) {
+        case OP_CONST:
+            load_value(s->expr->consts[node->index], out);
+            return SQLITE_OK;
+
+        case OP_PARAM:
+            load_value(s->argv[node->index], out);
+            return SQLITE_OK;
+
+        case OP_NEG:
+            if (eval_arg(s, node, 0, &a) != SQLITE_OK) {
+                return EXPR_FALLBACK;
+            }
+            set_int(&b, 0);
+            return eval_arith(OP_SUB, &b, &a, out);
+
+        case OP_NOT:
+            if (eval_truth(s, node, 0, &ta) != SQLITE_OK) {
+                return EXPR_FALLBACK;
+            }
+            if (ta < 0) {
+                set_null(out);
+            } else {
+                set_int(out, !ta);
+            }
+            return SQLITE_OK;
+
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_REM:
+        case OP_CONCAT:
+            if (eval_arg(s, node, 0, &a) != SQLITE_OK || eval_arg(s, node, 1, &b) != SQLITE_OK) {
+                return EXPR_FALLBACK;
+            }
+            if (node->op == OP_CONCAT) {
+                return eval_concat(s, &a, &b, out);
+            }
+            return eval_arith(node->op, &a, &b, out);
+
+        case OP_EQ:
+        case OP_NE:
+        case OP_LT:
+        case OP_LE:
+        case OP_GT:
+        case OP_GE:
+        case OP_IS:
+        case OP_ISNOT: {
+            if (eval_arg(s, node, 0, &a) != SQLITE_OK || eval_arg(s, node, 1, &b) != SQLITE_OK) {
+                return EXPR_FALLBACK;
+            }
+            bool is_null = a.type == SQLITE_NULL || b.type == SQLITE_NULL;
+            if (is_null && node->op != OP_IS && node->op != OP_ISNOT) {
+                set_null(out);
+                return SQLITE_OK;
+            }
+            int cmp = compare(&a, &b);
+            bool res = node->op == OP_EQ   ? cmp == 0
+                       : node->op == OP_NE ? cmp != 0
+                       : node->op == OP_LT ? cmp < 0
+                       : node->op == OP_LE ? cmp <= 0
+                       : node->op == OP_GT ? cmp > 0
+                       : node->op == OP_GE ? cmp >= 0
+                       : node->op == OP_IS ? cmp == 0
+                                           : cmp != 0;
+            set_int(out, res);
+            return SQLITE_OK;
+        }
+
+        case OP_AND:
+        case OP_OR:
+            if (eval_truth(s, node, 0, &ta) != SQLITE_OK ||
+                eval_truth(s, node, 1, &tb) != SQLITE_OK) {
+                return EXPR_FALLBACK;
+            }
+            if (node->op == OP_AND) {
+                if (ta == 0 || tb == 0) {
+                    set_int(out, 0);
+                } else if (ta < 0 || tb < 0) {
+                    set_null(out);
+                } else {
+                    set_int(out, 1);
+                }
+            } else {
+                if (ta == 1 || tb == 1) {
+                    set_int(out, 1);
+                } else if (ta < 0 || tb < 0) {
+                    set_null(out);
+                } else {
+                    set_int(out, 0);
+                }
+            }
+            return SQLITE_OK;
+
+        case OP_BETWEEN:
+        case OP_NOTBETWEEN: {
+            expr_value x;
+            if (eval_arg(s, node, 0, &x) != SQLITE_OK || eval_arg(s, node, 1, &a) != SQLITE_OK ||
+                eval_arg(s, node, 2, &b) != SQLITE_OK) {
+                return EXPR_FALLBACK;
+            }
+            // x >= a AND x <= b
+            ta = x.type == SQLITE_NULL || a.type == SQLITE_NULL ? -1 : compare(&x, &a) >= 0;
+            tb = x.type == SQLITE_NULL || b.type == SQLITE_NULL ? -1 : compare(&x, &b) <= 0;
+            int res = ta == 0 || tb == 0 ? 0 : ta < 0 || tb < 0 ? -1 : 1;
+            if (res < 0) {
+                set_null(out);
+            } else {
+                set_int(out, node->op == OP_BETWEEN ? res : !res);
+            }
+            return SQLITE_OK;
+        }
+
+        case OP_IN:
+        case OP_NOTIN:
+            return eval_in(s, node, out);
+
+        case OP_CASE:
+            return eval_case(s, node, out);
+
+        case OP_COALESCE:
+            for (int i = 0; i < node->nargs; i++) {
+                if (eval_arg(s, node, i, out) != SQLITE_OK) {
+                    return EXPR_FALLBACK;
+                }
+                if (out->type != SQLITE_NULL) {
+                    break;
+                }
+            }
+            return SQLITE_OK;
+
+        case OP_NULLIF:
+            if (eval_arg(s, node, 0, out) != SQLITE_OK || eval_arg(s, node, 1, &b) != SQLITE_OK) {
+                return EXPR_FALLBACK;
+            }
+            if (compare(out, &b) == 0) {
+                set_null(out);
+            }
+            return SQLITE_OK;
+
+        case OP_IIF:
+            if (eval_truth(s, node, 0, &ta) != SQLITE_OK) {
+                return EXPR_FALLBACK;
+            }
+            return eval_arg(s, node, ta == 1 ? 1 : 2, out);
+
+        case OP_MIN:
+        case OP_MAX:
+            return eval_minmax(s, node, out);
+    }
+    return EXPR_FALLBACK;
+}
+
+/*
+ * Evaluates the compiled expression with the arguments and sets the result.
+ * Returns SQLITE_OK on success, or EXPR_FALLBACK if the call should run
+ * as a statement (the result is not set then).
+ */
+int define_expr_eval(const define_expr* expr, sqlite3_context* ctx, sqlite3_value** argv) {
+    expr_state s;
+    s.expr = expr;
+    s.argv = argv;
+    s.nallocs = 0;
+    expr_value v;
+    int ret = eval(&s, expr->root, &v);
+    if (ret == SQLITE_OK) {
+        switch (v.type) {
+            case SQLITE_INTEGER:
+                sqlite3_result_int64(ctx, v.i);
+                break;
+            case SQLITE_FLOAT:
+                sqlite3_result_double(ctx, v.r);
+                break;
+            case SQLITE_TEXT:
+                sqlite3_result_text(ctx, v.z, v.n, SQLITE_TRANSIENT);
+                break;
+            case SQLITE_BLOB:
+                if (v.n == 0) {
+                    // the empty blob has no data pointer, and NULL data means NULL
+                    sqlite3_result_zeroblob(ctx, 0);
+                } else {
+                    sqlite3_result_blob(ctx, v.z, v.n, SQLITE_TRANSIENT);
+                }
+                break;
+            default:
+                sqlite3_result_null(ctx);
+                break;
+        }
+    }
+    for (int i = 0; i < s.nallocs; i++) {
+        sqlite3_free(s.allocs[i]);
+    }
+    return ret;
+}
+
+#pragma endregion
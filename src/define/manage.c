@@ -10,81 +10,41 @@
 #include "sqlite3ext.h"
 SQLITE_EXTENSION_INIT3
 
-#define DEFINE_CACHE 2
+#include "define/define.h"
 
-#pragma region statement cache
-
-typedef struct cache_node {
-    sqlite3_stmt* stmt;
-    struct cache_node* next;
-} cache_node;
-
-static cache_node* cache_head = NULL;
-static cache_node* cache_tail = NULL;
-static bool cache_freed = false;
-
-static int cache_add(sqlite3_stmt* stmt) {
-    if (cache_head == NULL) {
-        cache_head = (cache_node*)malloc(sizeof(cache_node));
-        if (cache_head == NULL) {
-            return SQLITE_ERROR;
-        }
-        cache_head->stmt = stmt;
-        cache_head->next = NULL;
-        cache_tail = cache_head;
-        return SQLITE_OK;
-    }
-    cache_tail->next = (cache_node*)malloc(sizeof(cache_node));
-    if (cache_tail->next == NULL) {
-        return SQLITE_ERROR;
-    }
-    cache_tail = cache_tail->next;
-    cache_tail->stmt = stmt;
-    cache_tail->next = NULL;
-    return SQLITE_OK;
-}
-
-static void cache_print() {
-    if (cache_freed) {
-        printf("cache is freed");
-        return;
-    }
-    if (cache_head == NULL) {
+/*
+ * Prints the pooled prepared statements and memoization statistics.
+ */
+static void define_cache(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    define_pool* pool = sqlite3_user_data(ctx);
+    if (pool->funcs == NULL) {
         printf("cache is empty");
         return;
     }
-    cache_node* curr = cache_head;
-    while (curr != NULL) {
-        printf("%s\n", sqlite3_sql(curr->stmt));
-        curr = curr->next;
-    }
-}
-
-static void cache_free() {
-    if (cache_head == NULL) {
-        return;
-    }
-    cache_node* prev;
-    cache_node* curr = cache_head;
-    while (curr != NULL) {
-        sqlite3_finalize(curr->stmt);
-        prev = curr;
-        curr = curr->next;
-        free(prev);
+    for (define_func* func = pool->funcs; func != NULL; func = func->next) {
+        int nstmts = 0;
+        for (define_stmt* node = func->stmts; node != NULL; node = node->next) {
+            nstmts++;
+        }
+        printf("%s: %s\n", func->name, func->sql);
+        if (func->nparams < 0) {
+            printf("  not prepared yet\n");
+            continue;
+        }
+        printf("  statements: %d, prepare time: %.3f ms\n", nstmts, func->prepare_ns / 1e6);
+        if (func->expr != NULL) {
+            printf("  compiled expression\n");
+        }
+        if (func->memo != NULL) {
+            int size;
+            sqlite3_int64 hits, misses;
+            define_memo_stats(func->memo, &size, &hits, &misses);
+            printf("  memoized results: %d, hits: %lld, misses: %lld\n", size, (long long)hits,
+                   (long long)misses);
+        }
     }
-    cache_head = cache_tail = NULL;
-    cache_freed = true;
 }
 
-/*
- * Prints prepared statements cache contents.
- */
-static void define_cache(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    cache_print();
-}
-
-#pragma endregion
-
 /*
  * Saves user-defined function into the database.
  */
@@ -108,101 +68,47 @@ int define_save_function(sqlite3* db, const char* name, const char* type, const
     return SQLITE_OK;
 }
 
-// no cache at all
-#if DEFINE_CACHE == 0
-
 /*
- * Executes user-defined sql from the context.
+ * Executes a pooled prepared statement of the function from the context.
  */
 static void define_exec(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    int ret = SQLITE_OK;
-    char* sql = sqlite3_user_data(ctx);
-    sqlite3_stmt* stmt;
-    // sqlite3_close requires all prepared statements to be closed before destroying functions, so
-    // we have to re-create this every call
-    if ((ret = sqlite3_prepare_v2(sqlite3_context_db_handle(ctx), sql, -1, &stmt, NULL)) !=
-        SQLITE_OK) {
-        sqlite3_result_error_code(ctx, ret);
+    define_func* func = sqlite3_user_data(ctx);
+    if (func->expr != NULL && argc == func->nparams &&
+        define_expr_eval(func->expr, ctx, argv) == SQLITE_OK) {
+        // simple body, evaluated without the statement
         return;
     }
-    for (int i = 0; i < argc; i++)
-        if ((ret = sqlite3_bind_value(stmt, i + 1, argv[i])) != SQLITE_OK)
-            goto end;
-    if ((ret = sqlite3_step(stmt)) != SQLITE_ROW) {
-        if (ret == SQLITE_DONE)
-            ret = SQLITE_MISUSE;
-        goto end;
-    }
-    sqlite3_result_value(ctx, sqlite3_column_value(stmt, 0));
-
-end:
-    sqlite3_finalize(stmt);
-    if (ret != SQLITE_ROW)
-        sqlite3_result_error_code(ctx, ret);
-}
-
-/*
- * Creates user-defined function without caching the prepared statement.
- */
-static int define_create(sqlite3* db, const char* name, const char* body) {
-    char* sql = sqlite3_mprintf("select %s", body);
-    if (!sql) {
-        return SQLITE_NOMEM;
-    }
-
-    sqlite3_stmt* stmt;
-    int ret = sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, NULL);
-    if (ret != SQLITE_OK) {
-        sqlite3_free(sql);
-        return ret;
+    if (func->memo != NULL) {
+        sqlite3_value* cached = define_memo_get(func->memo, func->pool, argc, argv);
+        if (cached != NULL) {
+            sqlite3_result_value(ctx, cached);
+            return;
+        }
     }
-    int nparams = sqlite3_bind_parameter_count(stmt);
-    sqlite3_finalize(stmt);
-
-    return sqlite3_create_function_v2(db, name, nparams, SQLITE_UTF8, sql, define_exec, NULL, NULL,
-                                      sqlite3_free);
-}
-
-/*
- * Creates user-defined function and saves it to the database.
- */
-static void define_function(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    sqlite3* db = sqlite3_context_db_handle(ctx);
-    const char* name = (const char*)sqlite3_value_text(argv[0]);
-    const char* body = (const char*)sqlite3_value_text(argv[1]);
-    int ret;
-    if ((ret = define_create(db, name, body)) != SQLITE_OK) {
-        sqlite3_result_error_code(ctx, ret);
+    if (func->depth >= DEFINE_MAX_DEPTH) {
+        sqlite3_result_error(ctx, "too many nested calls of a defined function", -1);
         return;
     }
-    if ((ret = define_save_function(db, name, "scalar", body)) != SQLITE_OK) {
+    define_stmt* node;
+    int ret = define_func_acquire(func, &node);
+    if (ret != SQLITE_OK) {
+        sqlite3_result_error(ctx, sqlite3_errmsg(func->pool->db), -1);
         sqlite3_result_error_code(ctx, ret);
         return;
     }
-}
-
-/*
- * No-op as nothing is cached.
- */
-static void define_free(sqlite3_context* ctx, int argc, sqlite3_value** argv) {}
-
-// custom cache
-#elif DEFINE_CACHE == 2
-
-/*
- * Executes compiled prepared statement from the context.
- */
-static void define_exec(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    if (cache_freed) {
-        // Calling defined functions after define_free is not allowed.
-        sqlite3_result_error_code(ctx, SQLITE_MISUSE);
+    if (argc != func->nparams) {
+        // functions loaded from the database accept any number of arguments
+        // until the body is prepared, so check the number here
+        define_func_release(func, node);
+        char* msg = sqlite3_mprintf("wrong number of arguments to function %s()", func->name);
+        sqlite3_result_error(ctx, msg, -1);
+        sqlite3_free(msg);
         return;
     }
-    int ret = SQLITE_OK;
-    sqlite3_stmt* stmt = sqlite3_user_data(ctx);
+    sqlite3_stmt* stmt = node->stmt;
     for (int i = 0; i < argc; i++) {
         if ((ret = sqlite3_bind_value(stmt, i + 1, argv[i])) != SQLITE_OK) {
-            sqlite3_reset(stmt);
+            define_func_release(func, node);
             sqlite3_result_error_code(ctx, ret);
             return;
         }
@@ -210,81 +116,93 @@ static void define_exec(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
     if ((ret = sqlite3_step(stmt)) != SQLITE_ROW) {
         if (ret == SQLITE_DONE) {
             ret = SQLITE_MISUSE;
+        } else {
+            // pass the error (e.g. from a nested call) up to the caller
+            sqlite3_result_error(ctx, sqlite3_errmsg(func->pool->db), -1);
         }
-        sqlite3_reset(stmt);
+        define_func_release(func, node);
         sqlite3_result_error_code(ctx, ret);
         return;
     }
-    sqlite3_result_value(ctx, sqlite3_column_value(stmt, 0));
-    sqlite3_reset(stmt);
+    sqlite3_value* result = sqlite3_column_value(stmt, 0);
+    sqlite3_result_value(ctx, result);
+    if (func->memo != NULL) {
+        define_memo_put(func->memo, func->pool, argc, argv, result);
+    }
+    define_func_release(func, node);
 }
 
 /*
- * Creates user-defined function and caches the prepared statement.
+ * Creates user-defined function and adds it to the pool.
+ * If lazy is true, the body is prepared on the first call,
+ * otherwise it is prepared right away (and checked for errors).
+ * If memoize is true, the function caches its results.
  */
-static int define_create(sqlite3* db, const char* name, const char* body) {
+static int define_create(define_pool* pool,
+                         const char* name,
+                         const char* body,
+                         bool lazy,
+                         bool memoize) {
     char* sql = sqlite3_mprintf("select %s", body);
     if (!sql) {
         return SQLITE_NOMEM;
     }
-
-    sqlite3_stmt* stmt;
-    int ret = sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, NULL);
+    define_func* func = define_func_new(pool, name, sql);
     sqlite3_free(sql);
-    if (ret != SQLITE_OK) {
-        return ret;
+    if (func == NULL) {
+        return SQLITE_NOMEM;
     }
-    int nparams = sqlite3_bind_parameter_count(stmt);
-    // We are going to cache the statement in the function constructor and retrieve it later
-    // when executing the function, using sqlite3_user_data(). But relying on this internal cache
-    // is not enough.
-    //
-    // SQLite requires all prepared statements to be closed before calling the function destructor
-    // when closing the connection. So we can't close the statement in the function destructor.
-    // We have to cache it in the external cache and ask the user to manually free it
-    // before closing the connection.
-    //
-    // Alternatively, we can cache via the sqlite3_set_auxdata() with a negative slot,
-    // but that seems rather hacky.
-    if ((ret = cache_add(stmt)) != SQLITE_OK) {
-        return ret;
+    if (memoize && (func->memo = define_memo_new()) == NULL) {
+        define_func_free(func);
+        return SQLITE_NOMEM;
+    }
+
+    if (!lazy) {
+        define_stmt* node;
+        int ret = define_func_prepare(func, &node);
+        if (ret != SQLITE_OK) {
+            define_func_free(func);
+            return ret;
+        }
+        define_func_release(func, node);
     }
 
-    return sqlite3_create_function(db, name, nparams, SQLITE_UTF8, stmt, define_exec, NULL, NULL);
+    // SQLite frees the function (and its statements) when it is redefined,
+    // or if it fails to create it.
+    return sqlite3_create_function_v2(pool->db, name, func->nparams, SQLITE_UTF8, func,
+                                      define_exec, NULL, NULL, define_func_free);
 }
 
 /*
  * Creates compiled user-defined function and saves it to the database.
+ * The optional third argument turns on memoization.
  */
 static void define_function(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    if (cache_freed) {
-        // Calling defined functions after define_free is not allowed.
-        sqlite3_result_error_code(ctx, SQLITE_MISUSE);
-        return;
-    }
-    sqlite3* db = sqlite3_context_db_handle(ctx);
+    define_pool* pool = sqlite3_user_data(ctx);
     const char* name = (const char*)sqlite3_value_text(argv[0]);
     const char* body = (const char*)sqlite3_value_text(argv[1]);
+    bool memoize = argc == 3 && sqlite3_value_int(argv[2]) != 0;
     int ret;
-    if ((ret = define_create(db, name, body)) != SQLITE_OK) {
+    if ((ret = define_create(pool, name, body, false, memoize)) != SQLITE_OK) {
         sqlite3_result_error_code(ctx, ret);
         return;
     }
-    if ((ret = define_save_function(db, name, "scalar", body)) != SQLITE_OK) {
+    const char* type = memoize ? "memoized" : "scalar";
+    if ((ret = define_save_function(pool->db, name, type, body)) != SQLITE_OK) {
         sqlite3_result_error_code(ctx, ret);
         return;
     }
 }
 
 /*
- * Frees prepared statements compiled by user-defined functions.
+ * Frees prepared statements that are not in use.
+ * Not required before closing the connection, since the pool
+ * frees them automatically.
  */
 static void define_free(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    cache_free();
+    define_pool_clear(sqlite3_user_data(ctx));
 }
 
-#endif  // DEFINE_CACHE
-
 /*
  * Deletes user-defined function (scalar or table-valued)
  */
@@ -309,8 +227,11 @@ static void define_undefine(sqlite3_context* ctx, int argc, sqlite3_value** argv
 
 /*
  * Loads user-defined functions from the database.
+ * Does not prepare the function bodies, so that loading does not
+ * depend on the number of stored functions, only on the ones used.
  */
-static int define_load(sqlite3* db) {
+static int define_load(define_pool* pool) {
+    sqlite3* db = pool->db;
     char* sql =
         "create table if not exists sqlean_define"
         "(name text primary key, type text, body text)";
@@ -320,17 +241,20 @@ static int define_load(sqlite3* db) {
     }
 
     sqlite3_stmt* stmt;
-    sql = "select name, body from sqlean_define where type = 'scalar'";
+    sql = "select name, type, body from sqlean_define where type in ('scalar', 'memoized')";
     if ((ret = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL)) != SQLITE_OK) {
         return ret;
     }
 
     const char* name;
+    const char* type;
     const char* body;
     while (sqlite3_step(stmt) != SQLITE_DONE) {
         name = (const char*)sqlite3_column_text(stmt, 0);
-        body = (const char*)sqlite3_column_text(stmt, 1);
-        ret = define_create(db, name, body);
+        type = (const char*)sqlite3_column_text(stmt, 1);
+        body = (const char*)sqlite3_column_text(stmt, 2);
+        bool memoize = sqlite3_stricmp(type, "memoized") == 0;
+        ret = define_create(pool, name, body, true, memoize);
         if (ret != SQLITE_OK) {
             break;
         }
@@ -339,10 +263,19 @@ static int define_load(sqlite3* db) {
 }
 
 int define_manage_init(sqlite3* db) {
+    define_pool* pool = define_pool_open(db);
+    if (pool == NULL) {
+        return SQLITE_NOMEM;
+    }
     const int flags = SQLITE_UTF8 | SQLITE_DIRECTONLY;
-    sqlite3_create_function(db, "define", 2, flags, NULL, define_function, NULL, NULL);
-    sqlite3_create_function(db, "define_free", 0, flags, NULL, define_free, NULL, NULL);
-    sqlite3_create_function(db, "define_cache", 0, flags, NULL, define_cache, NULL, NULL);
+    sqlite3_create_function_v2(db, "define", 2, flags, define_pool_retain(pool), define_function,
+                               NULL, NULL, define_pool_release);
+    sqlite3_create_function_v2(db, "define", 3, flags, define_pool_retain(pool), define_function,
+                               NULL, NULL, define_pool_release);
+    sqlite3_create_function_v2(db, "define_free", 0, flags, define_pool_retain(pool), define_free,
+                               NULL, NULL, define_pool_release);
+    sqlite3_create_function_v2(db, "define_cache", 0, flags, define_pool_retain(pool),
+                               define_cache, NULL, NULL, define_pool_release);
     sqlite3_create_function(db, "undefine", 1, flags, NULL, define_undefine, NULL, NULL);
-    return define_load(db);
+    return define_load(pool);
 }
@@ -0,0 +1,291 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// Memoized results of defined functions.
+//
+// Each memoized function keeps a bounded LRU cache that maps the argument
+// values to the result. The cache is cleared on any write to the databases
+// of the connection (main, temp and attached ones): by this connection
+// (sqlite3_total_changes), by others (the data versions), or to the schema
+// by any connection (the schema versions). The state is checked on every
+// call, hit or miss, which costs a few pragma statements per call.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sqlite3ext.h"
+SQLITE_EXTENSION_INIT3
+
+#include "define/define.h"
+
+// Number of hash buckets, a power of 2.
+#define MEMO_BUCKETS 2048
+
+// Arguments are encoded into a key on the stack, longer keys are not cached.
+#define MEMO_KEY_BUF 256
+
+// Results longer than this are not cached.
+#define MEMO_MAX_VALUE 4096
+
+typedef struct memo_entry {
+    uint64_t hash;
+    sqlite3_value* value;
+    // next entry in the same bucket
+    struct memo_entry* chain;
+    // LRU list, the most recently used entry comes first
+    struct memo_entry* prev;
+    struct memo_entry* next;
+    int nkey;
+    char key[];
+} memo_entry;
+
+struct define_memo {
+    memo_entry* buckets[MEMO_BUCKETS];
+    memo_entry* head;
+    memo_entry* tail;
+    int size;
+    // database state the entries are valid for
+    int changes;
+    sqlite3_uint64 data_version;
+    sqlite3_int64 hits;
+    sqlite3_int64 misses;
+};
+
+// encode_key writes the argument types and values to buf, and returns
+// the key length (which may be larger than cap, then nothing is written).
+static int encode_key(int argc, sqlite3_value** argv, char* buf, int cap) {
+    int n = 0;
+    for (int i = 0; i < argc; i++) {
+        int type = sqlite3_value_type(argv[i]);
+        const void* data = NULL;
+        sqlite3_int64 ival;
+        double rval;
+        int size = 0;
+        switch (type) {
+            case SQLITE_INTEGER:
+                ival = sqlite3_value_int64(argv[i]);
+                data = &ival;
+                size = sizeof(ival);
+                break;
+            case SQLITE_FLOAT:
+                rval = sqlite3_value_double(argv[i]);
+                data = &rval;
+                size = sizeof(rval);
+                break;
+            case SQLITE_TEXT:
+                data = sqlite3_value_text(argv[i]);
+                size = sqlite3_value_bytes(argv[i]);
+                break;
+            case SQLITE_BLOB:
+                data = sqlite3_value_blob(argv[i]);
+                size = sqlite3_value_bytes(argv[i]);
+                break;
+        }
+        // type, length and value
+        if (n + 1 + (int)sizeof(size) + size <= cap) {
+            buf[n] = (char)type;
+            memcpy(buf + n + 1, &size, sizeof(size));
+            if (size > 0) {
+                memcpy(buf + n + 1 + sizeof(size), data, size);
+            }
+        }
+        n += 1 + (int)sizeof(size) + size;
+    }
+    return n;
+}
+
+// hash_key returns the FNV-1a hash of the key.
+static uint64_t hash_key(const char* key, int n) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < n; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// unlink_lru removes the entry from the LRU list.
+static void unlink_lru(define_memo* memo, memo_entry* entry) {
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        memo->head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    } else {
+        memo->tail = entry->prev;
+    }
+}
+
+// push_lru adds the entry to the front of the LRU list.
+static void push_lru(define_memo* memo, memo_entry* entry) {
+    entry->prev = NULL;
+    entry->next = memo->head;
+    if (memo->head != NULL) {
+        memo->head->prev = entry;
+    } else {
+        memo->tail = entry;
+    }
+    memo->head = entry;
+}
+
+// remove_entry removes the entry from the cache and frees it.
+static void remove_entry(define_memo* memo, memo_entry* entry) {
+    memo_entry** link = &memo->buckets[entry->hash & (MEMO_BUCKETS - 1)];
+    while (*link != entry) {
+        link = &(*link)->chain;
+    }
+    *link = entry->chain;
+    unlink_lru(memo, entry);
+    sqlite3_value_free(entry->value);
+    sqlite3_free(entry);
+    memo->size--;
+}
+
+// clear removes all the entries.
+static void clear(define_memo* memo) {
+    while (memo->head != NULL) {
+        remove_entry(memo, memo->head);
+    }
+}
+
+// check_state checks if the entries are valid for the current database state,
+// and clears them if they are not. Returns false if the entries can't be used.
+static bool check_state(define_memo* memo, define_pool* pool) {
+    int changes = sqlite3_total_changes(pool->db);
+    sqlite3_uint64 data_version;
+    if (!define_pool_data_version(pool, &data_version)) {
+        return false;
+    }
+    if (changes == memo->changes && data_version == memo->data_version) {
+        return true;
+    }
+    clear(memo);
+    memo->changes = changes;
+    memo->data_version = data_version;
+    return false;
+}
+
+// find returns the entry for the key, or NULL if there is none.
+static memo_entry* find(define_memo* memo, const char* key, int nkey, uint64_t hash) {
+    memo_entry* entry = memo->buckets[hash & (MEMO_BUCKETS - 1)];
+    for (; entry != NULL; entry = entry->chain) {
+        if (entry->hash == hash && entry->nkey == nkey && memcmp(entry->key, key, nkey) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Creates an empty cache.
+ */
+define_memo* define_memo_new(void) {
+    define_memo* memo = sqlite3_malloc(sizeof(*memo));
+    if (memo == NULL) {
+        return NULL;
+    }
+    memset(memo, 0, sizeof(*memo));
+    return memo;
+}
+
+/*
+ * Frees the cache with all its entries.
+ */
+void define_memo_free(define_memo* memo) {
+    if (memo == NULL) {
+        return;
+    }
+    clear(memo);
+    sqlite3_free(memo);
+}
+
+/*
+ * Returns the cached result for the arguments, or NULL if there is none
+ * (or if the database may have changed since the cache was filled).
+ */
+sqlite3_value* define_memo_get(define_memo* memo,
+                               define_pool* pool,
+                               int argc,
+                               sqlite3_value** argv) {
+    char buf[MEMO_KEY_BUF];
+    int nkey = encode_key(argc, argv, buf, sizeof(buf));
+    memo_entry* entry = NULL;
+    if (check_state(memo, pool) && nkey <= (int)sizeof(buf)) {
+        // longer keys are never cached
+        entry = find(memo, buf, nkey, hash_key(buf, nkey));
+    }
+    if (entry == NULL) {
+        memo->misses++;
+        return NULL;
+    }
+    memo->hits++;
+    unlink_lru(memo, entry);
+    push_lru(memo, entry);
+    return entry->value;
+}
+
+/*
+ * Caches the result for the arguments, evicting the least recently used
+ * entry if the cache is full. Does nothing if the database has changed
+ * since the lookup (e.g. the function body wrote to it).
+ */
+void define_memo_put(define_memo* memo,
+                     define_pool* pool,
+                     int argc,
+                     sqlite3_value** argv,
+                     sqlite3_value* result) {
+    if (!check_state(memo, pool)) {
+        return;
+    }
+    char buf[MEMO_KEY_BUF];
+    int nkey = encode_key(argc, argv, buf, sizeof(buf));
+    if (nkey > (int)sizeof(buf)) {
+        return;
+    }
+    int type = sqlite3_value_type(result);
+    if ((type == SQLITE_TEXT || type == SQLITE_BLOB) &&
+        sqlite3_value_bytes(result) > MEMO_MAX_VALUE) {
+        return;
+    }
+    uint64_t hash = hash_key(buf, nkey);
+    if (find(memo, buf, nkey, hash) != NULL) {
+        // a nested call with the same arguments got here first
+        return;
+    }
+
+    memo_entry* entry = sqlite3_malloc(sizeof(*entry) + nkey);
+    if (entry == NULL) {
+        return;
+    }
+    entry->value = sqlite3_value_dup(result);
+    if (entry->value == NULL) {
+        sqlite3_free(entry);
+        return;
+    }
+    entry->hash = hash;
+    entry->nkey = nkey;
+    memcpy(entry->key, buf, nkey);
+    memo_entry** bucket = &memo->buckets[hash & (MEMO_BUCKETS - 1)];
+    entry->chain = *bucket;
+    *bucket = entry;
+    push_lru(memo, entry);
+    memo->size++;
+    if (memo->size > DEFINE_MEMO_SIZE) {
+        remove_entry(memo, memo->tail);
+    }
+}
+
+/*
+ * Returns the number of cached results, cache hits and misses.
+ */
+void define_memo_stats(const define_memo* memo,
+                       int* size,
+                       sqlite3_int64* hits,
+                       sqlite3_int64* misses) {
+    *size = memo->size;
+    *hits = memo->hits;
+    *misses = memo->misses;
+}
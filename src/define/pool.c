@@ -0,0 +1,491 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// Per-connection pool of prepared statements for defined functions.
+
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#include <sys/timeb.h>
+#elif !defined(__STDC_VERSION__) || __STDC_VERSION__ < 201112L || \
+    (!defined(TIME_UTC) && (!defined(_POSIX_TIMERS) || _POSIX_TIMERS <= 0))
+#include <sys/time.h>
+#endif
+
+#include "sqlite3ext.h"
+SQLITE_EXTENSION_INIT3
+
+#include "define/define.h"
+
+#pragma region pool
+
+/*
+ * Increments the pool reference count.
+ */
+define_pool* define_pool_retain(define_pool* pool) {
+    pool->refs++;
+    return pool;
+}
+
+/*
+ * Decrements the pool reference count and frees the pool
+ * when nobody references it anymore.
+ */
+void define_pool_release(void* ptr) {
+    define_pool* pool = ptr;
+    pool->refs--;
+    if (pool->refs == 0) {
+        sqlite3_free(pool);
+    }
+}
+
+/*
+ * Finalizes the prepared statements that are not in use.
+ * Defined functions prepare them again when called.
+ */
+void define_pool_clear(define_pool* pool) {
+    for (define_func* func = pool->funcs; func != NULL; func = func->next) {
+        define_stmt** link = &func->stmts;
+        while (*link != NULL) {
+            define_stmt* node = *link;
+            if (node->busy) {
+                link = &node->next;
+                continue;
+            }
+            *link = node->next;
+            sqlite3_finalize(node->stmt);
+            sqlite3_free(node);
+        }
+    }
+    sqlite3_finalize(pool->schemas);
+    pool->schemas = NULL;
+    while (pool->versions != NULL) {
+        define_version* version = pool->versions;
+        pool->versions = version->next;
+        sqlite3_finalize(version->data_stmt);
+        sqlite3_finalize(version->schema_stmt);
+        sqlite3_free(version->schema);
+        sqlite3_free(version);
+    }
+}
+
+// prepare_pragma prepares the pragma statement for the database.
+static int prepare_pragma(define_pool* pool,
+                          const char* schema,
+                          const char* pragma,
+                          sqlite3_stmt** stmt) {
+    char* sql = sqlite3_mprintf("pragma \"%w\".%s", schema, pragma);
+    if (sql == NULL) {
+        return SQLITE_NOMEM;
+    }
+    int ret = sqlite3_prepare_v3(pool->db, sql, -1, SQLITE_PREPARE_PERSISTENT, stmt, NULL);
+    sqlite3_free(sql);
+    return ret;
+}
+
+// find_version returns the version statements for the database,
+// preparing them if there are none yet.
+static define_version* find_version(define_pool* pool, const char* schema) {
+    for (define_version* version = pool->versions; version != NULL; version = version->next) {
+        if (strcmp(version->schema, schema) == 0) {
+            return version;
+        }
+    }
+    define_version* version = sqlite3_malloc(sizeof(*version));
+    if (version == NULL) {
+        return NULL;
+    }
+    memset(version, 0, sizeof(*version));
+    version->schema = sqlite3_mprintf("%s", schema);
+    if (version->schema == NULL ||
+        prepare_pragma(pool, schema, "data_version", &version->data_stmt) != SQLITE_OK ||
+        prepare_pragma(pool, schema, "schema_version", &version->schema_stmt) != SQLITE_OK) {
+        sqlite3_finalize(version->data_stmt);
+        sqlite3_finalize(version->schema_stmt);
+        sqlite3_free(version->schema);
+        sqlite3_free(version);
+        return NULL;
+    }
+    version->next = pool->versions;
+    pool->versions = version;
+    return version;
+}
+
+// step_version runs the version pragma and returns its value, or -1 on failure.
+static sqlite3_int64 step_version(sqlite3_stmt* stmt) {
+    sqlite3_int64 value = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : -1;
+    sqlite3_reset(stmt);
+    return value;
+}
+
+/*
+ * Computes a number that changes when any database of the connection
+ * (main, temp or attached) is changed by another connection, when its
+ * schema is changed by any connection, or when a database is attached
+ * or detached. Runs 'pragma database_list' and two pragmas per database,
+ * so it costs a few microseconds per call.
+ * Returns false if the number can't be computed.
+ */
+bool define_pool_data_version(define_pool* pool, sqlite3_uint64* out) {
+    if (!pool->armed) {
+        // the statements would keep the connection open
+        return false;
+    }
+    if (pool->schemas == NULL &&
+        sqlite3_prepare_v3(pool->db, "pragma database_list", -1, SQLITE_PREPARE_PERSISTENT,
+                           &pool->schemas, NULL) != SQLITE_OK) {
+        return false;
+    }
+    // FNV-1a hash of the database names, files, data and schema versions
+    sqlite3_uint64 hash = 0xcbf29ce484222325ULL;
+    bool ok = true;
+    while (ok && sqlite3_step(pool->schemas) == SQLITE_ROW) {
+        const char* schema = (const char*)sqlite3_column_text(pool->schemas, 1);
+        define_version* version = schema != NULL ? find_version(pool, schema) : NULL;
+        if (version == NULL) {
+            ok = false;
+            break;
+        }
+        // the pragmas read the versions in a transaction of their own,
+        // so they see the changes committed since the last call;
+        // the data version ignores the changes by this connection,
+        // and sqlite3_total_changes ignores schema changes
+        sqlite3_int64 data_version = step_version(version->data_stmt);
+        sqlite3_int64 schema_version = step_version(version->schema_stmt);
+        if (data_version < 0 || schema_version < 0) {
+            ok = false;
+            break;
+        }
+        const unsigned char* file = sqlite3_column_text(pool->schemas, 2);
+        for (const unsigned char* c = (const unsigned char*)schema; *c != 0; c++) {
+            hash = (hash ^ *c) * 0x100000001b3ULL;
+        }
+        for (; file != NULL && *file != 0; file++) {
+            hash = (hash ^ *file) * 0x100000001b3ULL;
+        }
+        hash = (hash ^ (sqlite3_uint64)data_version) * 0x100000001b3ULL;
+        hash = (hash ^ (sqlite3_uint64)schema_version) * 0x100000001b3ULL;
+    }
+    sqlite3_reset(pool->schemas);
+    *out = hash;
+    return ok;
+}
+
+#pragma endregion
+
+#pragma region close hook
+
+// SQLite refuses to close a connection with unfinalized statements,
+// and destroys the functions only after checking for them. So the pooled
+// statements can't be finalized in the function destructors.
+//
+// Virtual tables, on the other hand, are disconnected before the check.
+// So the pool registers an eponymous virtual table and finalizes
+// the statements when SQLite disconnects it on close (the same way
+// FTS5 frees its internal statements).
+
+typedef struct {
+    sqlite3_vtab base;
+    define_pool* pool;
+} hook_vtab;
+
+static int hook_connect(sqlite3* db,
+                        void* aux,
+                        int argc,
+                        const char* const* argv,
+                        sqlite3_vtab** vtabptr,
+                        char** errptr) {
+    (void)argc;
+    (void)argv;
+    (void)errptr;
+    int ret = sqlite3_declare_vtab(db, "create table x(name text)");
+    if (ret != SQLITE_OK) {
+        return ret;
+    }
+    hook_vtab* vtab = sqlite3_malloc(sizeof(*vtab));
+    if (vtab == NULL) {
+        return SQLITE_NOMEM;
+    }
+    memset(vtab, 0, sizeof(*vtab));
+    vtab->pool = aux;
+    vtab->pool->armed = true;
+    *vtabptr = &vtab->base;
+    return SQLITE_OK;
+}
+
+static int hook_disconnect(sqlite3_vtab* base) {
+    hook_vtab* vtab = (hook_vtab*)base;
+    vtab->pool->armed = false;
+    define_pool_clear(vtab->pool);
+    sqlite3_free(vtab);
+    return SQLITE_OK;
+}
+
+static int hook_best_index(sqlite3_vtab* base, sqlite3_index_info* index_info) {
+    (void)base;
+    index_info->estimatedCost = 1;
+    index_info->estimatedRows = 0;
+    return SQLITE_OK;
+}
+
+static int hook_open(sqlite3_vtab* base, sqlite3_vtab_cursor** curptr) {
+    (void)base;
+    sqlite3_vtab_cursor* cur = sqlite3_malloc(sizeof(*cur));
+    if (cur == NULL) {
+        return SQLITE_NOMEM;
+    }
+    memset(cur, 0, sizeof(*cur));
+    *curptr = cur;
+    return SQLITE_OK;
+}
+
+static int hook_close(sqlite3_vtab_cursor* cur) {
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+static int hook_filter(sqlite3_vtab_cursor* cur,
+                       int idx_num,
+                       const char* idx_str,
+                       int argc,
+                       sqlite3_value** argv) {
+    (void)cur;
+    (void)idx_num;
+    (void)idx_str;
+    (void)argc;
+    (void)argv;
+    return SQLITE_OK;
+}
+
+static int hook_next(sqlite3_vtab_cursor* cur) {
+    (void)cur;
+    return SQLITE_OK;
+}
+
+static int hook_eof(sqlite3_vtab_cursor* cur) {
+    (void)cur;
+    return 1;
+}
+
+static int hook_column(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int col_idx) {
+    (void)cur;
+    (void)ctx;
+    (void)col_idx;
+    return SQLITE_OK;
+}
+
+static int hook_rowid(sqlite3_vtab_cursor* cur, sqlite_int64* rowid_ptr) {
+    (void)cur;
+    *rowid_ptr = 0;
+    return SQLITE_OK;
+}
+
+static sqlite3_module hook_module = {
+    .xConnect = hook_connect,
+    .xBestIndex = hook_best_index,
+    .xDisconnect = hook_disconnect,
+    .xOpen = hook_open,
+    .xClose = hook_close,
+    .xFilter = hook_filter,
+    .xNext = hook_next,
+    .xEof = hook_eof,
+    .xColumn = hook_column,
+    .xRowid = hook_rowid,
+};
+
+/*
+ * Connects the close hook virtual table, if it's not connected already.
+ * Preparing a statement that refers to the table is enough.
+ */
+static void define_pool_arm(define_pool* pool) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(pool->db, "select * from sqlean_define_pool", -1, &stmt, NULL) ==
+        SQLITE_OK) {
+        sqlite3_finalize(stmt);
+    }
+}
+
+/*
+ * Creates the statement pool for the connection.
+ * The connection owns the pool, and frees it on close.
+ */
+define_pool* define_pool_open(sqlite3* db) {
+    define_pool* pool = sqlite3_malloc(sizeof(*pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    memset(pool, 0, sizeof(*pool));
+    pool->db = db;
+    pool->refs = 1;
+    // on failure, sqlite3_create_module_v2 releases the pool itself
+    if (sqlite3_create_module_v2(db, "sqlean_define_pool", &hook_module, pool,
+                                 define_pool_release) != SQLITE_OK) {
+        return NULL;
+    }
+    define_pool_arm(pool);
+    return pool;
+}
+
+#pragma endregion
+
+#pragma region functions
+
+/*
+ * Creates a defined function and adds it to the pool.
+ * The body is prepared on the first call, or by define_func_prepare.
+ */
+define_func* define_func_new(define_pool* pool, const char* name, const char* sql) {
+    define_func* func = sqlite3_malloc(sizeof(*func));
+    char* name_copy = sqlite3_mprintf("%s", name);
+    char* sql_copy = sqlite3_mprintf("%s", sql);
+    if (func == NULL || name_copy == NULL || sql_copy == NULL) {
+        sqlite3_free(func);
+        sqlite3_free(name_copy);
+        sqlite3_free(sql_copy);
+        return NULL;
+    }
+
+    memset(func, 0, sizeof(*func));
+    func->pool = define_pool_retain(pool);
+    func->name = name_copy;
+    func->sql = sql_copy;
+    func->nparams = -1;
+    func->next = pool->funcs;
+    if (pool->funcs != NULL) {
+        pool->funcs->prev = func;
+    }
+    pool->funcs = func;
+    return func;
+}
+
+/*
+ * Finalizes the function statements and removes it from the pool.
+ * Used as the destructor for the SQLite function.
+ */
+void define_func_free(void* ptr) {
+    define_func* func = ptr;
+    define_stmt* node = func->stmts;
+    while (node != NULL) {
+        define_stmt* next = node->next;
+        sqlite3_finalize(node->stmt);
+        sqlite3_free(node);
+        node = next;
+    }
+    if (func->prev != NULL) {
+        func->prev->next = func->next;
+    } else {
+        func->pool->funcs = func->next;
+    }
+    if (func->next != NULL) {
+        func->next->prev = func->prev;
+    }
+    define_pool_release(func->pool);
+    define_expr_free(func->expr);
+    define_memo_free(func->memo);
+    sqlite3_free(func->name);
+    sqlite3_free(func->sql);
+    sqlite3_free(func);
+}
+
+// now_ns returns the current time in nanoseconds.
+static sqlite3_int64 now_ns(void) {
+    struct timespec ts;
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && defined(TIME_UTC) && \
+    !defined(__ANDROID__)
+    // C11.
+    timespec_get(&ts, TIME_UTC);
+#elif defined(_POSIX_TIMERS) && (_POSIX_TIMERS > 0)
+    // POSIX.
+    clock_gettime(CLOCK_REALTIME, &ts);
+#elif defined(_WIN32)
+    // Windows.
+    struct __timeb64 tb;
+    _ftime64(&tb);
+    ts.tv_sec = (time_t)tb.time;
+    ts.tv_nsec = tb.millitm * 1000000;
+#else
+    // Fallback for older systems.
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    ts.tv_sec = tv.tv_sec;
+    ts.tv_nsec = tv.tv_usec * 1000;
+#endif
+    return (sqlite3_int64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Prepares a new statement for the function body and adds it to the pool
+ * as busy. Adds the time it took to the function statistics.
+ * The first time, also compiles the body if it's a simple expression.
+ */
+int define_func_prepare(define_func* func, define_stmt** out) {
+    define_pool* pool = func->pool;
+    if (!pool->armed) {
+        // the statements were freed by a failed sqlite3_close,
+        // so the close hook needs to be connected again
+        define_pool_arm(pool);
+    }
+
+    define_stmt* node = sqlite3_malloc(sizeof(*node));
+    if (node == NULL) {
+        return SQLITE_NOMEM;
+    }
+    sqlite3_int64 start = now_ns();
+    int ret = sqlite3_prepare_v3(pool->db, func->sql, -1, SQLITE_PREPARE_PERSISTENT, &node->stmt,
+                                 NULL);
+    if (ret == SQLITE_OK && func->nparams < 0) {
+        func->expr = define_expr_compile(node->stmt);
+    }
+    func->prepare_ns += now_ns() - start;
+    if (ret != SQLITE_OK) {
+        sqlite3_free(node);
+        return ret;
+    }
+    func->nparams = sqlite3_bind_parameter_count(node->stmt);
+    node->busy = true;
+    node->next = func->stmts;
+    func->stmts = node;
+    func->depth++;
+    *out = node;
+    return SQLITE_OK;
+}
+
+/*
+ * Checks out a prepared statement that is not in use by another
+ * (outer) call of the same function, or prepares a new one.
+ */
+int define_func_acquire(define_func* func, define_stmt** out) {
+    for (define_stmt* node = func->stmts; node != NULL; node = node->next) {
+        if (!node->busy) {
+            node->busy = true;
+            func->depth++;
+            *out = node;
+            return SQLITE_OK;
+        }
+    }
+    return define_func_prepare(func, out);
+}
+
+/*
+ * Resets the statement and returns it to the pool.
+ */
+void define_func_release(define_func* func, define_stmt* node) {
+    sqlite3_reset(node->stmt);
+    node->busy = false;
+    func->depth--;
+    if (func->pool->armed) {
+        return;
+    }
+    // without the close hook, the statement would keep the connection open
+    define_stmt** link = &func->stmts;
+    while (*link != node) {
+        link = &(*link)->next;
+    }
+    *link = node->next;
+    sqlite3_finalize(node->stmt);
+    sqlite3_free(node);
+}
+
+#pragma endregion
@@ -0,0 +1,247 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+/*
+ * Aho-Corasick automaton for finding many literal strings in one pass.
+ *
+ * The automaton is a trie of the words with failure links, so the text
+ * is scanned once regardless of the number of words. Transitions are
+ * stored sparsely, except for the root, which has a transition for every
+ * byte to quickly skip the text that does not start any word.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "regexp/ahocorasick.h"
+#include "regexp/chars.h"
+
+struct AcState {
+    // outgoing transitions, sorted by byte
+    uint8_t* bytes;
+    int32_t* targets;
+    int32_t nedges;
+    int32_t edges_cap;
+    // state for the longest proper suffix that is in the trie
+    int32_t fail;
+    // first word id reported by this state, or -1
+    int32_t output;
+    // nearest state reachable by failure links that reports words, or -1
+    int32_t dict;
+};
+
+struct AcOutput {
+    int32_t id;
+    int32_t next;
+};
+
+// find_edge returns the target of the state's transition on the byte, or -1.
+static int32_t find_edge(const AcState* state, uint8_t c) {
+    int32_t lo = 0;
+    int32_t hi = state->nedges;
+    while (lo < hi) {
+        int32_t mid = (lo + hi) / 2;
+        if (state->bytes[mid] < c) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < state->nedges && state->bytes[lo] == c) {
+        return state->targets[lo];
+    }
+    return -1;
+}
+
+// add_state appends an empty state and returns its index, or -1 if out of memory.
+static int32_t add_state(AhoCorasick* ac) {
+    if (ac->nstates == ac->states_cap) {
+        size_t cap = ac->states_cap * 2;
+        AcState* states = realloc(ac->states, cap * sizeof(AcState));
+        if (states == NULL) {
+            return -1;
+        }
+        ac->states = states;
+        ac->states_cap = cap;
+    }
+    AcState* state = &ac->states[ac->nstates];
+    memset(state, 0, sizeof(AcState));
+    state->output = -1;
+    state->dict = -1;
+    return (int32_t)ac->nstates++;
+}
+
+// add_edge adds a transition from the state on the byte, keeping the edges sorted.
+// Returns 0 on success, -1 if out of memory.
+static int add_edge(AcState* state, uint8_t c, int32_t target) {
+    if (state->nedges == state->edges_cap) {
+        int32_t cap = state->edges_cap == 0 ? 2 : state->edges_cap * 2;
+        uint8_t* bytes = realloc(state->bytes, cap);
+        if (bytes == NULL) {
+            return -1;
+        }
+        state->bytes = bytes;
+        int32_t* targets = realloc(state->targets, cap * sizeof(int32_t));
+        if (targets == NULL) {
+            return -1;
+        }
+        state->targets = targets;
+        state->edges_cap = cap;
+    }
+    int32_t pos = state->nedges;
+    while (pos > 0 && state->bytes[pos - 1] > c) {
+        state->bytes[pos] = state->bytes[pos - 1];
+        state->targets[pos] = state->targets[pos - 1];
+        pos--;
+    }
+    state->bytes[pos] = c;
+    state->targets[pos] = target;
+    state->nedges++;
+    return 0;
+}
+
+// aho_corasick_new creates an automaton without any words.
+AhoCorasick* aho_corasick_new(void) {
+    AhoCorasick* ac = calloc(1, sizeof(AhoCorasick));
+    if (ac == NULL) {
+        return NULL;
+    }
+    ac->states_cap = 16;
+    ac->states = malloc(ac->states_cap * sizeof(AcState));
+    if (ac->states == NULL) {
+        free(ac);
+        return NULL;
+    }
+    add_state(ac);
+    return ac;
+}
+
+// aho_corasick_free frees the automaton.
+void aho_corasick_free(AhoCorasick* ac) {
+    if (ac == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < ac->nstates; i++) {
+        free(ac->states[i].bytes);
+        free(ac->states[i].targets);
+    }
+    free(ac->states);
+    free(ac->outputs);
+    free(ac);
+}
+
+// aho_corasick_add adds the word with the given id to the automaton.
+// The same word may be added with different ids.
+// Returns 0 on success, -1 if out of memory.
+int aho_corasick_add(AhoCorasick* ac, const char* word, size_t len, int32_t id) {
+    int32_t cur = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = fold(word[i]);
+        int32_t next = find_edge(&ac->states[cur], c);
+        if (next == -1) {
+            next = add_state(ac);
+            if (next == -1) {
+                return -1;
+            }
+            if (add_edge(&ac->states[cur], c, next) != 0) {
+                return -1;
+            }
+        }
+        cur = next;
+    }
+
+    if (ac->noutputs == ac->outputs_cap) {
+        size_t cap = ac->outputs_cap == 0 ? 16 : ac->outputs_cap * 2;
+        AcOutput* outputs = realloc(ac->outputs, cap * sizeof(AcOutput));
+        if (outputs == NULL) {
+            return -1;
+        }
+        ac->outputs = outputs;
+        ac->outputs_cap = cap;
+    }
+    ac->outputs[ac->noutputs].id = id;
+    ac->outputs[ac->noutputs].next = ac->states[cur].output;
+    ac->states[cur].output = (int32_t)ac->noutputs;
+    ac->noutputs++;
+    return 0;
+}
+
+// aho_corasick_build calculates the failure links after all the words are added.
+// Returns 0 on success, -1 if out of memory.
+int aho_corasick_build(AhoCorasick* ac) {
+    int32_t* queue = malloc(ac->nstates * sizeof(int32_t));
+    if (queue == NULL) {
+        return -1;
+    }
+    size_t head = 0;
+    size_t tail = 0;
+
+    AcState* root = &ac->states[0];
+    for (int c = 0; c < 256; c++) {
+        ac->root_next[c] = 0;
+    }
+    for (int32_t i = 0; i < root->nedges; i++) {
+        int32_t child = root->targets[i];
+        ac->root_next[root->bytes[i]] = child;
+        ac->states[child].fail = 0;
+        queue[tail++] = child;
+    }
+
+    // breadth-first, so that the failure state is always processed before
+    while (head < tail) {
+        int32_t cur = queue[head++];
+        AcState* state = &ac->states[cur];
+        for (int32_t i = 0; i < state->nedges; i++) {
+            uint8_t c = state->bytes[i];
+            int32_t child = state->targets[i];
+            int32_t fail = state->fail;
+            int32_t next;
+            while ((next = find_edge(&ac->states[fail], c)) == -1 && fail != 0) {
+                fail = ac->states[fail].fail;
+            }
+            fail = next == -1 ? 0 : next;
+            ac->states[child].fail = fail;
+            ac->states[child].dict =
+                ac->states[fail].output != -1 ? fail : ac->states[fail].dict;
+            queue[tail++] = child;
+        }
+    }
+
+    free(queue);
+    return 0;
+}
+
+// aho_corasick_scan calls `found` for every occurrence of every word in the text.
+// The same id may be reported several times.
+void aho_corasick_scan(AhoCorasick* ac,
+                       const char* text,
+                       size_t len,
+                       void (*found)(int32_t id, void* arg),
+                       void* arg) {
+    const AcState* states = ac->states;
+    int32_t cur = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = fold(text[i]);
+        if (cur == 0) {
+            cur = ac->root_next[c];
+            if (cur == 0) {
+                continue;
+            }
+        } else {
+            int32_t next;
+            while ((next = find_edge(&states[cur], c)) == -1 && cur != 0) {
+                cur = states[cur].fail;
+            }
+            cur = next == -1 ? 0 : next;
+        }
+
+        for (int32_t s = states[cur].output != -1 ? cur : states[cur].dict; s != -1;
+             s = states[s].dict) {
+            for (int32_t out = states[s].output; out != -1; out = ac->outputs[out].next) {
+                found(ac->outputs[out].id, arg);
+            }
+        }
+    }
+}
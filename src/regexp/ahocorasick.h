@@ -0,0 +1,40 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// Aho-Corasick automaton for finding many literal strings in one pass.
+
+#ifndef REGEXP_AHOCORASICK_H
+#define REGEXP_AHOCORASICK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct AcState AcState;
+typedef struct AcOutput AcOutput;
+
+// AhoCorasick finds all occurrences of a set of words in a text.
+// Words are matched ignoring ASCII case.
+typedef struct {
+    // state 0 is the root
+    AcState* states;
+    size_t nstates;
+    size_t states_cap;
+    // word ids reported by the states, chained by AcOutput.next
+    AcOutput* outputs;
+    size_t noutputs;
+    size_t outputs_cap;
+    // transitions from the root, for every byte
+    int32_t root_next[256];
+} AhoCorasick;
+
+AhoCorasick* aho_corasick_new(void);
+void aho_corasick_free(AhoCorasick* ac);
+int aho_corasick_add(AhoCorasick* ac, const char* word, size_t len, int32_t id);
+int aho_corasick_build(AhoCorasick* ac);
+void aho_corasick_scan(AhoCorasick* ac,
+                       const char* text,
+                       size_t len,
+                       void (*found)(int32_t id, void* arg),
+                       void* arg);
+
+#endif /* REGEXP_AHOCORASICK_H */
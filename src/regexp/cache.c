@@ -0,0 +1,308 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+/*
+ * Cache of compiled regular expressions.
+ *
+ * Statement-level auxdata only works for constant patterns.
+ * When patterns come from a column, the connection-level cache
+ * saves a pcre2_compile call per row.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "regexp/cache.h"
+#include "regexp/regexp.h"
+
+struct CacheEntry {
+    char* pattern;
+    size_t len;
+    uint32_t flags;
+    uint64_t hash;
+    Regexp* re;
+    // next entry in the same hash bucket
+    CacheEntry* next_in_bucket;
+    // neighbours in the least recently used list
+    CacheEntry* prev;
+    CacheEntry* next;
+};
+
+// hash calculates the FNV-1a hash of the pattern and flags.
+static uint64_t hash(const char* pattern, size_t len, uint32_t flags) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)pattern[i];
+        h *= 1099511628211ULL;
+    }
+    h ^= flags;
+    h *= 1099511628211ULL;
+    return h;
+}
+
+// nbuckets_for returns the number of hash buckets for a given capacity.
+static size_t nbuckets_for(size_t capacity) {
+    size_t n = 16;
+    while (n < capacity * 2) {
+        n *= 2;
+    }
+    return n;
+}
+
+// list_remove removes the entry from the least recently used list.
+static void list_remove(RegexpCache* cache, CacheEntry* entry) {
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+// list_push_front makes the entry the most recently used one.
+static void list_push_front(RegexpCache* cache, CacheEntry* entry) {
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head != NULL) {
+        cache->head->prev = entry;
+    }
+    cache->head = entry;
+    if (cache->tail == NULL) {
+        cache->tail = entry;
+    }
+}
+
+// bucket_remove removes the entry from its hash bucket.
+static void bucket_remove(RegexpCache* cache, CacheEntry* entry) {
+    CacheEntry** ptr = &cache->buckets[entry->hash & (cache->nbuckets - 1)];
+    while (*ptr != NULL) {
+        if (*ptr == entry) {
+            *ptr = entry->next_in_bucket;
+            return;
+        }
+        ptr = &(*ptr)->next_in_bucket;
+    }
+}
+
+// entry_free releases the entry's regexp and frees the entry.
+static void entry_free(CacheEntry* entry) {
+    regexp_free(entry->re);
+    free(entry->pattern);
+    free(entry);
+}
+
+// evict removes the least recently used entry from the cache.
+static void evict(RegexpCache* cache) {
+    CacheEntry* entry = cache->tail;
+    if (entry == NULL) {
+        return;
+    }
+    list_remove(cache, entry);
+    bucket_remove(cache, entry);
+    entry_free(entry);
+    cache->size--;
+}
+
+// regexp_cache_new creates a new cache with the given capacity.
+RegexpCache* regexp_cache_new(size_t capacity) {
+    RegexpCache* cache = calloc(1, sizeof(RegexpCache));
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->nbuckets = nbuckets_for(capacity);
+    cache->buckets = calloc(cache->nbuckets, sizeof(CacheEntry*));
+    if (cache->buckets == NULL) {
+        free(cache);
+        return NULL;
+    }
+    cache->match_ctx = pcre2_match_context_create(NULL);
+    if (cache->match_ctx == NULL) {
+        free(cache->buckets);
+        free(cache);
+        return NULL;
+    }
+    pcre2_config(PCRE2_CONFIG_MATCHLIMIT, &cache->match_limit);
+    pcre2_config(PCRE2_CONFIG_DEPTHLIMIT, &cache->depth_limit);
+    pcre2_config(PCRE2_CONFIG_HEAPLIMIT, &cache->heap_limit);
+    cache->capacity = capacity;
+    cache->refs = 1;
+    return cache;
+}
+
+// regexp_cache_retain adds a reference to the cache.
+RegexpCache* regexp_cache_retain(RegexpCache* cache) {
+    cache->refs++;
+    return cache;
+}
+
+// regexp_cache_free releases a reference to the cache,
+// and frees it along with all the cached regexps if there are no references left.
+void regexp_cache_free(RegexpCache* cache) {
+    if (cache == NULL) {
+        return;
+    }
+    cache->refs--;
+    if (cache->refs > 0) {
+        return;
+    }
+    while (cache->tail != NULL) {
+        evict(cache);
+    }
+    pcre2_match_context_free(cache->match_ctx);
+    free(cache->buckets);
+    free(cache);
+}
+
+// regexp_cache_resize changes the cache capacity, evicting entries if necessary.
+// Capacity of 0 disables the cache.
+// Returns 0 on success, -1 if out of memory.
+int regexp_cache_resize(RegexpCache* cache, size_t capacity) {
+    while (cache->size > capacity) {
+        evict(cache);
+    }
+
+    size_t nbuckets = nbuckets_for(capacity);
+    if (nbuckets != cache->nbuckets) {
+        CacheEntry** buckets = calloc(nbuckets, sizeof(CacheEntry*));
+        if (buckets == NULL) {
+            return -1;
+        }
+        for (CacheEntry* entry = cache->head; entry != NULL; entry = entry->next) {
+            size_t idx = entry->hash & (nbuckets - 1);
+            entry->next_in_bucket = buckets[idx];
+            buckets[idx] = entry;
+        }
+        free(cache->buckets);
+        cache->buckets = buckets;
+        cache->nbuckets = nbuckets;
+    }
+
+    cache->capacity = capacity;
+    return 0;
+}
+
+// regexp_cache_set_limits changes the resource limits for matching
+// the regexps compiled with the cache:
+//  - match_limit: maximum number of backtracking steps,
+//  - depth_limit: maximum backtracking depth,
+//  - heap_limit: maximum heap memory for backtracking, in kilobytes.
+// The limits apply to all the regexps at once, including the cached ones.
+void regexp_cache_set_limits(RegexpCache* cache,
+                             uint32_t match_limit,
+                             uint32_t depth_limit,
+                             uint32_t heap_limit) {
+    pcre2_set_match_limit(cache->match_ctx, match_limit);
+    pcre2_set_depth_limit(cache->match_ctx, depth_limit);
+    pcre2_set_heap_limit(cache->match_ctx, heap_limit);
+    cache->match_limit = match_limit;
+    cache->depth_limit = depth_limit;
+    cache->heap_limit = heap_limit;
+}
+
+// regexp_cache_get returns the cached regexp for the pattern and flags,
+// or NULL if there is none. The caller must release the returned regexp.
+Regexp* regexp_cache_get(RegexpCache* cache, const char* pattern, size_t len, uint32_t flags) {
+    uint64_t h = hash(pattern, len, flags);
+    CacheEntry* entry = cache->buckets[h & (cache->nbuckets - 1)];
+    for (; entry != NULL; entry = entry->next_in_bucket) {
+        if (entry->hash == h && entry->len == len && entry->flags == flags &&
+            memcmp(entry->pattern, pattern, len) == 0) {
+            break;
+        }
+    }
+    if (entry == NULL) {
+        cache->misses++;
+        return NULL;
+    }
+    cache->hits++;
+    if (cache->head != entry) {
+        list_remove(cache, entry);
+        list_push_front(cache, entry);
+    }
+    return regexp_retain(entry->re);
+}
+
+// regexp_cache_put adds the compiled regexp to the cache,
+// evicting the least recently used entry if the cache is full.
+// The cache takes its own reference to the regexp.
+void regexp_cache_put(RegexpCache* cache,
+                      const char* pattern,
+                      size_t len,
+                      uint32_t flags,
+                      Regexp* re) {
+    if (cache->capacity == 0) {
+        return;
+    }
+
+    CacheEntry* entry = malloc(sizeof(CacheEntry));
+    if (entry == NULL) {
+        return;
+    }
+    entry->pattern = malloc(len > 0 ? len : 1);
+    if (entry->pattern == NULL) {
+        free(entry);
+        return;
+    }
+    memcpy(entry->pattern, pattern, len);
+    entry->len = len;
+    entry->flags = flags;
+    entry->hash = hash(pattern, len, flags);
+    entry->re = regexp_retain(re);
+
+    if (cache->size >= cache->capacity) {
+        evict(cache);
+    }
+
+    size_t idx = entry->hash & (cache->nbuckets - 1);
+    entry->next_in_bucket = cache->buckets[idx];
+    cache->buckets[idx] = entry;
+    list_push_front(cache, entry);
+    cache->size++;
+}
+
+// regexp_cache_compile returns the cached regexp for the pattern,
+// or compiles the pattern and adds it to the cache.
+// The caller must release the returned regexp.
+// On failure, returns NULL and sets `errmsg` like regexp_compile does.
+Regexp* regexp_cache_compile(RegexpCache* cache,
+                             const char* pattern,
+                             size_t len,
+                             char** errmsg) {
+    Regexp* re = regexp_cache_get(cache, pattern, len, REGEXP_CACHE_TEXT);
+    if (re != NULL) {
+        return re;
+    }
+    re = regexp_compile(pattern, len, cache->match_ctx, errmsg);
+    if (re == NULL) {
+        return NULL;
+    }
+    regexp_cache_put(cache, pattern, len, REGEXP_CACHE_TEXT, re);
+    return re;
+}
+
+// regexp_cache_deserialize returns the cached regexp for the serialized data,
+// or deserializes the data and adds the regexp to the cache.
+// The caller must release the returned regexp.
+// On failure, returns NULL and sets `errmsg` like regexp_deserialize does.
+Regexp* regexp_cache_deserialize(RegexpCache* cache,
+                                 const uint8_t* data,
+                                 size_t size,
+                                 char** errmsg) {
+    Regexp* re = regexp_cache_get(cache, (const char*)data, size, REGEXP_CACHE_SERIALIZED);
+    if (re != NULL) {
+        return re;
+    }
+    re = regexp_deserialize(data, size, cache->match_ctx, errmsg);
+    if (re == NULL) {
+        return NULL;
+    }
+    regexp_cache_put(cache, (const char*)data, size, REGEXP_CACHE_SERIALIZED, re);
+    return re;
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// Cache of compiled regular expressions.
+
+#ifndef REGEXP_CACHE_H
+#define REGEXP_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "regexp/regexp.h"
+
+// Default number of compiled patterns kept in the cache.
+#define REGEXP_CACHE_SIZE 256
+
+// Kinds of cache keys: pattern text or serialized regexp.
+#define REGEXP_CACHE_TEXT 0
+#define REGEXP_CACHE_SERIALIZED 1
+
+typedef struct CacheEntry CacheEntry;
+
+// RegexpCache is a bounded LRU cache of compiled regexps,
+// keyed by pattern text and flags. It also holds the match context
+// with the resource limits, shared by the regexps of a connection.
+typedef struct {
+    // hash table buckets, number of buckets is a power of 2
+    CacheEntry** buckets;
+    size_t nbuckets;
+    // least recently used list, from the most recent to the least recent
+    CacheEntry* head;
+    CacheEntry* tail;
+    // number of entries and maximum number of entries
+    size_t size;
+    size_t capacity;
+    // lookup statistics
+    int64_t hits;
+    int64_t misses;
+    // match context and its resource limits
+    pcre2_match_context* match_ctx;
+    uint32_t match_limit;
+    uint32_t depth_limit;
+    uint32_t heap_limit;
+    // number of references to the cache (e.g. from registered functions)
+    int refs;
+} RegexpCache;
+
+RegexpCache* regexp_cache_new(size_t capacity);
+RegexpCache* regexp_cache_retain(RegexpCache* cache);
+void regexp_cache_free(RegexpCache* cache);
+int regexp_cache_resize(RegexpCache* cache, size_t capacity);
+void regexp_cache_set_limits(RegexpCache* cache,
+                             uint32_t match_limit,
+                             uint32_t depth_limit,
+                             uint32_t heap_limit);
+Regexp* regexp_cache_get(RegexpCache* cache, const char* pattern, size_t len, uint32_t flags);
+void regexp_cache_put(RegexpCache* cache,
+                      const char* pattern,
+                      size_t len,
+                      uint32_t flags,
+                      Regexp* re);
+Regexp* regexp_cache_compile(RegexpCache* cache,
+                             const char* pattern,
+                             size_t len,
+                             char** errmsg);
+Regexp* regexp_cache_deserialize(RegexpCache* cache,
+                                 const uint8_t* data,
+                                 size_t size,
+                                 char** errmsg);
+
+#endif /* REGEXP_CACHE_H */
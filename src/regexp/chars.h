@@ -0,0 +1,31 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// Byte-level character helpers shared by the regexp modules.
+
+#ifndef REGEXP_CHARS_H
+#define REGEXP_CHARS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// fold maps ASCII uppercase letters to lowercase.
+static inline uint8_t fold(uint8_t c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// utf8_char_len returns the length of the UTF-8 character starting with the byte.
+static inline size_t utf8_char_len(unsigned char c) {
+    if (c < 0xC0) {
+        return 1;
+    }
+    if (c < 0xE0) {
+        return 2;
+    }
+    if (c < 0xF0) {
+        return 3;
+    }
+    return 4;
+}
+
+#endif /* REGEXP_CHARS_H */
@@ -10,22 +10,131 @@
  *   - returns a substring of the source string that matches the pattern
  * regexp_replace(source, pattern, replacement)
  *   - replaces all matching substrings with the replacement string
+ * regexp_matches(source, pattern)
+ *   - finds all matches of the pattern in the source string
+ * regexp_split(source, pattern)
+ *   - splits the source string by the pattern matches
+ * regexp_compile(pattern)
+ *   - compiles the pattern and returns the serialized regexp
+ * regexp_from_compiled(data)
+ *   - loads the regexp serialized with regexp_compile()
+ * regexp_config(name[, value])
+ *   - returns or changes the extension setting
+ * regexp_stats(name)
+ *   - returns the extension statistics
+ * regexp_file_matches(path, pattern)
+ *   - finds all matches of the pattern in the file
+ * regexp_set_create(name, sql)
+ *   - creates a named set of patterns from the query results
+ * regexp_set_match(name, source)
+ *   - returns the ids of the set patterns matching the source string
+ * regexp_set_matches(name, source)
+ *   - finds all matches of all the set patterns
+ * regexp_index(table, column)
+ *   - trigram index to speed up regexp_like and LIKE queries
  *
  * Supports PCRE syntax, see docs/regexp.md
  *
  */
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "regexp/cache.h"
+#include "regexp/internal.h"
 #include "regexp/pcre2/pcre2.h"
 #include "regexp/regexp.h"
 
 #include "sqlite3ext.h"
 SQLITE_EXTENSION_INIT3
 
+/*
+ * Checks if the pattern value is NULL. The regexps loaded
+ * with regexp_from_compiled() are NULL values carrying a pointer.
+ */
+bool regexp_is_null(sqlite3_value* value) {
+    return sqlite3_value_type(value) == SQLITE_NULL &&
+           sqlite3_value_pointer(value, REGEXP_POINTER_TYPE) == NULL;
+}
+
+/*
+ * Returns the compiled regexp for the pattern value, which is either
+ * the pattern text or the regexp loaded with regexp_from_compiled().
+ * Looks up the connection-level cache first.
+ * The caller must release the returned regexp.
+ * On failure, returns NULL and sets `errmsg` like regexp_compile does.
+ */
+Regexp* regexp_from_value(RegexpCache* cache, sqlite3_value* value, char** errmsg) {
+    Regexp* re = sqlite3_value_pointer(value, REGEXP_POINTER_TYPE);
+    if (re != NULL) {
+        return regexp_retain(re);
+    }
+    if (sqlite3_value_type(value) == SQLITE_BLOB &&
+        regexp_is_serialized(sqlite3_value_blob(value), sqlite3_value_bytes(value))) {
+        // compiled code from an untrusted source could crash PCRE2,
+        // so it is only loaded explicitly
+        *errmsg = strdup("use regexp_from_compiled() to load the compiled regexp");
+        return NULL;
+    }
+    const char* pattern = (const char*)sqlite3_value_text(value);
+    if (pattern == NULL) {
+        *errmsg = NULL;
+        return NULL;
+    }
+    size_t pattern_len = sqlite3_value_bytes(value);
+    return regexp_cache_compile(cache, pattern, pattern_len, errmsg);
+}
+
+/*
+ * Returns the compiled regexp for the pattern argument with the given index.
+ * Looks up the statement-level auxdata first (constant patterns),
+ * then the connection-level cache (patterns from columns),
+ * and compiles the pattern if neither has it.
+ * Sets `is_new` if the caller should store the regexp in the auxdata.
+ * On failure, sets the error result and returns NULL.
+ */
+static Regexp* get_regexp(sqlite3_context* context, sqlite3_value** argv, int idx, bool* is_new) {
+    Regexp* re = sqlite3_get_auxdata(context, idx);
+    if (re != NULL) {
+        *is_new = false;
+        return re;
+    }
+
+    RegexpCache* cache = sqlite3_user_data(context);
+    char* msg = NULL;
+    re = regexp_from_value(cache, argv[idx], &msg);
+    if (re == NULL) {
+        if (msg == NULL) {
+            sqlite3_result_error_nomem(context);
+            return NULL;
+        }
+        sqlite3_result_error(context, msg, -1);
+        free(msg);
+        return NULL;
+    }
+    *is_new = true;
+    return re;
+}
+
+/*
+ * Sets the error result for the failed match.
+ * Matches that hit a resource limit fail with SQLITE_ABORT,
+ * so that they can be told apart from other errors.
+ */
+static void result_match_error(sqlite3_context* context, Regexp* re, int rc) {
+    if (rc == REGEXP_LIMIT_EXCEEDED) {
+        PCRE2_UCHAR buffer[256];
+        pcre2_get_error_message(re->error, buffer, sizeof(buffer));
+        sqlite3_result_error(context, (char*)buffer, -1);
+        sqlite3_result_error_code(context, SQLITE_ABORT);
+        return;
+    }
+    sqlite3_result_error(context, "invalid regexp pattern", -1);
+}
+
 /*
  * Checks if the source string matches the pattern.
  * regexp_statement(pattern, source)
@@ -34,7 +143,6 @@ SQLITE_EXTENSION_INIT3
  */
 static void fn_statement(sqlite3_context* context, int argc, sqlite3_value** argv) {
     const char* source;
-    const char* pattern;
     int is_match = 0;
 
     assert(argc == 2);
@@ -44,32 +152,25 @@ static void fn_statement(sqlite3_context* context, int argc, sqlite3_value** arg
         sqlite3_result_int(context, is_match);
         return;
     }
+    size_t source_len = sqlite3_value_bytes(argv[1]);
 
-    pattern = (const char*)sqlite3_value_text(argv[0]);
-    if (!pattern) {
+    if (regexp_is_null(argv[0])) {
         sqlite3_result_error(context, "missing regexp pattern", -1);
         return;
     }
 
     bool is_new_re = false;
-    pcre2_code* re = sqlite3_get_auxdata(context, 0);
+    Regexp* re = get_regexp(context, argv, 0, &is_new_re);
     if (re == NULL) {
-        re = regexp_compile(pattern);
-        if (re == NULL) {
-            char* msg = regexp_get_error(pattern);
-            sqlite3_result_error(context, msg, -1);
-            free(msg);
-            return;
-        }
-        is_new_re = true;
+        return;
     }
 
-    int rc = regexp_like(re, source);
-    if (rc == -1) {
+    int rc = regexp_like(re, source, source_len);
+    if (rc < 0) {
+        result_match_error(context, re, rc);
         if (is_new_re) {
             regexp_free(re);
         }
-        sqlite3_result_error(context, "invalid regexp pattern", -1);
         return;
     }
 
@@ -89,7 +190,6 @@ static void fn_statement(sqlite3_context* context, int argc, sqlite3_value** arg
  */
 static void fn_like(sqlite3_context* context, int argc, sqlite3_value** argv) {
     const char* source;
-    const char* pattern;
     int is_match = 0;
 
     assert(argc == 2);
@@ -99,32 +199,25 @@ static void fn_like(sqlite3_context* context, int argc, sqlite3_value** argv) {
         sqlite3_result_int(context, is_match);
         return;
     }
+    size_t source_len = sqlite3_value_bytes(argv[0]);
 
-    pattern = (const char*)sqlite3_value_text(argv[1]);
-    if (!pattern) {
+    if (regexp_is_null(argv[1])) {
         sqlite3_result_error(context, "missing regexp pattern", -1);
         return;
     }
 
     bool is_new_re = false;
-    pcre2_code* re = sqlite3_get_auxdata(context, 1);
+    Regexp* re = get_regexp(context, argv, 1, &is_new_re);
     if (re == NULL) {
-        re = regexp_compile(pattern);
-        if (re == NULL) {
-            char* msg = regexp_get_error(pattern);
-            sqlite3_result_error(context, msg, -1);
-            free(msg);
-            return;
-        }
-        is_new_re = true;
+        return;
     }
 
-    int rc = regexp_like(re, source);
-    if (rc == -1) {
+    int rc = regexp_like(re, source, source_len);
+    if (rc < 0) {
+        result_match_error(context, re, rc);
         if (is_new_re) {
             regexp_free(re);
         }
-        sqlite3_result_error(context, "invalid regexp pattern", -1);
         return;
     }
 
@@ -143,7 +236,6 @@ static void fn_like(sqlite3_context* context, int argc, sqlite3_value** argv) {
  */
 static void fn_substr(sqlite3_context* context, int argc, sqlite3_value** argv) {
     const char* source;
-    const char* pattern;
 
     assert(argc == 2);
 
@@ -151,45 +243,38 @@ static void fn_substr(sqlite3_context* context, int argc, sqlite3_value** argv)
     if (!source) {
         return;
     }
+    size_t source_len = sqlite3_value_bytes(argv[0]);
 
-    pattern = (const char*)sqlite3_value_text(argv[1]);
-    if (!pattern) {
+    if (regexp_is_null(argv[1])) {
         sqlite3_result_error(context, "missing regexp pattern", -1);
         return;
     }
 
     bool is_new_re = false;
-    pcre2_code* re = sqlite3_get_auxdata(context, 1);
+    Regexp* re = get_regexp(context, argv, 1, &is_new_re);
     if (re == NULL) {
-        re = regexp_compile(pattern);
-        if (re == NULL) {
-            char* msg = regexp_get_error(pattern);
-            sqlite3_result_error(context, msg, -1);
-            free(msg);
-            return;
-        }
-        is_new_re = true;
+        return;
     }
 
-    char* matched_str;
-    int rc = regexp_extract(re, source, 0, &matched_str);
-    if (rc == -1) {
+    const char* matched_str;
+    size_t matched_len;
+    int rc = regexp_extract(re, source, source_len, 0, &matched_str, &matched_len);
+    if (rc < 0) {
+        result_match_error(context, re, rc);
         if (is_new_re) {
             regexp_free(re);
         }
-        sqlite3_result_error(context, "invalid regexp pattern", -1);
         return;
     }
 
     if (rc == 0) {
         if (is_new_re) {
-            regexp_free(re);
+            sqlite3_set_auxdata(context, 1, re, (void (*)(void*))regexp_free);
         }
         return;
     }
 
-    sqlite3_result_text(context, matched_str, -1, SQLITE_TRANSIENT);
-    free(matched_str);
+    sqlite3_result_text(context, matched_str, matched_len, SQLITE_TRANSIENT);
 
     if (is_new_re) {
         sqlite3_set_auxdata(context, 1, re, (void (*)(void*))regexp_free);
@@ -204,7 +289,6 @@ static void fn_substr(sqlite3_context* context, int argc, sqlite3_value** argv)
  */
 static void fn_capture(sqlite3_context* context, int argc, sqlite3_value** argv) {
     const char* source;
-    const char* pattern;
 
     assert(argc == 2 || argc == 3);
 
@@ -212,9 +296,9 @@ static void fn_capture(sqlite3_context* context, int argc, sqlite3_value** argv)
     if (!source) {
         return;
     }
+    size_t source_len = sqlite3_value_bytes(argv[0]);
 
-    pattern = (const char*)sqlite3_value_text(argv[1]);
-    if (!pattern) {
+    if (regexp_is_null(argv[1])) {
         sqlite3_result_error(context, "missing regexp pattern", -1);
         return;
     }
@@ -229,43 +313,42 @@ static void fn_capture(sqlite3_context* context, int argc, sqlite3_value** argv)
     }
 
     bool is_new_re = false;
-    pcre2_code* re = sqlite3_get_auxdata(context, 1);
+    Regexp* re = get_regexp(context, argv, 1, &is_new_re);
     if (re == NULL) {
-        re = regexp_compile(pattern);
-        if (re == NULL) {
-            char* msg = regexp_get_error(pattern);
-            sqlite3_result_error(context, msg, -1);
-            free(msg);
-            return;
-        }
-        is_new_re = true;
+        return;
     }
 
-    char* matched_str;
-    int rc = regexp_extract(re, source, group_idx, &matched_str);
-    if (rc == -1) {
+    const char* matched_str;
+    size_t matched_len;
+    int rc = regexp_extract(re, source, source_len, group_idx, &matched_str, &matched_len);
+    if (rc < 0) {
+        result_match_error(context, re, rc);
         if (is_new_re) {
             regexp_free(re);
         }
-        sqlite3_result_error(context, "invalid regexp pattern", -1);
         return;
     }
 
     if (rc == 0) {
         if (is_new_re) {
-            regexp_free(re);
+            sqlite3_set_auxdata(context, 1, re, (void (*)(void*))regexp_free);
         }
         return;
     }
 
-    sqlite3_result_text(context, matched_str, -1, SQLITE_TRANSIENT);
-    free(matched_str);
+    sqlite3_result_text(context, matched_str, matched_len, SQLITE_TRANSIENT);
 
     if (is_new_re) {
         sqlite3_set_auxdata(context, 1, re, (void (*)(void*))regexp_free);
     }
 }
 
+// result_alloc allocates memory for a function result,
+// which SQLite then takes over and frees with sqlite3_free.
+static void* result_alloc(size_t size) {
+    return sqlite3_malloc64(size);
+}
+
 /*
  * Replaces all matching substrings with the replacement string.
  * regexp_replace(source, pattern, replacement)
@@ -273,7 +356,6 @@ static void fn_capture(sqlite3_context* context, int argc, sqlite3_value** argv)
  */
 static void fn_replace(sqlite3_context* context, int argc, sqlite3_value** argv) {
     const char* source;
-    const char* pattern;
     const char* replacement;
     char* result;
 
@@ -283,9 +365,9 @@ static void fn_replace(sqlite3_context* context, int argc, sqlite3_value** argv)
     if (!source) {
         return;
     }
+    size_t source_len = sqlite3_value_bytes(argv[0]);
 
-    pattern = (char*)sqlite3_value_text(argv[1]);
-    if (!pattern) {
+    if (regexp_is_null(argv[1])) {
         sqlite3_result_error(context, "missing regexp pattern", -1);
         return;
     }
@@ -295,52 +377,240 @@ static void fn_replace(sqlite3_context* context, int argc, sqlite3_value** argv)
         sqlite3_result_value(context, argv[0]);
         return;
     }
+    size_t replacement_len = sqlite3_value_bytes(argv[2]);
 
     bool is_new_re = false;
-    pcre2_code* re = sqlite3_get_auxdata(context, 1);
+    Regexp* re = get_regexp(context, argv, 1, &is_new_re);
     if (re == NULL) {
-        re = regexp_compile(pattern);
-        if (re == NULL) {
-            char* msg = regexp_get_error(pattern);
-            sqlite3_result_error(context, msg, -1);
-            free(msg);
-            return;
-        }
-        is_new_re = true;
+        return;
     }
 
-    int rc = regexp_replace(re, source, replacement, &result);
-    if (rc == -1) {
+    size_t result_len;
+    int rc = regexp_replace(re, source, source_len, replacement, replacement_len, result_alloc,
+                            sqlite3_free, &result, &result_len);
+    if (rc < 0) {
+        if (rc == -1) {
+            // the pattern is valid, so the output could not be allocated
+            sqlite3_result_error_nomem(context);
+        } else {
+            result_match_error(context, re, rc);
+        }
         if (is_new_re) {
             regexp_free(re);
         }
-        sqlite3_result_error(context, "invalid regexp pattern", -1);
         return;
     }
 
     if (rc == 0) {
+        sqlite3_result_value(context, argv[0]);
         if (is_new_re) {
-            regexp_free(re);
+            sqlite3_set_auxdata(context, 1, re, (void (*)(void*))regexp_free);
         }
-        sqlite3_result_value(context, argv[0]);
         return;
     }
 
-    sqlite3_result_text(context, result, -1, SQLITE_TRANSIENT);
-    free(result);
+    sqlite3_result_text64(context, result, result_len, sqlite3_free, SQLITE_UTF8);
 
     if (is_new_re) {
         sqlite3_set_auxdata(context, 1, re, (void (*)(void*))regexp_free);
     }
 }
 
+/*
+ * Compiles the pattern and returns the serialized regexp,
+ * which can be loaded with regexp_from_compiled() without compiling it again.
+ * regexp_compile(pattern)
+ * E.g.: select regexp_compile('a.c');
+ */
+static void fn_compile(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 1);
+
+    const char* pattern = (const char*)sqlite3_value_text(argv[0]);
+    if (!pattern) {
+        sqlite3_result_error(context, "missing regexp pattern", -1);
+        return;
+    }
+    size_t pattern_len = sqlite3_value_bytes(argv[0]);
+
+    size_t size;
+    char* msg = NULL;
+    uint8_t* data = regexp_serialize(pattern, pattern_len, &size, &msg);
+    if (data == NULL) {
+        if (msg == NULL) {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        sqlite3_result_error(context, msg, -1);
+        free(msg);
+        return;
+    }
+    sqlite3_result_blob64(context, data, size, free);
+}
+
+/*
+ * Loads the regexp serialized with regexp_compile(),
+ * to be passed to the other functions in place of the pattern.
+ * Not allowed in triggers and views, so that a database file
+ * cannot make the extension load crafted compiled code.
+ * regexp_from_compiled(data)
+ * E.g.: select regexp_like('abc', regexp_from_compiled(regexp_compile('a.c'))) = 1;
+ */
+static void fn_from_compiled(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 1);
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return;
+    }
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB) {
+        sqlite3_result_error(context, "compiled regexp must be a blob", -1);
+        return;
+    }
+    const uint8_t* data = sqlite3_value_blob(argv[0]);
+    size_t size = sqlite3_value_bytes(argv[0]);
+
+    RegexpCache* cache = sqlite3_user_data(context);
+    char* msg = NULL;
+    Regexp* re = regexp_cache_deserialize(cache, data, size, &msg);
+    if (re == NULL) {
+        if (msg == NULL) {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        sqlite3_result_error(context, msg, -1);
+        free(msg);
+        return;
+    }
+    sqlite3_result_pointer(context, re, REGEXP_POINTER_TYPE, (void (*)(void*))regexp_free);
+}
+
+/*
+ * Returns or changes the extension setting.
+ * regexp_config(name[, value])
+ * Supported settings:
+ *   - cache_size: maximum number of compiled patterns cached per connection.
+ *   - match_limit: maximum number of backtracking steps per match.
+ *   - depth_limit: maximum backtracking depth per match.
+ *   - heap_limit: maximum heap memory for backtracking per match, in kilobytes.
+ * Matches that hit a limit fail with SQLITE_ABORT.
+ * E.g.: select regexp_config('cache_size', 1000);
+ */
+static void fn_config(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 1 || argc == 2);
+
+    const char* name = (const char*)sqlite3_value_text(argv[0]);
+    if (!name) {
+        sqlite3_result_error(context, "missing setting name", -1);
+        return;
+    }
+
+    RegexpCache* cache = sqlite3_user_data(context);
+    if (strcmp(name, "cache_size") == 0) {
+        if (argc == 2) {
+            if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER || sqlite3_value_int64(argv[1]) < 0) {
+                sqlite3_result_error(context, "cache_size should be a non-negative integer", -1);
+                return;
+            }
+            if (regexp_cache_resize(cache, sqlite3_value_int64(argv[1])) != 0) {
+                sqlite3_result_error_nomem(context);
+                return;
+            }
+        }
+        sqlite3_result_int64(context, cache->capacity);
+        return;
+    }
+
+    uint32_t* limit = NULL;
+    if (strcmp(name, "match_limit") == 0) {
+        limit = &cache->match_limit;
+    } else if (strcmp(name, "depth_limit") == 0) {
+        limit = &cache->depth_limit;
+    } else if (strcmp(name, "heap_limit") == 0) {
+        limit = &cache->heap_limit;
+    }
+    if (limit != NULL) {
+        if (argc == 2) {
+            sqlite3_int64 value = sqlite3_value_int64(argv[1]);
+            if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER || value < 1 || value > UINT32_MAX) {
+                char* msg = sqlite3_mprintf("%s should be a positive 32-bit integer", name);
+                sqlite3_result_error(context, msg, -1);
+                sqlite3_free(msg);
+                return;
+            }
+            *limit = value;
+            regexp_cache_set_limits(cache, cache->match_limit, cache->depth_limit,
+                                    cache->heap_limit);
+        }
+        sqlite3_result_int64(context, *limit);
+        return;
+    }
+
+    sqlite3_result_error(context, "unknown setting", -1);
+}
+
+/*
+ * Returns the extension statistics.
+ * regexp_stats(name)
+ * Supported statistics:
+ *   - cache_entries: number of compiled patterns in the cache.
+ *   - cache_hits: number of times a compiled pattern was found in the cache.
+ *   - cache_misses: number of times a pattern had to be compiled.
+ * E.g.: select regexp_stats('cache_hits');
+ */
+static void fn_stats(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 1);
+
+    const char* name = (const char*)sqlite3_value_text(argv[0]);
+    if (!name) {
+        sqlite3_result_error(context, "missing statistic name", -1);
+        return;
+    }
+
+    RegexpCache* cache = sqlite3_user_data(context);
+    if (strcmp(name, "cache_entries") == 0) {
+        sqlite3_result_int64(context, cache->size);
+    } else if (strcmp(name, "cache_hits") == 0) {
+        sqlite3_result_int64(context, cache->hits);
+    } else if (strcmp(name, "cache_misses") == 0) {
+        sqlite3_result_int64(context, cache->misses);
+    } else {
+        sqlite3_result_error(context, "unknown statistic", -1);
+    }
+}
+
+// create_function registers a function that shares the connection-level regexp cache.
+static int create_function(sqlite3* db,
+                           const char* name,
+                           int nargs,
+                           int flags,
+                           RegexpCache* cache,
+                           void (*func)(sqlite3_context*, int, sqlite3_value**)) {
+    return sqlite3_create_function_v2(db, name, nargs, flags, regexp_cache_retain(cache), func, 0,
+                                      0, (void (*)(void*))regexp_cache_free);
+}
+
 int regexp_init(sqlite3* db) {
     static const int flags = SQLITE_UTF8 | SQLITE_DETERMINISTIC;
-    sqlite3_create_function(db, "regexp", 2, flags, 0, fn_statement, 0, 0);
-    sqlite3_create_function(db, "regexp_like", 2, flags, 0, fn_like, 0, 0);
-    sqlite3_create_function(db, "regexp_substr", 2, flags, 0, fn_substr, 0, 0);
-    sqlite3_create_function(db, "regexp_capture", 2, flags, 0, fn_capture, 0, 0);
-    sqlite3_create_function(db, "regexp_capture", 3, flags, 0, fn_capture, 0, 0);
-    sqlite3_create_function(db, "regexp_replace", 3, flags, 0, fn_replace, 0, 0);
+    RegexpCache* cache = regexp_cache_new(REGEXP_CACHE_SIZE);
+    if (cache == NULL) {
+        return SQLITE_NOMEM;
+    }
+    create_function(db, "regexp", 2, flags, cache, fn_statement);
+    create_function(db, "regexp_like", 2, flags, cache, fn_like);
+    create_function(db, "regexp_substr", 2, flags, cache, fn_substr);
+    create_function(db, "regexp_capture", 2, flags, cache, fn_capture);
+    create_function(db, "regexp_capture", 3, flags, cache, fn_capture);
+    create_function(db, "regexp_replace", 3, flags, cache, fn_replace);
+    sqlite3_create_function(db, "regexp_compile", 1, flags, 0, fn_compile, 0, 0);
+    create_function(db, "regexp_from_compiled", 1, flags | SQLITE_DIRECTONLY, cache,
+                    fn_from_compiled);
+    create_function(db, "regexp_config", 1, SQLITE_UTF8, cache, fn_config);
+    create_function(db, "regexp_config", 2, SQLITE_UTF8, cache, fn_config);
+    create_function(db, "regexp_stats", 1, SQLITE_UTF8, cache, fn_stats);
+    regexp_file_init(db, cache);
+    regexp_set_init(db, cache);
+    regexp_index_init(db, cache);
+    regexp_matches_init(db, cache);
+    // the functions hold their own references to the cache
+    regexp_cache_free(cache);
     return SQLITE_OK;
 }
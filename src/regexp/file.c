@@ -0,0 +1,488 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// regexp_file_matches(path, pattern)
+// Finds all matches of the pattern in the file with the specified path.
+// Reads the file in fixed-size chunks, so memory usage does not depend on the file size.
+// Implemented as a table-valued function.
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include "sqlite3ext.h"
+SQLITE_EXTENSION_INIT3
+
+#include "regexp/cache.h"
+#include "regexp/chars.h"
+#include "regexp/internal.h"
+#include "regexp/pcre2/pcre2.h"
+#include "regexp/regexp.h"
+
+// Number of bytes read from the file at once.
+#define CHUNK_SIZE 65536
+// Maximum buffer size. A match (or a partial match) longer than that is an error.
+#define MAX_BUFFER_SIZE (64 * CHUNK_SIZE)
+
+typedef struct {
+    sqlite3_vtab base;
+    RegexpCache* cache;
+} Table;
+
+typedef struct {
+    sqlite3_vtab_cursor base;
+    Regexp* re;
+    FILE* in;
+    // buffer with the current part of the file
+    char* buf;
+    size_t buf_size;
+    size_t buf_len;
+    // number of buffer bytes forming complete UTF-8 characters
+    size_t valid_len;
+    // file offset of the first buffer byte
+    sqlite3_int64 buf_offset;
+    // number of bytes to keep before the search position for lookbehinds
+    size_t keep;
+    // buffer position to start the next search from
+    size_t pos;
+    // file offset right after an empty match, where only a non-empty match is allowed
+    sqlite3_int64 notempty_at;
+    // true if the whole file has been read
+    bool file_eof;
+    // true if the buffer has been checked for UTF-8 validity
+    bool utf_checked;
+    // current match as buffer positions
+    size_t match_start;
+    size_t match_end;
+    bool eof;
+    sqlite3_int64 rowid;
+} Cursor;
+
+#define COLUMN_MATCH 0
+#define COLUMN_START 1
+#define COLUMN_END 2
+#define COLUMN_PATH 3
+#define COLUMN_PATTERN 4
+
+// utf8_complete_len returns the number of bytes in the buffer
+// that form complete UTF-8 characters.
+static size_t utf8_complete_len(const char* buf, size_t len) {
+    // look for the lead byte of the last character
+    size_t i = len;
+    size_t n = 0;
+    while (i > 0 && n < 4) {
+        i--;
+        n++;
+        unsigned char c = (unsigned char)buf[i];
+        if ((c & 0xC0) != 0x80) {
+            size_t char_len = 1;
+            if ((c & 0xE0) == 0xC0) {
+                char_len = 2;
+            } else if ((c & 0xF0) == 0xE0) {
+                char_len = 3;
+            } else if ((c & 0xF8) == 0xF0) {
+                char_len = 4;
+            }
+            return char_len > n ? i : len;
+        }
+    }
+    return len;
+}
+
+// refill discards the buffer bytes before `keep_from`
+// and reads the next chunk of the file into the buffer.
+// Returns SQLITE_OK on success, or an error code with the vtab error message set.
+static int refill(Cursor* cursor, size_t keep_from) {
+    sqlite3_vtab* vtable = cursor->base.pVtab;
+
+    if (keep_from > 0) {
+        memmove(cursor->buf, cursor->buf + keep_from, cursor->buf_len - keep_from);
+        cursor->buf_len -= keep_from;
+        cursor->buf_offset += keep_from;
+        cursor->pos -= keep_from;
+    }
+
+    if (cursor->buf_size - cursor->buf_len < CHUNK_SIZE) {
+        // the retained part of the buffer is a partial match
+        // that does not fit, so the buffer has to grow
+        size_t size = cursor->buf_size * 2;
+        if (size > MAX_BUFFER_SIZE) {
+            sqlite3_free(vtable->zErrMsg);
+            vtable->zErrMsg = sqlite3_mprintf("match is longer than %d bytes", MAX_BUFFER_SIZE);
+            return SQLITE_ERROR;
+        }
+        char* buf = realloc(cursor->buf, size);
+        if (buf == NULL) {
+            return SQLITE_NOMEM;
+        }
+        cursor->buf = buf;
+        cursor->buf_size = size;
+    }
+
+    size_t want = cursor->buf_size - cursor->buf_len;
+    size_t n = fread(cursor->buf + cursor->buf_len, 1, want, cursor->in);
+    if (n < want) {
+        if (ferror(cursor->in)) {
+            sqlite3_free(vtable->zErrMsg);
+            vtable->zErrMsg = sqlite3_mprintf("cannot read the file");
+            return SQLITE_ERROR;
+        }
+        cursor->file_eof = true;
+    }
+    cursor->buf_len += n;
+    cursor->valid_len = cursor->file_eof ? cursor->buf_len
+                                         : utf8_complete_len(cursor->buf, cursor->buf_len);
+    cursor->utf_checked = false;
+    return SQLITE_OK;
+}
+
+// keep_from returns the buffer position before which the bytes are no longer needed
+// to continue the search from the given position.
+static size_t keep_from(Cursor* cursor, size_t pos) {
+    return pos > cursor->keep ? pos - cursor->keep : 0;
+}
+
+// xconnect creates the virtual table.
+static int xconnect(sqlite3* db,
+                    void* aux,
+                    int argc,
+                    const char* const* argv,
+                    sqlite3_vtab** vtabptr,
+                    char** errptr) {
+    (void)argc;
+    (void)argv;
+    (void)errptr;
+
+    int rc = sqlite3_declare_vtab(
+        db, "CREATE TABLE x(match text, start integer, end integer, path hidden, pattern hidden)");
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    Table* table = sqlite3_malloc(sizeof(*table));
+    *vtabptr = (sqlite3_vtab*)table;
+    if (table == NULL) {
+        return SQLITE_NOMEM;
+    }
+    memset(table, 0, sizeof(*table));
+    table->cache = aux;
+    sqlite3_vtab_config(db, SQLITE_VTAB_DIRECTONLY);
+    return SQLITE_OK;
+}
+
+// xdisconnect destroys the virtual table.
+static int xdisconnect(sqlite3_vtab* vtable) {
+    Table* table = (Table*)vtable;
+    sqlite3_free(table);
+    return SQLITE_OK;
+}
+
+// xopen creates a new cursor.
+static int xopen(sqlite3_vtab* vtable, sqlite3_vtab_cursor** curptr) {
+    (void)vtable;
+    Cursor* cursor = sqlite3_malloc(sizeof(*cursor));
+    if (cursor == NULL) {
+        return SQLITE_NOMEM;
+    }
+    memset(cursor, 0, sizeof(*cursor));
+    *curptr = &cursor->base;
+    return SQLITE_OK;
+}
+
+// reset frees the resources used by the cursor.
+static void reset(Cursor* cursor) {
+    if (cursor->in != NULL) {
+        fclose(cursor->in);
+        cursor->in = NULL;
+    }
+    free(cursor->buf);
+    cursor->buf = NULL;
+    regexp_free(cursor->re);
+    cursor->re = NULL;
+}
+
+// xclose destroys the cursor.
+static int xclose(sqlite3_vtab_cursor* cur) {
+    Cursor* cursor = (Cursor*)cur;
+    reset(cursor);
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+// xnext advances the cursor to the next match.
+static int xnext(sqlite3_vtab_cursor* cur) {
+    Cursor* cursor = (Cursor*)cur;
+    sqlite3_vtab* vtable = cursor->base.pVtab;
+    size_t* ovector = pcre2_get_ovector_pointer(cursor->re->match_data);
+
+    for (;;) {
+        uint32_t options = 0;
+        if (!cursor->file_eof) {
+            // report a match that reaches the end of the buffer as partial,
+            // since the next chunk could extend or complete it
+            options |= PCRE2_PARTIAL_HARD;
+        }
+        if (cursor->buf_offset > 0) {
+            options |= PCRE2_NOTBOL;
+        }
+        if (cursor->utf_checked) {
+            options |= PCRE2_NO_UTF_CHECK;
+        }
+        bool retry = cursor->notempty_at == cursor->buf_offset + (sqlite3_int64)cursor->pos;
+        if (retry) {
+            // look for a non-empty match at the same position first
+            // (the same way regexp_find_next does)
+            options |= PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED;
+        }
+
+        int rc = pcre2_match(cursor->re->code, (PCRE2_SPTR8)cursor->buf, cursor->valid_len,
+                             cursor->pos, options, cursor->re->match_data, cursor->re->match_ctx);
+
+        if (rc >= 0) {
+            cursor->utf_checked = true;
+            cursor->match_start = ovector[0];
+            cursor->match_end = ovector[1];
+            cursor->pos = ovector[1];
+            if (ovector[0] == ovector[1]) {
+                cursor->notempty_at = cursor->buf_offset + ovector[1];
+            }
+            cursor->rowid++;
+            return SQLITE_OK;
+        }
+
+        if (rc == PCRE2_ERROR_PARTIAL) {
+            // keep the partial match and continue with the next chunk
+            cursor->utf_checked = true;
+            cursor->pos = ovector[0];
+            rc = refill(cursor, keep_from(cursor, cursor->pos));
+            if (rc != SQLITE_OK) {
+                return rc;
+            }
+            continue;
+        }
+
+        if (rc == PCRE2_ERROR_NOMATCH && retry) {
+            cursor->utf_checked = true;
+            if (cursor->pos < cursor->valid_len) {
+                // no non-empty match there, move on by one character
+                size_t len = utf8_char_len(cursor->buf[cursor->pos]);
+                cursor->pos = cursor->pos + len < cursor->valid_len ? cursor->pos + len
+                                                                     : cursor->valid_len;
+                cursor->notempty_at = -1;
+                continue;
+            }
+            if (cursor->file_eof) {
+                cursor->eof = true;
+                return SQLITE_OK;
+            }
+            // the next character is in the next chunk
+            rc = refill(cursor, keep_from(cursor, cursor->pos));
+            if (rc != SQLITE_OK) {
+                return rc;
+            }
+            continue;
+        }
+
+        if (rc == PCRE2_ERROR_NOMATCH) {
+            cursor->utf_checked = true;
+            if (cursor->file_eof) {
+                cursor->eof = true;
+                return SQLITE_OK;
+            }
+            // nothing to match in the current chunk, continue with the next one
+            cursor->pos = cursor->valid_len;
+            rc = refill(cursor, keep_from(cursor, cursor->valid_len));
+            if (rc != SQLITE_OK) {
+                return rc;
+            }
+            continue;
+        }
+
+        PCRE2_UCHAR buffer[256];
+        pcre2_get_error_message(rc, buffer, sizeof(buffer));
+        sqlite3_free(vtable->zErrMsg);
+        vtable->zErrMsg = sqlite3_mprintf("%s", buffer);
+        // resource limits (see regexp_config) fail with a distinct code
+        bool limit = rc == PCRE2_ERROR_MATCHLIMIT || rc == PCRE2_ERROR_DEPTHLIMIT ||
+                     rc == PCRE2_ERROR_HEAPLIMIT;
+        return limit ? SQLITE_ABORT : SQLITE_ERROR;
+    }
+}
+
+// xcolumn returns the current cursor value.
+static int xcolumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int col_idx) {
+    Cursor* cursor = (Cursor*)cur;
+    switch (col_idx) {
+        case COLUMN_MATCH:
+            sqlite3_result_text(ctx, cursor->buf + cursor->match_start,
+                                cursor->match_end - cursor->match_start, SQLITE_TRANSIENT);
+            break;
+
+        case COLUMN_START:
+            sqlite3_result_int64(ctx, cursor->buf_offset + cursor->match_start);
+            break;
+
+        case COLUMN_END:
+            sqlite3_result_int64(ctx, cursor->buf_offset + cursor->match_end);
+            break;
+
+        default:
+            break;
+    }
+    return SQLITE_OK;
+}
+
+// xrowid returns the rowid for the current row.
+static int xrowid(sqlite3_vtab_cursor* cur, sqlite_int64* rowid_ptr) {
+    Cursor* cursor = (Cursor*)cur;
+    *rowid_ptr = cursor->rowid;
+    return SQLITE_OK;
+}
+
+// xeof returns TRUE if the cursor has been moved off of the last row of output.
+static int xeof(sqlite3_vtab_cursor* cur) {
+    Cursor* cursor = (Cursor*)cur;
+    return cursor->eof;
+}
+
+// xfilter opens the file and finds the first match.
+static int xfilter(sqlite3_vtab_cursor* cur,
+                   int idx_num,
+                   const char* idx_str,
+                   int argc,
+                   sqlite3_value** argv) {
+    (void)idx_num;
+    (void)idx_str;
+
+    if (argc != 2) {
+        return SQLITE_ERROR;
+    }
+
+    Cursor* cursor = (Cursor*)cur;
+    sqlite3_vtab* vtable = (cursor->base).pVtab;
+    Table* table = (Table*)vtable;
+
+    // free resources from the previous file, if any
+    reset(cursor);
+    cursor->eof = true;
+
+    const char* path = (const char*)sqlite3_value_text(argv[0]);
+    if (path == NULL || regexp_is_null(argv[1])) {
+        return SQLITE_OK;
+    }
+
+    char* msg = NULL;
+    cursor->re = regexp_from_value(table->cache, argv[1], &msg);
+    if (cursor->re == NULL) {
+        if (msg == NULL) {
+            return SQLITE_NOMEM;
+        }
+        vtable->zErrMsg = sqlite3_mprintf("%s", msg);
+        free(msg);
+        return SQLITE_ERROR;
+    }
+
+#if defined(_WIN32)
+    extern LPWSTR sqlite3_win32_utf8_to_unicode(const char*);
+    LPWSTR wpath = sqlite3_win32_utf8_to_unicode(path);
+    if (wpath == NULL) {
+        return SQLITE_NOMEM;
+    }
+    cursor->in = _wfopen(wpath, L"rb");
+    sqlite3_free(wpath);
+#else
+    cursor->in = fopen(path, "rb");
+#endif
+    if (cursor->in == NULL) {
+        vtable->zErrMsg = sqlite3_mprintf("cannot open '%s' for reading", path);
+        return SQLITE_ERROR;
+    }
+
+    cursor->buf = malloc(CHUNK_SIZE);
+    if (cursor->buf == NULL) {
+        return SQLITE_NOMEM;
+    }
+    cursor->buf_size = CHUNK_SIZE;
+    cursor->buf_len = 0;
+    cursor->valid_len = 0;
+    cursor->buf_offset = 0;
+    cursor->pos = 0;
+    cursor->notempty_at = -1;
+    cursor->file_eof = false;
+    cursor->eof = false;
+    cursor->rowid = 0;
+
+    // keep up to 4 bytes per lookbehind character, and at least one character
+    // so that \b, \B and \A see the byte before the search position
+    uint32_t lookbehind = 0;
+    pcre2_pattern_info(cursor->re->code, PCRE2_INFO_MAXLOOKBEHIND, &lookbehind);
+    cursor->keep = 4 * (lookbehind > 0 ? lookbehind : 1);
+
+    int rc = refill(cursor, 0);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    return xnext(cur);
+}
+
+// xbest_index instructs SQLite to pass the path and pattern arguments to xFilter.
+static int xbest_index(sqlite3_vtab* vtable, sqlite3_index_info* index_info) {
+    int path_idx = -1;
+    int pattern_idx = -1;
+    for (int i = 0; i < index_info->nConstraint; i++) {
+        const struct sqlite3_index_constraint* constraint = index_info->aConstraint + i;
+        if (constraint->op != SQLITE_INDEX_CONSTRAINT_EQ) {
+            continue;
+        }
+        if (constraint->iColumn == COLUMN_PATH) {
+            if (!constraint->usable) {
+                return SQLITE_CONSTRAINT;
+            }
+            path_idx = i;
+        } else if (constraint->iColumn == COLUMN_PATTERN) {
+            if (!constraint->usable) {
+                return SQLITE_CONSTRAINT;
+            }
+            pattern_idx = i;
+        }
+    }
+
+    if (path_idx == -1 || pattern_idx == -1) {
+        vtable->zErrMsg = sqlite3_mprintf("regexp_file_matches() expects path and pattern");
+        return SQLITE_ERROR;
+    }
+
+    index_info->aConstraintUsage[path_idx].argvIndex = 1;
+    index_info->aConstraintUsage[path_idx].omit = 1;
+    index_info->aConstraintUsage[pattern_idx].argvIndex = 2;
+    index_info->aConstraintUsage[pattern_idx].omit = 1;
+    index_info->estimatedCost = (double)1000;
+    index_info->estimatedRows = 1000;
+    return SQLITE_OK;
+}
+
+static sqlite3_module file_module = {
+    .xConnect = xconnect,
+    .xBestIndex = xbest_index,
+    .xDisconnect = xdisconnect,
+    .xOpen = xopen,
+    .xClose = xclose,
+    .xFilter = xfilter,
+    .xNext = xnext,
+    .xEof = xeof,
+    .xColumn = xcolumn,
+    .xRowid = xrowid,
+};
+
+int regexp_file_init(sqlite3* db, RegexpCache* cache) {
+    sqlite3_create_module_v2(db, "regexp_file_matches", &file_module, regexp_cache_retain(cache),
+                             (void (*)(void*))regexp_cache_free);
+    return SQLITE_OK;
+}
@@ -0,0 +1,904 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// Trigram index over a text column, used to speed up regexp and LIKE queries.
+//
+// create virtual table logs_idx using regexp_index(logs, body);
+// select rowid, body from logs_idx where regexp_like(body, 'err.*disk');
+//
+// The index keeps a posting list (sorted row ids) for every trigram
+// (three consecutive bytes, ASCII case folded) of the column values.
+// A query extracts the trigrams that any match must contain from the
+// pattern, intersects their posting lists, and checks only the rows
+// from the intersection. Patterns without such trigrams scan all rows.
+//
+// The index is kept up to date by triggers on the base table,
+// created along with the virtual table. The triggers write to the
+// virtual table through the hidden command column named after it
+// (like FTS5 does): 'insert' adds the row, 'delete' removes it.
+// Other writes are rejected, as the rows live in the base table.
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sqlite3ext.h"
+SQLITE_EXTENSION_INIT3
+
+#include "regexp/cache.h"
+#include "regexp/chars.h"
+#include "regexp/internal.h"
+#include "regexp/literal.h"
+#include "regexp/pcre2/pcre2.h"
+#include "regexp/regexp.h"
+
+#define COLUMN_VALUE 0
+#define COLUMN_COMMAND 1
+
+// Query plans.
+#define PLAN_SCAN 0
+#define PLAN_ROWID 1
+#define PLAN_REGEXP 2
+#define PLAN_LIKE 3
+#define PLAN_GLOB 4
+
+// Maximum number of posting lists intersected in a query.
+// More trigrams filter out more rows, but each one costs a posting list scan.
+#define MAX_QUERY_TRIGRAMS 16
+
+typedef struct {
+    sqlite3_vtab base;
+    sqlite3* db;
+    RegexpCache* cache;
+    char* schema;
+    char* name;
+    char* table;
+    char* column;
+    // statements to add and remove posting list entries
+    sqlite3_stmt* insert_stmt;
+    sqlite3_stmt* delete_stmt;
+} Table;
+
+typedef struct {
+    sqlite3_vtab_cursor base;
+    // regexp to check the rows against, if any
+    Regexp* re;
+    // statement returning the current row (rowid and value)
+    sqlite3_stmt* row;
+    // all rows or the row with the given rowid
+    sqlite3_stmt* scan;
+    // candidate rows from the posting lists and the current id in each list
+    sqlite3_stmt** lists;
+    sqlite3_int64* list_ids;
+    int nlists;
+    bool lists_started;
+    // the candidate row by rowid
+    sqlite3_stmt* lookup;
+    bool eof;
+} Cursor;
+
+// Trigrams is a growable array of trigrams.
+typedef struct {
+    uint32_t* items;
+    size_t len;
+    size_t cap;
+    bool nomem;
+} Trigrams;
+
+// add_trigrams adds the trigrams of the string to the array.
+static void add_trigrams(Trigrams* trigrams, const char* str, size_t len) {
+    for (size_t i = 0; i + 3 <= len; i++) {
+        if (trigrams->len == trigrams->cap) {
+            size_t cap = trigrams->cap == 0 ? 64 : trigrams->cap * 2;
+            uint32_t* items = realloc(trigrams->items, cap * sizeof(uint32_t));
+            if (items == NULL) {
+                trigrams->nomem = true;
+                return;
+            }
+            trigrams->items = items;
+            trigrams->cap = cap;
+        }
+        uint32_t t = ((uint32_t)fold(str[i]) << 16) | ((uint32_t)fold(str[i + 1]) << 8) |
+                     (uint32_t)fold(str[i + 2]);
+        trigrams->items[trigrams->len++] = t;
+    }
+}
+
+// add_literal_trigrams adds the trigrams of the literal to the array.
+static void add_literal_trigrams(const char* lit, size_t len, void* arg) {
+    add_trigrams(arg, lit, len);
+}
+
+// compare_trigrams orders trigrams for qsort.
+static int compare_trigrams(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// uniq sorts the trigrams and removes duplicates.
+static void uniq(Trigrams* trigrams) {
+    if (trigrams->len == 0) {
+        return;
+    }
+    qsort(trigrams->items, trigrams->len, sizeof(uint32_t), compare_trigrams);
+    size_t n = 1;
+    for (size_t i = 1; i < trigrams->len; i++) {
+        if (trigrams->items[i] != trigrams->items[n - 1]) {
+            trigrams->items[n++] = trigrams->items[i];
+        }
+    }
+    trigrams->len = n;
+}
+
+// wildcard_trigrams adds the trigrams of the literal parts of a LIKE or GLOB pattern.
+static void wildcard_trigrams(Trigrams* trigrams, const char* pattern, size_t len, int plan) {
+    size_t start = 0;
+    size_t i = 0;
+    while (i < len) {
+        char c = pattern[i];
+        bool wildcard = plan == PLAN_LIKE ? (c == '%' || c == '_')
+                                          : (c == '*' || c == '?' || c == '[');
+        if (!wildcard) {
+            i++;
+            continue;
+        }
+        add_trigrams(trigrams, pattern + start, i - start);
+        if (c == '[') {
+            // skip the GLOB character class, where ']' right after
+            // the opening '[' (or '[^') is a class member
+            i++;
+            if (i < len && pattern[i] == '^') {
+                i++;
+            }
+            if (i < len && pattern[i] == ']') {
+                i++;
+            }
+            while (i < len && pattern[i] != ']') {
+                i++;
+            }
+        }
+        i++;
+        start = i;
+    }
+    if (start < len) {
+        add_trigrams(trigrams, pattern + start, len - start);
+    }
+}
+
+// dequote removes the quotes around the SQL identifier.
+// Returns a new string, which the caller must free with sqlite3_free.
+static char* dequote(const char* str) {
+    size_t len = strlen(str);
+    char quote = str[0];
+    if (len < 2 || (quote != '"' && quote != '\'' && quote != '`' && quote != '[')) {
+        return sqlite3_mprintf("%s", str);
+    }
+    char end = quote == '[' ? ']' : quote;
+    char* result = sqlite3_malloc64(len);
+    if (result == NULL) {
+        return NULL;
+    }
+    size_t n = 0;
+    for (size_t i = 1; i < len - 1; i++) {
+        result[n++] = str[i];
+        if (str[i] == end && str[i + 1] == end) {
+            // doubled quote
+            i++;
+        }
+    }
+    result[n] = '\0';
+    return result;
+}
+
+// table_free frees the virtual table.
+static void table_free(Table* table) {
+    sqlite3_finalize(table->insert_stmt);
+    sqlite3_finalize(table->delete_stmt);
+    regexp_cache_free(table->cache);
+    sqlite3_free(table->schema);
+    sqlite3_free(table->name);
+    sqlite3_free(table->table);
+    sqlite3_free(table->column);
+    sqlite3_free(table);
+}
+
+// table_new parses the module arguments and declares the virtual table.
+static int table_new(sqlite3* db,
+                     RegexpCache* cache,
+                     int argc,
+                     const char* const* argv,
+                     Table** tableptr,
+                     char** errptr) {
+    if (argc != 5) {
+        *errptr = sqlite3_mprintf("regexp_index() expects table and column names");
+        return SQLITE_ERROR;
+    }
+
+    Table* table = sqlite3_malloc(sizeof(*table));
+    if (table == NULL) {
+        return SQLITE_NOMEM;
+    }
+    memset(table, 0, sizeof(*table));
+    table->db = db;
+    table->cache = regexp_cache_retain(cache);
+    table->schema = sqlite3_mprintf("%s", argv[1]);
+    table->name = sqlite3_mprintf("%s", argv[2]);
+    table->table = dequote(argv[3]);
+    table->column = dequote(argv[4]);
+    if (table->schema == NULL || table->name == NULL || table->table == NULL ||
+        table->column == NULL) {
+        table_free(table);
+        return SQLITE_NOMEM;
+    }
+
+    char* sql =
+        sqlite3_mprintf("CREATE TABLE x(\"%w\", \"%w\" HIDDEN)", table->column, table->name);
+    if (sql == NULL) {
+        table_free(table);
+        return SQLITE_NOMEM;
+    }
+    int rc = sqlite3_declare_vtab(db, sql);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK) {
+        table_free(table);
+        return rc;
+    }
+    // the triggers on the base table modify the virtual table
+    sqlite3_vtab_config(db, SQLITE_VTAB_INNOCUOUS);
+
+    *tableptr = table;
+    return SQLITE_OK;
+}
+
+// remove_postings removes the row from the posting lists.
+static int remove_postings(Table* table, sqlite3_int64 id) {
+    if (table->delete_stmt == NULL) {
+        char* sql = sqlite3_mprintf("DELETE FROM \"%w\".\"%w_postings\" WHERE id = ?",
+                                    table->schema, table->name);
+        if (sql == NULL) {
+            return SQLITE_NOMEM;
+        }
+        int rc = sqlite3_prepare_v2(table->db, sql, -1, &table->delete_stmt, NULL);
+        sqlite3_free(sql);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+    }
+    sqlite3_bind_int64(table->delete_stmt, 1, id);
+    sqlite3_step(table->delete_stmt);
+    return sqlite3_reset(table->delete_stmt);
+}
+
+// add_postings adds the row to the posting lists of the value trigrams.
+static int add_postings(Table* table, sqlite3_int64 id, sqlite3_value* value) {
+    const char* text = (const char*)sqlite3_value_text(value);
+    if (text == NULL) {
+        return SQLITE_OK;
+    }
+    size_t len = sqlite3_value_bytes(value);
+
+    if (table->insert_stmt == NULL) {
+        char* sql = sqlite3_mprintf(
+            "INSERT OR IGNORE INTO \"%w\".\"%w_postings\"(trigram, id) VALUES (?, ?)",
+            table->schema, table->name);
+        if (sql == NULL) {
+            return SQLITE_NOMEM;
+        }
+        int rc = sqlite3_prepare_v2(table->db, sql, -1, &table->insert_stmt, NULL);
+        sqlite3_free(sql);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+    }
+
+    Trigrams trigrams = {0};
+    add_trigrams(&trigrams, text, len);
+    if (trigrams.nomem) {
+        free(trigrams.items);
+        return SQLITE_NOMEM;
+    }
+    uniq(&trigrams);
+
+    int rc = SQLITE_OK;
+    for (size_t i = 0; i < trigrams.len && rc == SQLITE_OK; i++) {
+        sqlite3_bind_int64(table->insert_stmt, 1, trigrams.items[i]);
+        sqlite3_bind_int64(table->insert_stmt, 2, id);
+        sqlite3_step(table->insert_stmt);
+        rc = sqlite3_reset(table->insert_stmt);
+    }
+    free(trigrams.items);
+    return rc;
+}
+
+// populate indexes the existing rows of the base table.
+static int populate(Table* table) {
+    char* sql = sqlite3_mprintf("SELECT rowid, \"%w\" FROM \"%w\".\"%w\"", table->column,
+                                table->schema, table->table);
+    if (sql == NULL) {
+        return SQLITE_NOMEM;
+    }
+    sqlite3_stmt* stmt;
+    int rc = sqlite3_prepare_v2(table->db, sql, -1, &stmt, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        rc = add_postings(table, sqlite3_column_int64(stmt, 0), sqlite3_column_value(stmt, 1));
+        if (rc != SQLITE_OK) {
+            break;
+        }
+    }
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
+// xcreate creates the virtual table along with the posting lists and triggers,
+// and indexes the existing rows.
+static int xcreate(sqlite3* db,
+                   void* aux,
+                   int argc,
+                   const char* const* argv,
+                   sqlite3_vtab** vtabptr,
+                   char** errptr) {
+    Table* table;
+    int rc = table_new(db, aux, argc, argv, &table, errptr);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    // the vtable is not visible yet, but the trigger bodies are only
+    // resolved when the triggers fire
+    char* sql = sqlite3_mprintf(
+        "CREATE TABLE \"%w\".\"%w_postings\"("
+        "trigram INTEGER, id INTEGER, PRIMARY KEY (trigram, id)) WITHOUT ROWID;"
+        "CREATE INDEX \"%w\".\"%w_postings_id\" ON \"%w_postings\"(id);"
+        "CREATE TRIGGER \"%w\".\"%w_insert\" AFTER INSERT ON \"%w\" BEGIN "
+        "INSERT INTO \"%w\"(\"%w\", rowid, \"%w\") VALUES ('insert', new.rowid, new.\"%w\"); "
+        "END;"
+        "CREATE TRIGGER \"%w\".\"%w_delete\" BEFORE DELETE ON \"%w\" BEGIN "
+        "INSERT INTO \"%w\"(\"%w\", rowid) VALUES ('delete', old.rowid); END;"
+        "CREATE TRIGGER \"%w\".\"%w_update_before\" BEFORE UPDATE ON \"%w\" BEGIN "
+        "INSERT INTO \"%w\"(\"%w\", rowid) VALUES ('delete', old.rowid); END;"
+        "CREATE TRIGGER \"%w\".\"%w_update_after\" AFTER UPDATE ON \"%w\" BEGIN "
+        "INSERT INTO \"%w\"(\"%w\", rowid, \"%w\") VALUES ('insert', new.rowid, new.\"%w\"); "
+        "END;",
+        table->schema, table->name, table->schema, table->name, table->name, table->schema,
+        table->name, table->table, table->name, table->name, table->column, table->column,
+        table->schema, table->name, table->table, table->name, table->name, table->schema,
+        table->name, table->table, table->name, table->name, table->schema, table->name,
+        table->table, table->name, table->name, table->column, table->column);
+    if (sql == NULL) {
+        table_free(table);
+        return SQLITE_NOMEM;
+    }
+    rc = sqlite3_exec(db, sql, NULL, NULL, errptr);
+    sqlite3_free(sql);
+    if (rc == SQLITE_OK) {
+        rc = populate(table);
+        if (rc != SQLITE_OK) {
+            *errptr = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+        }
+    }
+    if (rc != SQLITE_OK) {
+        table_free(table);
+        return rc;
+    }
+
+    *vtabptr = (sqlite3_vtab*)table;
+    return SQLITE_OK;
+}
+
+// xconnect connects to the existing virtual table.
+static int xconnect(sqlite3* db,
+                    void* aux,
+                    int argc,
+                    const char* const* argv,
+                    sqlite3_vtab** vtabptr,
+                    char** errptr) {
+    Table* table;
+    int rc = table_new(db, aux, argc, argv, &table, errptr);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    *vtabptr = (sqlite3_vtab*)table;
+    return SQLITE_OK;
+}
+
+// xdisconnect disconnects from the virtual table.
+static int xdisconnect(sqlite3_vtab* vtable) {
+    table_free((Table*)vtable);
+    return SQLITE_OK;
+}
+
+// xdestroy drops the virtual table along with the posting lists and triggers.
+static int xdestroy(sqlite3_vtab* vtable) {
+    Table* table = (Table*)vtable;
+    char* sql = sqlite3_mprintf(
+        "DROP TRIGGER IF EXISTS \"%w\".\"%w_insert\";"
+        "DROP TRIGGER IF EXISTS \"%w\".\"%w_delete\";"
+        "DROP TRIGGER IF EXISTS \"%w\".\"%w_update_before\";"
+        "DROP TRIGGER IF EXISTS \"%w\".\"%w_update_after\";"
+        "DROP TABLE IF EXISTS \"%w\".\"%w_postings\";",
+        table->schema, table->name, table->schema, table->name, table->schema, table->name,
+        table->schema, table->name, table->schema, table->name);
+    if (sql == NULL) {
+        return SQLITE_NOMEM;
+    }
+    // finalize the statements using the posting lists before dropping them
+    sqlite3_finalize(table->insert_stmt);
+    sqlite3_finalize(table->delete_stmt);
+    table->insert_stmt = NULL;
+    table->delete_stmt = NULL;
+    int rc = sqlite3_exec(table->db, sql, NULL, NULL, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    table_free(table);
+    return SQLITE_OK;
+}
+
+// xupdate runs the command from the triggers on the base table:
+// 'insert' adds the row to the index, 'delete' removes it.
+// The rows themselves stay in the base table, so other writes are rejected.
+static int xupdate(sqlite3_vtab* vtable,
+                   int argc,
+                   sqlite3_value** argv,
+                   sqlite_int64* rowid_ptr) {
+    Table* table = (Table*)vtable;
+    const char* command =
+        argc > 1 ? (const char*)sqlite3_value_text(argv[2 + COLUMN_COMMAND]) : NULL;
+    bool is_insert = command != NULL && strcmp(command, "insert") == 0;
+    bool is_delete = command != NULL && strcmp(command, "delete") == 0;
+    if (sqlite3_value_type(argv[0]) != SQLITE_NULL || (!is_insert && !is_delete)) {
+        sqlite3_free(vtable->zErrMsg);
+        vtable->zErrMsg = sqlite3_mprintf(
+            "regexp_index is read-only, modify the %s table instead", table->table);
+        return SQLITE_CONSTRAINT;
+    }
+    if (sqlite3_value_type(argv[1]) == SQLITE_NULL) {
+        sqlite3_free(vtable->zErrMsg);
+        vtable->zErrMsg = sqlite3_mprintf("regexp_index requires the rowid of the row");
+        return SQLITE_CONSTRAINT;
+    }
+    *rowid_ptr = sqlite3_value_int64(argv[1]);
+    int rc = is_insert ? add_postings(table, *rowid_ptr, argv[2 + COLUMN_VALUE])
+                       : remove_postings(table, *rowid_ptr);
+    if (rc != SQLITE_OK && rc != SQLITE_NOMEM) {
+        sqlite3_free(vtable->zErrMsg);
+        vtable->zErrMsg = sqlite3_mprintf("%s", sqlite3_errmsg(table->db));
+    }
+    return rc;
+}
+
+// xopen creates a new cursor.
+static int xopen(sqlite3_vtab* vtable, sqlite3_vtab_cursor** curptr) {
+    (void)vtable;
+    Cursor* cursor = sqlite3_malloc(sizeof(*cursor));
+    if (cursor == NULL) {
+        return SQLITE_NOMEM;
+    }
+    memset(cursor, 0, sizeof(*cursor));
+    *curptr = &cursor->base;
+    return SQLITE_OK;
+}
+
+// reset frees the resources used by the cursor.
+static void reset(Cursor* cursor) {
+    regexp_free(cursor->re);
+    cursor->re = NULL;
+    sqlite3_finalize(cursor->scan);
+    cursor->scan = NULL;
+    for (int i = 0; i < cursor->nlists; i++) {
+        sqlite3_finalize(cursor->lists[i]);
+    }
+    free(cursor->lists);
+    cursor->lists = NULL;
+    free(cursor->list_ids);
+    cursor->list_ids = NULL;
+    cursor->nlists = 0;
+    cursor->lists_started = false;
+    sqlite3_finalize(cursor->lookup);
+    cursor->lookup = NULL;
+    cursor->row = NULL;
+}
+
+// xclose destroys the cursor.
+static int xclose(sqlite3_vtab_cursor* cur) {
+    Cursor* cursor = (Cursor*)cur;
+    reset(cursor);
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+// step_list advances the posting list with the given index.
+static int step_list(Cursor* cursor, int idx) {
+    int rc = sqlite3_step(cursor->lists[idx]);
+    if (rc == SQLITE_ROW) {
+        cursor->list_ids[idx] = sqlite3_column_int64(cursor->lists[idx], 0);
+    }
+    return rc;
+}
+
+// next_candidate finds the next row id present in all the posting lists.
+// Returns SQLITE_ROW and sets the id, SQLITE_DONE if there are no more ids,
+// or an error code.
+static int next_candidate(Cursor* cursor, sqlite3_int64* id) {
+    int rc;
+    if (!cursor->lists_started) {
+        cursor->lists_started = true;
+        for (int i = 0; i < cursor->nlists; i++) {
+            if ((rc = step_list(cursor, i)) != SQLITE_ROW) {
+                return rc;
+            }
+        }
+    } else if ((rc = step_list(cursor, 0)) != SQLITE_ROW) {
+        return rc;
+    }
+
+    // posting lists are sorted by id, so advance each one
+    // up to the largest current id until they all agree
+    sqlite3_int64 target = cursor->list_ids[0];
+    int agreed = 0;
+    int i = 0;
+    while (agreed < cursor->nlists) {
+        while (cursor->list_ids[i] < target) {
+            if ((rc = step_list(cursor, i)) != SQLITE_ROW) {
+                return rc;
+            }
+        }
+        if (cursor->list_ids[i] > target) {
+            target = cursor->list_ids[i];
+            agreed = 1;
+        } else {
+            agreed++;
+        }
+        i = (i + 1) % cursor->nlists;
+    }
+    *id = target;
+    return SQLITE_ROW;
+}
+
+// next_row moves to the next row from the base table.
+// Returns SQLITE_ROW, SQLITE_DONE or an error code.
+static int next_row(Cursor* cursor) {
+    if (cursor->nlists == 0) {
+        cursor->row = cursor->scan;
+        return sqlite3_step(cursor->scan);
+    }
+    for (;;) {
+        sqlite3_int64 id;
+        int rc = next_candidate(cursor, &id);
+        if (rc != SQLITE_ROW) {
+            return rc;
+        }
+        sqlite3_reset(cursor->lookup);
+        sqlite3_bind_int64(cursor->lookup, 1, id);
+        rc = sqlite3_step(cursor->lookup);
+        if (rc != SQLITE_DONE) {
+            cursor->row = cursor->lookup;
+            return rc;
+        }
+        // the row is no longer in the base table
+    }
+}
+
+// xnext advances the cursor to the next matching row.
+static int xnext(sqlite3_vtab_cursor* cur) {
+    Cursor* cursor = (Cursor*)cur;
+    sqlite3_vtab* vtable = cursor->base.pVtab;
+    for (;;) {
+        int rc = next_row(cursor);
+        if (rc == SQLITE_DONE) {
+            cursor->eof = true;
+            return SQLITE_OK;
+        }
+        if (rc != SQLITE_ROW) {
+            Table* table = (Table*)vtable;
+            sqlite3_free(vtable->zErrMsg);
+            vtable->zErrMsg = sqlite3_mprintf("%s", sqlite3_errmsg(table->db));
+            return rc;
+        }
+        if (cursor->re == NULL) {
+            return SQLITE_OK;
+        }
+        const char* source = (const char*)sqlite3_column_text(cursor->row, 1);
+        if (source == NULL) {
+            continue;
+        }
+        size_t source_len = sqlite3_column_bytes(cursor->row, 1);
+        rc = regexp_like(cursor->re, source, source_len);
+        if (rc == REGEXP_LIMIT_EXCEEDED) {
+            PCRE2_UCHAR buffer[256];
+            pcre2_get_error_message(cursor->re->error, buffer, sizeof(buffer));
+            sqlite3_free(vtable->zErrMsg);
+            vtable->zErrMsg = sqlite3_mprintf("%s", buffer);
+            return SQLITE_ABORT;
+        }
+        if (rc == 1) {
+            return SQLITE_OK;
+        }
+    }
+}
+
+// xcolumn returns the current cursor value.
+static int xcolumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int col_idx) {
+    Cursor* cursor = (Cursor*)cur;
+    if (col_idx == COLUMN_VALUE) {
+        sqlite3_result_value(ctx, sqlite3_column_value(cursor->row, 1));
+    }
+    return SQLITE_OK;
+}
+
+// xrowid returns the rowid for the current row.
+static int xrowid(sqlite3_vtab_cursor* cur, sqlite_int64* rowid_ptr) {
+    Cursor* cursor = (Cursor*)cur;
+    *rowid_ptr = sqlite3_column_int64(cursor->row, 0);
+    return SQLITE_OK;
+}
+
+// xeof returns TRUE if the cursor has been moved off of the last row of output.
+static int xeof(sqlite3_vtab_cursor* cur) {
+    Cursor* cursor = (Cursor*)cur;
+    return cursor->eof;
+}
+
+// prepare prepares the statement, setting the error message on failure.
+static int prepare(Table* table, const char* sql, sqlite3_stmt** stmt) {
+    if (sql == NULL) {
+        return SQLITE_NOMEM;
+    }
+    int rc = sqlite3_prepare_v2(table->db, sql, -1, stmt, NULL);
+    if (rc != SQLITE_OK) {
+        sqlite3_free(table->base.zErrMsg);
+        table->base.zErrMsg = sqlite3_mprintf("%s", sqlite3_errmsg(table->db));
+    }
+    return rc;
+}
+
+// open_lists prepares the posting list statements for the trigrams.
+static int open_lists(Cursor* cursor, Table* table, Trigrams* trigrams) {
+    int n = trigrams->len < MAX_QUERY_TRIGRAMS ? (int)trigrams->len : MAX_QUERY_TRIGRAMS;
+    cursor->lists = calloc(n, sizeof(sqlite3_stmt*));
+    cursor->list_ids = calloc(n, sizeof(sqlite3_int64));
+    if (cursor->lists == NULL || cursor->list_ids == NULL) {
+        return SQLITE_NOMEM;
+    }
+
+    char* sql = sqlite3_mprintf("SELECT id FROM \"%w\".\"%w_postings\" WHERE trigram = ? ORDER BY id",
+                                table->schema, table->name);
+    for (int i = 0; i < n; i++) {
+        int rc = prepare(table, sql, &cursor->lists[i]);
+        if (rc != SQLITE_OK) {
+            sqlite3_free(sql);
+            return rc;
+        }
+        cursor->nlists++;
+        sqlite3_bind_int64(cursor->lists[i], 1, trigrams->items[i]);
+    }
+    sqlite3_free(sql);
+
+    sql = sqlite3_mprintf("SELECT rowid, \"%w\" FROM \"%w\".\"%w\" WHERE rowid = ?", table->column,
+                          table->schema, table->table);
+    int rc = prepare(table, sql, &cursor->lookup);
+    sqlite3_free(sql);
+    return rc;
+}
+
+// xfilter starts the query with the given plan.
+static int xfilter(sqlite3_vtab_cursor* cur,
+                   int idx_num,
+                   const char* idx_str,
+                   int argc,
+                   sqlite3_value** argv) {
+    (void)idx_str;
+    Cursor* cursor = (Cursor*)cur;
+    Table* table = (Table*)cursor->base.pVtab;
+
+    // free resources from the previous query, if any
+    reset(cursor);
+    cursor->eof = false;
+
+    Trigrams trigrams = {0};
+    if (idx_num == PLAN_REGEXP) {
+        assert(argc == 1);
+        if (regexp_is_null(argv[0])) {
+            cursor->eof = true;
+            return SQLITE_OK;
+        }
+        char* msg = NULL;
+        cursor->re = regexp_from_value(table->cache, argv[0], &msg);
+        if (cursor->re == NULL) {
+            if (msg == NULL) {
+                return SQLITE_NOMEM;
+            }
+            sqlite3_free(table->base.zErrMsg);
+            table->base.zErrMsg = sqlite3_mprintf("%s", msg);
+            free(msg);
+            return SQLITE_ERROR;
+        }
+        if (sqlite3_value_type(argv[0]) == SQLITE_TEXT) {
+            const char* pattern = (const char*)sqlite3_value_text(argv[0]);
+            size_t pattern_len = sqlite3_value_bytes(argv[0]);
+            if (regexp_literals(pattern, pattern_len, add_literal_trigrams, &trigrams) < 0) {
+                // no required literals, check every row
+                trigrams.len = 0;
+            }
+        }
+    } else if (idx_num == PLAN_LIKE || idx_num == PLAN_GLOB) {
+        assert(argc == 1);
+        const char* pattern = (const char*)sqlite3_value_text(argv[0]);
+        if (pattern == NULL) {
+            cursor->eof = true;
+            return SQLITE_OK;
+        }
+        wildcard_trigrams(&trigrams, pattern, sqlite3_value_bytes(argv[0]), idx_num);
+    }
+    if (trigrams.nomem) {
+        free(trigrams.items);
+        return SQLITE_NOMEM;
+    }
+    uniq(&trigrams);
+
+    int rc;
+    if (trigrams.len > 0) {
+        rc = open_lists(cursor, table, &trigrams);
+    } else {
+        char* sql = idx_num == PLAN_ROWID
+                        ? sqlite3_mprintf("SELECT rowid, \"%w\" FROM \"%w\".\"%w\" WHERE rowid = ?",
+                                          table->column, table->schema, table->table)
+                        : sqlite3_mprintf("SELECT rowid, \"%w\" FROM \"%w\".\"%w\"",
+                                          table->column, table->schema, table->table);
+        rc = prepare(table, sql, &cursor->scan);
+        sqlite3_free(sql);
+        if (rc == SQLITE_OK && idx_num == PLAN_ROWID) {
+            sqlite3_bind_value(cursor->scan, 1, argv[0]);
+        }
+    }
+    free(trigrams.items);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    return xnext(cur);
+}
+
+// xbest_index chooses the query plan: by rowid, by pattern or a full scan.
+static int xbest_index(sqlite3_vtab* vtable, sqlite3_index_info* index_info) {
+    (void)vtable;
+    int rowid_idx = -1;
+    int pattern_idx = -1;
+    int plan = PLAN_SCAN;
+    for (int i = 0; i < index_info->nConstraint; i++) {
+        const struct sqlite3_index_constraint* constraint = index_info->aConstraint + i;
+        if (!constraint->usable) {
+            continue;
+        }
+        if (constraint->iColumn == -1 && constraint->op == SQLITE_INDEX_CONSTRAINT_EQ) {
+            rowid_idx = i;
+        } else if (constraint->iColumn == COLUMN_VALUE) {
+            int op = constraint->op;
+            if (op == SQLITE_INDEX_CONSTRAINT_FUNCTION || op == SQLITE_INDEX_CONSTRAINT_REGEXP) {
+                pattern_idx = i;
+                plan = PLAN_REGEXP;
+            } else if (op == SQLITE_INDEX_CONSTRAINT_LIKE && plan != PLAN_REGEXP) {
+                pattern_idx = i;
+                plan = PLAN_LIKE;
+            } else if (op == SQLITE_INDEX_CONSTRAINT_GLOB && plan == PLAN_SCAN) {
+                pattern_idx = i;
+                plan = PLAN_GLOB;
+            }
+        }
+    }
+
+    if (rowid_idx != -1) {
+        index_info->idxNum = PLAN_ROWID;
+        index_info->aConstraintUsage[rowid_idx].argvIndex = 1;
+        index_info->aConstraintUsage[rowid_idx].omit = 1;
+        index_info->estimatedCost = 1;
+        index_info->estimatedRows = 1;
+        index_info->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+        return SQLITE_OK;
+    }
+
+    index_info->idxNum = plan;
+    if (plan == PLAN_SCAN) {
+        index_info->estimatedCost = 1000000;
+        index_info->estimatedRows = 1000000;
+        return SQLITE_OK;
+    }
+
+    index_info->aConstraintUsage[pattern_idx].argvIndex = 1;
+    // regexps are checked by the cursor, LIKE and GLOB by SQLite itself
+    index_info->aConstraintUsage[pattern_idx].omit = plan == PLAN_REGEXP;
+    index_info->estimatedCost = 1000;
+    index_info->estimatedRows = 1000;
+    return SQLITE_OK;
+}
+
+// fn_like implements regexp_like(source, pattern) for the rows
+// that the virtual table does not filter itself.
+static void fn_like(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 2);
+    const char* source = (const char*)sqlite3_value_text(argv[0]);
+    if (source == NULL) {
+        sqlite3_result_int(context, 0);
+        return;
+    }
+    size_t source_len = sqlite3_value_bytes(argv[0]);
+    if (regexp_is_null(argv[1])) {
+        sqlite3_result_error(context, "missing regexp pattern", -1);
+        return;
+    }
+
+    char* msg = NULL;
+    Regexp* re = regexp_from_value(sqlite3_user_data(context), argv[1], &msg);
+    if (re == NULL) {
+        if (msg == NULL) {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        sqlite3_result_error(context, msg, -1);
+        free(msg);
+        return;
+    }
+    int rc = regexp_like(re, source, source_len);
+    if (rc == REGEXP_LIMIT_EXCEEDED) {
+        PCRE2_UCHAR buffer[256];
+        pcre2_get_error_message(re->error, buffer, sizeof(buffer));
+        sqlite3_result_error(context, (char*)buffer, -1);
+        sqlite3_result_error_code(context, SQLITE_ABORT);
+    } else {
+        sqlite3_result_int(context, rc == 1);
+    }
+    regexp_free(re);
+}
+
+// xfind_function overloads regexp_like, so that it is passed to xBestIndex.
+static int xfind_function(sqlite3_vtab* vtable,
+                          int nargs,
+                          const char* name,
+                          void (**fn_ptr)(sqlite3_context*, int, sqlite3_value**),
+                          void** arg_ptr) {
+    Table* table = (Table*)vtable;
+    if (nargs == 2 && sqlite3_stricmp(name, "regexp_like") == 0) {
+        *fn_ptr = fn_like;
+        *arg_ptr = table->cache;
+        return SQLITE_INDEX_CONSTRAINT_FUNCTION;
+    }
+    return 0;
+}
+
+// xshadow_name reports the posting lists as a shadow table,
+// so that they cannot be modified directly in defensive mode.
+static int xshadow_name(const char* suffix) {
+    return sqlite3_stricmp(suffix, "postings") == 0;
+}
+
+static sqlite3_module index_module = {
+    .iVersion = 3,
+    .xCreate = xcreate,
+    .xConnect = xconnect,
+    .xBestIndex = xbest_index,
+    .xDisconnect = xdisconnect,
+    .xDestroy = xdestroy,
+    .xOpen = xopen,
+    .xClose = xclose,
+    .xFilter = xfilter,
+    .xNext = xnext,
+    .xEof = xeof,
+    .xColumn = xcolumn,
+    .xRowid = xrowid,
+    .xUpdate = xupdate,
+    .xFindFunction = xfind_function,
+    .xShadowName = xshadow_name,
+};
+
+int regexp_index_init(sqlite3* db, RegexpCache* cache) {
+    sqlite3_create_module_v2(db, "regexp_index", &index_module, regexp_cache_retain(cache),
+                             (void (*)(void*))regexp_cache_free);
+    return SQLITE_OK;
+}
@@ -0,0 +1,25 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// SQLite extension for working with regular expressions.
+
+#ifndef REGEXP_INTERNAL_H
+#define REGEXP_INTERNAL_H
+
+#include <stdbool.h>
+
+#include "sqlite3ext.h"
+
+#include "regexp/cache.h"
+
+// Type of the pointer values returned by regexp_from_compiled().
+#define REGEXP_POINTER_TYPE "sqlean_regexp"
+
+bool regexp_is_null(sqlite3_value* value);
+Regexp* regexp_from_value(RegexpCache* cache, sqlite3_value* value, char** errmsg);
+int regexp_file_init(sqlite3* db, RegexpCache* cache);
+int regexp_set_init(sqlite3* db, RegexpCache* cache);
+int regexp_index_init(sqlite3* db, RegexpCache* cache);
+int regexp_matches_init(sqlite3* db, RegexpCache* cache);
+
+#endif /* REGEXP_INTERNAL_H */
@@ -0,0 +1,377 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+/*
+ * Literal strings required by a regular expression.
+ *
+ * Any match of 'connection timeout after \d+ms' must contain
+ * 'connection timeout after ' and 'ms'. Such literals allow to quickly
+ * rule out strings that cannot match, without running the regexp engine.
+ *
+ * Only the top level of the pattern is analyzed: the contents of groups
+ * are skipped, and alternation at the top level means there are
+ * no required literals. Patterns with constructs that are hard to analyze
+ * (e.g. extended syntax, \Q...\E quoting, conditionals or backtracking verbs
+ * like (*ACCEPT)) have no required literals either.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "regexp/literal.h"
+
+// Run is a sequence of literal bytes collected while parsing the pattern.
+typedef struct {
+    char* buf;
+    size_t len;
+    // start of the last character in the run
+    size_t last;
+} Run;
+
+// Output receives the finished runs.
+typedef struct {
+    void (*found)(const char* lit, size_t len, void* arg);
+    void* arg;
+    int count;
+} Output;
+
+// end_run finishes the current run, reporting it if it is not empty.
+static void end_run(Run* cur, Output* out) {
+    if (cur->len > 0) {
+        if (out->found != NULL) {
+            out->found(cur->buf, cur->len, out->arg);
+        }
+        out->count++;
+    }
+    cur->len = 0;
+}
+
+// add_byte appends the literal byte to the current run.
+// Returns false if the byte cannot be part of a literal.
+static bool add_byte(Run* cur, Output* out, unsigned char c, bool caseless) {
+    // caseless 'k' and 's' also match the Kelvin sign and the long s,
+    // and non-ASCII characters have other case variants,
+    // which ASCII case folding does not cover
+    if (caseless && (c >= 0x80 || c == 'k' || c == 'K' || c == 's' || c == 'S')) {
+        end_run(cur, out);
+        return false;
+    }
+    if ((c & 0xC0) != 0x80) {
+        cur->last = cur->len;
+    }
+    cur->buf[cur->len++] = c;
+    return true;
+}
+
+// skip_class returns the position right after the character class starting at `i`.
+static size_t skip_class(const char* p, size_t len, size_t i) {
+    size_t j = i + 1;
+    if (j < len && p[j] == '^') {
+        j++;
+    }
+    if (j < len && p[j] == ']') {
+        j++;
+    }
+    while (j < len) {
+        if (p[j] == '\\') {
+            j += 2;
+        } else if (p[j] == '[' && j + 1 < len && p[j + 1] == ':') {
+            // POSIX class like [:alpha:]
+            j += 2;
+            while (j + 1 < len && !(p[j] == ':' && p[j + 1] == ']')) {
+                j++;
+            }
+            j += 2;
+        } else if (p[j] == ']') {
+            return j + 1;
+        } else {
+            j++;
+        }
+    }
+    return len;
+}
+
+// skip_until returns the position right after the first `c` at or after `i`.
+static size_t skip_until(const char* p, size_t len, size_t i, char c) {
+    while (i < len && p[i] != c) {
+        i++;
+    }
+    return i < len ? i + 1 : len;
+}
+
+// option_verb_len returns the length of the start-of-pattern option
+// like (*UTF) or (*LIMIT_MATCH=10) at `i`, or 0 if there is none.
+// Other verbs like (*ACCEPT) or (*SKIP) change what the match must contain.
+static size_t option_verb_len(const char* p, size_t len, size_t i) {
+    static const char* options[] = {
+        "UTF",         "UCP",          "NOTEMPTY", "NOTEMPTY_ATSTART", "NO_AUTO_POSSESS",
+        "NO_JIT",      "NO_START_OPT", "CR",       "LF",               "CRLF",
+        "ANYCRLF",     "ANY",          "NUL",      "BSR_ANYCRLF",      "BSR_UNICODE",
+        "LIMIT_DEPTH=", "LIMIT_HEAP=",  "LIMIT_MATCH=", "LIMIT_RECURSION=", "NO_DOTSTAR_ANCHOR",
+    };
+    if (i + 1 >= len || p[i] != '(' || p[i + 1] != '*') {
+        return 0;
+    }
+    size_t end = skip_until(p, len, i, ')');
+    if (p[end - 1] != ')') {
+        return 0;
+    }
+    const char* name = p + i + 2;
+    size_t n = end - 1 - (i + 2);
+    for (size_t k = 0; k < sizeof(options) / sizeof(options[0]); k++) {
+        size_t olen = strlen(options[k]);
+        if (options[k][olen - 1] == '=') {
+            // limit with a number
+            if (n <= olen || strncmp(name, options[k], olen) != 0) {
+                continue;
+            }
+            size_t j = olen;
+            while (j < n && name[j] >= '0' && name[j] <= '9') {
+                j++;
+            }
+            if (j == n) {
+                return end - i;
+            }
+        } else if (n == olen && strncmp(name, options[k], olen) == 0) {
+            return end - i;
+        }
+    }
+    return 0;
+}
+
+// quantifier_len returns the length of the quantifier at `i` (including
+// the lazy or possessive suffix), or 0 if there is no quantifier.
+static size_t quantifier_len(const char* p, size_t len, size_t i) {
+    size_t j = i;
+    if (p[j] == '*' || p[j] == '+' || p[j] == '?') {
+        j++;
+    } else if (p[j] == '{') {
+        // {n}, {n,} or {n,m}, anything else is a literal brace
+        j++;
+        size_t digits = 0;
+        while (j < len && p[j] >= '0' && p[j] <= '9') {
+            j++;
+            digits++;
+        }
+        if (digits == 0) {
+            return 0;
+        }
+        if (j < len && p[j] == ',') {
+            j++;
+            while (j < len && p[j] >= '0' && p[j] <= '9') {
+                j++;
+            }
+        }
+        if (j >= len || p[j] != '}') {
+            return 0;
+        }
+        j++;
+    } else {
+        return 0;
+    }
+    if (j < len && (p[j] == '?' || p[j] == '+')) {
+        j++;
+    }
+    return j - i;
+}
+
+// parse reports the literal runs of the pattern to the output.
+// Returns the number of runs, or -1 if the pattern is too complex to analyze.
+static int parse(const char* p, size_t len, Output* out) {
+    // quoted sequences may contain anything, do not bother parsing them
+    for (size_t i = 0; i + 1 < len; i++) {
+        if (p[i] == '\\' && p[i + 1] == 'Q') {
+            return -1;
+        }
+    }
+
+    char* cur_buf = malloc(len > 0 ? len : 1);
+    if (cur_buf == NULL) {
+        return -1;
+    }
+    Run cur = {cur_buf, 0, 0};
+    out->count = 0;
+    bool caseless = false;
+    bool prev_literal = false;
+    int depth = 0;
+    size_t i = 0;
+
+    // options like (*UTF) are only allowed at the start of the pattern
+    size_t olen;
+    while ((olen = option_verb_len(p, len, i)) > 0) {
+        i += olen;
+    }
+
+    while (i < len) {
+        char c = p[i];
+
+        if (depth > 0) {
+            if (c == '\\') {
+                i += 2;
+            } else if (c == '[') {
+                i = skip_class(p, len, i);
+            } else if (c == '(') {
+                if (i + 1 < len && p[i + 1] == '*') {
+                    // verbs like (*ACCEPT) affect the whole match
+                    goto fail;
+                }
+                if (i + 2 < len && p[i + 1] == '?' && p[i + 2] == '(') {
+                    // conditional group
+                    goto fail;
+                }
+                if (i + 2 < len && p[i + 1] == '?' && p[i + 2] == '#') {
+                    i = skip_until(p, len, i, ')');
+                } else {
+                    depth++;
+                    i++;
+                }
+            } else if (c == ')') {
+                depth--;
+                i++;
+            } else {
+                i++;
+            }
+            continue;
+        }
+
+        size_t qlen = quantifier_len(p, len, i);
+        if (qlen > 0) {
+            // the quantified character is optional unless the quantifier is +
+            if (prev_literal && c != '+') {
+                cur.len = cur.last;
+            }
+            end_run(&cur, out);
+            prev_literal = false;
+            i += qlen;
+            continue;
+        }
+
+        switch (c) {
+            case '\\': {
+                if (i + 1 >= len) {
+                    goto fail;
+                }
+                char n = p[i + 1];
+                const char* controls = "ntrfae";
+                const char values[] = {'\n', '\t', '\r', '\f', '\a', 0x1b};
+                const char* pos;
+                if (!((n >= 'a' && n <= 'z') || (n >= 'A' && n <= 'Z') || (n >= '0' && n <= '9'))) {
+                    // escaped punctuation (or any non-alphanumeric) is literal
+                    prev_literal = add_byte(&cur, out, n, caseless);
+                } else if ((pos = strchr(controls, n)) != NULL) {
+                    prev_literal = add_byte(&cur, out, values[pos - controls], caseless);
+                } else if (strchr("dDwWsSbBhHvVRXAzZGK", n) != NULL ||
+                           (n == 'N' && !(i + 2 < len && p[i + 2] == '{'))) {
+                    // character types and assertions
+                    end_run(&cur, out);
+                    prev_literal = false;
+                } else {
+                    // backreferences, code points, properties etc.
+                    goto fail;
+                }
+                i += 2;
+                break;
+            }
+
+            case '[':
+                end_run(&cur, out);
+                prev_literal = false;
+                i = skip_class(p, len, i);
+                break;
+
+            case '(':
+                end_run(&cur, out);
+                prev_literal = false;
+                if (i + 1 < len && p[i + 1] == '*') {
+                    // verbs like (*ACCEPT) or (*SKIP) change what the match must contain
+                    goto fail;
+                }
+                if (i + 2 < len && p[i + 1] == '?' && p[i + 2] == '(') {
+                    // conditional group
+                    goto fail;
+                }
+                if (i + 2 < len && p[i + 1] == '?' && p[i + 2] == '#') {
+                    // comment
+                    i = skip_until(p, len, i, ')');
+                    break;
+                }
+                if (i + 1 < len && p[i + 1] == '?') {
+                    // option setting like (?i) or (?-i)
+                    size_t j = i + 2;
+                    bool on = true;
+                    int set_caseless = -1;
+                    while (j < len && ((p[j] >= 'a' && p[j] <= 'z') ||
+                                       (p[j] >= 'A' && p[j] <= 'Z') || p[j] == '-' ||
+                                       p[j] == '^')) {
+                        if (p[j] == '-') {
+                            on = false;
+                        } else if (p[j] == 'x') {
+                            // extended syntax ignores whitespace and allows comments
+                            goto fail;
+                        } else if (p[j] == 'i') {
+                            set_caseless = on;
+                        }
+                        j++;
+                    }
+                    if (j < len && p[j] == ')') {
+                        if (set_caseless != -1) {
+                            caseless = set_caseless;
+                        }
+                        i = j + 1;
+                        break;
+                    }
+                }
+                depth++;
+                i++;
+                break;
+
+            case ')':
+            case '|':
+                // alternation at the top level, there is no single required literal
+                goto fail;
+
+            case '.':
+            case '^':
+            case '$':
+                end_run(&cur, out);
+                prev_literal = false;
+                i++;
+                break;
+
+            default:
+                prev_literal = add_byte(&cur, out, c, caseless);
+                i++;
+                break;
+        }
+    }
+
+    end_run(&cur, out);
+    free(cur_buf);
+    return out->count;
+
+fail:
+    free(cur_buf);
+    return -1;
+}
+
+// regexp_literals calls `found` for every literal string (in order of appearance)
+// that any match of the pattern must contain. Literal strings are reported
+// as they appear in the pattern, but may match with a different ASCII case
+// if the pattern is caseless.
+// Returns the number of literals, or -1 if the pattern is too complex to analyze,
+// in which case `found` is not called.
+int regexp_literals(const char* pattern,
+                    size_t len,
+                    void (*found)(const char* lit, size_t len, void* arg),
+                    void* arg) {
+    // validate first, so as not to report the literals of a pattern
+    // that turns out to be too complex in the end
+    Output none = {NULL, NULL, 0};
+    if (parse(pattern, len, &none) < 0) {
+        return -1;
+    }
+    Output out = {found, arg, 0};
+    return parse(pattern, len, &out);
+}
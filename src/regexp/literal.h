@@ -0,0 +1,16 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// Literal strings required by a regular expression.
+
+#ifndef REGEXP_LITERAL_H
+#define REGEXP_LITERAL_H
+
+#include <stddef.h>
+
+int regexp_literals(const char* pattern,
+                    size_t len,
+                    void (*found)(const char* lit, size_t len, void* arg),
+                    void* arg);
+
+#endif /* REGEXP_LITERAL_H */
@@ -0,0 +1,397 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// regexp_matches(source, pattern)
+//   - finds all matches of the pattern in the source string
+// regexp_split(source, pattern)
+//   - splits the source string into parts separated by the pattern matches
+//
+// Implemented as table-valued functions. The next match is searched for
+// only when the next row is requested, so the memory usage does not depend
+// on the number of matches.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sqlite3ext.h"
+SQLITE_EXTENSION_INIT3
+
+#include "regexp/cache.h"
+#include "regexp/internal.h"
+#include "regexp/pcre2/pcre2.h"
+#include "regexp/regexp.h"
+
+// Maximum number of capture groups returned as columns.
+#define MAX_GROUPS 9
+
+// regexp_matches columns.
+#define COLUMN_MATCH 0
+#define COLUMN_START 1
+#define COLUMN_END 2
+#define COLUMN_GROUP1 3
+#define COLUMN_MATCHES_SOURCE (COLUMN_GROUP1 + MAX_GROUPS)
+#define COLUMN_MATCHES_PATTERN (COLUMN_MATCHES_SOURCE + 1)
+
+// regexp_split columns.
+#define COLUMN_VALUE 0
+#define COLUMN_SPLIT_SOURCE 3
+#define COLUMN_SPLIT_PATTERN 4
+
+typedef struct {
+    sqlite3_vtab base;
+    RegexpCache* cache;
+    // true for regexp_split, false for regexp_matches
+    bool split;
+} Table;
+
+typedef struct {
+    sqlite3_vtab_cursor base;
+    Regexp* re;
+    // copy of the source string
+    char* source;
+    size_t source_len;
+    // number of capture groups returned as columns
+    int ngroups;
+    // current row boundaries
+    size_t row_start;
+    size_t row_end;
+    // capture group boundaries of the current match (pairs of offsets)
+    size_t groups[2 * MAX_GROUPS];
+    // position to search for the next match from
+    size_t pos;
+    // true if the previous match was empty
+    bool after_empty;
+    // end of the previous match, where the next part of the split starts
+    size_t part_start;
+    // true if there are no more matches
+    bool done;
+    bool eof;
+    sqlite3_int64 rowid;
+} Cursor;
+
+// xconnect creates the virtual table.
+static int xconnect(sqlite3* db,
+                    void* aux,
+                    int argc,
+                    const char* const* argv,
+                    sqlite3_vtab** vtabptr,
+                    char** errptr) {
+    (void)argc;
+    (void)errptr;
+
+    bool split = strcmp(argv[0], "regexp_split") == 0;
+    int rc;
+    if (split) {
+        rc = sqlite3_declare_vtab(db,
+                                  "CREATE TABLE x(value text, start integer, end integer, "
+                                  "source hidden, pattern hidden)");
+    } else {
+        rc = sqlite3_declare_vtab(db,
+                                  "CREATE TABLE x(match text, start integer, end integer, "
+                                  "group1 text, group2 text, group3 text, group4 text, "
+                                  "group5 text, group6 text, group7 text, group8 text, "
+                                  "group9 text, source hidden, pattern hidden)");
+    }
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    Table* table = sqlite3_malloc(sizeof(*table));
+    *vtabptr = (sqlite3_vtab*)table;
+    if (table == NULL) {
+        return SQLITE_NOMEM;
+    }
+    memset(table, 0, sizeof(*table));
+    table->cache = aux;
+    table->split = split;
+    sqlite3_vtab_config(db, SQLITE_VTAB_INNOCUOUS);
+    return SQLITE_OK;
+}
+
+// xdisconnect destroys the virtual table.
+static int xdisconnect(sqlite3_vtab* vtable) {
+    Table* table = (Table*)vtable;
+    sqlite3_free(table);
+    return SQLITE_OK;
+}
+
+// xopen creates a new cursor.
+static int xopen(sqlite3_vtab* vtable, sqlite3_vtab_cursor** curptr) {
+    (void)vtable;
+    Cursor* cursor = sqlite3_malloc(sizeof(*cursor));
+    if (cursor == NULL) {
+        return SQLITE_NOMEM;
+    }
+    memset(cursor, 0, sizeof(*cursor));
+    *curptr = &cursor->base;
+    return SQLITE_OK;
+}
+
+// reset frees the resources used by the cursor.
+static void reset(Cursor* cursor) {
+    regexp_free(cursor->re);
+    cursor->re = NULL;
+    free(cursor->source);
+    cursor->source = NULL;
+}
+
+// xclose destroys the cursor.
+static int xclose(sqlite3_vtab_cursor* cur) {
+    Cursor* cursor = (Cursor*)cur;
+    reset(cursor);
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+// find_next finds the next match and moves the search position past it.
+// Sets `found` to false if there are no more matches.
+// Returns SQLITE_OK on success, or an error code with the vtab error message set.
+static int find_next(Cursor* cursor, size_t* start, size_t* end, bool* found) {
+    *found = false;
+    if (cursor->done) {
+        return SQLITE_OK;
+    }
+
+    int rc = regexp_find_next(cursor->re, cursor->source, cursor->source_len, cursor->pos,
+                              cursor->after_empty, start, end);
+    if (rc == REGEXP_LIMIT_EXCEEDED) {
+        sqlite3_vtab* vtable = cursor->base.pVtab;
+        PCRE2_UCHAR buffer[256];
+        pcre2_get_error_message(cursor->re->error, buffer, sizeof(buffer));
+        sqlite3_free(vtable->zErrMsg);
+        vtable->zErrMsg = sqlite3_mprintf("%s", buffer);
+        return SQLITE_ABORT;
+    }
+    if (rc != 1) {
+        cursor->done = true;
+        return SQLITE_OK;
+    }
+
+    cursor->pos = *end;
+    cursor->after_empty = *end == *start;
+    *found = true;
+    return SQLITE_OK;
+}
+
+// save_groups copies the capture group boundaries of the last match,
+// since the regexp match data may be reused by other queries before
+// the columns are read.
+static void save_groups(Cursor* cursor) {
+    if (cursor->ngroups == 0) {
+        return;
+    }
+    size_t* ovector = pcre2_get_ovector_pointer(cursor->re->match_data);
+    memcpy(cursor->groups, ovector + 2, 2 * cursor->ngroups * sizeof(size_t));
+}
+
+// xnext advances the cursor to the next match or split part.
+static int xnext(sqlite3_vtab_cursor* cur) {
+    Cursor* cursor = (Cursor*)cur;
+    Table* table = (Table*)cursor->base.pVtab;
+
+    if (table->split && cursor->done) {
+        // the part after the last match has been returned
+        cursor->eof = true;
+        return SQLITE_OK;
+    }
+
+    size_t start, end;
+    bool found;
+    int rc = find_next(cursor, &start, &end, &found);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    if (table->split) {
+        cursor->row_start = cursor->part_start;
+        if (found) {
+            cursor->row_end = start;
+            cursor->part_start = end;
+        } else {
+            cursor->row_end = cursor->source_len;
+        }
+    } else {
+        if (!found) {
+            cursor->eof = true;
+            return SQLITE_OK;
+        }
+        cursor->row_start = start;
+        cursor->row_end = end;
+        save_groups(cursor);
+    }
+
+    cursor->rowid++;
+    return SQLITE_OK;
+}
+
+// xcolumn returns the current cursor value.
+static int xcolumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int col_idx) {
+    Cursor* cursor = (Cursor*)cur;
+    switch (col_idx) {
+        case COLUMN_MATCH:
+            sqlite3_result_text(ctx, cursor->source + cursor->row_start,
+                                cursor->row_end - cursor->row_start, SQLITE_TRANSIENT);
+            break;
+
+        case COLUMN_START:
+            sqlite3_result_int64(ctx, cursor->row_start);
+            break;
+
+        case COLUMN_END:
+            sqlite3_result_int64(ctx, cursor->row_end);
+            break;
+
+        default: {
+            Table* table = (Table*)cursor->base.pVtab;
+            int group_idx = col_idx - COLUMN_GROUP1;
+            if (table->split || group_idx < 0 || group_idx >= cursor->ngroups) {
+                break;
+            }
+            size_t start = cursor->groups[2 * group_idx];
+            size_t end = cursor->groups[2 * group_idx + 1];
+            if (start == PCRE2_UNSET) {
+                // the group did not participate in the match
+                break;
+            }
+            sqlite3_result_text(ctx, cursor->source + start, end - start, SQLITE_TRANSIENT);
+            break;
+        }
+    }
+    return SQLITE_OK;
+}
+
+// xrowid returns the rowid for the current row.
+static int xrowid(sqlite3_vtab_cursor* cur, sqlite_int64* rowid_ptr) {
+    Cursor* cursor = (Cursor*)cur;
+    *rowid_ptr = cursor->rowid;
+    return SQLITE_OK;
+}
+
+// xeof returns TRUE if the cursor has been moved off of the last row of output.
+static int xeof(sqlite3_vtab_cursor* cur) {
+    Cursor* cursor = (Cursor*)cur;
+    return cursor->eof;
+}
+
+// xfilter compiles the pattern and finds the first match.
+static int xfilter(sqlite3_vtab_cursor* cur,
+                   int idx_num,
+                   const char* idx_str,
+                   int argc,
+                   sqlite3_value** argv) {
+    (void)idx_num;
+    (void)idx_str;
+
+    if (argc != 2) {
+        return SQLITE_ERROR;
+    }
+
+    Cursor* cursor = (Cursor*)cur;
+    sqlite3_vtab* vtable = (cursor->base).pVtab;
+    Table* table = (Table*)vtable;
+
+    // free resources from the previous source, if any
+    reset(cursor);
+    cursor->eof = true;
+    cursor->rowid = 0;
+
+    const char* source = (const char*)sqlite3_value_text(argv[0]);
+    if (source == NULL || regexp_is_null(argv[1])) {
+        return SQLITE_OK;
+    }
+
+    char* msg = NULL;
+    cursor->re = regexp_from_value(table->cache, argv[1], &msg);
+    if (cursor->re == NULL) {
+        if (msg == NULL) {
+            return SQLITE_NOMEM;
+        }
+        vtable->zErrMsg = sqlite3_mprintf("%s", msg);
+        free(msg);
+        return SQLITE_ERROR;
+    }
+
+    cursor->source_len = sqlite3_value_bytes(argv[0]);
+    cursor->source = malloc(cursor->source_len + 1);
+    if (cursor->source == NULL) {
+        return SQLITE_NOMEM;
+    }
+    memcpy(cursor->source, source, cursor->source_len + 1);
+
+    uint32_t ngroups = 0;
+    if (cursor->re->kind == REGEXP_GENERAL) {
+        pcre2_pattern_info(cursor->re->code, PCRE2_INFO_CAPTURECOUNT, &ngroups);
+    }
+    cursor->ngroups = ngroups < MAX_GROUPS ? (int)ngroups : MAX_GROUPS;
+
+    cursor->pos = 0;
+    cursor->after_empty = false;
+    cursor->part_start = 0;
+    cursor->done = false;
+    cursor->eof = false;
+    return xnext(cur);
+}
+
+// xbest_index instructs SQLite to pass the source and pattern arguments to xFilter.
+static int xbest_index(sqlite3_vtab* vtable, sqlite3_index_info* index_info) {
+    Table* table = (Table*)vtable;
+    int source_col = table->split ? COLUMN_SPLIT_SOURCE : COLUMN_MATCHES_SOURCE;
+    int pattern_col = table->split ? COLUMN_SPLIT_PATTERN : COLUMN_MATCHES_PATTERN;
+
+    int source_idx = -1;
+    int pattern_idx = -1;
+    for (int i = 0; i < index_info->nConstraint; i++) {
+        const struct sqlite3_index_constraint* constraint = index_info->aConstraint + i;
+        if (constraint->op != SQLITE_INDEX_CONSTRAINT_EQ) {
+            continue;
+        }
+        if (constraint->iColumn == source_col) {
+            if (!constraint->usable) {
+                return SQLITE_CONSTRAINT;
+            }
+            source_idx = i;
+        } else if (constraint->iColumn == pattern_col) {
+            if (!constraint->usable) {
+                return SQLITE_CONSTRAINT;
+            }
+            pattern_idx = i;
+        }
+    }
+
+    if (source_idx == -1 || pattern_idx == -1) {
+        vtable->zErrMsg = sqlite3_mprintf("%s() expects source and pattern",
+                                          table->split ? "regexp_split" : "regexp_matches");
+        return SQLITE_ERROR;
+    }
+
+    index_info->aConstraintUsage[source_idx].argvIndex = 1;
+    index_info->aConstraintUsage[source_idx].omit = 1;
+    index_info->aConstraintUsage[pattern_idx].argvIndex = 2;
+    index_info->aConstraintUsage[pattern_idx].omit = 1;
+    index_info->estimatedCost = (double)1000;
+    index_info->estimatedRows = 1000;
+    return SQLITE_OK;
+}
+
+static sqlite3_module matches_module = {
+    .xConnect = xconnect,
+    .xBestIndex = xbest_index,
+    .xDisconnect = xdisconnect,
+    .xOpen = xopen,
+    .xClose = xclose,
+    .xFilter = xfilter,
+    .xNext = xnext,
+    .xEof = xeof,
+    .xColumn = xcolumn,
+    .xRowid = xrowid,
+};
+
+int regexp_matches_init(sqlite3* db, RegexpCache* cache) {
+    sqlite3_create_module_v2(db, "regexp_matches", &matches_module, regexp_cache_retain(cache),
+                             (void (*)(void*))regexp_cache_free);
+    sqlite3_create_module_v2(db, "regexp_split", &matches_module, regexp_cache_retain(cache),
+                             (void (*)(void*))regexp_cache_free);
+    return SQLITE_OK;
+}
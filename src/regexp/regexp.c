@@ -6,152 +6,727 @@
  */
 
 #include <assert.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "regexp/chars.h"
 #include "regexp/pcre2/pcre2.h"
 #include "regexp/regexp.h"
 
+// get_error returns the error message for a given error code and offset.
+static char* get_error(int errcode, size_t erroffset) {
+    PCRE2_UCHAR buffer[256];
+    pcre2_get_error_message(errcode, buffer, sizeof(buffer));
+
+    // Allocate memory for the error message
+    // (additional space for formatting)
+    char* msg = (char*)malloc(256 + 32);
+    if (msg != NULL) {
+        snprintf(msg, 256 + 32, "%s (offset %d)", buffer, (int)erroffset);
+    }
+    return msg;
+}
+
+// is_meta checks if the character has a special meaning in a pattern.
+static bool is_meta(char c) {
+    return strchr("\\^$.|?*+()[]{}", c) != NULL;
+}
+
+// analyze detects patterns that can be matched without PCRE:
+//  - literal: `timeout`
+//  - prefix-anchored literal: `^GET /api`
+//  - suffix-anchored literal: `.json$`
+//  - exact literal: `^done$`
+// Escaped punctuation (e.g. `\.`) counts as a literal character.
+// Sets the regexp kind and literal text.
+static void analyze(Regexp* re, const char* pattern, size_t pattern_len) {
+    re->kind = REGEXP_GENERAL;
+    re->literal = NULL;
+    re->literal_len = 0;
+
+    const char* start = pattern;
+    const char* end = pattern + pattern_len;
+    bool prefix = false;
+    bool suffix = false;
+    if (start < end && *start == '^') {
+        prefix = true;
+        start++;
+    }
+    if (end > start && *(end - 1) == '$' && (end - 1 == start || *(end - 2) != '\\')) {
+        suffix = true;
+        end--;
+    }
+
+    char* literal = malloc(end - start + 1);
+    if (literal == NULL) {
+        return;
+    }
+    size_t len = 0;
+    for (const char* p = start; p < end; p++) {
+        if (*p == '\\') {
+            // only escaped punctuation is literal, e.g. \. or \/
+            // (escaped letters and digits are classes, assertions or backreferences)
+            if (p + 1 == end || !ispunct((unsigned char)*(p + 1))) {
+                free(literal);
+                return;
+            }
+            p++;
+        } else if (is_meta(*p)) {
+            free(literal);
+            return;
+        }
+        literal[len++] = *p;
+    }
+
+    re->literal = literal;
+    re->literal_len = len;
+    if (prefix && suffix) {
+        re->kind = REGEXP_EXACT;
+    } else if (prefix) {
+        re->kind = REGEXP_PREFIX;
+    } else if (suffix) {
+        re->kind = REGEXP_SUFFIX;
+    } else {
+        re->kind = REGEXP_LITERAL;
+    }
+}
+
+// study extracts the information used to quickly reject
+// non-matching subjects before calling pcre2_match:
+// the minimum subject length and a code unit that any match must contain.
+static void study(Regexp* re) {
+    uint32_t min_len = 0;
+    pcre2_pattern_info(re->code, PCRE2_INFO_MINLENGTH, &min_len);
+    re->min_len = min_len;
+
+    re->req_cu = -1;
+    re->req_cu2 = -1;
+    uint32_t type = 0;
+    uint32_t cu = 0;
+    if (pcre2_pattern_info(re->code, PCRE2_INFO_LASTCODETYPE, &type) == 0 && type == 1) {
+        pcre2_pattern_info(re->code, PCRE2_INFO_LASTCODEUNIT, &cu);
+        re->req_cu = cu;
+    } else if (pcre2_pattern_info(re->code, PCRE2_INFO_FIRSTCODETYPE, &type) == 0 && type == 1) {
+        pcre2_pattern_info(re->code, PCRE2_INFO_FIRSTCODEUNIT, &cu);
+        re->req_cu = cu;
+    }
+    if (re->req_cu == -1) {
+        return;
+    }
+
+    // The code unit may be caseless, and pcre2_pattern_info does not tell.
+    // In UTF-8 mode, PCRE2 only treats ASCII code units as caseless
+    // in this optimization, so checking both ASCII cases is always safe.
+    re->req_cu2 = re->req_cu;
+    if (re->req_cu >= 'a' && re->req_cu <= 'z') {
+        re->req_cu2 = re->req_cu - 'a' + 'A';
+    } else if (re->req_cu >= 'A' && re->req_cu <= 'Z') {
+        re->req_cu2 = re->req_cu - 'A' + 'a';
+    }
+}
+
+// find returns the offset of the first occurrence of `needle` in `haystack`,
+// or -1 if there is none. Uses memchr to skip to the candidate positions,
+// which is vectorized in most C libraries.
+static int64_t find(const char* haystack, size_t haystack_len, const char* needle,
+                    size_t needle_len) {
+    if (needle_len == 0) {
+        return 0;
+    }
+    if (needle_len > haystack_len) {
+        return -1;
+    }
+    const char first = needle[0];
+    const char last = needle[needle_len - 1];
+    const char* p = haystack;
+    const char* end = haystack + haystack_len - needle_len + 1;
+    while (p < end) {
+        p = memchr(p, first, end - p);
+        if (p == NULL) {
+            return -1;
+        }
+        if (p[needle_len - 1] == last && memcmp(p, needle, needle_len) == 0) {
+            return p - haystack;
+        }
+        p++;
+    }
+    return -1;
+}
+
+// is_valid_utf8 checks if the string is well-formed UTF-8, as PCRE requires
+// the subject to be: no overlong forms, surrogates or code points above U+10FFFF.
+static bool is_valid_utf8(const char* str, size_t len) {
+    const unsigned char* s = (const unsigned char*)str;
+    size_t i = 0;
+    while (i < len) {
+        unsigned char c = s[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+        // number of continuation bytes and the range of the first one
+        size_t n;
+        unsigned char lo = 0x80, hi = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            n = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            n = 2;
+            lo = c == 0xE0 ? 0xA0 : 0x80;
+            hi = c == 0xED ? 0x9F : 0xBF;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            n = 3;
+            lo = c == 0xF0 ? 0x90 : 0x80;
+            hi = c == 0xF4 ? 0x8F : 0xBF;
+        } else {
+            return false;
+        }
+        if (len - i - 1 < n || s[i + 1] < lo || s[i + 1] > hi) {
+            return false;
+        }
+        for (size_t k = 2; k <= n; k++) {
+            if ((s[i + k] & 0xC0) != 0x80) {
+                return false;
+            }
+        }
+        i += n + 1;
+    }
+    return true;
+}
+
+// match_literal finds the leftmost match of a literal pattern in the source.
+// Returns the match offset, or -1 if there is no match.
+static int64_t match_literal(Regexp* re, const char* source, size_t source_len) {
+    const char* lit = re->literal;
+    size_t len = re->literal_len;
+    switch (re->kind) {
+        case REGEXP_LITERAL:
+            return find(source, source_len, lit, len);
+
+        case REGEXP_PREFIX:
+            if (source_len >= len && memcmp(source, lit, len) == 0) {
+                return 0;
+            }
+            return -1;
+
+        case REGEXP_SUFFIX:
+            // $ matches at the end of the subject or before the final newline,
+            // the latter being the leftmost match
+            if (source_len >= len + 1 && source[source_len - 1] == '\n' &&
+                memcmp(source + source_len - 1 - len, lit, len) == 0) {
+                return source_len - 1 - len;
+            }
+            if (source_len >= len && memcmp(source + source_len - len, lit, len) == 0) {
+                return source_len - len;
+            }
+            return -1;
+
+        case REGEXP_EXACT:
+            if ((source_len == len || (source_len == len + 1 && source[len] == '\n')) &&
+                memcmp(source, lit, len) == 0) {
+                return 0;
+            }
+            return -1;
+
+        default:
+            return -1;
+    }
+}
+
+// can_match quickly checks if the source string can possibly match a general pattern.
+static bool can_match(Regexp* re, const char* source, size_t source_len) {
+    if (source_len < re->min_len) {
+        return false;
+    }
+    if (re->req_cu == -1) {
+        return true;
+    }
+    if (memchr(source, re->req_cu, source_len) != NULL) {
+        return true;
+    }
+    return re->req_cu2 != re->req_cu && memchr(source, re->req_cu2, source_len) != NULL;
+}
+
+// new_regexp wraps the compiled pattern code into a Regexp.
+// Takes ownership of the code, but not of the match context.
+// Returns NULL if out of memory.
+static Regexp* new_regexp(pcre2_code* code,
+                          const char* pattern,
+                          size_t pattern_len,
+                          pcre2_match_context* match_ctx) {
+    Regexp* re = malloc(sizeof(Regexp));
+    if (re == NULL) {
+        pcre2_code_free(code);
+        return NULL;
+    }
+    re->code = code;
+    re->match_data = pcre2_match_data_create_from_pattern(code, NULL);
+    re->match_ctx = match_ctx;
+    re->error = 0;
+    re->refs = 1;
+    analyze(re, pattern, pattern_len);
+    study(re);
+    if (re->match_data == NULL) {
+        regexp_free(re);
+        return NULL;
+    }
+    return re;
+}
+
 // regexp_compile compiles and returns the compiled regexp.
-pcre2_code* regexp_compile(const char* pattern) {
+// Allocates the match data once, so that matching the regexp does not allocate memory.
+// The regexp uses the match context (if not NULL) to limit the resources spent
+// on matching. The match context must outlive the regexp.
+// On failure, returns NULL and sets `errmsg` (if not NULL)
+// to the error message, which the caller must free.
+Regexp* regexp_compile(const char* pattern,
+                       size_t pattern_len,
+                       pcre2_match_context* match_ctx,
+                       char** errmsg) {
     size_t erroffset;
     int errcode;
     uint32_t options = PCRE2_UCP | PCRE2_UTF;
-    pcre2_code* re = pcre2_compile((PCRE2_SPTR8)pattern, PCRE2_ZERO_TERMINATED, options, &errcode,
-                                   &erroffset, NULL);
+    pcre2_code* code =
+        pcre2_compile((PCRE2_SPTR8)pattern, pattern_len, options, &errcode, &erroffset, NULL);
+    if (code == NULL) {
+        if (errmsg != NULL) {
+            *errmsg = get_error(errcode, erroffset);
+        }
+        return NULL;
+    }
+
+    Regexp* re = new_regexp(code, pattern, pattern_len, match_ctx);
+    if (re == NULL && errmsg != NULL) {
+        *errmsg = NULL;
+    }
     return re;
 }
 
-// regexp_free frees the compiled regexp.
-void regexp_free(pcre2_code* re) {
-    pcre2_code_free(re);
+// Serialized regexp format:
+//  - magic "SQRE" (4 bytes),
+//  - format version (1 byte),
+//  - pattern length (4 bytes, little-endian),
+//  - checksum of the rest of the data (4 bytes, little-endian),
+//  - pattern text,
+//  - compiled pattern code as produced by pcre2_serialize_encode.
+// The pattern text is kept to analyze the pattern without recompiling it.
+#define SERIAL_MAGIC "SQRE"
+#define SERIAL_VERSION 1
+#define SERIAL_HEADER_SIZE 13
+
+// put_uint32 writes the number as 4 little-endian bytes.
+static void put_uint32(uint8_t* buf, uint32_t n) {
+    buf[0] = n & 0xff;
+    buf[1] = (n >> 8) & 0xff;
+    buf[2] = (n >> 16) & 0xff;
+    buf[3] = (n >> 24) & 0xff;
+}
+
+// get_uint32 reads the number from 4 little-endian bytes.
+static uint32_t get_uint32(const uint8_t* buf) {
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) |
+           ((uint32_t)buf[3] << 24);
 }
 
-// regexp_get_error returns the error message for a given pattern.
-char* regexp_get_error(const char* pattern) {
+// checksum calculates the FNV-1a hash of the data.
+static uint32_t checksum(const uint8_t* data, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// regexp_serialize compiles the pattern and serializes the compiled code,
+// so that it can be stored and later loaded with regexp_deserialize
+// without compiling the pattern again.
+// Returns the serialized data (which the caller must free) and sets its size.
+// On failure, returns NULL and sets `errmsg` like regexp_compile does.
+uint8_t* regexp_serialize(const char* pattern, size_t pattern_len, size_t* size, char** errmsg) {
     size_t erroffset;
     int errcode;
     uint32_t options = PCRE2_UCP | PCRE2_UTF;
-    pcre2_code* re = pcre2_compile((PCRE2_SPTR8)pattern, PCRE2_ZERO_TERMINATED, options, &errcode,
-                                   &erroffset, NULL);
+    pcre2_code* code =
+        pcre2_compile((PCRE2_SPTR8)pattern, pattern_len, options, &errcode, &erroffset, NULL);
+    if (code == NULL) {
+        *errmsg = get_error(errcode, erroffset);
+        return NULL;
+    }
 
-    if (re != NULL) {
-        // free the compiled pattern if successful
-        pcre2_code_free(re);
+    uint8_t* code_bytes;
+    PCRE2_SIZE code_size;
+    const pcre2_code* codes[] = {code};
+    int rc = pcre2_serialize_encode(codes, 1, &code_bytes, &code_size, NULL);
+    pcre2_code_free(code);
+    if (rc < 0) {
+        PCRE2_UCHAR buffer[256];
+        pcre2_get_error_message(rc, buffer, sizeof(buffer));
+        *errmsg = strdup((char*)buffer);
         return NULL;
     }
 
-    PCRE2_UCHAR buffer[256];
-    pcre2_get_error_message(errcode, buffer, sizeof(buffer));
+    *size = SERIAL_HEADER_SIZE + pattern_len + code_size;
+    uint8_t* data = malloc(*size);
+    if (data == NULL) {
+        pcre2_serialize_free(code_bytes);
+        *errmsg = NULL;
+        return NULL;
+    }
+    memcpy(data, SERIAL_MAGIC, 4);
+    data[4] = SERIAL_VERSION;
+    put_uint32(data + 5, pattern_len);
+    memcpy(data + SERIAL_HEADER_SIZE, pattern, pattern_len);
+    memcpy(data + SERIAL_HEADER_SIZE + pattern_len, code_bytes, code_size);
+    put_uint32(data + 9,
+               checksum(data + SERIAL_HEADER_SIZE, pattern_len + code_size));
+    pcre2_serialize_free(code_bytes);
+    return data;
+}
 
-    // Allocate memory for the error message
-    // (additional space for formatting)
-    char* msg = (char*)malloc(256 + 32);
-    if (msg != NULL) {
-        snprintf(msg, 256 + 32, "%s (offset %d)", buffer, (int)erroffset);
+// regexp_is_serialized checks if the data looks like a serialized regexp.
+int regexp_is_serialized(const uint8_t* data, size_t size) {
+    return size >= 4 && memcmp(data, SERIAL_MAGIC, 4) == 0;
+}
+
+// regexp_deserialize loads the regexp serialized with regexp_serialize.
+// The data must come from the same version of the extension.
+// Uses the match context like regexp_compile does.
+// On failure, returns NULL and sets `errmsg` like regexp_compile does.
+Regexp* regexp_deserialize(const uint8_t* data,
+                           size_t size,
+                           pcre2_match_context* match_ctx,
+                           char** errmsg) {
+    if (size < SERIAL_HEADER_SIZE || memcmp(data, SERIAL_MAGIC, 4) != 0) {
+        *errmsg = strdup("invalid compiled regexp");
+        return NULL;
     }
-    return msg;
+    if (data[4] != SERIAL_VERSION) {
+        *errmsg = strdup("unsupported compiled regexp version");
+        return NULL;
+    }
+    size_t pattern_len = get_uint32(data + 5);
+    if (pattern_len > size - SERIAL_HEADER_SIZE ||
+        get_uint32(data + 9) != checksum(data + SERIAL_HEADER_SIZE, size - SERIAL_HEADER_SIZE)) {
+        *errmsg = strdup("invalid compiled regexp");
+        return NULL;
+    }
+
+    const char* pattern = (const char*)data + SERIAL_HEADER_SIZE;
+    const uint8_t* code_bytes = data + SERIAL_HEADER_SIZE + pattern_len;
+    size_t code_size = size - SERIAL_HEADER_SIZE - pattern_len;
+
+    // pcre2_serialize_decode expects the data to be aligned,
+    // while SQLite returns blobs at arbitrary addresses
+    uint8_t* aligned = NULL;
+    if ((uintptr_t)code_bytes % sizeof(void*) != 0) {
+        aligned = malloc(code_size > 0 ? code_size : 1);
+        if (aligned == NULL) {
+            *errmsg = NULL;
+            return NULL;
+        }
+        memcpy(aligned, code_bytes, code_size);
+        code_bytes = aligned;
+    }
+
+    pcre2_code* codes[1];
+    int rc = pcre2_serialize_decode(codes, 1, code_bytes, NULL);
+    free(aligned);
+    if (rc < 0) {
+        // e.g. serialized by a different PCRE2 version or on a different architecture
+        PCRE2_UCHAR buffer[256];
+        pcre2_get_error_message(rc, buffer, sizeof(buffer));
+        *errmsg = strdup((char*)buffer);
+        return NULL;
+    }
+
+    Regexp* re = new_regexp(codes[0], pattern, pattern_len, match_ctx);
+    if (re == NULL) {
+        *errmsg = NULL;
+    }
+    return re;
+}
+
+// regexp_retain adds a reference to the compiled regexp.
+Regexp* regexp_retain(Regexp* re) {
+    re->refs++;
+    return re;
+}
+
+// regexp_free releases a reference to the compiled regexp,
+// and frees it if there are no references left.
+void regexp_free(Regexp* re) {
+    if (re == NULL) {
+        return;
+    }
+    re->refs--;
+    if (re->refs > 0) {
+        return;
+    }
+    pcre2_match_data_free(re->match_data);
+    pcre2_code_free(re->code);
+    free(re->literal);
+    free(re);
+}
+
+// limit_exceeded checks if the PCRE2 error code means that matching
+// hit a resource limit, and remembers the error if it does.
+static bool limit_exceeded(Regexp* re, int rc) {
+    switch (rc) {
+        case PCRE2_ERROR_MATCHLIMIT:
+        case PCRE2_ERROR_DEPTHLIMIT:
+        case PCRE2_ERROR_HEAPLIMIT:
+            re->error = rc;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// match runs the regexp against the source string starting at the given offset.
+// Stores the result in the regexp match data.
+// Returns the number of matched groups + 1, REGEXP_LIMIT_EXCEEDED if matching
+// hit a resource limit, or another negative PCRE2 error code.
+// Partial matching is not used, so the result is never PCRE2_ERROR_PARTIAL.
+static int match(Regexp* re, const char* source, size_t source_len, size_t offset,
+                 uint32_t options) {
+    int rc = pcre2_match(re->code, (PCRE2_SPTR8)source, source_len, offset, options,
+                         re->match_data, re->match_ctx);
+    if (rc < 0 && limit_exceeded(re, rc)) {
+        return REGEXP_LIMIT_EXCEEDED;
+    }
+    return rc;
 }
 
 // regexp_like checks if source string matches pattern.
 // Returns:
 //  -1 if the pattern is invalid
+//  REGEXP_LIMIT_EXCEEDED if matching hit a resource limit
 //  0 if there is no match
 //  1 if there is a match
-int regexp_like(pcre2_code* re, const char* source) {
+int regexp_like(Regexp* re, const char* source, size_t source_len) {
     if (re == NULL) {
         return -1;
     }
 
-    pcre2_match_data* match_data;
-    match_data = pcre2_match_data_create_from_pattern(re, NULL);
-
-    size_t source_len = strlen(source);
-
-    int rc = pcre2_match(re, (const unsigned char*)source, source_len, 0, 0, match_data, NULL);
-
-    pcre2_match_data_free(match_data);
+    if (re->kind != REGEXP_GENERAL) {
+        // PCRE finds no match in an invalid UTF-8 subject, and neither do literals
+        if (match_literal(re, source, source_len) == -1 || !is_valid_utf8(source, source_len)) {
+            return 0;
+        }
+        return 1;
+    }
+    if (!can_match(re, source, source_len)) {
+        return 0;
+    }
 
+    int rc = match(re, source, source_len, 0, 0);
     if (rc <= 0) {
-        return 0;
+        return rc == REGEXP_LIMIT_EXCEEDED ? rc : 0;
     } else {
         return 1;
     }
 }
 
-// regexp_extract extracts source substring matching pattern into substr.
+// regexp_extract extracts source substring matching pattern.
 // If group_idx > 0, returns the corresponding group instead of the whole matched substring.
+// The substring is not copied: `substr` points into the source string.
 // Returns:
 //  -1 if the pattern is invalid
+//  REGEXP_LIMIT_EXCEEDED if matching hit a resource limit
 //  0 if there is no match
 //  1 if there is a match
-int regexp_extract(pcre2_code* re, const char* source, size_t group_idx, char** substr) {
+int regexp_extract(Regexp* re,
+                   const char* source,
+                   size_t source_len,
+                   size_t group_idx,
+                   const char** substr,
+                   size_t* substr_len) {
     if (re == NULL) {
         return -1;
     }
 
-    pcre2_match_data* match_data;
-    match_data = pcre2_match_data_create_from_pattern(re, NULL);
-
-    int rc = pcre2_match(re, (const unsigned char*)source, PCRE2_ZERO_TERMINATED, 0, 0, match_data,
-                         NULL);
+    if (re->kind != REGEXP_GENERAL) {
+        // literal patterns have no groups
+        int64_t offset = match_literal(re, source, source_len);
+        if (offset == -1 || group_idx > 0 || !is_valid_utf8(source, source_len)) {
+            return 0;
+        }
+        *substr = source + offset;
+        *substr_len = re->literal_len;
+        return 1;
+    }
+    if (!can_match(re, source, source_len)) {
+        return 0;
+    }
 
+    int rc = match(re, source, source_len, 0, 0);
     if (rc <= 0) {
-        pcre2_match_data_free(match_data);
-        return 0;
+        return rc == REGEXP_LIMIT_EXCEEDED ? rc : 0;
     }
 
     if (group_idx >= (size_t)rc) {
-        pcre2_match_data_free(match_data);
         return 0;
     }
 
-    size_t* ovector = pcre2_get_ovector_pointer(match_data);
-
-    const char* substr_start = source + ovector[2 * group_idx];
-    size_t substr_len = ovector[2 * group_idx + 1] - ovector[2 * group_idx];
-
-    *substr = malloc(substr_len + 1);
-    memcpy(*substr, substr_start, substr_len);
-    (*substr)[substr_len] = '\0';
-
-    pcre2_match_data_free(match_data);
+    size_t* ovector = pcre2_get_ovector_pointer(re->match_data);
+    if (ovector[2 * group_idx] == PCRE2_UNSET) {
+        // the group did not participate in the match
+        *substr = source;
+        *substr_len = 0;
+        return 1;
+    }
+    *substr = source + ovector[2 * group_idx];
+    *substr_len = ovector[2 * group_idx + 1] - ovector[2 * group_idx];
     return 1;
 }
 
-// regexp_replace replaces matching substring with replacement string into `dest`.
+// regexp_find finds the leftmost match starting at or after the offset.
+// Sets `start` and `end` to the match boundaries within the source.
+// A non-zero offset means the source has already been searched from the start,
+// so it is not checked for UTF-8 validity again (which would take O(n) per call).
 // Returns:
 //  -1 if the pattern is invalid
+//  REGEXP_LIMIT_EXCEEDED if matching hit a resource limit
 //  0 if there is no match
 //  1 if there is a match
-int regexp_replace(pcre2_code* re, const char* source, const char* repl, char** dest) {
+int regexp_find(Regexp* re,
+                const char* source,
+                size_t source_len,
+                size_t offset,
+                size_t* start,
+                size_t* end) {
     if (re == NULL) {
         return -1;
     }
+    if (offset > source_len) {
+        return 0;
+    }
 
-    pcre2_match_data* match_data;
-    match_data = pcre2_match_data_create_from_pattern(re, NULL);
-
-    const int options = PCRE2_SUBSTITUTE_GLOBAL | PCRE2_SUBSTITUTE_EXTENDED;
-    size_t source_len = strlen(source);
-    size_t outlen = source_len + 1024;
-    char* output = malloc(outlen);
-    int rc = pcre2_substitute(re, (const unsigned char*)source, PCRE2_ZERO_TERMINATED, 0, options,
-                              match_data, NULL, (const unsigned char*)repl, PCRE2_ZERO_TERMINATED,
-                              (unsigned char*)output, &outlen);
+    if (re->kind != REGEXP_GENERAL) {
+        // anchored literal patterns only match at the start of the subject
+        if (offset > 0 && (re->kind == REGEXP_PREFIX || re->kind == REGEXP_EXACT)) {
+            return 0;
+        }
+        int64_t found = match_literal(re, source + offset, source_len - offset);
+        if (found == -1 || (offset == 0 && !is_valid_utf8(source, source_len))) {
+            return 0;
+        }
+        *start = offset + found;
+        *end = *start + re->literal_len;
+        return 1;
+    }
+    if (offset == 0 && !can_match(re, source, source_len)) {
+        return 0;
+    }
 
+    int rc = match(re, source, source_len, offset, offset > 0 ? PCRE2_NO_UTF_CHECK : 0);
     if (rc <= 0) {
-        pcre2_match_data_free(match_data);
-        free(output);
+        return rc == REGEXP_LIMIT_EXCEEDED ? rc : 0;
+    }
+    size_t* ovector = pcre2_get_ovector_pointer(re->match_data);
+    *start = ovector[0];
+    *end = ovector[1];
+    return 1;
+}
+
+// regexp_find_next finds the next match after the previous one, which ended at the offset.
+// After an empty match, first looks for a non-empty match at the same offset,
+// and then moves on by one character (the same way pcre2demo and
+// regexp_replace do), so that the search does not get stuck.
+// Returns the same values as regexp_find.
+int regexp_find_next(Regexp* re,
+                     const char* source,
+                     size_t source_len,
+                     size_t offset,
+                     bool after_empty,
+                     size_t* start,
+                     size_t* end) {
+    if (!after_empty) {
+        return regexp_find(re, source, source_len, offset, start, end);
+    }
+    if (re == NULL) {
+        return -1;
+    }
+    if (offset >= source_len) {
         return 0;
     }
+    if (re->kind == REGEXP_GENERAL) {
+        int rc = match(re, source, source_len, offset,
+                       PCRE2_NO_UTF_CHECK | PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED);
+        if (rc == REGEXP_LIMIT_EXCEEDED) {
+            return rc;
+        }
+        if (rc > 0) {
+            size_t* ovector = pcre2_get_ovector_pointer(re->match_data);
+            *start = ovector[0];
+            *end = ovector[1];
+            return 1;
+        }
+    }
+    offset += utf8_char_len(source[offset]);
+    return regexp_find(re, source, source_len, offset > source_len ? source_len : offset, start,
+                       end);
+}
+
+// regexp_replace replaces matching substring with replacement string into `dest`.
+// The output buffer is allocated with `alloc` (and released with `dealloc` on failure),
+// so the caller can take ownership of it without copying. Sets `dest_len`
+// to the output length, not including the terminating zero.
+// Returns:
+//  -1 if the pattern is invalid or out of memory
+//  REGEXP_LIMIT_EXCEEDED if matching hit a resource limit
+//  0 if there is no match
+//  1 if there is a match
+int regexp_replace(Regexp* re,
+                   const char* source,
+                   size_t source_len,
+                   const char* repl,
+                   size_t repl_len,
+                   void* (*alloc)(size_t size),
+                   void (*dealloc)(void* ptr),
+                   char** dest,
+                   size_t* dest_len) {
+    if (re == NULL) {
+        return -1;
+    }
 
-    *dest = malloc(outlen + 1);
-    memcpy(*dest, output, outlen);
-    (*dest)[outlen] = '\0';
+    if (!can_match(re, source, source_len)) {
+        return 0;
+    }
 
-    pcre2_match_data_free(match_data);
-    free(output);
-    return 1;
+    // with PCRE2_SUBSTITUTE_OVERFLOW_LENGTH, the output length is calculated
+    // even if the output does not fit, so it takes at most two attempts:
+    // the first one with a buffer that fits most replacements,
+    // and the second one with the buffer of the exact size
+    const uint32_t options =
+        PCRE2_SUBSTITUTE_GLOBAL | PCRE2_SUBSTITUTE_EXTENDED | PCRE2_SUBSTITUTE_OVERFLOW_LENGTH;
+    size_t size = source_len + 1024;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        char* output = alloc(size);
+        if (output == NULL) {
+            return -1;
+        }
+        size_t outlen = size;
+        // pcre2_substitute checks the source for UTF validity once,
+        // and skips the check for subsequent matches
+        int rc = pcre2_substitute(re->code, (PCRE2_SPTR8)source, source_len, 0, options,
+                                  re->match_data, re->match_ctx, (PCRE2_SPTR8)repl, repl_len,
+                                  (unsigned char*)output, &outlen);
+        if (rc > 0) {
+            *dest = output;
+            *dest_len = outlen;
+            return 1;
+        }
+        dealloc(output);
+        if (rc != PCRE2_ERROR_NOMEMORY) {
+            return limit_exceeded(re, rc) ? REGEXP_LIMIT_EXCEEDED : 0;
+        }
+        // outlen is the required size, including the terminating zero
+        size = outlen;
+    }
+    return -1;
 }
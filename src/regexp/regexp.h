@@ -4,13 +4,86 @@
 #ifndef REGEXP_H
 #define REGEXP_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include "regexp/pcre2/pcre2.h"
 
-pcre2_code* regexp_compile(const char* pattern);
-void regexp_free(pcre2_code* re);
-char* regexp_get_error(const char* pattern);
-int regexp_like(pcre2_code* re, const char* source);
-int regexp_extract(pcre2_code* re, const char* source, size_t group_idx, char** substr);
-int regexp_replace(pcre2_code* re, const char* source, const char* repl, char** dest);
+// Kinds of patterns. Literal patterns are matched without PCRE.
+#define REGEXP_GENERAL 0
+#define REGEXP_LITERAL 1
+#define REGEXP_PREFIX 2
+#define REGEXP_SUFFIX 3
+#define REGEXP_EXACT 4
+
+// Result of the match functions when a resource limit
+// (match_limit, depth_limit or heap_limit) is exceeded.
+#define REGEXP_LIMIT_EXCEEDED -2
+
+// Regexp is a compiled pattern along with the match data and match context,
+// so that the pattern can be matched many times without allocating memory.
+typedef struct {
+    pcre2_code* code;
+    pcre2_match_data* match_data;
+    // match context with the resource limits, shared by the regexps
+    // of a connection and not owned by the regexp (NULL means default limits)
+    pcre2_match_context* match_ctx;
+    // last PCRE2 error code returned by matching
+    int error;
+    // number of references to the regexp (e.g. from cache and auxdata)
+    int refs;
+    // pattern kind and literal text for literal patterns
+    int kind;
+    char* literal;
+    size_t literal_len;
+    // minimum subject length and a code unit (in both cases, if caseless)
+    // that any match must contain, or -1 if unknown
+    size_t min_len;
+    int req_cu;
+    int req_cu2;
+} Regexp;
+
+Regexp* regexp_compile(const char* pattern,
+                       size_t pattern_len,
+                       pcre2_match_context* match_ctx,
+                       char** errmsg);
+uint8_t* regexp_serialize(const char* pattern, size_t pattern_len, size_t* size, char** errmsg);
+int regexp_is_serialized(const uint8_t* data, size_t size);
+Regexp* regexp_deserialize(const uint8_t* data,
+                           size_t size,
+                           pcre2_match_context* match_ctx,
+                           char** errmsg);
+Regexp* regexp_retain(Regexp* re);
+void regexp_free(Regexp* re);
+int regexp_like(Regexp* re, const char* source, size_t source_len);
+int regexp_extract(Regexp* re,
+                   const char* source,
+                   size_t source_len,
+                   size_t group_idx,
+                   const char** substr,
+                   size_t* substr_len);
+int regexp_find(Regexp* re,
+                const char* source,
+                size_t source_len,
+                size_t offset,
+                size_t* start,
+                size_t* end);
+int regexp_find_next(Regexp* re,
+                     const char* source,
+                     size_t source_len,
+                     size_t offset,
+                     bool after_empty,
+                     size_t* start,
+                     size_t* end);
+int regexp_replace(Regexp* re,
+                   const char* source,
+                   size_t source_len,
+                   const char* repl,
+                   size_t repl_len,
+                   void* (*alloc)(size_t size),
+                   void (*dealloc)(void* ptr),
+                   char** dest,
+                   size_t* dest_len);
 
 #endif /* REGEXP_H */
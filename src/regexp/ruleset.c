@@ -0,0 +1,191 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+/*
+ * Set of regular expressions matched against the input in one pass.
+ *
+ * Most real-world patterns contain a literal string that any match must
+ * include (e.g. 'timeout' in 'connection timeout after \d+ms'). These
+ * literals (factors) go into an Aho-Corasick automaton, which finds all of
+ * them in a single scan of the input. Only the patterns whose factors occur
+ * in the input (and the patterns without factors) are then matched with PCRE.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "regexp/ahocorasick.h"
+#include "regexp/literal.h"
+#include "regexp/regexp.h"
+#include "regexp/ruleset.h"
+
+// Factor is the longest literal found so far.
+typedef struct {
+    char* buf;
+    size_t len;
+} Factor;
+
+// keep_longest remembers the literal if it is the longest so far.
+static void keep_longest(const char* lit, size_t len, void* arg) {
+    Factor* factor = arg;
+    if (len > factor->len) {
+        memcpy(factor->buf, lit, len);
+        factor->len = len;
+    }
+}
+
+// literal_factor finds the longest literal string that any match of the pattern
+// must contain. Writes the factor into `buf` (which must be at least `len` bytes)
+// and returns its length, or 0 if there is no such string.
+static size_t literal_factor(const char* pattern, size_t len, char* buf) {
+    Factor factor = {buf, 0};
+    if (regexp_literals(pattern, len, keep_longest, &factor) < 0) {
+        return 0;
+    }
+    return factor.len;
+}
+
+// regexp_set_new creates an empty set.
+RegexpSet* regexp_set_new(void) {
+    RegexpSet* set = calloc(1, sizeof(RegexpSet));
+    if (set == NULL) {
+        return NULL;
+    }
+    set->prefilter = aho_corasick_new();
+    if (set->prefilter == NULL) {
+        free(set);
+        return NULL;
+    }
+    set->refs = 1;
+    return set;
+}
+
+// regexp_set_retain adds a reference to the set.
+RegexpSet* regexp_set_retain(RegexpSet* set) {
+    set->refs++;
+    return set;
+}
+
+// regexp_set_free releases a reference to the set,
+// and frees it along with the patterns if there are no references left.
+void regexp_set_free(RegexpSet* set) {
+    if (set == NULL) {
+        return;
+    }
+    set->refs--;
+    if (set->refs > 0) {
+        return;
+    }
+    for (size_t i = 0; i < set->size; i++) {
+        regexp_free(set->res[i]);
+    }
+    free(set->ids);
+    free(set->res);
+    free(set->has_factor);
+    free(set->seen);
+    aho_corasick_free(set->prefilter);
+    free(set);
+}
+
+// regexp_set_add adds the compiled pattern with the given id to the set.
+// The set takes its own reference to the regexp.
+// `pattern` is the pattern text used to find the literal factor,
+// or NULL if the text is unknown (the pattern is then matched against every input).
+// Returns 0 on success, -1 if out of memory.
+int regexp_set_add(RegexpSet* set,
+                   int64_t id,
+                   Regexp* re,
+                   const char* pattern,
+                   size_t pattern_len) {
+    if (set->size == set->cap) {
+        size_t cap = set->cap == 0 ? 16 : set->cap * 2;
+        int64_t* ids = realloc(set->ids, cap * sizeof(int64_t));
+        if (ids == NULL) {
+            return -1;
+        }
+        set->ids = ids;
+        Regexp** res = realloc(set->res, cap * sizeof(Regexp*));
+        if (res == NULL) {
+            return -1;
+        }
+        set->res = res;
+        uint8_t* has_factor = realloc(set->has_factor, cap);
+        if (has_factor == NULL) {
+            return -1;
+        }
+        set->has_factor = has_factor;
+        set->cap = cap;
+    }
+
+    size_t idx = set->size;
+    set->has_factor[idx] = 0;
+    if (pattern != NULL && pattern_len > 0) {
+        char* factor = malloc(pattern_len);
+        if (factor == NULL) {
+            return -1;
+        }
+        size_t factor_len = literal_factor(pattern, pattern_len, factor);
+        if (factor_len > 0) {
+            if (aho_corasick_add(set->prefilter, factor, factor_len, (int32_t)idx) != 0) {
+                free(factor);
+                return -1;
+            }
+            set->has_factor[idx] = 1;
+        }
+        free(factor);
+    }
+
+    set->ids[idx] = id;
+    set->res[idx] = regexp_retain(re);
+    set->size++;
+    return 0;
+}
+
+// regexp_set_build prepares the set for matching after all the patterns are added.
+// Returns 0 on success, -1 if out of memory.
+int regexp_set_build(RegexpSet* set) {
+    set->seen = calloc(set->size > 0 ? set->size : 1, sizeof(uint32_t));
+    if (set->seen == NULL) {
+        return -1;
+    }
+    set->generation = 0;
+    return aho_corasick_build(set->prefilter);
+}
+
+// mark_candidate marks the pattern whose factor the prefilter found.
+static void mark_candidate(int32_t idx, void* arg) {
+    RegexpSet* set = arg;
+    set->seen[idx] = set->generation;
+}
+
+// regexp_set_match finds the patterns matching the source string.
+// Writes the indexes of the matching patterns (in the order they were added)
+// into `matched`, which must have room for all the patterns in the set.
+// Returns the number of matching patterns,
+// or REGEXP_LIMIT_EXCEEDED if matching hit a resource limit.
+int regexp_set_match(RegexpSet* set, const char* source, size_t source_len, size_t* matched) {
+    set->generation++;
+    if (set->generation == 0) {
+        memset(set->seen, 0, set->size * sizeof(uint32_t));
+        set->generation = 1;
+    }
+    aho_corasick_scan(set->prefilter, source, source_len, mark_candidate, set);
+
+    int count = 0;
+    for (size_t i = 0; i < set->size; i++) {
+        if (set->has_factor[i] && set->seen[i] != set->generation) {
+            continue;
+        }
+        int rc = regexp_like(set->res[i], source, source_len);
+        if (rc == REGEXP_LIMIT_EXCEEDED) {
+            set->error = set->res[i]->error;
+            return rc;
+        }
+        if (rc == 1) {
+            matched[count++] = i;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,47 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// Set of regular expressions matched against the input in one pass.
+
+#ifndef REGEXP_RULESET_H
+#define REGEXP_RULESET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "regexp/ahocorasick.h"
+#include "regexp/regexp.h"
+
+// RegexpSet is a set of compiled patterns with their ids.
+// A literal string required by each pattern (if any) goes into
+// an Aho-Corasick prefilter, so that the input is scanned once,
+// and only the patterns whose literals occur in it are matched with PCRE.
+typedef struct {
+    int64_t* ids;
+    Regexp** res;
+    size_t size;
+    size_t cap;
+    // true if the pattern has a required literal in the prefilter
+    uint8_t* has_factor;
+    AhoCorasick* prefilter;
+    // prefilter results: the pattern is a candidate if seen[i] == generation
+    uint32_t* seen;
+    uint32_t generation;
+    // last PCRE2 error code returned by matching
+    int error;
+    // number of references to the set (e.g. from the registry and cursors)
+    int refs;
+} RegexpSet;
+
+RegexpSet* regexp_set_new(void);
+RegexpSet* regexp_set_retain(RegexpSet* set);
+void regexp_set_free(RegexpSet* set);
+int regexp_set_add(RegexpSet* set,
+                   int64_t id,
+                   Regexp* re,
+                   const char* pattern,
+                   size_t pattern_len);
+int regexp_set_build(RegexpSet* set);
+int regexp_set_match(RegexpSet* set, const char* source, size_t source_len, size_t* matched);
+
+#endif /* REGEXP_RULESET_H */
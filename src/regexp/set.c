@@ -0,0 +1,603 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// Named sets of regular expressions (rule sets) matched in one pass.
+//
+// regexp_set_create(name, sql)
+//   - creates the set from the query results (id and pattern columns)
+// regexp_set_match(name, source)
+//   - returns the ids of the matching patterns as a JSON array
+// regexp_set_matches(name, source)
+//   - finds all matches of all patterns, implemented as a table-valued function
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sqlite3ext.h"
+SQLITE_EXTENSION_INIT3
+
+#include "regexp/cache.h"
+#include "regexp/internal.h"
+#include "regexp/pcre2/pcre2.h"
+#include "regexp/regexp.h"
+#include "regexp/ruleset.h"
+
+// SetEntry is a named set in the registry.
+typedef struct SetEntry {
+    char* name;
+    RegexpSet* set;
+    struct SetEntry* next;
+} SetEntry;
+
+// SetRegistry keeps the sets created in the connection.
+typedef struct {
+    SetEntry* head;
+    // provides the match context for the set patterns
+    RegexpCache* cache;
+    // number of references to the registry (e.g. from registered functions)
+    int refs;
+} SetRegistry;
+
+// registry_new creates an empty registry.
+static SetRegistry* registry_new(RegexpCache* cache) {
+    SetRegistry* registry = calloc(1, sizeof(SetRegistry));
+    if (registry == NULL) {
+        return NULL;
+    }
+    registry->cache = regexp_cache_retain(cache);
+    registry->refs = 1;
+    return registry;
+}
+
+// registry_retain adds a reference to the registry.
+static SetRegistry* registry_retain(SetRegistry* registry) {
+    registry->refs++;
+    return registry;
+}
+
+// registry_free releases a reference to the registry,
+// and frees it along with all the sets if there are no references left.
+static void registry_free(SetRegistry* registry) {
+    registry->refs--;
+    if (registry->refs > 0) {
+        return;
+    }
+    SetEntry* entry = registry->head;
+    while (entry != NULL) {
+        SetEntry* next = entry->next;
+        regexp_set_free(entry->set);
+        free(entry->name);
+        free(entry);
+        entry = next;
+    }
+    regexp_cache_free(registry->cache);
+    free(registry);
+}
+
+// registry_get returns the set with the given name, or NULL if there is none.
+static RegexpSet* registry_get(SetRegistry* registry, const char* name) {
+    for (SetEntry* entry = registry->head; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->name, name) == 0) {
+            return entry->set;
+        }
+    }
+    return NULL;
+}
+
+// registry_put adds the set to the registry, replacing the existing set
+// with the same name. The registry takes ownership of the set reference.
+// Returns 0 on success, -1 if out of memory.
+static int registry_put(SetRegistry* registry, const char* name, RegexpSet* set) {
+    for (SetEntry* entry = registry->head; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->name, name) == 0) {
+            // cursors still using the old set hold their own references
+            regexp_set_free(entry->set);
+            entry->set = set;
+            return 0;
+        }
+    }
+    SetEntry* entry = malloc(sizeof(SetEntry));
+    if (entry == NULL) {
+        return -1;
+    }
+    entry->name = strdup(name);
+    if (entry->name == NULL) {
+        free(entry);
+        return -1;
+    }
+    entry->set = set;
+    entry->next = registry->head;
+    registry->head = entry;
+    return 0;
+}
+
+// load_set creates the set from the query results.
+// On failure, returns NULL and sets the error result.
+static RegexpSet* load_set(sqlite3_context* context, RegexpCache* cache, const char* sql) {
+    sqlite3* db = sqlite3_context_db_handle(context);
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+        return NULL;
+    }
+    if (sqlite3_column_count(stmt) < 2) {
+        sqlite3_finalize(stmt);
+        sqlite3_result_error(context, "query must return id and pattern columns", -1);
+        return NULL;
+    }
+
+    RegexpSet* set = regexp_set_new();
+    if (set == NULL) {
+        sqlite3_finalize(stmt);
+        sqlite3_result_error_nomem(context);
+        return NULL;
+    }
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        sqlite3_int64 id = sqlite3_column_int64(stmt, 0);
+        int type = sqlite3_column_type(stmt, 1);
+        const char* pattern = NULL;
+        size_t pattern_len = 0;
+        char* msg = NULL;
+        Regexp* re = NULL;
+
+        Regexp* loaded = sqlite3_value_pointer(sqlite3_column_value(stmt, 1), REGEXP_POINTER_TYPE);
+        if (loaded != NULL) {
+            // loaded with regexp_from_compiled(), the pattern text is unknown
+            re = regexp_retain(loaded);
+        } else if (type == SQLITE_BLOB &&
+                   regexp_is_serialized(sqlite3_column_blob(stmt, 1),
+                                        sqlite3_column_bytes(stmt, 1))) {
+            msg = strdup("use regexp_from_compiled() to load the compiled regexp");
+        } else if (type != SQLITE_NULL) {
+            pattern = (const char*)sqlite3_column_text(stmt, 1);
+            pattern_len = sqlite3_column_bytes(stmt, 1);
+            re = regexp_compile(pattern, pattern_len, cache->match_ctx, &msg);
+        } else {
+            msg = strdup("missing regexp pattern");
+        }
+
+        if (re == NULL) {
+            if (msg == NULL) {
+                sqlite3_result_error_nomem(context);
+            } else {
+                char* err = sqlite3_mprintf("pattern %lld: %s", id, msg);
+                sqlite3_result_error(context, err, -1);
+                sqlite3_free(err);
+                free(msg);
+            }
+            sqlite3_finalize(stmt);
+            regexp_set_free(set);
+            return NULL;
+        }
+
+        int added = regexp_set_add(set, id, re, pattern, pattern_len);
+        regexp_free(re);
+        if (added != 0) {
+            sqlite3_finalize(stmt);
+            regexp_set_free(set);
+            sqlite3_result_error_nomem(context);
+            return NULL;
+        }
+    }
+
+    if (rc != SQLITE_DONE) {
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+        sqlite3_finalize(stmt);
+        regexp_set_free(set);
+        return NULL;
+    }
+    sqlite3_finalize(stmt);
+
+    if (regexp_set_build(set) != 0) {
+        regexp_set_free(set);
+        sqlite3_result_error_nomem(context);
+        return NULL;
+    }
+    return set;
+}
+
+/*
+ * Creates the set of patterns with the given name from the query results.
+ * The query must return the pattern id and the pattern (text or compiled)
+ * as the first two columns. Replaces the existing set with the same name.
+ * Returns the number of patterns in the set.
+ * regexp_set_create(name, sql)
+ * E.g.: select regexp_set_create('rules', 'select id, pattern from rules');
+ */
+static void fn_set_create(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 2);
+
+    const char* name = (const char*)sqlite3_value_text(argv[0]);
+    if (name == NULL) {
+        sqlite3_result_error(context, "missing set name", -1);
+        return;
+    }
+    const char* sql = (const char*)sqlite3_value_text(argv[1]);
+    if (sql == NULL) {
+        sqlite3_result_error(context, "missing set query", -1);
+        return;
+    }
+
+    SetRegistry* registry = sqlite3_user_data(context);
+    RegexpSet* set = load_set(context, registry->cache, sql);
+    if (set == NULL) {
+        return;
+    }
+    size_t size = set->size;
+
+    if (registry_put(registry, name, set) != 0) {
+        regexp_set_free(set);
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    sqlite3_result_int64(context, size);
+}
+
+/*
+ * Returns the ids of the set patterns matching the source string,
+ * as a JSON array in the order the patterns were loaded.
+ * regexp_set_match(name, source)
+ * E.g.: select regexp_set_match('rules', 'connection timeout after 30ms');
+ */
+static void fn_set_match(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 2);
+
+    const char* name = (const char*)sqlite3_value_text(argv[0]);
+    if (name == NULL) {
+        sqlite3_result_error(context, "missing set name", -1);
+        return;
+    }
+
+    SetRegistry* registry = sqlite3_user_data(context);
+    RegexpSet* set = registry_get(registry, name);
+    if (set == NULL) {
+        char* msg = sqlite3_mprintf("unknown regexp set: %s", name);
+        sqlite3_result_error(context, msg, -1);
+        sqlite3_free(msg);
+        return;
+    }
+
+    const char* source = (const char*)sqlite3_value_text(argv[1]);
+    if (source == NULL) {
+        return;
+    }
+    size_t source_len = sqlite3_value_bytes(argv[1]);
+
+    size_t* matched = malloc((set->size > 0 ? set->size : 1) * sizeof(size_t));
+    if (matched == NULL) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    int count = regexp_set_match(set, source, source_len, matched);
+    if (count == REGEXP_LIMIT_EXCEEDED) {
+        free(matched);
+        PCRE2_UCHAR buffer[256];
+        pcre2_get_error_message(set->error, buffer, sizeof(buffer));
+        sqlite3_result_error(context, (char*)buffer, -1);
+        sqlite3_result_error_code(context, SQLITE_ABORT);
+        return;
+    }
+
+    sqlite3_str* str = sqlite3_str_new(NULL);
+    sqlite3_str_appendchar(str, 1, '[');
+    for (int i = 0; i < count; i++) {
+        sqlite3_str_appendf(str, i == 0 ? "%lld" : ",%lld", set->ids[matched[i]]);
+    }
+    sqlite3_str_appendchar(str, 1, ']');
+    free(matched);
+
+    int len = sqlite3_str_length(str);
+    char* result = sqlite3_str_finish(str);
+    if (result == NULL) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    sqlite3_result_text(context, result, len, sqlite3_free);
+}
+
+// regexp_set_matches table-valued function.
+
+#define COLUMN_ID 0
+#define COLUMN_MATCH 1
+#define COLUMN_START 2
+#define COLUMN_END 3
+#define COLUMN_NAME 4
+#define COLUMN_SOURCE 5
+
+typedef struct {
+    sqlite3_vtab base;
+    SetRegistry* registry;
+} Table;
+
+typedef struct {
+    sqlite3_vtab_cursor base;
+    RegexpSet* set;
+    // copy of the source string
+    char* source;
+    size_t source_len;
+    // indexes of the matching patterns and the current one
+    size_t* matched;
+    int nmatched;
+    int current;
+    // current match and the position to search for the next one
+    size_t match_start;
+    size_t match_end;
+    size_t pos;
+    // true if the current match is empty
+    bool after_empty;
+    bool eof;
+    sqlite3_int64 rowid;
+} Cursor;
+
+// xconnect creates the virtual table.
+static int xconnect(sqlite3* db,
+                    void* aux,
+                    int argc,
+                    const char* const* argv,
+                    sqlite3_vtab** vtabptr,
+                    char** errptr) {
+    (void)argc;
+    (void)argv;
+    (void)errptr;
+
+    int rc = sqlite3_declare_vtab(db,
+                                  "CREATE TABLE x(id integer, match text, start integer, "
+                                  "end integer, name hidden, source hidden)");
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    Table* table = sqlite3_malloc(sizeof(*table));
+    *vtabptr = (sqlite3_vtab*)table;
+    if (table == NULL) {
+        return SQLITE_NOMEM;
+    }
+    memset(table, 0, sizeof(*table));
+    table->registry = aux;
+    sqlite3_vtab_config(db, SQLITE_VTAB_INNOCUOUS);
+    return SQLITE_OK;
+}
+
+// xdisconnect destroys the virtual table.
+static int xdisconnect(sqlite3_vtab* vtable) {
+    Table* table = (Table*)vtable;
+    sqlite3_free(table);
+    return SQLITE_OK;
+}
+
+// xopen creates a new cursor.
+static int xopen(sqlite3_vtab* vtable, sqlite3_vtab_cursor** curptr) {
+    (void)vtable;
+    Cursor* cursor = sqlite3_malloc(sizeof(*cursor));
+    if (cursor == NULL) {
+        return SQLITE_NOMEM;
+    }
+    memset(cursor, 0, sizeof(*cursor));
+    *curptr = &cursor->base;
+    return SQLITE_OK;
+}
+
+// reset frees the resources used by the cursor.
+static void reset(Cursor* cursor) {
+    regexp_set_free(cursor->set);
+    cursor->set = NULL;
+    free(cursor->source);
+    cursor->source = NULL;
+    free(cursor->matched);
+    cursor->matched = NULL;
+}
+
+// xclose destroys the cursor.
+static int xclose(sqlite3_vtab_cursor* cur) {
+    Cursor* cursor = (Cursor*)cur;
+    reset(cursor);
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+// limit_error sets the error message for a match that hit a resource limit.
+static int limit_error(Cursor* cursor, int error) {
+    sqlite3_vtab* vtable = cursor->base.pVtab;
+    PCRE2_UCHAR buffer[256];
+    pcre2_get_error_message(error, buffer, sizeof(buffer));
+    sqlite3_free(vtable->zErrMsg);
+    vtable->zErrMsg = sqlite3_mprintf("%s", buffer);
+    return SQLITE_ABORT;
+}
+
+// xnext advances the cursor to the next match of the current pattern,
+// or to the first match of the next matching pattern.
+static int xnext(sqlite3_vtab_cursor* cur) {
+    Cursor* cursor = (Cursor*)cur;
+    while (cursor->current < cursor->nmatched) {
+        Regexp* re = cursor->set->res[cursor->matched[cursor->current]];
+        size_t start, end;
+        int rc = regexp_find_next(re, cursor->source, cursor->source_len, cursor->pos,
+                                  cursor->after_empty, &start, &end);
+        if (rc == REGEXP_LIMIT_EXCEEDED) {
+            return limit_error(cursor, re->error);
+        }
+        if (rc == 1) {
+            cursor->match_start = start;
+            cursor->match_end = end;
+            cursor->pos = end;
+            cursor->after_empty = end == start;
+            cursor->rowid++;
+            return SQLITE_OK;
+        }
+        cursor->current++;
+        cursor->pos = 0;
+        cursor->after_empty = false;
+    }
+    cursor->eof = true;
+    return SQLITE_OK;
+}
+
+// xcolumn returns the current cursor value.
+static int xcolumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int col_idx) {
+    Cursor* cursor = (Cursor*)cur;
+    switch (col_idx) {
+        case COLUMN_ID:
+            sqlite3_result_int64(ctx, cursor->set->ids[cursor->matched[cursor->current]]);
+            break;
+
+        case COLUMN_MATCH:
+            sqlite3_result_text(ctx, cursor->source + cursor->match_start,
+                                cursor->match_end - cursor->match_start, SQLITE_TRANSIENT);
+            break;
+
+        case COLUMN_START:
+            sqlite3_result_int64(ctx, cursor->match_start);
+            break;
+
+        case COLUMN_END:
+            sqlite3_result_int64(ctx, cursor->match_end);
+            break;
+
+        default:
+            break;
+    }
+    return SQLITE_OK;
+}
+
+// xrowid returns the rowid for the current row.
+static int xrowid(sqlite3_vtab_cursor* cur, sqlite_int64* rowid_ptr) {
+    Cursor* cursor = (Cursor*)cur;
+    *rowid_ptr = cursor->rowid;
+    return SQLITE_OK;
+}
+
+// xeof returns TRUE if the cursor has been moved off of the last row of output.
+static int xeof(sqlite3_vtab_cursor* cur) {
+    Cursor* cursor = (Cursor*)cur;
+    return cursor->eof;
+}
+
+// xfilter finds the matching patterns and the first match.
+static int xfilter(sqlite3_vtab_cursor* cur,
+                   int idx_num,
+                   const char* idx_str,
+                   int argc,
+                   sqlite3_value** argv) {
+    (void)idx_num;
+    (void)idx_str;
+
+    if (argc != 2) {
+        return SQLITE_ERROR;
+    }
+
+    Cursor* cursor = (Cursor*)cur;
+    sqlite3_vtab* vtable = (cursor->base).pVtab;
+    Table* table = (Table*)vtable;
+
+    // free resources from the previous source, if any
+    reset(cursor);
+    cursor->eof = true;
+    cursor->rowid = 0;
+
+    const char* name = (const char*)sqlite3_value_text(argv[0]);
+    const char* source = (const char*)sqlite3_value_text(argv[1]);
+    if (name == NULL || source == NULL) {
+        return SQLITE_OK;
+    }
+
+    RegexpSet* set = registry_get(table->registry, name);
+    if (set == NULL) {
+        sqlite3_free(vtable->zErrMsg);
+        vtable->zErrMsg = sqlite3_mprintf("unknown regexp set: %s", name);
+        return SQLITE_ERROR;
+    }
+    // the set may be replaced while the cursor is still in use
+    cursor->set = regexp_set_retain(set);
+
+    cursor->source_len = sqlite3_value_bytes(argv[1]);
+    cursor->source = malloc(cursor->source_len + 1);
+    cursor->matched = malloc((set->size > 0 ? set->size : 1) * sizeof(size_t));
+    if (cursor->source == NULL || cursor->matched == NULL) {
+        return SQLITE_NOMEM;
+    }
+    memcpy(cursor->source, source, cursor->source_len + 1);
+
+    cursor->nmatched = regexp_set_match(set, cursor->source, cursor->source_len, cursor->matched);
+    if (cursor->nmatched == REGEXP_LIMIT_EXCEEDED) {
+        cursor->nmatched = 0;
+        return limit_error(cursor, set->error);
+    }
+    cursor->current = 0;
+    cursor->pos = 0;
+    cursor->after_empty = false;
+    cursor->eof = false;
+    return xnext(cur);
+}
+
+// xbest_index instructs SQLite to pass the name and source arguments to xFilter.
+static int xbest_index(sqlite3_vtab* vtable, sqlite3_index_info* index_info) {
+    int name_idx = -1;
+    int source_idx = -1;
+    for (int i = 0; i < index_info->nConstraint; i++) {
+        const struct sqlite3_index_constraint* constraint = index_info->aConstraint + i;
+        if (constraint->op != SQLITE_INDEX_CONSTRAINT_EQ) {
+            continue;
+        }
+        if (constraint->iColumn == COLUMN_NAME) {
+            if (!constraint->usable) {
+                return SQLITE_CONSTRAINT;
+            }
+            name_idx = i;
+        } else if (constraint->iColumn == COLUMN_SOURCE) {
+            if (!constraint->usable) {
+                return SQLITE_CONSTRAINT;
+            }
+            source_idx = i;
+        }
+    }
+
+    if (name_idx == -1 || source_idx == -1) {
+        vtable->zErrMsg = sqlite3_mprintf("regexp_set_matches() expects name and source");
+        return SQLITE_ERROR;
+    }
+
+    index_info->aConstraintUsage[name_idx].argvIndex = 1;
+    index_info->aConstraintUsage[name_idx].omit = 1;
+    index_info->aConstraintUsage[source_idx].argvIndex = 2;
+    index_info->aConstraintUsage[source_idx].omit = 1;
+    index_info->estimatedCost = (double)1000;
+    index_info->estimatedRows = 1000;
+    return SQLITE_OK;
+}
+
+static sqlite3_module set_module = {
+    .xConnect = xconnect,
+    .xBestIndex = xbest_index,
+    .xDisconnect = xdisconnect,
+    .xOpen = xopen,
+    .xClose = xclose,
+    .xFilter = xfilter,
+    .xNext = xnext,
+    .xEof = xeof,
+    .xColumn = xcolumn,
+    .xRowid = xrowid,
+};
+
+int regexp_set_init(sqlite3* db, RegexpCache* cache) {
+    SetRegistry* registry = registry_new(cache);
+    if (registry == NULL) {
+        return SQLITE_NOMEM;
+    }
+    sqlite3_create_function_v2(db, "regexp_set_create", 2, SQLITE_UTF8 | SQLITE_DIRECTONLY,
+                               registry_retain(registry), fn_set_create, 0, 0,
+                               (void (*)(void*))registry_free);
+    sqlite3_create_function_v2(db, "regexp_set_match", 2, SQLITE_UTF8,
+                               registry_retain(registry), fn_set_match, 0, 0,
+                               (void (*)(void*))registry_free);
+    sqlite3_create_module_v2(db, "regexp_set_matches", &set_module, registry_retain(registry),
+                             (void (*)(void*))registry_free);
+    // the functions hold their own references to the registry
+    registry_free(registry);
+    return SQLITE_OK;
+}
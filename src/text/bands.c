@@ -0,0 +1,246 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// text_minhash_bands(signature, bands)
+//   - splits the MinHash signature into bands and returns a key for each band
+//
+// Locality-sensitive hashing: the texts that share a key for at least
+// one band are candidates for being similar, so they can be grouped
+// with a plain GROUP BY (band, key) instead of comparing every pair.
+//
+// Implemented as a table-valued function.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sqlite3ext.h"
+SQLITE_EXTENSION_INIT3
+
+#include "text/bands.h"
+#include "text/minhash.h"
+
+#define COLUMN_BAND 0
+#define COLUMN_KEY 1
+#define COLUMN_SIGNATURE 2
+#define COLUMN_BANDS 3
+
+typedef struct {
+    sqlite3_vtab_cursor base;
+    // copy of the signature
+    uint8_t* sig;
+    // number of bands and signature values per band
+    size_t nbands;
+    size_t rows;
+    // current band (0-based)
+    size_t band;
+    sqlite3_int64 rowid;
+} Cursor;
+
+// xconnect creates the virtual table.
+static int xconnect(sqlite3* db,
+                    void* aux,
+                    int argc,
+                    const char* const* argv,
+                    sqlite3_vtab** vtabptr,
+                    char** errptr) {
+    (void)aux;
+    (void)argc;
+    (void)argv;
+    (void)errptr;
+
+    int rc = sqlite3_declare_vtab(
+        db, "CREATE TABLE x(band integer, key integer, signature hidden, bands hidden)");
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    sqlite3_vtab* table = sqlite3_malloc(sizeof(*table));
+    *vtabptr = table;
+    if (table == NULL) {
+        return SQLITE_NOMEM;
+    }
+    memset(table, 0, sizeof(*table));
+    sqlite3_vtab_config(db, SQLITE_VTAB_INNOCUOUS);
+    return SQLITE_OK;
+}
+
+// xdisconnect destroys the virtual table.
+static int xdisconnect(sqlite3_vtab* table) {
+    sqlite3_free(table);
+    return SQLITE_OK;
+}
+
+// xopen creates a new cursor.
+static int xopen(sqlite3_vtab* table, sqlite3_vtab_cursor** curptr) {
+    (void)table;
+    Cursor* cursor = sqlite3_malloc(sizeof(*cursor));
+    if (cursor == NULL) {
+        return SQLITE_NOMEM;
+    }
+    memset(cursor, 0, sizeof(*cursor));
+    *curptr = &cursor->base;
+    return SQLITE_OK;
+}
+
+// xclose destroys the cursor.
+static int xclose(sqlite3_vtab_cursor* cur) {
+    Cursor* cursor = (Cursor*)cur;
+    sqlite3_free(cursor->sig);
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+// xnext advances the cursor to the next band.
+static int xnext(sqlite3_vtab_cursor* cur) {
+    Cursor* cursor = (Cursor*)cur;
+    cursor->band++;
+    cursor->rowid++;
+    return SQLITE_OK;
+}
+
+// xcolumn returns the current cursor value.
+static int xcolumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int col_idx) {
+    Cursor* cursor = (Cursor*)cur;
+    switch (col_idx) {
+        case COLUMN_BAND:
+            sqlite3_result_int64(ctx, (sqlite3_int64)cursor->band + 1);
+            break;
+        case COLUMN_KEY:
+            sqlite3_result_int64(ctx, minhash_band_key(cursor->sig, cursor->band, cursor->rows));
+            break;
+        case COLUMN_SIGNATURE:
+            sqlite3_result_blob(ctx, cursor->sig,
+                                (int)(cursor->nbands * cursor->rows * MINHASH_VALUE_LEN),
+                                SQLITE_TRANSIENT);
+            break;
+        case COLUMN_BANDS:
+            sqlite3_result_int64(ctx, (sqlite3_int64)cursor->nbands);
+            break;
+    }
+    return SQLITE_OK;
+}
+
+// xrowid returns the rowid for the current row.
+static int xrowid(sqlite3_vtab_cursor* cur, sqlite_int64* rowid_ptr) {
+    Cursor* cursor = (Cursor*)cur;
+    *rowid_ptr = cursor->rowid;
+    return SQLITE_OK;
+}
+
+// xeof returns TRUE if the cursor has been moved off of the last row of output.
+static int xeof(sqlite3_vtab_cursor* cur) {
+    Cursor* cursor = (Cursor*)cur;
+    return cursor->band >= cursor->nbands;
+}
+
+// xfilter validates the arguments and copies the signature.
+static int xfilter(sqlite3_vtab_cursor* cur,
+                   int idx_num,
+                   const char* idx_str,
+                   int argc,
+                   sqlite3_value** argv) {
+    (void)idx_num;
+    (void)idx_str;
+
+    if (argc != 2) {
+        return SQLITE_ERROR;
+    }
+
+    Cursor* cursor = (Cursor*)cur;
+    sqlite3_vtab* table = cursor->base.pVtab;
+
+    sqlite3_free(cursor->sig);
+    cursor->sig = NULL;
+    cursor->nbands = 0;
+    cursor->rows = 0;
+    cursor->band = 0;
+    cursor->rowid = 1;
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return SQLITE_OK;
+    }
+
+    const uint8_t* sig = sqlite3_value_blob(argv[0]);
+    size_t len = (size_t)sqlite3_value_bytes(argv[0]);
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB || len == 0 || len % MINHASH_VALUE_LEN != 0) {
+        table->zErrMsg = sqlite3_mprintf("invalid minhash signature");
+        return SQLITE_ERROR;
+    }
+    size_t k = len / MINHASH_VALUE_LEN;
+
+    if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER) {
+        table->zErrMsg = sqlite3_mprintf("number of bands should be an integer");
+        return SQLITE_ERROR;
+    }
+    sqlite3_int64 nbands = sqlite3_value_int64(argv[1]);
+    if (nbands < 1 || (size_t)nbands > k || k % (size_t)nbands != 0) {
+        table->zErrMsg = sqlite3_mprintf(
+            "number of bands should be a positive divisor of the signature size (%d)", (int)k);
+        return SQLITE_ERROR;
+    }
+
+    cursor->sig = sqlite3_malloc64(len);
+    if (cursor->sig == NULL) {
+        return SQLITE_NOMEM;
+    }
+    memcpy(cursor->sig, sig, len);
+    cursor->nbands = (size_t)nbands;
+    cursor->rows = k / (size_t)nbands;
+    return SQLITE_OK;
+}
+
+// xbest_index instructs SQLite to pass the signature and bands arguments to xFilter.
+static int xbest_index(sqlite3_vtab* table, sqlite3_index_info* index_info) {
+    int sig_idx = -1;
+    int bands_idx = -1;
+    for (int i = 0; i < index_info->nConstraint; i++) {
+        const struct sqlite3_index_constraint* constraint = index_info->aConstraint + i;
+        if (constraint->op != SQLITE_INDEX_CONSTRAINT_EQ) {
+            continue;
+        }
+        if (constraint->iColumn == COLUMN_SIGNATURE) {
+            if (!constraint->usable) {
+                return SQLITE_CONSTRAINT;
+            }
+            sig_idx = i;
+        } else if (constraint->iColumn == COLUMN_BANDS) {
+            if (!constraint->usable) {
+                return SQLITE_CONSTRAINT;
+            }
+            bands_idx = i;
+        }
+    }
+
+    if (sig_idx == -1 || bands_idx == -1) {
+        table->zErrMsg = sqlite3_mprintf("minhash_bands() expects signature and bands");
+        return SQLITE_ERROR;
+    }
+
+    index_info->aConstraintUsage[sig_idx].argvIndex = 1;
+    index_info->aConstraintUsage[sig_idx].omit = 1;
+    index_info->aConstraintUsage[bands_idx].argvIndex = 2;
+    index_info->aConstraintUsage[bands_idx].omit = 1;
+    index_info->estimatedCost = (double)20;
+    index_info->estimatedRows = 20;
+    return SQLITE_OK;
+}
+
+static sqlite3_module bands_module = {
+    .xConnect = xconnect,
+    .xBestIndex = xbest_index,
+    .xDisconnect = xdisconnect,
+    .xOpen = xopen,
+    .xClose = xclose,
+    .xFilter = xfilter,
+    .xNext = xnext,
+    .xEof = xeof,
+    .xColumn = xcolumn,
+    .xRowid = xrowid,
+};
+
+int text_minhash_bands_init(sqlite3* db) {
+    sqlite3_create_module(db, "text_minhash_bands", &bands_module, 0);
+    sqlite3_create_module(db, "minhash_bands", &bands_module, 0);
+    return SQLITE_OK;
+}
@@ -0,0 +1,13 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// Locality-sensitive hashing for MinHash signatures.
+
+#ifndef TEXT_BANDS_H
+#define TEXT_BANDS_H
+
+#include "sqlite3ext.h"
+
+int text_minhash_bands_init(sqlite3* db);
+
+#endif /* TEXT_BANDS_H */
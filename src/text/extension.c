@@ -12,7 +12,9 @@
 #include "sqlite3ext.h"
 SQLITE_EXTENSION_INIT3
 
+#include "text/bands.h"
 #include "text/bstring.h"
+#include "text/minhash.h"
 #include "text/rstring.h"
 #include "text/utf8/utf8.h"
 
@@ -902,6 +904,83 @@ static void text_bit_size(sqlite3_context* context, int argc, sqlite3_value** ar
 
 #pragma endregion
 
+#pragma region Similarity
+
+// Calculates the MinHash signature of the string using k hash functions
+// and shingles of shingle_size characters (5 by default).
+// text_minhash(str, k[, shingle_size])
+static void text_minhash(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 2 || argc == 3);
+
+    const char* src = (char*)sqlite3_value_text(argv[0]);
+    if (src == NULL) {
+        sqlite3_result_null(context);
+        return;
+    }
+    size_t len = sqlite3_value_bytes(argv[0]);
+
+    if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER) {
+        sqlite3_result_error(context, "k parameter should be integer", -1);
+        return;
+    }
+    sqlite3_int64 k = sqlite3_value_int64(argv[1]);
+    if (k < 1 || k > MINHASH_MAX_HASHES) {
+        sqlite3_result_error(context, "k parameter should be between 1 and 1024", -1);
+        return;
+    }
+
+    sqlite3_int64 shingle_size = 5;
+    if (argc == 3) {
+        if (sqlite3_value_type(argv[2]) != SQLITE_INTEGER) {
+            sqlite3_result_error(context, "shingle_size parameter should be integer", -1);
+            return;
+        }
+        shingle_size = sqlite3_value_int64(argv[2]);
+        if (shingle_size < 1 || shingle_size > MINHASH_MAX_SHINGLE) {
+            sqlite3_result_error(context, "shingle_size parameter should be between 1 and 64",
+                                 -1);
+            return;
+        }
+    }
+
+    size_t sig_len = (size_t)k * MINHASH_VALUE_LEN;
+    uint8_t* sig = sqlite3_malloc64(sig_len);
+    if (sig == NULL) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    minhash_signature(src, len, (size_t)shingle_size, (size_t)k, sig);
+    sqlite3_result_blob64(context, sig, sig_len, sqlite3_free);
+}
+
+// Estimates the Jaccard similarity of two strings by their MinHash signatures.
+// text_minhash_similarity(sig1, sig2)
+static void text_minhash_similarity(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    assert(argc == 2);
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL || sqlite3_value_type(argv[1]) == SQLITE_NULL) {
+        sqlite3_result_null(context);
+        return;
+    }
+
+    const uint8_t* sig1 = sqlite3_value_blob(argv[0]);
+    size_t len1 = sqlite3_value_bytes(argv[0]);
+    const uint8_t* sig2 = sqlite3_value_blob(argv[1]);
+    size_t len2 = sqlite3_value_bytes(argv[1]);
+    if (len1 == 0 || len1 % MINHASH_VALUE_LEN != 0 || len2 % MINHASH_VALUE_LEN != 0) {
+        sqlite3_result_error(context, "invalid minhash signature", -1);
+        return;
+    }
+    if (len1 != len2) {
+        sqlite3_result_error(context, "signatures should have the same size", -1);
+        return;
+    }
+
+    sqlite3_result_double(context, minhash_similarity(sig1, sig2, len1 / MINHASH_VALUE_LEN));
+}
+
+#pragma endregion
+
 #pragma region Collation
 
 static int collate_nocase(void* unused, int n1, const void* s1, int n2, const void* s2) {
@@ -980,6 +1059,16 @@ int text_init(sqlite3* db) {
     sqlite3_create_function(db, "text_bitsize", 1, flags, 0, text_bit_size, 0, 0);
     sqlite3_create_function(db, "bit_length", 1, flags, 0, text_bit_size, 0, 0);
 
+    // similarity
+    sqlite3_create_function(db, "text_minhash", 2, flags, 0, text_minhash, 0, 0);
+    sqlite3_create_function(db, "text_minhash", 3, flags, 0, text_minhash, 0, 0);
+    sqlite3_create_function(db, "minhash", 2, flags, 0, text_minhash, 0, 0);
+    sqlite3_create_function(db, "minhash", 3, flags, 0, text_minhash, 0, 0);
+    sqlite3_create_function(db, "text_minhash_similarity", 2, flags, 0, text_minhash_similarity,
+                            0, 0);
+    sqlite3_create_function(db, "minhash_similarity", 2, flags, 0, text_minhash_similarity, 0, 0);
+    text_minhash_bands_init(db);
+
     // collation
     sqlite3_create_collation(db, "text_nocase", SQLITE_UTF8, NULL, collate_nocase);
 
@@ -0,0 +1,108 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// MinHash signatures for estimating the similarity of texts.
+// See Broder: On the resemblance and containment of documents.
+//
+// The text is split into overlapping shingles of `shingle_size` characters,
+// and each shingle is hashed with XXH3. The signature consists of `k` values,
+// each is the minimum of a different hash function over all the shingles.
+// The k hash functions are derived from the shingle hash by multiply-add
+// with different constants.
+//
+// The probability that two texts have the same value at some position
+// equals the Jaccard similarity of their shingle sets, so the share
+// of matching values estimates the similarity.
+//
+// The signature is stored as k little-endian 32-bit values.
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "crypto/xxhash.h"
+#include "text/minhash.h"
+#include "text/utf8/utf8.h"
+
+// splitmix64 generates the constants for the hash functions.
+static uint64_t splitmix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// update_mins updates the signature values with the shingle hash.
+static inline void update_mins(uint32_t* mins,
+                               const uint64_t* mul,
+                               const uint64_t* add,
+                               size_t k,
+                               uint64_t hash) {
+    for (size_t i = 0; i < k; i++) {
+        uint32_t value = (uint32_t)((mul[i] * hash + add[i]) >> 32);
+        mins[i] = value < mins[i] ? value : mins[i];
+    }
+}
+
+// minhash_signature calculates the signature of the UTF-8 string s
+// using k hash functions (at most MINHASH_MAX_HASHES) and shingles
+// of `shingle_size` characters (at most MINHASH_MAX_SHINGLE).
+// Writes k * MINHASH_VALUE_LEN bytes to sig.
+void minhash_signature(const char* s, size_t n, size_t shingle_size, size_t k, uint8_t* sig) {
+    uint64_t mul[MINHASH_MAX_HASHES];
+    uint64_t add[MINHASH_MAX_HASHES];
+    uint32_t mins[MINHASH_MAX_HASHES];
+    uint64_t state = 0;
+    for (size_t i = 0; i < k; i++) {
+        mul[i] = splitmix64(&state) | 1;
+        add[i] = splitmix64(&state);
+        mins[i] = UINT32_MAX;
+    }
+
+    // starting positions of the last shingle_size characters (ring buffer)
+    size_t starts[MINHASH_MAX_SHINGLE];
+    size_t nchars = 0;
+    size_t pos = 0;
+    while (pos < n) {
+        starts[nchars % shingle_size] = pos;
+        nchars++;
+        size_t step = utf8_pos(s + pos, n - pos, 1);
+        pos += step > 0 ? step : 1;
+        if (nchars >= shingle_size) {
+            size_t start = starts[(nchars - shingle_size) % shingle_size];
+            update_mins(mins, mul, add, k, XXH3_64bits(s + start, pos - start));
+        }
+    }
+    if (nchars > 0 && nchars < shingle_size) {
+        // the text is shorter than a shingle, so it's a single shingle itself
+        update_mins(mins, mul, add, k, XXH3_64bits(s, n));
+    }
+
+    for (size_t i = 0; i < k; i++) {
+        sig[i * 4] = (uint8_t)mins[i];
+        sig[i * 4 + 1] = (uint8_t)(mins[i] >> 8);
+        sig[i * 4 + 2] = (uint8_t)(mins[i] >> 16);
+        sig[i * 4 + 3] = (uint8_t)(mins[i] >> 24);
+    }
+}
+
+// minhash_similarity estimates the Jaccard similarity of the texts
+// by their signatures of k values each.
+double minhash_similarity(const uint8_t* a, const uint8_t* b, size_t k) {
+    if (k == 0) {
+        return 0;
+    }
+    size_t same = 0;
+    for (size_t i = 0; i < k; i++) {
+        same += memcmp(a + i * MINHASH_VALUE_LEN, b + i * MINHASH_VALUE_LEN,
+                       MINHASH_VALUE_LEN) == 0;
+    }
+    return (double)same / (double)k;
+}
+
+// minhash_band_key returns the hash of the band (a group of `rows`
+// consecutive signature values). Texts with the same key for any band
+// are candidates for being similar (locality-sensitive hashing).
+int64_t minhash_band_key(const uint8_t* sig, size_t band, size_t rows) {
+    size_t len = rows * MINHASH_VALUE_LEN;
+    return (int64_t)XXH3_64bits(sig + band * len, len);
+}
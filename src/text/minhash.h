@@ -0,0 +1,23 @@
+// Copyright (c) 2025 Anton Zhiyanov, MIT License
+// https://github.com/nalgeon/sqlean
+
+// MinHash signatures for estimating the similarity of texts.
+
+#ifndef MINHASH_H
+#define MINHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Limits for the number of hash functions and the shingle size.
+#define MINHASH_MAX_HASHES 1024
+#define MINHASH_MAX_SHINGLE 64
+
+// Size of a single signature value in bytes.
+#define MINHASH_VALUE_LEN 4
+
+void minhash_signature(const char* s, size_t n, size_t shingle_size, size_t k, uint8_t* sig);
+double minhash_similarity(const uint8_t* a, const uint8_t* b, size_t k);
+int64_t minhash_band_key(const uint8_t* sig, size_t band, size_t rows);
+
+#endif /* MINHASH_H */
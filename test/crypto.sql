@@ -10,10 +10,14 @@ select '1_03', hex(crypto_md5('abc')) = upper('900150983cd24fb0d6963f7d28e17f72'
 select '2_01', crypto_sha1(null) is NULL;
 select '2_02', hex(crypto_sha1('')) = upper('da39a3ee5e6b4b0d3255bfef95601890afd80709');
 select '2_03', hex(crypto_sha1('abc')) = upper('a9993e364706816aba3e25717850c26c9cd0d89d');
+select '2_04', hex(crypto_sha1('abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq')) = upper('84983e441c3bd26ebaae4aa1f95129e5e54670f1');
+select '2_05', hex(crypto_sha1(printf('%.1000000c', 'a'))) = upper('34aa973cd4c4daa4f61eeb2bdbad27316534016f');
 
 select '3_01', crypto_sha256(null) is NULL;
 select '3_02', hex(crypto_sha256('')) = upper('e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855');
 select '3_03', hex(crypto_sha256('abc')) = upper('ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad');
+select '3_04', hex(crypto_sha256('abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq')) = upper('248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1');
+select '3_05', hex(crypto_sha256(printf('%.1000000c', 'a'))) = upper('cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0');
 
 select '4_01', crypto_sha384(null) is NULL;
 select '4_02', hex(crypto_sha384('')) = upper('38b060a751ac96384cd9327eb1b1e36a21fdb71114be07434c0cc7bf63f6e1da274edebfe76f65fbd51ad2f14898b95b');
@@ -36,6 +40,8 @@ select '6_10', crypto_encode('abcdef', 'base64') = 'YWJjZGVm';
 select '6_11', crypto_encode('эй, мир!', 'base64') = '0Y3QuSwg0LzQuNGAIQ==';
 select '6_12', crypto_encode('(ಠ_ಠ)', 'base64') = 'KOCyoF/gsqAp';
 select '6_13', crypto_encode('The quick brown 🦊 jumps over 13 lazy 🐶.', 'base64') = 'VGhlIHF1aWNrIGJyb3duIPCfpooganVtcHMgb3ZlciAxMyBsYXp5IPCfkLYu';
+select '6_14', crypto_encode(printf('%.3000c', 'a'), 'base64') = replace(printf('%.1000c', 'x'), 'x', 'YWFh');
+select '6_15', crypto_encode(zeroblob(1001), 'base64') = replace(printf('%.333c', 'x'), 'x', 'AAAA') || 'AAA=';
 
 select '7_01', crypto_decode(null, 'base64') is null;
 select '7_02', crypto_decode('', 'base64') = cast('' as blob);
@@ -50,6 +56,8 @@ select '7_10', crypto_decode('YWJjZGVm', 'base64') = cast('abcdef' as blob);
 select '7_11', crypto_decode('0Y3QuSwg0LzQuNGAIQ==', 'base64') = cast('эй, мир!' as blob);
 select '7_12', crypto_decode('KOCyoF/gsqAp', 'base64') = cast('(ಠ_ಠ)' as blob);
 select '7_13', crypto_decode('VGhlIHF1aWNrIGJyb3duIPCfpooganVtcHMgb3ZlciAxMyBsYXp5IPCfkLYu', 'base64') = cast('The quick brown 🦊 jumps over 13 lazy 🐶.' as blob);
+select '7_14', crypto_decode(replace(printf('%.1000c', 'x'), 'x', 'YWFh'), 'base64') = cast(printf('%.3000c', 'a') as blob);
+select '7_15', crypto_decode(replace(printf('%.333c', 'x'), 'x', '+/+/') || 'AA==', 'base64') = unhex(replace(printf('%.333c', 'x'), 'x', 'FBFFBF') || '00');
 
 select '8_01', crypto_encode(null, 'base32') is null;
 select '8_02', crypto_encode('', 'base32') = '';
@@ -87,6 +95,8 @@ select '10_07', crypto_encode('xyz{|}', 'hex') = '78797a7b7c7d';
 select '10_08', crypto_encode('эй, мир!', 'hex') = 'd18dd0b92c20d0bcd0b8d18021';
 select '10_09', crypto_encode('(ಠ_ಠ)', 'hex') = '28e0b2a05fe0b2a029';
 select '10_10', crypto_encode('The quick brown 🦊 jumps over 13 lazy 🐶.', 'hex') = '54686520717569636b2062726f776e20f09fa68a206a756d7073206f766572203133206c617a7920f09f90b62e';
+select '10_11', crypto_encode(printf('%.1000c', 'z'), 'hex') = replace(printf('%.1000c', 'x'), 'x', '7a');
+select '10_12', crypto_encode(x'00ff10ab' || zeroblob(100), 'hex') = lower(hex(x'00ff10ab' || zeroblob(100)));
 
 select '11_01', crypto_decode(null, 'hex') is null;
 select '11_02', crypto_decode('', 'hex') = cast('' as blob);
@@ -100,6 +110,8 @@ select '11_09', crypto_decode('28e0b2a05fe0b2a029', 'hex') = cast('(ಠ_ಠ)' as
 select '11_10', crypto_decode('54686520717569636b2062726f776e20f09fa68a206a756d7073206f766572203133206c617a7920f09f90b62e', 'hex') = cast('The quick brown 🦊 jumps over 13 lazy 🐶.' as blob);
 select '11_11', crypto_decode('68656C6C6F', 'hex') = cast('hello' as blob);
 select '11_12', crypto_decode('2CF24DBA5FB0A30E26E83B2AC5B9E29E1B161E5C1FA7425E73043362938B9824', 'hex') = sha256('hello');
+select '11_13', crypto_decode(replace(printf('%.1000c', 'x'), 'x', '7A'), 'hex') = cast(printf('%.1000c', 'z') as blob);
+select '11_14', crypto_decode(replace(printf('%.1000c', 'x'), 'x', 'aB09'), 'hex') = unhex(replace(printf('%.1000c', 'x'), 'x', 'AB09'));
 
 select '12_01', crypto_encode(null, 'url') is null;
 select '12_02', crypto_encode('', 'url') = '';
@@ -147,6 +159,14 @@ select '15_09', crypto_decode('<+ohcEHPu*CER),Dg-(An=QS8+DQ%9E-!.?G%G\:0f''qg@=!
 select '16_01', crypto_blake3(null) is NULL;
 select '16_02', hex(crypto_blake3('')) = upper('af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262');
 select '16_03', hex(crypto_blake3('abc')) = upper('6437b3ac38465133ffb63b75273a8db548c558465d79db03fd359c6cd5bd9d85');
+select '16_04', hex(crypto_blake3(zeroblob(16385))) = upper('08e01882d7fa9bcf71114ace9485da07aca9fb402679eac91aea3d75fc106899');
+select '16_05', hex(crypto_blake3(zeroblob(100000))) = upper('b1fc3c3bf473596bc8ac1f5c86f77c2fc0e0186a872b88adf841716fe9140a50');
+select '16_06', hex(crypto_blake3(printf('%.1000000c', 'a'))) = upper('616f575a1b58d4c9797d4217b9730ae5e6eb319d76edef6549b46f4efe31ff8b');
+select '16_07', crypto_blake3(null, 4) is NULL;
+select '16_08', crypto_blake3('abc', 4) = crypto_blake3('abc');
+select '16_09', crypto_blake3(zeroblob(5000000), 1) = crypto_blake3(zeroblob(5000000));
+select '16_10', hex(crypto_blake3(printf('%.3000000c', 'a'), 4)) = hex(crypto_blake3(printf('%.3000000c', 'a')));
+select '16_11', blake3(zeroblob(5000000), 3) = blake3(zeroblob(5000000));
 
 select '17_01', crypto_xxh32(null) is NULL;
 select '17_02', hex(crypto_xxh32('')) = '02CC5D05';
@@ -167,3 +187,65 @@ select '20_01', crypto_xxh3_128(null) is NULL;
 select '20_02', hex(crypto_xxh3_128('')) = '99AA06D3014798D86001C324468D497F';
 select '20_03', hex(crypto_xxh3_128('abc')) = '06B05AB6733A618578AF5F94892F3950';
 select '20_04', hex(crypto_xxh3_128('The quick brown 🦊 jumps over 13 lazy 🐶.')) = 'E688EC7B9C40A08C87C989C0484E449E';
+
+create table hash_data(id integer primary key, value);
+insert into hash_data(value) values ('one'), (x'0102'), (null), (42), ('');
+select '21_01', crypto_hash_agg('sha256', value) is null from hash_data where false;
+select '21_02', crypto_hash_agg('sha256', null) is null from hash_data;
+select '21_03', crypto_hash_agg('sha256', value) = crypto_sha256(group_concat(value, '')) from (select value from hash_data order by id);
+select '21_04', crypto_hash_agg('blake3', value) = crypto_blake3(group_concat(value, '')) from (select value from hash_data order by id);
+select '21_05', crypto_hash_agg('xxh3_128', value) = crypto_xxh3_128(group_concat(value, '')) from (select value from hash_data order by id);
+select '21_06', crypto_md5_agg(value) = crypto_md5(group_concat(value, '')) from (select value from hash_data order by id);
+select '21_07', sha1_agg(value) = sha1(group_concat(value, '')) from (select value from hash_data order by id);
+select '21_08', xxh64_agg(value) = xxh64(group_concat(value, '')) from (select value from hash_data order by id);
+select '21_09', hex(crypto_hash_agg('md5', value)) = '900150983CD24FB0D6963F7D28E17F72' from (select 'a' as value union all select 'bc');
+select '21_10', count(*) = 5 from (select id, sha384_agg(value) over (order by id) as h from hash_data) as w where h = (select sha384(group_concat(value, '')) from (select value from hash_data where id <= w.id order by id));
+select '21_11', count(distinct h) = 3 from (select xxh32_agg(value) over (order by id) as h from hash_data);
+drop table hash_data;
+
+create table hash_blobs(id integer primary key, data);
+insert into hash_blobs(data) values ('abc'), (zeroblob(100000)), (randomblob(200000)), (null);
+select '22_01', crypto_hash_blob('sha256', 'main', 'hash_blobs', 'data', 1) = crypto_sha256('abc');
+select '22_02', hex(crypto_hash_blob('blake3', 'main', 'hash_blobs', 'data', 2)) = upper('b1fc3c3bf473596bc8ac1f5c86f77c2fc0e0186a872b88adf841716fe9140a50');
+select '22_03', crypto_hash_blob('xxh3_128', 'main', 'hash_blobs', 'data', 3) = crypto_xxh3_128(data) from hash_blobs where id = 3;
+select '22_04', crypto_hash_blob('md5', null, 'hash_blobs', 'data', 1) = crypto_md5('abc');
+select '22_05', crypto_hash_blob('md5', 'main', 'hash_blobs', 'data', null) is null;
+select '22_06', crypto_hash_blob('sha256', 'main', null, 'data', 1) is null;
+select '22_07', crypto_hash_blob('sha256', 'main', 'hash_blobs', null, 1) is null;
+drop table hash_blobs;
+
+.shell printf 'abc' > hash_file.txt
+select '23_01', crypto_hash_file('sha256', 'hash_file.txt') = crypto_sha256('abc');
+select '23_02', crypto_hash_file('xxh64', 'hash_file.txt') = crypto_xxh64('abc');
+select '23_03', crypto_hash_file('sha256', 'hash_file_missing.txt') is null;
+select '23_04', crypto_hash_file('sha256', null) is null;
+.shell rm -f hash_file.txt
+
+select '24_01', crypto_xxh3_int('abc') = 8696274497037089104;
+select '24_02', printf('%016X', xxh3_int('abc')) = hex(xxh3_64('abc'));
+select '24_03', crypto_xxh3_int('abc', 0) = crypto_xxh3_int('abc');
+select '24_04', crypto_xxh3_int('abc', 42) = -2863288879874843453;
+select '24_05', crypto_xxh64_int('abc') = 4952883123889572249;
+select '24_06', xxh64_int('abc', 7) <> xxh64_int('abc');
+select '24_07', xxh3_int(42) = xxh3_int('42');
+select '24_08', xxh3_int(null) is null;
+select '24_09', crypto_hash_bucket('alice', 4) = 1;
+select '24_10', hash_bucket('bob', 5) = 4;
+select '24_11', hash_bucket('abc', 1) = 0;
+select '24_12', hash_bucket(null, 10) is null;
+select '24_13', count(*) = 0 from generate_series(1, 10000) where hash_bucket(value, 11) not in (hash_bucket(value, 10), 10);
+
+create table bloom_data(id integer primary key, value);
+insert into bloom_data(value) select 'item-' || value from generate_series(1, 1000);
+insert into bloom_data(value) values (42), (x'0102'), (null);
+select '25_01', crypto_bloom_agg(value) is null from bloom_data where false;
+select '25_02', count(*) = 1002 from bloom_data, (select crypto_bloom_agg(value, 1000) as f from bloom_data) where bloom_contains(f, value);
+select '25_03', count(*) < 30 from generate_series(1, 1000), (select bloom_agg(value, 1000, 0.01) as f from bloom_data) where bloom_contains(f, 'other-' || value);
+select '25_04', bloom_contains(f, 42) and bloom_contains(f, x'0102') from (select bloom_agg(value) as f from bloom_data);
+select '25_05', bloom_contains(f, null) is null from (select bloom_agg(value) as f from bloom_data);
+select '25_06', bloom_contains(null, 'item-1') is null;
+select '25_07', length(bloom_agg(value, 100000, 0.01)) < length(bloom_agg(value, 100000, 0.001)) from bloom_data;
+select '25_08', count(*) = 1002 from bloom_data, (select crypto_bloom_merge((select bloom_agg(value, 1000) from bloom_data where id <= 500), (select bloom_agg(value, 1000) from bloom_data where id > 500)) as f) where bloom_contains(f, value);
+select '25_09', bloom_merge(null, f) = f from (select bloom_agg(value) as f from bloom_data);
+select '25_10', bloom_merge(null, null) is null;
+drop table bloom_data;
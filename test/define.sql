@@ -65,6 +65,31 @@ select undefine('f "; drop table innocent; --');
 select '61', count(*) = 1 from sqlite_master where type = 'table' and name = 'innocent';
 
 select define_free();
+select '62', sumn(3) = 1 + 2 + 3;
+
+select define('evalf', 'eval(:sql)');
+select '63', evalf('select 1 + evalf(''select 2 + evalf(''''select 3'''')'')') = '6';
+
+-- stored functions are prepared on the first call,
+-- so they can refer to themselves and to functions loaded after them
+insert into sqlean_define(name, type, body) values
+  ('fact', 'scalar', 'case when :n <= 1 then 1 else :n * fact(:n - 1) end'),
+  ('double_sq', 'scalar', 'sq(:x) * 2'),
+  ('sq', 'scalar', ':x * :x');
+.load dist/define
+select '64', fact(5) = 120;
+select '65', double_sq(3) = 18;
+select '66', sumn(4) = 1 + 2 + 3 + 4;
+
+-- simple bodies are evaluated without running the statement,
+-- except for values that need conversion
+select define('lerp', ':a + (:b - :a) * :t');
+select '67', lerp(1, 3, 0.5) = 2.0 and typeof(lerp(1, 3, 1)) = 'integer' and lerp(null, 1, 1) is null;
+select define('grade', 'case when :score >= 90 then ''A'' when :score >= 75 then ''B'' else ''C'' || coalesce(:note, '''') end');
+select '68', grade(95, null) = 'A' and grade(80, null) = 'B' and grade(10, '-') = 'C-';
+select '69', lerp('1', '3', '0.5') = 2.0;
+select define('ident', 'coalesce(:x, :y)');
+select '70', typeof(ident(x'', 1)) = 'blob' and length(ident(x'', 1)) = 0;
 
 select '71', eval('select 42') = '42';
 select '72', eval('select 1, 2, 3') = '1 2 3';
@@ -82,3 +107,27 @@ select '84', count(*) = 3 from tmp;
 select '85', eval('select value from tmp') = '1 2 3';
 select '86', eval('drop table tmp') is null;
 select '87', count(*) = 0 from sqlite_master where type = 'table' and name = 'tmp';
+
+-- memoized functions cache the results until the database changes
+create table plans(id integer primary key, tier text);
+insert into plans values (1, 'free'), (2, 'pro');
+select define('tier', '(select tier from plans where id = :id)', true);
+select '91', tier(1) = 'free' and tier(1) = 'free' and tier(2) = 'pro';
+update plans set tier = 'gold' where id = 1;
+select '92', tier(1) = 'gold';
+select '93', type = 'memoized' from sqlean_define where name = 'tier';
+attach ':memory:' as rates;
+create table rates.rates(id integer primary key, rate real);
+insert into rates.rates values (1, 0.1);
+select define('rate', '(select rate from rates.rates where id = :id)', true);
+select '94', rate(1) = 0.1 and rate(1) = 0.1;
+update rates.rates set rate = 0.2 where id = 1;
+select '95', rate(1) = 0.2;
+detach rates;
+create table counts(value integer);
+insert into counts values (1), (2);
+select define('cnt', '(select count(*) from counts where :k = :k)', true);
+select '96', cnt(1) = 2 and cnt(1) = 2;
+drop table counts;
+create table counts as select 1 as value union all select 2 union all select 3;
+select '97', cnt(1) = 3;
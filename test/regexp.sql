@@ -41,6 +41,8 @@ select '151', regexp_substr('-- привет --', '\b\w+\b') = 'привет';
 select '171', regexp_substr('abcdef', 'b.d') = 'bcd';
 select '172', regexp_substr('abcdef', 'b(.)d') = 'bcd';
 select '173', regexp_substr('abcdef', 'z') is null;
+select '174', group_concat(coalesce(regexp_substr(column1, '\d+'), '-'), ',') = '-,12,-,3'
+from (values ('a'), ('b12'), ('c'), ('d3'));
 
 -- regexp capture
 select '181', regexp_capture('abcdef', 'b.d', 0) = 'bcd';
@@ -49,3 +51,202 @@ select '183', regexp_capture('abcdef', 'b(.)d', 0) = 'bcd';
 select '184', regexp_capture('abcdef', 'b(.)d', 1) = 'c';
 select '185', regexp_capture('abcdef', 'b(.)d', 2) is null;
 select '186', regexp_capture('abcdef', 'z', 0) is null;
+
+-- regexp cache
+create table rules(id integer primary key, pattern text);
+insert into rules(pattern) values ('\d+'), ('^the'), ('year$'), ('\d+');
+select '301', regexp_config('cache_size') = 256;
+select '302', regexp_config('cache_size', 0) = 0;
+select '303', regexp_stats('cache_entries') = 0;
+select '304', regexp_config('cache_size', 256) = 256;
+create table stats as
+select regexp_stats('cache_hits') as hits, regexp_stats('cache_misses') as misses;
+select '305', count(*) = 3 from rules where regexp_like('the year is 2021', pattern);
+select '306', regexp_stats('cache_entries') = 3;
+select '307', regexp_stats('cache_misses') - misses = 3 from stats;
+select '308', regexp_stats('cache_hits') - hits = 1 from stats;
+select '309', regexp_config('cache_size', 2) = 2;
+select '310', regexp_stats('cache_entries') = 2;
+select '311', count(*) = 3 from rules where regexp_like('the year is 2021', pattern);
+select '312', regexp_config('cache_size', 256) = 256;
+drop table stats;
+drop table rules;
+
+-- literal patterns
+select '401', regexp_like('request timeout', 'timeout') = 1;
+select '402', regexp_like('request timed out', 'timeout') = 0;
+select '403', regexp_like('GET /api/users', '^GET /api') = 1;
+select '404', regexp_like('x GET /api/users', '^GET /api') = 0;
+select '405', regexp_like('data.json', '\.json$') = 1;
+select '406', regexp_like('data.json' || char(10), '\.json$') = 1;
+select '407', regexp_like('data.jsonl', '\.json$') = 0;
+select '408', regexp_like('done', '^done$') = 1;
+select '409', regexp_like('done!', '^done$') = 0;
+select '410', regexp_like('a$b', 'a\$b') = 1;
+select '411', regexp_substr('the year is 2021', 'year') = 'year';
+select '412', regexp_substr('the year is 2021', '2021$') = '2021';
+select '413', regexp_capture('the year is 2021', 'year', 1) is null;
+select '414', regexp_like('anything', '') = 1;
+select '415', regexp_replace('a.b.c', '\.', '-') = 'a-b-c';
+-- invalid UTF-8 subjects never match, as with PCRE
+select '416', regexp_like(cast(x'61ff62' as text), 'a') = 0;
+select '417', regexp_substr(cast(x'61ff62' as text), 'b') is null;
+select '418', (select count(*) from regexp_matches(cast(x'61eda080' as text), 'a')) = 0;
+select '419', regexp_substr('-- привет --', 'рив') = 'рив';
+-- required code unit prefilter
+select '421', regexp_like('the year is 2021', 'y.a') = 1;
+select '422', regexp_like('the Year is 2021', '(?i)y.a') = 1;
+select '423', regexp_like('the year is 2021', 'z\d') = 0;
+select '424', regexp_like('x' || char(8490) || 'y', '(?i)xky') = 1;
+
+-- regexp_file_matches
+.output regexp_file.txt
+select printf('%.*c', 65534, 'x') || '12345' || char(10) || 'the year is 2021, привет';
+.output stdout
+select '501', count(*) = 2 from regexp_file_matches('regexp_file.txt', '\d+');
+select '502', (match, start, end) = ('12345', 65534, 65539)
+from regexp_file_matches('regexp_file.txt', '\d+') where rowid = 1;
+select '503', (match, start, end) = ('2021', 65552, 65556)
+from regexp_file_matches('regexp_file.txt', '\d+') where rowid = 2;
+select '504', (start, end) = (0, 65539)
+from regexp_file_matches('regexp_file.txt', '[x\d]+') where rowid = 1;
+select '505', (match, start) = ('привет', 65558) from regexp_file_matches('regexp_file.txt', '\bпр\w+');
+select '506', (match, start) = ('is', 65549) from regexp_file_matches('regexp_file.txt', '(?<=year )\w+');
+select '507', count(*) = 0 from regexp_file_matches('regexp_file.txt', '^\d');
+.shell rm regexp_file.txt
+
+-- regexp_compile
+select '601', typeof(regexp_compile('a.c')) = 'blob';
+select '602', substr(regexp_compile('a.c'), 1, 4) = cast('SQRE' as blob);
+select '603', regexp_like('abc', regexp_from_compiled(regexp_compile('a.c'))) = 1;
+select '604', regexp_like('abd', regexp_from_compiled(regexp_compile('a.c'))) = 0;
+select '605', regexp_substr('the year is 2021', regexp_from_compiled(regexp_compile('[0-9]+'))) = '2021';
+select '606', regexp_capture('years is 2021', regexp_from_compiled(regexp_compile('(\w+) is (\d+)')), 2) = '2021';
+select '607', regexp_replace('a.b.c', regexp_from_compiled(regexp_compile('\.')), '-') = 'a-b-c';
+select '608', regexp_like('ПРИВЕТ', regexp_from_compiled(regexp_compile('(?i)привет'))) = 1;
+select '609', regexp_like('the year', regexp_from_compiled(regexp_compile('year'))) = 1;
+with patterns(re) as (select regexp_compile('\d+') from generate_series(1, 3))
+select '610', sum(regexp_like('abc 42', regexp_from_compiled(re))) = 3 from patterns;
+select '611', regexp_like('abc', cast('a.c' as blob)) = 1;
+select '612', regexp_from_compiled(null) is null;
+
+-- regexp sets
+create table regexp_rules(id integer primary key, pattern text);
+insert into regexp_rules values
+(1, 'timeout'), (2, '(?i)error'), (3, 'conn\w+ refused'), (4, 'colou?r'),
+(5, 'a|b'), (6, '(?i)kelvin'), (7, '\d+ms'), (8, 'привет?');
+select '701', regexp_set_create('rules', 'select id, pattern from regexp_rules') = 8;
+select '702', regexp_set_match('rules', 'connection timeout after 30ms') = '[1,5,7]';
+select '703', regexp_set_match('rules', 'ERROR: connection refused') = '[2,3]';
+select '704', regexp_set_match('rules', 'color and colour') = '[4,5]';
+select '705', regexp_set_match('rules', 'x' || char(8490) || 'elvin') = '[6]';
+select '706', regexp_set_match('rules', 'приве') = '[8]';
+select '707', regexp_set_match('rules', 'xyz') = '[]';
+select '708', regexp_set_match('rules', null) is null;
+select '709', count(*) = 0 from (
+  select s from (select 'connection timeout' as s union all select 'an error 5ms'
+    union all select 'colr b' union all select 'kelvin' union all select '')
+  where regexp_set_match('rules', s) != (
+    select json_group_array(id) from (
+      select id from regexp_rules where regexp_like(s, pattern) order by id))
+);
+select '710', count(*) = 3 from regexp_set_matches('rules', 'timeout 5ms, 7ms');
+select '711', (id, match, start, end) = (7, '7ms', 13, 16)
+from regexp_set_matches('rules', 'timeout 5ms, 7ms') where rowid = 3;
+select '712', count(*) = 0 from regexp_set_matches('rules', 'xyz');
+select '713', regexp_set_create('rules', 'select 42, regexp_from_compiled(regexp_compile(''\d+''))') = 1;
+select '714', regexp_set_match('rules', 'timeout 5ms') = '[42]';
+select '715', regexp_set_create('rules', 'select 1, ''f(*ACCEPT)barbaz''') = 1;
+select '716', regexp_set_match('rules', 'f') = '[1]';
+select '717', (id, match) = (1, 'f') from regexp_set_matches('rules', 'f');
+drop table regexp_rules;
+
+-- regexp_index
+create table regexp_logs(id integer primary key, body text);
+insert into regexp_logs(body) values
+('disk error on sda'), ('ERROR: disk full'), ('all good'), ('network down'), (null),
+('error writing to disk');
+create virtual table regexp_logs_idx using regexp_index(regexp_logs, body);
+select '801', (select count(*) from regexp_logs_idx) = 6;
+select '802', (select group_concat(rowid) from regexp_logs_idx
+  where regexp_like(body, 'err.*disk')) = '6';
+select '803', (select group_concat(rowid) from regexp_logs_idx
+  where regexp_like(body, '(?i)err.*disk')) = '2,6';
+select '804', (select group_concat(rowid) from regexp_logs_idx where body like '%DISK%') = '1,2,6';
+select '805', (select group_concat(rowid) from regexp_logs_idx where body glob '*disk*') = '1,2,6';
+select '806', (select group_concat(rowid) from regexp_logs_idx where body regexp 'd[io]') = '1,2,4,6';
+select '807', (select count(*) from regexp_logs_idx where regexp_like(body, 'good|down')) = 2;
+select '808', (select count(*) from regexp_logs_idx where regexp_like(body, 'nothing')) = 0;
+insert into regexp_logs(body) values ('new disk error');
+update regexp_logs set body = 'fine now' where id = 1;
+delete from regexp_logs where id = 2;
+select '809', (select group_concat(rowid) from regexp_logs_idx
+  where regexp_like(body, 'disk')) = '6,7';
+select '810', (select group_concat(rowid) from regexp_logs_idx
+  where regexp_like(body, 'fine')) = '1';
+select '811', (select count(distinct id) from regexp_logs_idx_postings) = 5;
+select '812', (select group_concat(rowid) from regexp_logs_idx
+  where regexp_like(body, 'fin') or rowid = 3) = '1,3';
+-- verbs and conditionals have no usable literals, so the index checks every row
+insert into regexp_logs(body) values ('f');
+select '813', count(*) = 0 from (
+  select 'f(*ACCEPT)barbaz' as re union all select '(?:f(*ACCEPT))barbaz'
+  union all select 'fi(*COMMIT)ne' union all select '(?(?=f)f|x)ine'
+  union all select '(*UTF)fine' union all select '(*LIMIT_MATCH=100)(*UCP)fine')
+  where (select group_concat(rowid) from regexp_logs_idx where regexp_like(body, re))
+    is not (select group_concat(id) from regexp_logs where regexp_like(body, re));
+-- changing the rowid moves the row in the index
+update regexp_logs set id = 100 where body = 'network down';
+select '814', (select group_concat(rowid) from regexp_logs_idx where regexp_like(body, 'network')) = '100';
+select '815', type = 'shadow' from pragma_table_list where name = 'regexp_logs_idx_postings';
+-- ']' right after '[' or '[^' belongs to the GLOB class
+insert into regexp_logs(body) values ('xyz');
+select '816', count(*) = 0 from (
+  select 'x[^]abc]z' as pat union all select 'x[]y]z*' union all select '*[]a]yz')
+  where (select group_concat(rowid) from regexp_logs_idx where body glob pat)
+    is not (select group_concat(id) from regexp_logs where body glob pat);
+drop table regexp_logs_idx;
+select '817', (select count(*) from sqlite_master where name like 'regexp_logs_idx%') = 0;
+drop table regexp_logs;
+
+-- regexp limits
+select '901', regexp_config('match_limit') = 10000000;
+select '902', regexp_config('depth_limit') = 10000000;
+select '903', regexp_config('heap_limit') = 20000000;
+select '904', regexp_config('match_limit', 1000) = 1000;
+select '905', regexp_like('the year is 2021', '\d+') = 1;
+select '906', regexp_substr('the year is 2021', '\d+') = '2021';
+select '907', regexp_config('match_limit', 10000000) = 10000000;
+
+-- regexp_matches and regexp_split
+select '1001', (select count(*) from regexp_matches('the year is 2021', '\d+')) = 1;
+select '1002', (select group_concat(match, '|') from regexp_matches('a1b22c333', '\d+')) = '1|22|333';
+select '1003', (select group_concat(start || '-' || end) from regexp_matches('a1b22c333', '\d+')) = '1-2,3-5,6-9';
+select '1004', (select group_concat(group1 || '=' || group2) from regexp_matches('x=1, y=2', '(\w)=(\d)')) = 'x=1,y=2';
+select '1005', (select match from regexp_matches('a1b22c333', '\d+') where rowid = 2) = '22';
+select '1006', (select group3 is null and group2 = 'b' from regexp_matches('ab', 'a(x)?(b)?(z)?')) = 1;
+select '1007', (select count(*) from regexp_matches('abc', 'x')) = 0;
+select '1008', (select group_concat(match, '|') from regexp_matches('héllo wörld', '\w+')) = 'héllo|wörld';
+select '1009', (select count(*) from regexp_matches('abc', '')) = 4;
+select '1010', (select group_concat(quote(value), '|') from regexp_split('a, b,,c', ',\s*')) = '''a''|''b''|''''|''c''';
+select '1011', (select group_concat(start || '-' || end) from regexp_split('a, b', ',\s*')) = '0-1,3-4';
+select '1012', (select group_concat(value, '|') from regexp_split('no separators', ',')) = 'no separators';
+select '1013', (select count(*) from regexp_split(',a,', ',')) = 3;
+select '1014', (select count(*) from regexp_split(null, ',')) = 0;
+
+-- regexp_replace output size
+select '1101', length(regexp_replace(printf('%.2000c', 'a'), 'a', 'bb')) = 4000;
+select '1102', regexp_replace(printf('%.2000c', 'a'), 'a', 'bb') = printf('%.4000c', 'b');
+select '1103', length(regexp_replace(printf('%.5000c', 'a'), 'a+', '')) = 0;
+
+-- empty matches are handled the same way by all functions
+select '1201', (select group_concat(start || '-' || end) from regexp_matches('aa', '(?=a)|a')) = '0-0,0-1,1-1,1-2';
+select '1202', regexp_replace('aa', '(?=a)|a', '-') = '----';
+select '1203', regexp_set_create('empty', 'select 1, ''(?=a)|a''') = 1;
+select '1204', (select group_concat(start || '-' || end) from regexp_set_matches('empty', 'aa')) = '0-0,0-1,1-1,1-2';
+.output regexp_file.txt
+select 'aa';
+.output stdout
+select '1205', (select group_concat(start || '-' || end) from regexp_file_matches('regexp_file.txt', '(?=a)|a')) = '0-0,0-1,1-1,1-2';
+.shell rm regexp_file.txt
+select '1206', (select group_concat(start || '-' || end) from regexp_matches('ab', '')) = '0-0,1-1,2-2';
@@ -489,3 +489,19 @@ select '29_09', text_like('прив_т', 'пРиВеТ') = 1;
 select '31_01', (select 1 where 'hello' = 'hello' collate text_nocase) = 1;
 select '31_02', (select 1 where 'hell0' = 'hello' collate text_nocase) is null;
 select '31_03', (select 1 where 'привет' = 'ПРИВЕТ' collate text_nocase) = 1;
+
+-- MinHash
+select '32_01', text_minhash(null, 4) is null;
+select '32_02', length(text_minhash('hello world', 64)) = 256;
+select '32_03', text_minhash('', 2) = x'ffffffffffffffff';
+select '32_04', text_minhash('hello world', 16) = text_minhash('hello world', 16);
+select '32_05', text_minhash('hello world', 16) <> text_minhash('hello world', 16, 3);
+select '32_06', text_minhash('hi', 8) = text_minhash('hi', 8, 2);
+select '32_07', minhash('hello', 4) = text_minhash('hello', 4);
+select '32_08', text_minhash_similarity(text_minhash('привет мир', 32), text_minhash('привет мир', 32)) = 1.0;
+select '32_09', round(text_minhash_similarity(text_minhash('the quick brown fox jumps over the lazy dog', 128), text_minhash('the quick brown fox jumped over the lazy dog', 128)), 2) = 0.73;
+select '32_10', text_minhash_similarity(text_minhash('the quick brown fox', 128), text_minhash('a lazy dog sleeps all day', 128)) < 0.1;
+select '32_11', text_minhash_similarity(null, x'00000000') is null;
+select '32_12', (select count(*) from text_minhash_bands(text_minhash('hello world', 32), 8)) = 8;
+select '32_13', (select count(*) from minhash_bands(null, 8)) = 0;
+select '32_14', (select count(distinct a.key) from minhash_bands(text_minhash('hello world', 32), 4) as a join minhash_bands(text_minhash('hello world', 32), 4) as b using (band, key)) = 4;